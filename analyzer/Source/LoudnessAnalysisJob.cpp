@@ -0,0 +1,145 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*		    Loudness analyzer
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include "LoudnessAnalysisJob.h"
+#include "../../plugin/Source/LufsProcessor.h"
+
+LoudnessAnalysisJob::LoudnessAnalysisJob(LoudnessAnalysisResult& r, int size)
+	: ThreadPoolJob(r.file.getFileName()),
+	  result(r),
+	  blockSize(size)
+{
+}
+
+ThreadPoolJob::JobStatus LoudnessAnalysisJob::runJob()
+{
+	analyse();
+	return jobHasFinished;
+}
+
+void LoudnessAnalysisJob::analyse()
+{
+	if (result.file.hasFileExtension(LUFS_LOG_FILE_EXTENSION))
+	{
+		analyseLog();
+		return;
+	}
+
+	// Each job has its own format manager, so that jobs share nothing.
+	AudioFormatManager formatManager;
+	formatManager.registerBasicFormats();
+
+	std::unique_ptr<AudioFormatReader> reader;
+	MemoryMappedAudioFormatReader* mappedReader = nullptr;
+
+	if (AudioFormat* format = formatManager.findFormatForFileExtension(result.file.getFileExtension()))
+	{
+		mappedReader = format->createMemoryMappedReader(result.file);
+		reader.reset(mappedReader);
+	}
+	if (reader == nullptr)
+		reader.reset(formatManager.createReaderFor(result.file));
+
+	if (reader == nullptr)
+	{
+		result.error = "unsupported or unreadable file";
+		return;
+	}
+
+	result.sampleRate = reader->sampleRate;
+	result.numChannels = (int)reader->numChannels;
+	result.seconds = reader->lengthInSamples / reader->sampleRate;
+
+	if (result.numChannels > LUFS_TP_MAX_NB_CHANNELS)
+	{
+		result.error = "more than " + String(LUFS_TP_MAX_NB_CHANNELS) + " channels";
+		return;
+	}
+
+	// update() must run before the processor's measurement FIFO fills, 10 s is well inside it.
+	const int samplesPerBlock = jlimit(1024, jmax(1024, (int)(reader->sampleRate * 10.0)), blockSize);
+
+	LufsProcessor lufs(result.numChannels);
+	lufs.prepareToPlay(reader->sampleRate, samplesPerBlock);
+
+	AudioSampleBuffer buffer(result.numChannels, samplesPerBlock);
+	int historyPosition = 0;
+
+	for (int64 start = 0; start < reader->lengthInSamples; start += samplesPerBlock)
+	{
+		if (shouldExit())
+		{
+			result.error = "cancelled";
+			return;
+		}
+
+		const int numSamples = (int)jmin((int64)samplesPerBlock, reader->lengthInSamples - start);
+
+		// Map only the block being read, the mapped reader can't read outside it.
+		if (mappedReader != nullptr && !mappedReader->mapSectionOfFile(Range<int64>(start, start + numSamples)))
+		{
+			result.error = "couldn't map file";
+			return;
+		}
+
+		buffer.setSize(result.numChannels, numSamples, false, false, true);
+		reader->read(&buffer, 0, numSamples, start, true, true);
+
+		lufs.processBlock(buffer);
+		lufs.update();
+
+		// Momentary and short term max over the 100 ms values added by this block.
+		for (; historyPosition < lufs.getValidSize(); historyPosition++)
+		{
+			result.momentaryMax = jmax(result.momentaryMax, lufs.getMomentaryVolumeArray()[historyPosition]);
+			result.shortTermMax = jmax(result.shortTermMax, lufs.getShortTermVolumeArray()[historyPosition]);
+		}
+	}
+
+	result.integrated = lufs.getIntegratedVolume();
+	result.range = lufs.getRangeMaxVolume() - lufs.getRangeMinVolume();
+	result.truePeak = lufs.getTruePeak();
+	result.analysed = true;
+}
+
+void LoudnessAnalysisJob::analyseLog()
+{
+	LufsLog log;
+	if (!log.openForReading(result.file))
+	{
+		result.error = "unreadable loudness log";
+		return;
+	}
+
+	result.sampleRate = log.getSampleRate();
+	result.numChannels = log.getNumChannels();
+	result.seconds = log.getNumRecords() / 10.0;
+
+	LufsProcessor lufs(result.numChannels);
+	lufs.prepareToPlay(result.sampleRate, 1024);
+	lufs.update();	// handles the reset done by prepareToPlay, which would clear the restored values
+	lufs.restore(log);
+
+	for (int position = 0; position < lufs.getValidSize(); position++)
+	{
+		result.momentaryMax = jmax(result.momentaryMax, lufs.getMomentaryVolumeArray()[position]);
+		result.shortTermMax = jmax(result.shortTermMax, lufs.getShortTermVolumeArray()[position]);
+	}
+
+	result.integrated = lufs.getIntegratedVolume();
+	result.range = lufs.getRangeMaxVolume() - lufs.getRangeMinVolume();
+	result.truePeak = lufs.getTruePeak();
+	result.analysed = true;
+}
@@ -0,0 +1,69 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*		    Loudness analyzer
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+/** Loudness and true peak of one file, as measured by the plugin's meters. */
+struct LoudnessAnalysisResult
+{
+	File file;
+	bool analysed = false;
+	String error;
+
+	double sampleRate = 0.0;
+	int numChannels = 0;
+	double seconds = 0.0;
+
+	float integrated = -100.0f;
+	float shortTermMax = -100.0f;
+	float momentaryMax = -100.0f;
+	float range = 0.0f;			// LRA, in LU
+	float truePeak = -100.0f;	// dBTP, max of all channels
+};
+
+//==============================================================================
+/**
+	Analyses one file on a ThreadPool thread, with the plugin's LufsProcessor.
+
+	The file is streamed in blocks of blockSize samples, through a memory mapped
+	reader where the format has one (WAV, AIFF) and a normal reader otherwise, so
+	memory doesn't depend on the length of the file.
+
+	Loudness logs written by the plugin are read instead: their 100 ms records are
+	restored into the processor, without any audio.
+
+	Writes to result only, which the caller owns and reads once the job has finished.
+*/
+class LoudnessAnalysisJob : public ThreadPoolJob
+{
+public:
+	enum { defaultBlockSize = 65536 };
+
+	LoudnessAnalysisJob(LoudnessAnalysisResult& result, int blockSize = defaultBlockSize);
+
+	JobStatus runJob() override;
+
+private:
+	void analyse();
+	void analyseLog();
+
+	LoudnessAnalysisResult& result;
+	const int blockSize;
+
+	JUCE_DECLARE_NON_COPYABLE(LoudnessAnalysisJob)
+};
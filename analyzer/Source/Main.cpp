@@ -0,0 +1,140 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*		    Loudness analyzer
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+// Offline EBU R128 / ITU 1770 analysis of audio files, using the plugin's meters.
+// Files are analysed in parallel, one ThreadPool job each, and printed as tab separated
+// values in the order given, e.g. for QC of a whole album delivery:
+//
+//		LoudnessAnalyzer -j 8 "D:/Deliveries/Album" > album.tsv
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "LoudnessAnalysisJob.h"
+#include "../../plugin/Source/LufsProcessor.h"
+
+#include <iostream>
+
+static void printUsage()
+{
+	std::cerr << "Usage: LoudnessAnalyzer [-j threads] [-b blockSize] files or folders..." << std::endl
+			  << "  -j  number of files analysed at once (default: number of CPU cores)" << std::endl
+			  << "  -b  samples read from each file at a time (default: "
+			  << (int)LoudnessAnalysisJob::defaultBlockSize << ")" << std::endl
+			  << "Folders are searched recursively for files of any supported format," << std::endl
+			  << "and for loudness logs (" LUFS_LOG_FILE_EXTENSION ") written by the plugin." << std::endl;
+}
+
+static String formatLevel(float value)
+{
+	return String(value, 1);
+}
+
+//==============================================================================
+int main(int argc, char* argv[])
+{
+	AudioFormatManager formatManager;
+	formatManager.registerBasicFormats();
+
+	int numThreads = SystemStats::getNumCpus();
+	int blockSize = LoudnessAnalysisJob::defaultBlockSize;
+	Array<File> files;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const String arg(CharPointer_UTF8(argv[i]));
+
+		if ((arg == "-j" || arg == "-b") && i + 1 < argc)
+		{
+			const int value = String(argv[++i]).getIntValue();
+			if (value <= 0)
+			{
+				printUsage();
+				return 1;
+			}
+
+			if (arg == "-j")
+				numThreads = value;
+			else
+				blockSize = value;
+		}
+		else if (arg.startsWith("-"))
+		{
+			printUsage();
+			return 1;
+		}
+		else
+		{
+			const File file(File::getCurrentWorkingDirectory().getChildFile(arg));
+
+			if (file.isDirectory())
+			{
+				Array<File> children;
+				file.findChildFiles(children, File::findFiles, true, formatManager.getWildcardForAllFormats() + ";*" LUFS_LOG_FILE_EXTENSION);
+				children.sort();
+				files.addArray(children);
+			}
+			else
+				files.add(file);
+		}
+	}
+
+	if (files.isEmpty())
+	{
+		printUsage();
+		return 1;
+	}
+
+	OwnedArray<LoudnessAnalysisResult> results;
+	{
+		ThreadPool pool(jmin(numThreads, files.size()));
+
+		for (auto& file : files)
+		{
+			LoudnessAnalysisResult* result = results.add(new LoudnessAnalysisResult());
+			result->file = file;
+			pool.addJob(new LoudnessAnalysisJob(*result, blockSize), true);
+		}
+
+		while (pool.getNumJobs() > 0)
+			Thread::sleep(100);
+	}
+
+	std::cout << "File\tIntegrated (LUFS)\tShort term max (LUFS)\tMomentary max (LUFS)\tRange (LU)\tTrue peak (dBTP)\tDuration (s)\tChannels\tSample rate" << std::endl;
+
+	int numFailed = 0;
+	for (auto* result : results)
+	{
+		std::cout << result->file.getFullPathName();
+
+		if (result->analysed)
+		{
+			std::cout << "\t" << formatLevel(result->integrated)
+					  << "\t" << formatLevel(result->shortTermMax)
+					  << "\t" << formatLevel(result->momentaryMax)
+					  << "\t" << formatLevel(result->range)
+					  << "\t" << formatLevel(result->truePeak)
+					  << "\t" << String(result->seconds, 1)
+					  << "\t" << result->numChannels
+					  << "\t" << result->sampleRate;
+		}
+		else
+		{
+			std::cout << "\terror: " << result->error;
+			numFailed++;
+		}
+		std::cout << std::endl;
+	}
+
+	return numFailed > 0 ? 2 : 0;
+}
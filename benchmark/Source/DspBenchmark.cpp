@@ -0,0 +1,204 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*		     DSP benchmark
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include "DspBenchmark.h"
+#include "../../plugin/Source/PluginProcessor.h"
+
+const int DspBenchmark::blockSizes[] = { 16, 32, 64, 128, 256, 512, 1024, 2048, 4096 };
+const int DspBenchmark::numBlockSizes = numElementsInArray(DspBenchmark::blockSizes);
+const double DspBenchmark::sampleRates[] = { 44100.0, 48000.0, 88200.0, 96000.0, 192000.0 };
+const int DspBenchmark::numSampleRates = numElementsInArray(DspBenchmark::sampleRates);
+
+DspBenchmark::DspBenchmark(double seconds, const String& filter)
+	: secondsPerCase(seconds),
+	  modeFilter(filter),
+	  noise(numChannels, 192000)
+{
+	// Fixed seed, so every run processes the same signal.
+	Random random(1);
+	for (int ch = 0; ch < numChannels; ch++)
+	{
+		float* data = noise.getWritePointer(ch);
+		for (int i = 0; i < noise.getNumSamples(); i++)
+			data[i] = (random.nextFloat() * 2.0f - 1.0f) * 0.25f;
+	}
+}
+
+Array<DspBenchmark::Mode> DspBenchmark::createModes()
+{
+	Array<Mode> modes;
+
+	// Metering and gain are always on in the plugin.
+	modes.add({ "meters", 0, false, false, false, none });
+
+	for (int mask = 1; mask < (1 << BandSplitter::numBands); mask++)
+	{
+		String name = "band";
+		for (int band = 0; band < BandSplitter::numBands; band++)
+			if (mask & (1 << band))
+				name << (name == "band" ? " " : "+") << (band + 1);
+
+		modes.add({ name, mask, false, false, false, none });
+	}
+
+	modes.add({ "mid", 0, true, false, false, none });
+	modes.add({ "side", 0, false, true, false, none });
+	modes.add({ "loud", 0, false, false, true, none });
+	modes.add({ "band 1 side loud", 1, false, true, true, none });
+	modes.add({ "band 1 side loud silent", 1, false, true, true, none, true });
+
+	modes.add({ "LufsProcessor::processBlock", 0, false, false, false, lufsProcessor });
+	modes.add({ "TruePeak::process", 0, false, false, false, truePeak });
+
+	return modes;
+}
+
+void DspBenchmark::run(std::ostream& output)
+{
+	output << "Mode\tSample rate\tBlock size\tns/sample\tWorst block (us)\tWorst block (% of budget)" << std::endl;
+
+	for (auto& mode : createModes())
+	{
+		if (modeFilter.isNotEmpty() && !mode.name.containsIgnoreCase(modeFilter))
+			continue;
+
+		for (int r = 0; r < numSampleRates; r++)
+		{
+			for (int b = 0; b < numBlockSizes; b++)
+			{
+				double worstBlockSeconds = 0.0;
+				const double nsPerSample = runCase(mode, sampleRates[r], blockSizes[b], worstBlockSeconds);
+				const double blockSeconds = blockSizes[b] / sampleRates[r];
+
+				output << mode.name
+					   << "\t" << sampleRates[r]
+					   << "\t" << blockSizes[b]
+					   << "\t" << String(nsPerSample, 2)
+					   << "\t" << String(worstBlockSeconds * 1.0e6, 2)
+					   << "\t" << String(100.0 * worstBlockSeconds / blockSeconds, 2)
+					   << std::endl;
+			}
+		}
+	}
+}
+
+void DspBenchmark::setParameter(AudioProcessor& processor, const String& paramId, float value)
+{
+	for (auto* param : processor.getParameters())
+	{
+		auto* paramWithId = dynamic_cast<AudioProcessorParameterWithID*>(param);
+		if (paramWithId == nullptr || paramWithId->paramID != paramId)
+			continue;
+
+		if (auto* floatParam = dynamic_cast<AudioParameterFloat*>(param))
+			*floatParam = value;
+		else
+			param->setValueNotifyingHost(value);
+
+		return;
+	}
+
+	jassertfalse;	// no such parameter
+}
+
+double DspBenchmark::runCase(const Mode& mode, double sampleRate, int blockSize, double& worstBlockSeconds)
+{
+	// The plugin, stereo in and out, as a host would prepare it. Its meters are ticked below instead of
+	// by the hub's timer, so the timer's thread doesn't run during the timing.
+	DreamControlAudioProcessor plugin;
+	plugin.setRateAndBufferSizeDetails(sampleRate, blockSize);
+	plugin.prepareToPlay(sampleRate, blockSize);
+	deviceHub->setTicking(&plugin, false);
+
+	for (int band = 0; band < BandSplitter::numBands; band++)
+		setParameter(plugin, "solo" + String(band + 1), (mode.bandSoloMask & (1 << band)) != 0 ? 1.0f : 0.0f);
+
+	setParameter(plugin, "midSolo", mode.midSolo ? 1.0f : 0.0f);
+	setParameter(plugin, "sideSolo", mode.sideSolo ? 1.0f : 0.0f);
+	setParameter(plugin, "loudMode", mode.loud ? 1.0f : 0.0f);
+	setParameter(plugin, "monitorLevel", -10.0f);
+
+	LufsProcessor lufs(numChannels);
+	lufs.prepareToPlay(sampleRate, blockSize);
+
+	AudioProcessing::TruePeak peak;
+	peak.setOversamplingFactor(AudioProcessing::TruePeak::getOversamplingFactor(sampleRate));
+	peak.prepare(numChannels, blockSize);
+
+	AudioSampleBuffer buffer(numChannels, blockSize);
+	MidiBuffer midiMessages;
+	const int numBlocks = jmax(1, (int)(secondsPerCase * sampleRate / blockSize));
+	const int numWarmUpBlocks = jmax(1, numBlocks / 10);
+	const int blocksPerUpdate = jmax(1, (int)(sampleRate * 0.01 / blockSize));
+	int sourcePosition = 0;
+
+	int64 totalTicks = 0;
+	int64 worstTicks = 0;
+
+	for (int block = 0; block < numWarmUpBlocks + numBlocks; block++)
+	{
+		if (sourcePosition + blockSize > noise.getNumSamples())
+			sourcePosition = 0;
+		for (int ch = 0; ch < numChannels; ch++)
+		{
+			if (mode.silent)
+				buffer.clear(ch, 0, blockSize);
+			else
+				buffer.copyFrom(ch, 0, noise, ch, sourcePosition, blockSize);
+		}
+		sourcePosition += blockSize;
+
+		// Denormals are flushed in the plugin's callback too.
+		ScopedNoDenormals noDenormals;
+		const int64 start = Time::getHighResolutionTicks();
+
+		switch (mode.component)
+		{
+		case lufsProcessor:
+			lufs.processBlock(buffer);
+			break;
+
+		case truePeak:
+			peak.process(buffer);
+			break;
+
+		default:
+			plugin.processBlock(buffer, midiMessages);
+			break;
+		}
+
+		const int64 ticks = Time::getHighResolutionTicks() - start;
+
+		if (block >= numWarmUpBlocks)
+		{
+			totalTicks += ticks;
+			worstTicks = jmax(worstTicks, ticks);
+		}
+
+		// The plugin's timer thread.
+		if ((block % blocksPerUpdate) == 0)
+		{
+			if (mode.component == none)
+				plugin.deviceHubTick(false);
+			else
+				lufs.update();
+		}
+	}
+
+	plugin.releaseResources();
+
+	worstBlockSeconds = Time::highResolutionTicksToSeconds(worstTicks);
+	return Time::highResolutionTicksToSeconds(totalTicks) * 1.0e9 / ((double)numBlocks * blockSize);
+}
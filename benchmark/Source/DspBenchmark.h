@@ -0,0 +1,85 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*		     DSP benchmark
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "../../plugin/Source/DeviceHub.h"
+
+#include <iostream>
+
+//==============================================================================
+/**
+	Times the plugin's audio path, mode by mode, at each sample rate and block size.
+
+	Chain modes time DreamControlAudioProcessor::processBlock itself, with the mode's
+	parameters set on the plugin as the hardware or a host would. The hub's tick that
+	reads the meters every 10 ms runs between blocks, outside the timing, as it's not on
+	the audio thread. Component modes time one class alone.
+
+	Results are tab separated: ns per sample frame, and the worst block, in microseconds
+	and as a percentage of the block's duration (the real-time budget).
+*/
+class DspBenchmark
+{
+public:
+	struct Mode
+	{
+		String name;
+		int bandSoloMask;	// bit per band, band 1 is bit 0
+		bool midSolo;
+		bool sideSolo;
+		bool loud;
+		int component;		// chain when none
+		bool silent;		// digital silence instead of noise
+	};
+
+	enum Component
+	{
+		none = 0,
+		lufsProcessor,
+		truePeak
+	};
+
+	enum { numChannels = 2 };
+
+	static const int blockSizes[];
+	static const int numBlockSizes;
+	static const double sampleRates[];
+	static const int numSampleRates;
+
+	// seconds of audio timed for each case, modeFilter runs only modes whose name contains it.
+	DspBenchmark(double secondsPerCase, const String& modeFilter);
+
+	void run(std::ostream& output);
+
+private:
+	static Array<Mode> createModes();
+
+	// Returns ns per sample frame, and the worst block in seconds.
+	double runCase(const Mode& mode, double sampleRate, int blockSize, double& worstBlockSeconds);
+
+	// A plugin parameter, plain value. Bool parameters take 0 or 1.
+	static void setParameter(AudioProcessor& processor, const String& paramId, float value);
+
+	const double secondsPerCase;
+	const String modeFilter;
+	AudioSampleBuffer noise;	// 1 s of source signal, looped
+
+	// Kept for the whole run, so the ports aren't opened again for each case's plugin
+	SharedResourcePointer<DeviceHub> deviceHub;
+
+	JUCE_DECLARE_NON_COPYABLE(DspBenchmark)
+};
@@ -0,0 +1,169 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*		     DSP benchmark
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include "EbuConformance.h"
+#include "../../plugin/Source/LufsProcessor.h"
+
+// Same level on both channels of a stereo signal.
+static EbuConformance::Segment stereo(float decibels, double seconds, double phaseDegrees = 0.0)
+{
+	return { { decibels, decibels, 0.0f, 0.0f, 0.0f }, seconds, phaseDegrees };
+}
+
+Array<EbuConformance::TestCase> EbuConformance::createTestCases()
+{
+	Array<TestCase> cases;
+
+	auto addLoudness = [&cases](const String& name, int numChannels, const Array<Segment>& segments, Measurement measurement, float expected, float tolerance)
+	{
+		cases.add({ name, numChannels, 1000.0, segments, measurement, expected, tolerance, tolerance });
+	};
+
+	// Sine at fs / sampleRateDivisor
+	auto addTruePeak = [&cases](const String& name, float decibels, int sampleRateDivisor, double phaseDegrees, float expected)
+	{
+		cases.add({ name, 2, (double)sampleRate / sampleRateDivisor, { stereo(decibels, 2.0, phaseDegrees) }, truePeak, expected, 0.4f, 0.2f });
+	};
+
+	// EBU Tech 3341, loudness meters
+	addLoudness("3341 case 1 integrated", 2, { stereo(-23.0f, 20.0) }, integrated, -23.0f, 0.1f);
+	addLoudness("3341 case 1 momentary", 2, { stereo(-23.0f, 20.0) }, momentary, -23.0f, 0.1f);
+	addLoudness("3341 case 1 short term", 2, { stereo(-23.0f, 20.0) }, shortTerm, -23.0f, 0.1f);
+	addLoudness("3341 case 2 integrated", 2, { stereo(-33.0f, 20.0) }, integrated, -33.0f, 0.1f);
+	addLoudness("3341 case 2 momentary", 2, { stereo(-33.0f, 20.0) }, momentary, -33.0f, 0.1f);
+	addLoudness("3341 case 2 short term", 2, { stereo(-33.0f, 20.0) }, shortTerm, -33.0f, 0.1f);
+	addLoudness("3341 case 3 integrated", 2, { stereo(-36.0f, 10.0), stereo(-23.0f, 60.0), stereo(-36.0f, 10.0) }, integrated, -23.0f, 0.1f);
+	addLoudness("3341 case 4 integrated", 2, { stereo(-72.0f, 10.0), stereo(-36.0f, 10.0), stereo(-23.0f, 60.0), stereo(-36.0f, 10.0), stereo(-72.0f, 10.0) }, integrated, -23.0f, 0.1f);
+	addLoudness("3341 case 5 integrated", 2, { stereo(-26.0f, 20.0), stereo(-20.0f, 20.1), stereo(-26.0f, 20.0) }, integrated, -23.0f, 0.1f);
+	const Segment surround = { { -28.0f, -28.0f, -24.0f, -30.0f, -30.0f }, 20.0, 0.0 };
+	addLoudness("3341 case 6 integrated", 5, { surround }, integrated, -23.0f, 0.1f);
+
+	Array<Segment> case9;
+	for (int i = 0; i < 5; i++)
+	{
+		case9.add(stereo(-20.0f, 1.34));
+		case9.add(stereo(-30.0f, 1.66));
+	}
+	addLoudness("3341 case 9 short term", 2, case9, shortTerm, -23.0f, 0.1f);
+
+	// EBU Tech 3341, true peak: sines at fs/4, fs/6 and fs/8 with the phase chosen so the sample peaks fall below the true peak.
+	addTruePeak("3341 case 15 true peak", -6.0f, 4, 0.0, -6.0f);
+	addTruePeak("3341 case 16 true peak", -6.0f, 4, 45.0, -6.0f);
+	addTruePeak("3341 case 17 true peak", -6.0f, 6, 60.0, -6.0f);
+	addTruePeak("3341 case 18 true peak", -6.0f, 8, 67.5, -6.0f);
+	addTruePeak("3341 case 19 true peak", 3.0f, 4, 45.0, 3.0f);
+
+	// EBU Tech 3342, loudness range
+	addLoudness("3342 case 1 range", 2, { stereo(-20.0f, 20.0), stereo(-30.0f, 20.0) }, loudnessRange, 10.0f, 1.0f);
+	addLoudness("3342 case 2 range", 2, { stereo(-20.0f, 20.0), stereo(-15.0f, 20.0) }, loudnessRange, 5.0f, 1.0f);
+	addLoudness("3342 case 3 range", 2, { stereo(-40.0f, 20.0), stereo(-20.0f, 20.0) }, loudnessRange, 20.0f, 1.0f);
+	addLoudness("3342 case 4 range", 2, { stereo(-50.0f, 20.0), stereo(-35.0f, 20.0), stereo(-20.0f, 20.0), stereo(-35.0f, 20.0), stereo(-50.0f, 20.0) }, loudnessRange, 15.0f, 1.0f);
+
+	return cases;
+}
+
+float EbuConformance::measure(const TestCase& testCase)
+{
+	const int numChannels = testCase.numChannels;
+	const double frequency = testCase.frequency > 0.0 ? testCase.frequency : sampleRate / 4.0;
+
+	LufsProcessor lufs(numChannels);
+	lufs.prepareToPlay(sampleRate, blockSize);
+
+	AudioSampleBuffer buffer(numChannels, blockSize);
+
+	// Momentary and short term values are valid once their window (4 or 30 values of 100 ms) is filled.
+	const int firstPosition = testCase.measurement == momentary ? 4 : 30;
+	int historyPosition = firstPosition;
+	float furthest = testCase.expected;
+
+	int segment = 0;
+	int64 segmentEnd = roundToInt(testCase.segments[0].seconds * sampleRate);
+	int64 sampleIndex = 0;
+
+	while (segment < testCase.segments.size())
+	{
+		int numSamples = 0;
+
+		// Generate the next block, across segment boundaries.
+		while (numSamples < blockSize && segment < testCase.segments.size())
+		{
+			const Segment& s = testCase.segments.getReference(segment);
+			const double phase = s.phaseDegrees * double_Pi / 180.0;
+
+			for (int ch = 0; ch < numChannels; ch++)
+			{
+				const double amplitude = Decibels::decibelsToGain((double)s.decibels[ch], -200.0);
+				const double angle = 2.0 * double_Pi * frequency * (double)sampleIndex / sampleRate + phase;
+				buffer.setSample(ch, numSamples, (float)(amplitude * std::sin(angle)));
+			}
+
+			numSamples++;
+			if (++sampleIndex == segmentEnd && ++segment < testCase.segments.size())
+				segmentEnd += roundToInt(testCase.segments[segment].seconds * sampleRate);
+		}
+
+		AudioSampleBuffer block(buffer.getArrayOfWritePointers(), numChannels, numSamples);
+		lufs.processBlock(block);
+		lufs.update();
+
+		if (testCase.measurement == momentary || testCase.measurement == shortTerm)
+		{
+			const LufsHistoryArray& values = testCase.measurement == momentary ? lufs.getMomentaryVolumeArray() : lufs.getShortTermVolumeArray();
+
+			for (; historyPosition < lufs.getValidSize(); historyPosition++)
+			{
+				if (std::abs(values[historyPosition] - testCase.expected) > std::abs(furthest - testCase.expected))
+					furthest = values[historyPosition];
+			}
+		}
+	}
+
+	switch (testCase.measurement)
+	{
+	case integrated:
+		return lufs.getIntegratedVolume();
+	case loudnessRange:
+		return lufs.getRangeMaxVolume() - lufs.getRangeMinVolume();
+	case truePeak:
+		return lufs.getTruePeak();
+	default:
+		return furthest;
+	}
+}
+
+int EbuConformance::run(std::ostream& output)
+{
+	output << "Test\tExpected\tMeasured\tResult" << std::endl;
+
+	int numFailed = 0;
+	for (auto& testCase : createTestCases())
+	{
+		const float measured = measure(testCase);
+		const bool passed = measured >= testCase.expected - testCase.toleranceBelow
+						 && measured <= testCase.expected + testCase.toleranceAbove;
+
+		output << testCase.name
+			   << "\t" << String(testCase.expected, 1)
+			   << "\t" << String(measured, 2)
+			   << "\t" << (passed ? "pass" : "FAIL")
+			   << std::endl;
+
+		if (!passed)
+			numFailed++;
+	}
+
+	return numFailed;
+}
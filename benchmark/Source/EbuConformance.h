@@ -0,0 +1,73 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*		     DSP benchmark
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+#include <iostream>
+
+//==============================================================================
+/**
+	Checks the plugin's LufsProcessor against the EBU test signals that can be
+	generated: Tech 3341 (loudness meters) cases 1-6 and 9, the fs/4 true peak
+	cases 15-19, and Tech 3342 (loudness range) cases 1-4. The cases that are
+	programme material or impulse trains need the EBU files, so aren't run.
+
+	Signals are 1 kHz sines (fs/4 for true peak) at 48 kHz, levels in dBFS are
+	sine peak levels as in the EBU documents.
+*/
+class EbuConformance
+{
+public:
+	enum Measurement
+	{
+		integrated,
+		momentary,		// every momentary value once the window is inside the signal
+		shortTerm,		// same for short term
+		loudnessRange,
+		truePeak
+	};
+
+	struct Segment
+	{
+		float decibels[5];	// per channel, L R C Ls Rs
+		double seconds;
+		double phaseDegrees;
+	};
+
+	struct TestCase
+	{
+		String name;
+		int numChannels;
+		double frequency;	// 0 for fs/4
+		Array<Segment> segments;
+		Measurement measurement;
+		float expected;
+		float toleranceBelow;
+		float toleranceAbove;
+	};
+
+	enum { sampleRate = 48000, blockSize = 1024 };
+
+	// Prints a line per case, returns the number of cases that failed.
+	static int run(std::ostream& output);
+
+private:
+	static Array<TestCase> createTestCases();
+
+	// Returns the measured value. For momentary and short term, the value furthest from expected.
+	static float measure(const TestCase& testCase);
+};
@@ -0,0 +1,84 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*		     DSP benchmark
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+// Headless benchmark and conformance checks of the plugin's DSP, so a change to the
+// audio path can be timed against the previous build without losing accuracy:
+//
+//		DspBenchmark > before.tsv
+//		DspBenchmark -c				(conformance and plugin checks only, exit code is the number of failures)
+//		DspBenchmark -m band -s 5	(only modes with "band" in their name, 5 s of audio per case)
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "DspBenchmark.h"
+#include "EbuConformance.h"
+#include "PluginChecks.h"
+
+static void printUsage()
+{
+	std::cerr << "Usage: DspBenchmark [-c | -b] [-m mode] [-s seconds]" << std::endl
+			  << "  -c  EBU Tech 3341/3342 conformance and plugin checks only" << std::endl
+			  << "  -b  benchmark only" << std::endl
+			  << "  -m  only benchmark modes whose name contains mode" << std::endl
+			  << "  -s  seconds of audio per benchmark case (default: 1)" << std::endl;
+}
+
+//==============================================================================
+int main(int argc, char* argv[])
+{
+	bool runConformance = true;
+	bool runBenchmark = true;
+	String modeFilter;
+	double secondsPerCase = 1.0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const String arg(argv[i]);
+
+		if (arg == "-c")
+			runBenchmark = false;
+		else if (arg == "-b")
+			runConformance = false;
+		else if (arg == "-m" && i + 1 < argc)
+			modeFilter = argv[++i];
+		else if (arg == "-s" && i + 1 < argc && String(argv[i + 1]).getDoubleValue() > 0.0)
+			secondsPerCase = String(argv[++i]).getDoubleValue();
+		else
+		{
+			printUsage();
+			return -1;
+		}
+	}
+
+	int numFailed = 0;
+
+	if (runConformance)
+	{
+		numFailed = EbuConformance::run(std::cout);
+		std::cout << std::endl;
+
+		numFailed += PluginChecks::run(std::cout);
+		std::cout << std::endl;
+	}
+
+	if (runBenchmark)
+	{
+		// The plugin's processor and device hub post to the message thread.
+		ScopedJuceInitialiser_GUI juceInitialiser;
+		DspBenchmark benchmark(secondsPerCase, modeFilter);
+		benchmark.run(std::cout);
+	}
+
+	return numFailed;
+}
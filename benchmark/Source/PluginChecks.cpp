@@ -0,0 +1,121 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*		     DSP benchmark
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include "PluginChecks.h"
+#include "../../plugin/Source/SurfaceStateEncoder.h"
+#include "../../plugin/Source/StateChunk.h"
+
+// As in PluginProcessor.cpp and firmware/dc_sysex.h
+static const int manufacturerId[3] = { 0x00, 0x21, 0x69 };
+enum { syncButtonsCommand = 2, meterFrameCommand = 3, snapshotCommand = 5, deltaCommand = 6 };
+
+static MidiMessage fromBytes(std::initializer_list<uint8> bytes)
+{
+	const std::vector<uint8> data(bytes);
+	return MidiMessage(data.data(), (int)data.size());
+}
+
+// A versioned state with a value of each kind, the log path last as in getStateInformation.
+static MemoryBlock createStateChunk()
+{
+	MemoryBlock data;
+	StateChunkWriter state(data, 1);
+	state.writeFloat(1, -12.0f);
+	state.writeBool(2, true);
+	state.writeInt(3, 7);
+	state.writeString(4, "/Users/me/Loudness logs/2018-06-01 10-00-00.lufslog");
+	return data;
+}
+
+Array<PluginChecks::Check> PluginChecks::createChecks()
+{
+	Array<Check> checks;
+
+	// firmware/dc_state.c DC_STATE_RequestSnapshot, through DC_SYSEX_SendCommand with no data.
+	checks.add({ "surface snapshot request", []
+	{
+		SurfaceStateEncoder encoder(manufacturerId, snapshotCommand, deltaCommand, syncButtonsCommand);
+		return encoder.isSnapshotRequest(fromBytes({ 0xf0, 0x00, 0x21, 0x69, syncButtonsCommand, 0xf7 }));
+	} });
+
+	checks.add({ "surface request from another manufacturer", []
+	{
+		SurfaceStateEncoder encoder(manufacturerId, snapshotCommand, deltaCommand, syncButtonsCommand);
+		return !encoder.isSnapshotRequest(fromBytes({ 0xf0, 0x00, 0x21, 0x6a, syncButtonsCommand, 0xf7 }))
+			&& !encoder.isSnapshotRequest(fromBytes({ 0xf0, syncButtonsCommand, 0xf7 }));
+	} });
+
+	checks.add({ "surface other command", []
+	{
+		SurfaceStateEncoder encoder(manufacturerId, snapshotCommand, deltaCommand, syncButtonsCommand);
+		return !encoder.isSnapshotRequest(fromBytes({ 0xf0, 0x00, 0x21, 0x69, meterFrameCommand, 0x00, 0xf7 }));
+	} });
+
+	checks.add({ "state chunk", []
+	{
+		const MemoryBlock data = createStateChunk();
+		StateChunkReader state;
+		return state.read(data.getData(), (int)data.getSize()) == StateChunkReader::ok
+			&& state.getFloat(1, 0.0f) == -12.0f && state.getBool(2, false) && state.getInt(3, 0) == 7
+			&& state.getString(4, String()).endsWith(".lufslog");
+	} });
+
+	// Every length short of the whole chunk, down to the magic number and version.
+	checks.add({ "truncated state chunk", []
+	{
+		const MemoryBlock data = createStateChunk();
+		StateChunkReader state;
+
+		for (int size = 5; size < (int)data.getSize(); size++)
+		{
+			// Cut between two entries, the chunk reads as one without the later values.
+			const StateChunkReader::Result result = state.read(data.getData(), size);
+			if (result == StateChunkReader::notStateChunk || (result == StateChunkReader::ok && state.hasTag(4)))
+				return false;
+		}
+
+		// The string entry cut in its middle.
+		return state.read(data.getData(), (int)data.getSize() - 10) == StateChunkReader::badStateChunk;
+	} });
+
+	// The unversioned state of older versions starts with the monitor level.
+	checks.add({ "unversioned state", []
+	{
+		MemoryOutputStream legacy;
+		legacy.writeFloat(-20.0f);
+		legacy.writeFloat(-40.0f);
+		StateChunkReader state;
+		return state.read(legacy.getData(), (int)legacy.getDataSize()) == StateChunkReader::notStateChunk;
+	} });
+
+	return checks;
+}
+
+int PluginChecks::run(std::ostream& output)
+{
+	output << "Check\tResult" << std::endl;
+
+	int numFailed = 0;
+	for (auto& check : createChecks())
+	{
+		const bool passed = check.passes();
+		output << check.name << "\t" << (passed ? "pass" : "FAIL") << std::endl;
+
+		if (!passed)
+			numFailed++;
+	}
+
+	return numFailed;
+}
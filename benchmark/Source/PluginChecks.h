@@ -0,0 +1,41 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*		     DSP benchmark
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+#include <iostream>
+
+//==============================================================================
+/**
+	Checks of the plugin's protocol and state code that don't need a host or the
+	hardware: messages are fed in as the exact bytes the firmware or a host sends.
+*/
+class PluginChecks
+{
+public:
+	// Prints a line per check, returns the number of checks that failed.
+	static int run(std::ostream& output);
+
+private:
+	struct Check
+	{
+		String name;
+		std::function<bool()> passes;
+	};
+
+	static Array<Check> createChecks();
+};
@@ -27,6 +27,7 @@
 #include "dc_buttons.h"
 #include "dc_lcd.h"
 #include "dc_sysex.h"
+#include "dc_state.h"
 
 /////////////////////////////////////////////////////////////////////////////
 // Globals
@@ -58,7 +59,9 @@ void APP_Init(void)
     DC_BUTTONS_Init();
     DC_LCD_Init();
     DC_KNOB_Init();
+    DC_METERS_Init();
     DC_SYSEX_Init();
+    DC_STATE_Init();
     MIOS32_LCD_Init(0);
     
     if (success < 0)
@@ -97,6 +100,7 @@ void APP_Tick(void)
 {
     DC_LCD_Tick();
     DC_BUTTONS_Tick();
+    DC_KNOB_Tick();
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -104,7 +108,8 @@ void APP_Tick(void)
 /////////////////////////////////////////////////////////////////////////////
 void APP_MIDI_Tick(void)
 {
-
+    DC_FADER_Tick();
+    DC_STATE_Tick();
 }
 
 /////////////////////////////////////////////////////////////////////////////
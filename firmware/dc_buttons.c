@@ -28,6 +28,7 @@
 
 #define DOUT_PINS_COUNT 32              // The number of DOUT pins that we are using for LEDs.
 #define J10_PINS_USED 6                 // The number of GPIO pins on J10A that we are using for buttons.
+#define DC_BUTTONS_DEBUG_STATE 0        // 1 sends a debug message for each LED and command set by the plugin or DAW.
 
 /////////////// BUTTONS
 // * DO NOT CHANGE ORDER * index corresponds with DIN pin (0-31) or J10A pin (32-37, pins D0-D5)
@@ -86,6 +87,7 @@ typedef enum {
     BUTTON_ABS_REL = 1002,
     BUTTON_1DB_PEAK_SCALE = 1003,
     BUTTON_3RD_METER_IS_MOMENTARY = 1004,
+    BUTTON_DSP_LOAD = 1005,
 
     BUTTON_SAVE = 1008,
 
@@ -163,7 +165,7 @@ typedef enum {
 // Array index: 0 = Port to send/receive (bitfield: 0=none, 1=plugin, 2=daw, 3=both), 1 = Button number, 2 = LED number... etc.
 // -1 means no LED for that button. >=35 are shifted functions.
 
-const int midi_button_led_map[171] = {                      // MIDI note number
+const int midi_button_led_map[174] = {                      // MIDI note number
     PORT_PLUGIN, BUTTON_LOUD, LED_LOUD,                     // 0
     PORT_PLUGIN, BUTTON_MONO, LED_MONO,                     // 1
     PORT_PLUGIN, BUTTON_SIDE, LED_SIDE,                     // 2
@@ -224,6 +226,8 @@ const int midi_button_led_map[171] = {                      // MIDI note number
     PORT_DAW, BUTTON_CUE4, -1,                              // 54
     PORT_DAW, BUTTON_EXT1, -1,                              // 55
     PORT_DAW, BUTTON_EXT2, -1,                              // 56
+
+    PORT_PLUGIN, BUTTON_DSP_LOAD, -1,                       // 57   Shifted, plugin replies with SYSEX_COMMAND_DSP_LOAD
 };
 
 u16 current_j10_state;
@@ -241,9 +245,8 @@ void DC_BUTTONS_Init()
 
     for (i = 0; i < DOUT_PINS_COUNT; i++)
         MIOS32_DOUT_PinSet(i, 0);
-    
-    // Request all plugin button states from plugin.
-    DC_SYSEX_SendCommand(PLUGIN_USB_PORT, SYSEX_COMMAND_SYNC_BUTTONS, "");
+
+    // The plugin's button states are requested by DC_STATE_Init.
 }
 
 void DC_BUTTONS_Tick()
@@ -338,20 +341,26 @@ void DC_BUTTONS_MIDI_NotifyPackage(mios32_midi_port_t port, mios32_midi_package_
 {  
     // Turn on/off an LED if corresponding NoteOn value received.
     if (midi_package.chn == Chn1 && midi_package.type == NoteOn)
+        DC_BUTTONS_SetNoteState(port, midi_package.note, midi_package.velocity > 0);
+}
+
+void DC_BUTTONS_SetNoteState(mios32_midi_port_t port, u8 note, bool state)
+{
+    // A note's state from the plugin or DAW, by NoteOn or from the plugin's state messages (see dc_state.c).
+    if (note < (sizeof(midi_button_led_map) / 4 / 3) && 
+    ((port == PLUGIN_USB_PORT && midi_button_led_map[note * 3] & PORT_PLUGIN > 0) || 
+    (port == DAW_USB_PORT && midi_button_led_map[note * 3] & PORT_DAW > 0)))
     {
-        if (midi_package.note < (sizeof(midi_button_led_map) / 4 / 3) && 
-        ((port == PLUGIN_USB_PORT && midi_button_led_map[midi_package.note * 3] & PORT_PLUGIN > 0) || 
-        (port == DAW_USB_PORT && midi_button_led_map[midi_package.note * 3] & PORT_DAW > 0)))
-        {
-            int led_pin = midi_button_led_map[(midi_package.note * 3) + 2];
-            MIOS32_MIDI_SendDebugMessage("LED PIN  %d   = %d", led_pin, midi_package.velocity > 0 ? 1 : 0);
+        int led_pin = midi_button_led_map[(note * 3) + 2];
+#if DC_BUTTONS_DEBUG_STATE
+        MIOS32_MIDI_SendDebugMessage("LED PIN  %d   = %d", led_pin, state ? 1 : 0);
+#endif
 
-            if (led_pin > -1) 
-                MIOS32_DOUT_PinSet(led_pin, midi_package.velocity > 0 ? 1 : 0);
+        if (led_pin > -1) 
+            MIOS32_DOUT_PinSet(led_pin, state ? 1 : 0);
 
-            int button = midi_button_led_map[(midi_package.note * 3) + 1];
-            DC_BUTTONS_HandleCommand(button, midi_package.velocity > 0);
-        }
+        int button = midi_button_led_map[(note * 3) + 1];
+        DC_BUTTONS_HandleCommand(button, state);
     }
 }
 
@@ -359,7 +368,9 @@ void DC_BUTTONS_HandleCommand(int button, bool state)
 {
     // Perform an action when a button is pressed. Some buttons simply send MIDI messages,
     // others may change options or require feedback on the hardware.
+#if DC_BUTTONS_DEBUG_STATE
     MIOS32_MIDI_SendDebugMessage("HANDLECOMMAND %d  =  %d", button, state);
+#endif
 
     if (button == BUTTON_PEAK_LUFS)    
         DC_METERS_SetMeterMode(state);
@@ -27,11 +27,71 @@
 #define MF_TOUCH_CC 47
 #define MF_VALUE_NRPN_LSB 1                             // DAW selected channel fader set to NRPN #1.
 
-u8 current_mf_value_msb = -1;                           // if -1, we're waiting for a new value's MSB, 
+#define FADER_COALESCE_INTERVAL_MS 10                   // Minimum time between fader values sent to each destination.
+
+s16 current_mf_value_msb = -1;                          // if -1, we're waiting for a new value's MSB, 
                                                         // otherwise we're waiting for the corresponding LSB.
-u8 current_daw_channel_value_lsb = -1;
-u8 daw_channel_nrpn_is_next = -1;
+s16 current_daw_channel_value_lsb = -1;
+s8 daw_channel_nrpn_is_next = -1;
+
+// Fader values are coalesced, latest value wins: each destination gets at most one value per interval.
+// Ticks and MIDI packages are both handled in the MIDI task, so no locking is needed.
+s16 pending_mf_value = -1;                              // 14 bit value from MF board waiting to go to DAW and plugin, or -1.
+s16 pending_daw_value = -1;                             // 14 bit value from DAW waiting to go to MF board, or -1.
+u8 ms_since_mf_value_sent = 0;
+u8 ms_since_daw_value_sent = 0;
+
+void DC_FADER_SendMfValue()
+{
+    // Convert to NRPN for DAW and plugin.
+    u8 msb = (pending_mf_value >> 7) & 0x7f;
+    u8 lsb = pending_mf_value & 0x7f;
+
+    MIOS32_MIDI_SendCC(DAW_USB_PORT, Chn1, 99, 0);
+    MIOS32_MIDI_SendCC(DAW_USB_PORT, Chn1, 98, MF_VALUE_NRPN_LSB);
+    MIOS32_MIDI_SendCC(DAW_USB_PORT, Chn1, 38, lsb);
+    MIOS32_MIDI_SendCC(DAW_USB_PORT, Chn1, 6, msb);
+
+    MIOS32_MIDI_SendCC(PLUGIN_USB_PORT, Chn1, 99, 0);
+    MIOS32_MIDI_SendCC(PLUGIN_USB_PORT, Chn1, 98, MF_VALUE_NRPN_LSB);
+    MIOS32_MIDI_SendCC(PLUGIN_USB_PORT, Chn1, 38, lsb);
+    MIOS32_MIDI_SendCC(PLUGIN_USB_PORT, Chn1, 6, msb);
+
+    pending_mf_value = -1;
+    ms_since_mf_value_sent = 0;
+}
+
+void DC_FADER_SendDawValue()
+{
+    // Convert to CC for MF board.
+    MIOS32_MIDI_SendCC(UART0, Chn1, MF_VALUE_CC_MSB, (pending_daw_value >> 7) & 0x7f);
+    MIOS32_MIDI_SendCC(UART0, Chn1, MF_VALUE_CC_LSB, pending_daw_value & 0x7f);
 
+    pending_daw_value = -1;
+    ms_since_daw_value_sent = 0;
+}
+
+void DC_FADER_SetDawValue(u16 value)
+{
+    // 14 bit value from the plugin's state messages (see dc_state.c), sent to MF board by DC_FADER_Tick.
+    // Inverted like the NRPN values, because our fader is upside down.
+    pending_daw_value = 0x3fff - (value & 0x3fff);
+}
+
+void DC_FADER_Tick(void)
+{
+    // Called each mS from the MIDI task.
+    if (ms_since_mf_value_sent < 255)
+        ms_since_mf_value_sent++;
+    if (ms_since_daw_value_sent < 255)
+        ms_since_daw_value_sent++;
+
+    if (pending_mf_value >= 0 && ms_since_mf_value_sent >= FADER_COALESCE_INTERVAL_MS)
+        DC_FADER_SendMfValue();
+
+    if (pending_daw_value >= 0 && ms_since_daw_value_sent >= FADER_COALESCE_INTERVAL_MS)
+        DC_FADER_SendDawValue();
+}
 
 void DC_FADER_MIDI_NotifyPackage(mios32_midi_port_t port, mios32_midi_package_t midi_package)
 {  
@@ -49,21 +109,16 @@ void DC_FADER_MIDI_NotifyPackage(mios32_midi_port_t port, mios32_midi_package_t
         }
         else if (midi_package.cc_number == MF_VALUE_CC_LSB && current_mf_value_msb > -1)
         {
-            // Convert to NRPN for DAW and plugin.
-            MIOS32_MIDI_SendCC(DAW_USB_PORT, Chn1, 99, 0);
-            MIOS32_MIDI_SendCC(DAW_USB_PORT, Chn1, 98, MF_VALUE_NRPN_LSB);
-            MIOS32_MIDI_SendCC(DAW_USB_PORT, Chn1, 38, 127 - midi_package.value);
-            MIOS32_MIDI_SendCC(DAW_USB_PORT, Chn1, 6, 127 - current_mf_value_msb);
-
-            MIOS32_MIDI_SendCC(PLUGIN_USB_PORT, Chn1, 99, 0);
-            MIOS32_MIDI_SendCC(PLUGIN_USB_PORT, Chn1, 98, MF_VALUE_NRPN_LSB);
-            MIOS32_MIDI_SendCC(PLUGIN_USB_PORT, Chn1, 38, 127 - midi_package.value);        
-            MIOS32_MIDI_SendCC(PLUGIN_USB_PORT, Chn1, 6, 127 - current_mf_value_msb);
-
+            // Sent to DAW and plugin by DC_FADER_Tick.
+            pending_mf_value = ((127 - current_mf_value_msb) << 7) | (127 - midi_package.value);
             current_mf_value_msb = -1;
         }
         else if (midi_package.cc_number == MF_TOUCH_CC)
         {
+            // On release, send the final position straight away, before the touch sense.
+            if (midi_package.value == 0 && pending_mf_value >= 0)
+                DC_FADER_SendMfValue();
+
             // Send fader touch sense to DAW and plugin.
             MIOS32_MIDI_SendCC(DAW_USB_PORT, Chn1, MF_TOUCH_CC, midi_package.value);
             MIOS32_MIDI_SendCC(PLUGIN_USB_PORT, Chn1, MF_TOUCH_CC, midi_package.value);
@@ -83,11 +138,10 @@ void DC_FADER_MIDI_NotifyPackage(mios32_midi_port_t port, mios32_midi_package_t
         }
         else if (midi_package.cc_number == 6 && current_daw_channel_value_lsb > -1)        // 6 = Data Entry MSB
         {
-            // Convert to CC for MF board
-            MIOS32_MIDI_SendCC(UART0, Chn1, MF_VALUE_CC_MSB, 127 - midi_package.value);
-            MIOS32_MIDI_SendCC(UART0, Chn1, MF_VALUE_CC_LSB, 127 - current_daw_channel_value_lsb);
+            // Sent to MF board by DC_FADER_Tick.
+            pending_daw_value = ((127 - midi_package.value) << 7) | (127 - current_daw_channel_value_lsb);
             current_daw_channel_value_lsb = -1;
             daw_channel_nrpn_is_next = -1;
         }
     }
-}
\ No newline at end of file
+}
@@ -28,6 +28,11 @@
 /////////////////////////////////////////////////////////////////////////////
 
 extern void DC_FADER_MIDI_NotifyPackage(mios32_midi_port_t port, mios32_midi_package_t midi_package);
+extern void DC_FADER_Tick(void);
+extern void DC_FADER_SetDawValue(u16 value);
+
+void DC_FADER_SendMfValue();
+void DC_FADER_SendDawValue();
 
 
 /////////////////////////////////////////////////////////////////////////////
@@ -17,6 +17,7 @@
 #include <ws2812.h>
 #include <math.h>
 #include <stdbool.h>
+#include <stdio.h>
 
 #include "app.h"
 #include "dc_knob.h"
@@ -27,9 +28,15 @@
 /////////////////////////////////////////////////////////////////////////////
 
 #define ENCODER_COUNT 1                                 // The number of physical knobs. This could be expanded in future.
-#define ENCODER_VOLUME_RANGE 97                         // The range of the encoder when controlling volume (corresponds to dB).
+#define ENCODER_VOLUME_RANGE 481                        // The range of the encoder when controlling volume, 0.1 dB steps from -48 dB to 0 dB.
+#define ENCODER_VOLUME_STEPS_PER_DB 10
+#define ENCODER_VOLUME_STATE_STEPS 5                    // The plugin's state messages and CC 7 have 0.5 dB steps.
 #define ENCODER_CC_RANGE 128                            // The range of the encoder when controlling other parameters (7 bit MIDI standard).
 
+#define VOLUME_NRPN_LSB 2                               // Volume is sent to the plugin as 14 bit NRPN #2, 0 to 16383 for -48 dB to 0 dB.
+#define KNOB_COALESCE_INTERVAL_MS 10                    // Minimum time between knob values sent, and LCD and LED ring updates.
+#define KNOB_ACCEL_IDLE_MS 1000                         // Detent interval counter stops here.
+
 #define LED_RING_SIZE 16                                // Number of LEDs in our encoder ring.
 #define LED_RING_START_INDEX 45                         // The start index of the first LED.
 #define LED_RING_OFFSET 5                               // Depending on how the led ring board is mounted, the first LED may not be at the '-45' position.
@@ -40,10 +47,24 @@
 /////////////////////////////////////////////////////////////////////////////
 
 const u8 virtual_knob_CCs[2] = {0x07, 0x01};            // We have 2 virtual knobs, VOLUME and MODULATION. This could be expanded in future.
-u8 virtual_knob_pos[2];                                 // MIDI CC's for each virtual knob.
+u16 virtual_knob_pos[2];                                // Position of each virtual knob, 0 to its range - 1.
 u8 current_virtual_knob = 0;                            // Index of the currently selected virtual knob.
 s16 led_hue_override = -1;                              // The LED ring's colour can be overridden by certain functions, e.g. monitor mute.
 
+// Encoder acceleration: the shorter the time since the last detent, the bigger the step.
+// A slow turn moves volume 0.1 dB per detent, a fast spin 2 dB.
+static const u16 accel_interval_ms[] = { 15, 30, 60, 120 };
+static const u8 accel_volume_steps[] = { 20, 10, 5, 2, 1 };
+static const u8 accel_cc_steps[] = { 8, 4, 2, 1, 1 };
+#define ACCEL_INTERVAL_COUNT (sizeof(accel_interval_ms) / sizeof(accel_interval_ms[0]))
+
+// Detents only move the position, the tick sends it: a burst of detents is sent as one value
+// per KNOB_COALESCE_INTERVAL_MS, with one LCD popup and LED ring update.
+static u16 ms_since_detent = KNOB_ACCEL_IDLE_MS;
+static u8 ms_since_knob_sent = KNOB_COALESCE_INTERVAL_MS;
+static volatile bool is_knob_changed = false;
+static u8 changed_knob = 0;
+
 void DC_KNOB_Init()
 {
     // Init all pins of J5A, J5B and J5C as inputs with internal Pull-Up.
@@ -61,8 +82,8 @@ void DC_KNOB_Init()
         enc_config.cfg.type = NON_DETENTED; // see mios32_enc.h for available types
         enc_config.cfg.sr = 0;              
         enc_config.cfg.pos = 0;             
-        enc_config.cfg.speed = FAST;
-        enc_config.cfg.speed_par = 1;
+        enc_config.cfg.speed = NORMAL;      // Accelerated by DC_KNOB_NotifyChange instead.
+        enc_config.cfg.speed_par = 0;
 
         MIOS32_ENC_ConfigSet(enc, enc_config);
 
@@ -73,6 +94,35 @@ void DC_KNOB_Init()
     DC_KNOB_UpdateLedRing();   
 }
 
+static int DC_KNOB_GetRange(u8 knob_index)
+{
+    return virtual_knob_CCs[knob_index] == 7 ? ENCODER_VOLUME_RANGE : ENCODER_CC_RANGE;
+}
+
+static void DC_KNOB_SetPositionFromPlugin(u8 knob_index, int position)
+{
+    // Position in the plugin's units: 0.5 dB steps for volume, the CC value otherwise.
+    // A volume position already within the step is kept, so the knob doesn't lose its finer position.
+    int max = DC_KNOB_GetRange(knob_index);
+
+    if (virtual_knob_CCs[knob_index] == 7)
+    {
+        if ((virtual_knob_pos[knob_index] + ENCODER_VOLUME_STATE_STEPS / 2) / ENCODER_VOLUME_STATE_STEPS == position)
+            return;
+
+        position *= ENCODER_VOLUME_STATE_STEPS;
+    }
+
+    if (position < 0)
+        position = 0;
+    else if (position >= max)
+        position = max - 1;
+
+    virtual_knob_pos[knob_index] = position;
+
+    if (current_virtual_knob == knob_index) DC_KNOB_UpdateLedRing();
+}
+
 void DC_KNOB_MIDI_NotifyPackage(mios32_midi_port_t port, mios32_midi_package_t midi_package)
 {
     // MIDI received, update our virtual knob value if necessary.
@@ -82,27 +132,46 @@ void DC_KNOB_MIDI_NotifyPackage(mios32_midi_port_t port, mios32_midi_package_t m
         if ((i == 0 && port == PLUGIN_USB_PORT || i > 0 && port == MODULATE_USB_PORT)
             && midi_package.chn == Chn1 && midi_package.type == CC && midi_package.cc_number == virtual_knob_CCs[i])
         {
-            int max = virtual_knob_CCs[current_virtual_knob] == 7 ? ENCODER_VOLUME_RANGE : ENCODER_CC_RANGE;
-            int value = midi_package.value - (128 - max);
+            // Volume CC values are offset, 31 is -48 dB.
+            int value = midi_package.value;
+            if (virtual_knob_CCs[i] == 7)
+                value -= 128 - (ENCODER_VOLUME_RANGE - 1) / ENCODER_VOLUME_STATE_STEPS - 1;
 
-            if (value < 0)
-                value = 0;
-            else if (value >= max)
-                value = max - 1;
+            DC_KNOB_SetPositionFromPlugin(i, value);
+        }
+    }
+}
 
-            virtual_knob_pos[i] = value;
+void DC_KNOB_SetKnobPosition(u8 knob_index, u8 position)
+{
+    // Position in 0.5 dB steps for volume, from the plugin's state messages (see dc_state.c).
+    if (knob_index >= sizeof(virtual_knob_CCs))
+        return;
 
-            if (current_virtual_knob == i) DC_KNOB_UpdateLedRing();
-        }
+    DC_KNOB_SetPositionFromPlugin(knob_index, position);
+}
+
+static int DC_KNOB_GetAcceleratedSteps(bool is_volume)
+{
+    // Steps per detent for the time since the previous detent.
+    int i;
+    for (i = 0; i < ACCEL_INTERVAL_COUNT; i++)
+    {
+        if (ms_since_detent < accel_interval_ms[i])
+            break;
     }
+
+    return is_volume ? accel_volume_steps[i] : accel_cc_steps[i];
 }
 
 void DC_KNOB_NotifyChange(u32 encoder, s32 incrementer)
 {
-    // Knob moved - increment to virtual position and ensure that the value is in correct range
+    // Knob moved - increment to virtual position and ensure that the value is in correct range.
+    // Sent by DC_KNOB_Tick.
     bool is_volume = virtual_knob_CCs[current_virtual_knob] == 7;
-    int max = is_volume ? ENCODER_VOLUME_RANGE : ENCODER_CC_RANGE;
-    int value = virtual_knob_pos[current_virtual_knob] + incrementer;
+    int max = DC_KNOB_GetRange(current_virtual_knob);
+    int value = virtual_knob_pos[current_virtual_knob] + incrementer * DC_KNOB_GetAcceleratedSteps(is_volume);
+    ms_since_detent = 0;
 
     if (value < 0)
         value = 0;
@@ -112,25 +181,74 @@ void DC_KNOB_NotifyChange(u32 encoder, s32 incrementer)
     // Only send if value has changed.
     if (virtual_knob_pos[current_virtual_knob] != value)
     {
-        // Store new value and send MIDI.
+        MIOS32_IRQ_Disable();
         virtual_knob_pos[current_virtual_knob] = value;
+        changed_knob = current_virtual_knob;
+        is_knob_changed = true;
+        MIOS32_IRQ_Enable();
+    }
+}
 
-        MIOS32_MIDI_SendCC(current_virtual_knob == 0 ? PLUGIN_USB_PORT : MODULATE_USB_PORT, 
-            Chn1, virtual_knob_CCs[current_virtual_knob], value);
-      
-        // Display dB value on LCD.
-        if (is_volume) value = (int)((float)(-max + value) / 2.0f);
-        char label[11];
-        sprintf(label, "MIDI CC %d", virtual_knob_CCs[current_virtual_knob]);
+static void DC_KNOB_SendValue(u8 knob_index, int value)
+{
+    if (virtual_knob_CCs[knob_index] == 7)
+    {
+        // 14 bit NRPN, for finer steps than a CC.
+        u16 nrpn_value = (u16)(((u32)value * 0x3fff + (ENCODER_VOLUME_RANGE - 1) / 2) / (ENCODER_VOLUME_RANGE - 1));
 
-        if (value == -48)
+        MIOS32_MIDI_SendCC(PLUGIN_USB_PORT, Chn1, 99, 0);
+        MIOS32_MIDI_SendCC(PLUGIN_USB_PORT, Chn1, 98, VOLUME_NRPN_LSB);
+        MIOS32_MIDI_SendCC(PLUGIN_USB_PORT, Chn1, 38, nrpn_value & 0x7f);
+        MIOS32_MIDI_SendCC(PLUGIN_USB_PORT, Chn1, 6, (nrpn_value >> 7) & 0x7f);
+    }
+    else
+    {
+        MIOS32_MIDI_SendCC(MODULATE_USB_PORT, Chn1, virtual_knob_CCs[knob_index], value);
+    }
+}
+
+void DC_KNOB_Tick()
+{
+    // Called each mS from the main task.
+    if (ms_since_detent < KNOB_ACCEL_IDLE_MS)
+        ms_since_detent++;
+    if (ms_since_knob_sent < KNOB_COALESCE_INTERVAL_MS)
+        ms_since_knob_sent++;
+
+    if (!is_knob_changed || ms_since_knob_sent < KNOB_COALESCE_INTERVAL_MS)
+        return;
+
+    MIOS32_IRQ_Disable();
+    u8 knob_index = changed_knob;
+    int value = virtual_knob_pos[knob_index];
+    is_knob_changed = false;
+    MIOS32_IRQ_Enable();
+
+    ms_since_knob_sent = 0;
+    DC_KNOB_SendValue(knob_index, value);
+
+    // Display dB value on LCD, to 0.1 dB.
+    if (virtual_knob_CCs[knob_index] == 7)
+    {
+        int tenths = value - (ENCODER_VOLUME_RANGE - 1);
+        char text[8];
+        sprintf(text, "%s%d.%d", tenths < 0 ? "-" : "", -tenths / ENCODER_VOLUME_STEPS_PER_DB, -tenths % ENCODER_VOLUME_STEPS_PER_DB);
+
+        if (value == 0)
             DC_LCD_PopupBigText("OFF", "MONITOR LEVEL    dBFS");
-        else 
-            DC_LCD_PopupBigValue(value, is_volume ? "MONITOR LEVEL    dBFS" : label);
+        else
+            DC_LCD_PopupBigText(text, "MONITOR LEVEL    dBFS");
+    }
+    else
+    {
+        char label[11];
+        sprintf(label, "MIDI CC %d", virtual_knob_CCs[knob_index]);
+        DC_LCD_PopupBigValue(value, label);
     }
 
     // update LED ring
-    DC_KNOB_UpdateLedRing();
+    if (knob_index == current_virtual_knob)
+        DC_KNOB_UpdateLedRing();
 }
 
 
@@ -139,7 +257,7 @@ void DC_KNOB_UpdateLedRing()
     // Update LED ring. We display a nice colour spectrum from blue through green to red, unless the
     // colour is overridden. Also, values 'between' individual LEDs are shown by varying brightness.
     int value = virtual_knob_pos[current_virtual_knob];
-    float values_per_led = (virtual_knob_CCs[current_virtual_knob] == 7 ? ENCODER_VOLUME_RANGE : ENCODER_CC_RANGE) / LED_RING_SIZE;
+    float values_per_led = DC_KNOB_GetRange(current_virtual_knob) / LED_RING_SIZE;
     int led;
     float h, v;
 
@@ -177,7 +295,7 @@ void DC_KNOB_UpdateLedRing()
 
 void DC_KNOB_SetCurrentKnob(u8 knob_index)
 {
-    if (knob_index < sizeof(virtual_knob_pos))
+    if (knob_index < sizeof(virtual_knob_CCs))
     {
         current_virtual_knob = knob_index;
         DC_KNOB_UpdateLedRing();
@@ -186,12 +304,12 @@ void DC_KNOB_SetCurrentKnob(u8 knob_index)
 
 s8 DC_KNOB_GetKnobValue(u8 knob_index)
 {
-    if (knob_index < sizeof(virtual_knob_pos))
+    if (knob_index < sizeof(virtual_knob_CCs))
     {    
+        // Volume in whole dB, -48 is off.
         bool is_volume = virtual_knob_CCs[current_virtual_knob] == 7;
-        int max = is_volume ? ENCODER_VOLUME_RANGE : ENCODER_CC_RANGE;
         int value = virtual_knob_pos[current_virtual_knob];
-        if (is_volume) value = (int)((float)(-max + value) / 2.0f);
+        if (is_volume) value = (value - (ENCODER_VOLUME_RANGE - 1)) / ENCODER_VOLUME_STEPS_PER_DB;
 
         return value;
     }
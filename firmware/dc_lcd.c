@@ -14,6 +14,8 @@
 /////////////////////////////////////////////////////////////////////////////
 
 #include <mios32.h>
+#include <FreeRTOS.h>
+#include <semphr.h>
 #include <glcd_font.h>
 #include <stdbool.h>
 
@@ -33,12 +35,30 @@ static bool init_complete = false;
 static bool splash_complete = false;
 static unsigned int init_timer_value = 0;
 
+// The meter render task and the popups (knob, DSP load) draw from different tasks, so LCD access
+// from tasks is serialised. Recursive, as the DSP load popup is drawn by PopupBigValue.
+// The splash screen is drawn from the init timer interrupt, before anything else may draw.
+static xSemaphoreHandle lcd_mutex;
+#define LCD_LOCK() xSemaphoreTakeRecursive(lcd_mutex, portMAX_DELAY)
+#define LCD_UNLOCK() xSemaphoreGiveRecursive(lcd_mutex)
+
+// Counts every clear of the whole display, so anything caching what it drew knows to redraw.
+static volatile u32 clear_count = 0;
+
+// DSP load popup: stage shown, moves on each time the popup is requested while it is still showing.
+static const char *dsp_load_stage_names[] = { "BAND SOLO", "MID/SIDE", "LOUD EQ", "METERS", "GAIN", "DSP TOTAL" };
+#define DSP_LOAD_STAGE_COUNT (sizeof(dsp_load_stage_names) / sizeof(dsp_load_stage_names[0]))
+static u8 dsp_load_stage = DSP_LOAD_STAGE_COUNT - 1;
+static bool is_dsp_load_popup = false;
+
 void DC_LCD_Init()
 {
     // LCD reset pin is connected to J10A pin 8.
     MIOS32_BOARD_J10_PinInit(7, MIOS32_BOARD_PIN_MODE_OUTPUT_OD);
     MIOS32_BOARD_J10_PinSet(7, 0);
 
+    lcd_mutex = xSemaphoreCreateRecursiveMutex();
+
     MIOS32_TIMER_Init(0, 1000, DC_LCD_Init_Timer, MIOS32_IRQ_PRIO_MID);
 }
 
@@ -68,8 +88,9 @@ static void DC_LCD_Init_Timer(void)
             // After another INIT_TIME_MS period, display the splash screen.
             splash_complete = true;
             MIOS32_LCD_Clear();
-            DC_LCD_Print(0, 0, 4, " Dream");
-            DC_LCD_Print(4, 0, 4, "Control");
+            clear_count++;
+            DC_LCD_PrintText(0, 0, 4, " Dream");
+            DC_LCD_PrintText(4, 0, 4, "Control");
         }
         else
         {
@@ -86,16 +107,41 @@ void DC_LCD_Tick()
 
     if (popup_timeout_value >= POPUP_TIMEOUT_MS)
     {
+        LCD_LOCK();
         popup_timeout_value = -1;
         MIOS32_LCD_Clear();
+        clear_count++;
+        LCD_UNLOCK();
     }
 }
 
+// True once the LCD is initialised and the splash screen has been shown.
+bool DC_LCD_IsReady()
+{
+    return splash_complete;
+}
+
+bool DC_LCD_IsPopupShowing()
+{
+    return popup_timeout_value > 0;
+}
+
+u32 DC_LCD_GetClearCount()
+{
+    return clear_count;
+}
+
 // Pop up a message on the LCD for a few seconds.
 void DC_LCD_PopupBigValue(const int value, const char *value_label)
 {
+    LCD_LOCK();
+    is_dsp_load_popup = false;
+
     if (popup_timeout_value <= 0)
+    {
         MIOS32_LCD_Clear();
+        clear_count++;
+    }
 
     popup_timeout_value = 1;
 
@@ -110,13 +156,20 @@ void DC_LCD_PopupBigValue(const int value, const char *value_label)
 
     MIOS32_LCD_GCursorSet(0, 7 * 8);
     MIOS32_LCD_PrintString(value_label);
+    LCD_UNLOCK();
 }
 
 // Pop up a message on the LCD for a few seconds.
 void DC_LCD_PopupBigText(const char* text, const char *value_label)
 {
+    LCD_LOCK();
+    is_dsp_load_popup = false;
+
     if (popup_timeout_value <= 0)
+    {
         MIOS32_LCD_Clear();
+        clear_count++;
+    }
 
     popup_timeout_value = 1;
 
@@ -131,33 +184,65 @@ void DC_LCD_PopupBigText(const char* text, const char *value_label)
 
     MIOS32_LCD_GCursorSet(0, 7 * 8);
     MIOS32_LCD_PrintString(value_label);
+    LCD_UNLOCK();
+}
+
+// Pop up the plugin's processing load: worst block as a big value, average in the label, in % of the block time.
+// load_data is average then worst for each stage, total last. Total is shown first, then each stage in turn.
+void DC_LCD_PopupDspLoad(const char* load_data, const u8 length)
+{
+    if (length < DSP_LOAD_STAGE_COUNT * 2)
+        return;
+
+    LCD_LOCK();
+    bool is_showing = is_dsp_load_popup && popup_timeout_value > 0 && popup_timeout_value < POPUP_TIMEOUT_MS;
+    dsp_load_stage = is_showing ? (dsp_load_stage + 1) % DSP_LOAD_STAGE_COUNT : DSP_LOAD_STAGE_COUNT - 1;
+
+    char label[24];
+    sprintf(label, "%-9s AVG%3d%% MAX", dsp_load_stage_names[dsp_load_stage], load_data[dsp_load_stage * 2]);
+
+    DC_LCD_PopupBigValue(load_data[dsp_load_stage * 2 + 1], label);
+    is_dsp_load_popup = true;
+    LCD_UNLOCK();
 }
 
 void DC_LCD_Clear()
 {
+    LCD_LOCK();
     if (popup_timeout_value <= 0)
+    {
         MIOS32_LCD_Clear();
+        clear_count++;
+    }
+    LCD_UNLOCK();
 }
 
 void DC_LCD_Print(const int row, const int X, const int font_size, const char *text)
 {
-    if (popup_timeout_value <= 0)
-        MIOS32_LCD_FontInit(font_size == 0
-                                ? (u8 *)GLCD_FONT_TINY
-                                : font_size == 1
-                                      ? (u8 *)GLCD_FONT_SMALL
-                                      : font_size == 2
-                                            ? (u8 *)GLCD_FONT_NORMAL
-                                            : font_size == 3
-                                                  ? (u8 *)GLCD_FONT_BIG
-                                                  : font_size == 4
-                                                        ? (u8 *)GLCD_FONT_HUGE
-                                                        : font_size == 5
-                                                              ? (u8 *)GLCD_FONT_MEGA
-                                                              : (u8 *)GLCD_FONT_NORMAL);
+    LCD_LOCK();
+    DC_LCD_PrintText(row, X, font_size, text);
+    LCD_UNLOCK();
+}
 
-    if (popup_timeout_value <= 0)
-        MIOS32_LCD_GCursorSet(X, row * 8);
-    if (popup_timeout_value <= 0)
-        MIOS32_LCD_PrintString(text);
+static void DC_LCD_PrintText(const int row, const int X, const int font_size, const char *text)
+{
+    if (popup_timeout_value > 0)
+        return;
+
+    MIOS32_LCD_FontInit(font_size == 0
+                            ? (u8 *)GLCD_FONT_TINY
+                            : font_size == 1
+                                  ? (u8 *)GLCD_FONT_SMALL
+                                  : font_size == 2
+                                        ? (u8 *)GLCD_FONT_NORMAL
+                                        : font_size == 3
+                                              ? (u8 *)GLCD_FONT_BIG
+                                              : font_size == 4
+                                                    ? (u8 *)GLCD_FONT_HUGE
+                                                    : font_size == 5
+                                                          ? (u8 *)GLCD_FONT_MEGA
+                                                          : (u8 *)GLCD_FONT_NORMAL);
+
+    MIOS32_LCD_GCursorSet(X, row * 8);
+    MIOS32_LCD_PrintString(text);
 }
@@ -12,6 +12,8 @@
 #ifndef _DC_LCD_H
 #define _DC_LCD_H
 
+#include <stdbool.h>
+
 
 /////////////////////////////////////////////////////////////////////////////
 // global definitions
@@ -27,12 +29,17 @@
 
 extern void DC_LCD_Init();
 extern void DC_LCD_Tick();
+extern bool DC_LCD_IsReady();
+extern bool DC_LCD_IsPopupShowing();
+extern u32 DC_LCD_GetClearCount();
 extern void DC_LCD_PopupBigValue(const int value, const char* value_label);
 extern void DC_LCD_PopupBigText(const char* text, const char* value_label);
+extern void DC_LCD_PopupDspLoad(const char* load_data, const u8 length);
 extern void DC_LCD_Clear();
 extern void DC_LCD_Print(const int row, const int X, const int font_size, const char* text);
 
 static void DC_LCD_Init_Timer(void);
+static void DC_LCD_PrintText(const int row, const int X, const int font_size, const char* text);
 
 /////////////////////////////////////////////////////////////////////////////
 // Exported variables
@@ -14,11 +14,14 @@
 /////////////////////////////////////////////////////////////////////////////
 
 #include <mios32.h>
+#include <FreeRTOS.h>
+#include <task.h>
 #include <ws2812.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 
 #include "app.h"
 #include "dc_meters.h"
@@ -32,6 +35,14 @@
 #define LED_METER_SIZE 15               // The number of LEDs in each of our meters.
 #define LED_METER_START_INDEX 0         // The start index of the first LED of the first meter.
 #define LED_METER_COUNT 3               // The number of meters we have.
+#define METER_BLANK_LEVEL -99.0f        // Levels at or below this are not displayed.
+#define LED_METER_TOTAL (LED_METER_SIZE * LED_METER_COUNT)
+
+#define METER_RENDER_PERIOD_MS 16       // The meters are drawn at most this often, ~60 Hz.
+#define METER_RENDER_STACK_SIZE configMINIMAL_STACK_SIZE
+#define PRIORITY_TASK_METER_RENDER (tskIDLE_PRIORITY + 1)   // Below the MIOS32 tasks, so button, encoder and MIDI handling come first.
+#define METER_LINE_LENGTH 19
+#define LED_RAMP_STEPS 8                // Brightness steps while an LED fades in, about what LED_BRIGHTNESS leaves of the WS2812's 8 bits.
 
 // Arrays of hue (colour) values and dB values for each LED for the different meter types. Values start at bottom of meter.
 // Because of the way things work, we need LED_METER_SIZE+1 elements in these arrays.
@@ -48,6 +59,17 @@ const int lufs_abs_meter_vals[16] = {-35, -31, -27, -25, -23, -21, -19, -17, -15
 const int lufs_rel_meter_hue[15] = {130, 130, 130, 130, 130, 130, 130, 130, 130, 114, 30, 0, 0, 0, 0};
 const int lufs_rel_meter_vals[16] = {-18, -16, -14, -12, -10, -8, -6, -4, -2, 0, 2, 4, 6, 8, 10, 12};
 
+// One of the scales above, built for the current mode so a meter refresh is a table walk on centi-dB levels.
+// LED 0 is the bottom of the meter. It is off at or below off_level, fully lit at or above full_level,
+// and in between takes one of LED_RAMP_STEPS brightness steps.
+typedef struct {
+    s16 off_level[LED_METER_SIZE];
+    s16 full_level[LED_METER_SIZE];
+    s16 ramp_width[LED_METER_SIZE];
+    u32 rgb[LED_METER_SIZE][LED_RAMP_STEPS + 1];  // Packed 0xRRGGBB, [LED_RAMP_STEPS] is fully lit.
+    u32 max_rgb;                                  // Max marker on the peak meters.
+} dc_led_scale_t;
+
 /////////////////////////////////////////////////////////////////////////////
 // local variables
 /////////////////////////////////////////////////////////////////////////////
@@ -56,26 +78,144 @@ bool is_lufs_mode = false;                      // true = LUFS mode, false = Tru
 bool is_peak_with_momentary = false;            // true = True Peak mode also shows LUFS Momentary, false = LUFS Short
 bool is_1db_scale = false;                      // true = True Peak scale is 1dB, false = 3dB
 bool is_lufs_relative = false;                  // true = LUFS meter is relative mode, false = absolute mode
-float current_lufs_target = -16.0f;             // Our current LUFS target value (set in plugin).
+dc_meter_state_t meter_state;                   // Meter values being drawn, owned by the render task.
+
+// The SysEx parser applies each frame to received_state, then publishes a copy in pending_state.
+// The render task takes the newest pending_state, frames in between are simply superseded.
+static dc_meter_state_t received_state;
+static dc_meter_state_t pending_state;
+static volatile bool is_state_pending = false;
+static volatile bool is_redraw_needed = false;  // Set when a mode change affects what is drawn.
+
+// What the render task last drew, so only changed LCD lines and LEDs are written.
+static char drawn_top_line[METER_LINE_LENGTH];
+static char drawn_lufs_i[6];
+static char drawn_bottom_line[METER_LINE_LENGTH];
+static u32 drawn_clear_count = 0;
+static bool is_lcd_drawn = false;
+static u32 drawn_led_rgb[LED_METER_TOTAL];
+static bool is_led_drawn[LED_METER_TOTAL];
+
+// LED scales for the current modes, rebuilt by the render task after a scale mode change.
+static dc_led_scale_t peak_scale;
+static dc_led_scale_t lufs_scale;
+static volatile bool is_led_scale_stale = true;
+
+static void DC_METERS_BuildLedScale(dc_led_scale_t *scale, const int *led_hue_list, const int *led_val_list, int dim_led_count);
+
+static void TASK_MeterRender(void *pvParameters);
 
 void DC_METERS_Init()
 {
+    int i;
+    for (i = 0; i < METER_LEVEL_COUNT; i++)
+    {
+        received_state.level[i] = -100.0f;
+        received_state.centi_db[i] = -10000;
+    }
+    received_state.level[LUFS_TARGET] = -16.0f;
+    received_state.centi_db[LUFS_TARGET] = -1600;
+    received_state.clip_l = false;
+    received_state.clip_r = false;
+    meter_state = pending_state = received_state;
+
+    for (i = 0; i < LED_METER_TOTAL; i++)
+        is_led_drawn[i] = false;
+
+    xTaskCreate(TASK_MeterRender, (signed portCHAR *)"MeterRender", METER_RENDER_STACK_SIZE, NULL, PRIORITY_TASK_METER_RENDER, NULL);
+}
+
+static void TASK_MeterRender(void *pvParameters)
+{
+    portTickType last_wake_time = xTaskGetTickCount();
+
+    while (1)
+    {
+        vTaskDelayUntil(&last_wake_time, METER_RENDER_PERIOD_MS / portTICK_RATE_MS);
+        DC_METERS_Render();
+    }
+}
+
+bool DC_METERS_DecodeFrame(const char *frame_data, u8 frame_length)
+{
+    // Frames only carry the fields that changed, so apply them on top of our current state.
+    if (frame_length < 3 || frame_data[0] != METER_FRAME_VERSION)
+        return false;
+
+    u16 mask = (u8)frame_data[1] | ((u16)(u8)frame_data[2] << 7);
+    u8 pos = 3;
+    int field;
+
+    for (field = 0; field <= METER_CLIP_FLAGS; field++)
+    {
+        if (!(mask & (1 << field)))
+            continue;
+
+        if (field < METER_LEVEL_COUNT)
+        {
+            if (pos + 2 > frame_length)
+                return false;
+
+            s32 value = ((s32)(u8)frame_data[pos] << 7) | (u8)frame_data[pos + 1];
+            received_state.centi_db[field] = (s16)(value - METER_FRAME_LEVEL_OFFSET);
+            received_state.level[field] = (float)(value - METER_FRAME_LEVEL_OFFSET) / 100.0f;
+            pos += 2;
+        }
+        else
+        {
+            if (pos + 1 > frame_length)
+                return false;
+
+            received_state.clip_l = (frame_data[pos] & METER_FRAME_CLIP_L) != 0;
+            received_state.clip_r = (frame_data[pos] & METER_FRAME_CLIP_R) != 0;
+            pos++;
+        }
+    }
+
+    return true;
 }
 
 void DC_METERS_MIDI_NotifyPackage(mios32_midi_port_t port, mios32_midi_package_t midi_package)
 {
 }
 
-void DC_METERS_Update(char *meter_data)
+void DC_METERS_Update(const char *frame_data, u8 frame_length)
+{
+    // We are passed a meter frame received as MIDI sysex data, see DC_METERS_DecodeFrame.
+    // This runs in MIDI receive context, so only store the state here; the render task draws it.
+    if (!DC_METERS_DecodeFrame(frame_data, frame_length))
+        return;
+
+    MIOS32_IRQ_Disable();
+    pending_state = received_state;
+    is_state_pending = true;
+    MIOS32_IRQ_Enable();
+}
+
+void DC_METERS_Render()
 {
-    // We are passed a pointer to an array of meter values, which were received as MIDI sysex data.
-    // Each value is split into integral and fractional, i.e. 0=integral, 1=fractional, except CLIP_L and CLIP_R which are boolean.
-    // The integral is always a negative number. True peak values have 3dB subtracted, as they can go up to +3dB.
-    // This makes the total range -99.99 to 0.00.
+    // Mode changes only redraw once there are meters on the display, the splash screen stays until the first frame.
+    if (!is_state_pending && (!is_redraw_needed || !is_lcd_drawn))
+        return;
+
+    // Nothing may be drawn before the LCD is initialised, keep the state pending until then.
+    if (!DC_LCD_IsReady())
+        return;
+
+    MIOS32_IRQ_Disable();
+    meter_state = pending_state;
+    is_state_pending = false;
+    MIOS32_IRQ_Enable();
+
+    bool is_full_redraw = is_redraw_needed;
+    is_redraw_needed = false;
 
-    current_lufs_target = -((float)meter_data[LUFS_TARGET] + (float)(meter_data[LUFS_TARGET + 1] / 100.0f));
-    float max_peak = -((float)meter_data[MAX_TOTAL] + ((float)(meter_data[MAX_TOTAL + 1] / 100.0f)));
-    max_peak = max_peak + 3.0f;
+    if (is_led_scale_stale)
+    {
+        is_led_scale_stale = false;
+        DC_METERS_BuildLedScale(&peak_scale, is_1db_scale ? peak_1db_meter_hue : peak_3db_meter_hue, is_1db_scale ? peak_1db_meter_vals : peak_3db_meter_vals, 0);
+        DC_METERS_BuildLedScale(&lufs_scale, is_lufs_relative ? lufs_rel_meter_hue : lufs_abs_meter_hue, is_lufs_relative ? lufs_rel_meter_vals : lufs_abs_meter_vals, is_lufs_relative ? 8 : 0);
+    }
 
     ///////////////   LCD
     // Our display layout shows:
@@ -84,9 +224,9 @@ void DC_METERS_Update(char *meter_data)
     // Bottom line (small) - LUFS range, LUFS target, LUFS Short
 
     char max_l[6];
-    DC_METERS_GetLevelStringFromMeterData(max_l, meter_data, MAX_L, true);
+    DC_METERS_GetLevelStringFromMeterData(max_l, MAX_L, true);
     char max_r[6];
-    DC_METERS_GetLevelStringFromMeterData(max_r, meter_data, MAX_R, true);
+    DC_METERS_GetLevelStringFromMeterData(max_r, MAX_R, true);
     char level[6];
     s8 vol = DC_KNOB_GetKnobValue(0);
     if (vol == -48)
@@ -94,27 +234,45 @@ void DC_METERS_Update(char *meter_data)
     else
         sprintf(level, " %d", vol);
 
-    char top_line[19];
-    sprintf(top_line, "%s %s %s ", max_l, max_r, meter_data[CLIP_L] || meter_data[CLIP_R] ? " CLIP" : level);
+    char top_line[METER_LINE_LENGTH];
+    sprintf(top_line, "%s %s %s ", max_l, max_r, meter_state.clip_l || meter_state.clip_r ? " CLIP" : level);
 
     char lufs_i[6];
-    DC_METERS_GetLevelStringFromMeterData(lufs_i, meter_data, LUFS_I, false);
+    DC_METERS_GetLevelStringFromMeterData(lufs_i, LUFS_I, false);
 
     char lufs_range[6];
-    DC_METERS_GetLevelStringFromMeterData(lufs_range, meter_data, LUFS_RANGE, false);
+    DC_METERS_GetLevelStringFromMeterData(lufs_range, LUFS_RANGE, false);
     char lufs_target[6];
-    DC_METERS_GetLevelStringFromMeterData(lufs_target, meter_data, LUFS_TARGET, false);
+    DC_METERS_GetLevelStringFromMeterData(lufs_target, LUFS_TARGET, false);
     char lufs_s[6];
-    DC_METERS_GetLevelStringFromMeterData(lufs_s, meter_data, LUFS_S, false);
+    DC_METERS_GetLevelStringFromMeterData(lufs_s, LUFS_S, false);
 
-    char bottom_line[19];
+    char bottom_line[METER_LINE_LENGTH];
     sprintf(bottom_line, "%s %s %s ", lufs_range, lufs_target, lufs_s);
 
-    DC_LCD_Print(0, 0, 2, top_line);
-    DC_LCD_Print(0, 108, 0, " dBTP");
-    DC_LCD_Print(1, 0, 5, lufs_i);
-    DC_LCD_Print(7, 0, 2, bottom_line);
-    DC_LCD_Print(7, 108, 0, " LUFS");
+    // While a popup is showing nothing is drawn, and the popup clears the display when it ends.
+    if (!DC_LCD_IsPopupShowing())
+    {
+        u32 clear_count = DC_LCD_GetClearCount();
+        bool is_lcd_redraw = is_full_redraw || !is_lcd_drawn || clear_count != drawn_clear_count;
+
+        if (is_lcd_redraw || strcmp(top_line, drawn_top_line) != 0)
+            DC_LCD_Print(0, 0, 2, top_line);
+        if (is_lcd_redraw)
+            DC_LCD_Print(0, 108, 0, " dBTP");
+        if (is_lcd_redraw || strcmp(lufs_i, drawn_lufs_i) != 0)
+            DC_LCD_Print(1, 0, 5, lufs_i);
+        if (is_lcd_redraw || strcmp(bottom_line, drawn_bottom_line) != 0)
+            DC_LCD_Print(7, 0, 2, bottom_line);
+        if (is_lcd_redraw)
+            DC_LCD_Print(7, 108, 0, " LUFS");
+
+        strcpy(drawn_top_line, top_line);
+        strcpy(drawn_lufs_i, lufs_i);
+        strcpy(drawn_bottom_line, bottom_line);
+        drawn_clear_count = clear_count;
+        is_lcd_drawn = true;
+    }
 
     ////////////////  LED METERS
     // in LUFS mode:
@@ -124,136 +282,158 @@ void DC_METERS_Update(char *meter_data)
 
     if (is_lufs_mode)
     {
-        DC_METERS_UpdateLedMeter(0, meter_data, LUFS_M, false);
-        DC_METERS_UpdateLedMeter(1, meter_data, LUFS_S, false);
-        DC_METERS_UpdateLedMeter(2, meter_data, LUFS_I, false);
+        DC_METERS_UpdateLedMeter(0, LUFS_M, false);
+        DC_METERS_UpdateLedMeter(1, LUFS_S, false);
+        DC_METERS_UpdateLedMeter(2, LUFS_I, false);
     }
     else
     {
-        DC_METERS_UpdateLedMeter(0, meter_data, PEAK_L, true);
-        DC_METERS_UpdateLedMeter(1, meter_data, PEAK_R, true);
-        DC_METERS_UpdateLedMeter(2, meter_data, is_peak_with_momentary ? LUFS_M : LUFS_I, false);
+        DC_METERS_UpdateLedMeter(0, PEAK_L, true);
+        DC_METERS_UpdateLedMeter(1, PEAK_R, true);
+        DC_METERS_UpdateLedMeter(2, is_peak_with_momentary ? LUFS_M : LUFS_I, false);
     }
 }
 
-void DC_METERS_GetLevelStringFromMeterData(char *output_string, char *meter_data, dc_meter_data_index_t index, bool is_peak_meter)
+void DC_METERS_GetLevelStringFromMeterData(char *output_string, dc_meter_data_index_t index, bool is_peak_meter)
 {
-    int integral = -meter_data[index];
-    int fractional = meter_data[index + 1];
+    float value = meter_state.level[index];
 
-    if (integral == -99 && fractional == 0)
+    if (value <= METER_BLANK_LEVEL)
     {
         sprintf(output_string, "     ");
         return;
     }
 
-    // Add 3dB for true peak values, as they are supplied to us with 3dB subtracted so we don't have to worry about +/-.
-    // TODO: This is a fairly naff way of doing this and could be improved.
-    if (is_peak_meter)
-        integral = integral + 3;
-    if (is_peak_meter && integral > 0 && fractional > 0)
+    // Format with integers, rounded to 0.1dB. True peak values above 0 get a '+' sign.
+    int tenths = (int)(value * 10.0f + (value < 0.0f ? -0.5f : 0.5f));
+    int integral = abs(tenths) / 10;
+    int fractional = abs(tenths) % 10;
+    const char *sign = tenths < 0 ? "-" : is_peak_meter ? "+" : " ";
+
+    // Keep within 5 characters.
+    if (integral > 99)
     {
-        integral = integral - 1;
-        fractional = 99 - fractional;
+        integral = 99;
+        fractional = 9;
     }
 
-    sprintf(output_string, "%s%d.%01d", (integral <= -10 ? "" : integral >= 0 ? " +" : " "), integral, fractional);
-    if (strlen(output_string) >= 6)
-        output_string[strlen(output_string) - 1] = 0;
+    sprintf(output_string, "%s%s%d.%d", (integral >= 10 ? "" : " "), sign, integral, fractional);
 }
 
-void DC_METERS_UpdateLedMeter(char meter_index, char *meter_data, dc_meter_data_index_t data_index, bool is_peak_meter)
+// Packs a fully saturated colour, h in degrees and v from 0 to 1, as 0xRRGGBB.
+static u32 DC_METERS_PackHue(float h, float v)
 {
-    int led, values_per_led;
-    int *led_val_list;
-    int *led_hue_list;
-    float h, v;
+    float c = v * 255.0f;
+    float sector = fmodf(h, 360.0f) / 60.0f;
+    float x = c * (1.0f - fabsf(fmodf(sector, 2.0f) - 1.0f));
+    float r, g, b;
 
-    float value = -((float)meter_data[data_index] + (float)(meter_data[data_index + 1] / 100.0f));
+    switch ((int)sector)
+    {
+        case 0:  r = c; g = x; b = 0; break;
+        case 1:  r = x; g = c; b = 0; break;
+        case 2:  r = 0; g = c; b = x; break;
+        case 3:  r = 0; g = x; b = c; break;
+        case 4:  r = x; g = 0; b = c; break;
+        default: r = c; g = 0; b = x; break;
+    }
 
-    float max_l = -((float)meter_data[MAX_L] + (float)(meter_data[MAX_L + 1] / 100.0f)) + 3.0f;
-    float max_r = -((float)meter_data[MAX_R] + (float)(meter_data[MAX_R + 1] / 100.0f)) + 3.0f;
+    return ((u32)(r + 0.5f) << 16) | ((u32)(g + 0.5f) << 8) | (u32)(b + 0.5f);
+}
 
-    if (!is_peak_meter && is_lufs_relative)
-        value = value - current_lufs_target;
+static void DC_METERS_BuildLedScale(dc_led_scale_t *scale, const int *led_hue_list, const int *led_val_list, int dim_led_count)
+{
+    int led, step;
 
-    //MIOS32_MIDI_SendDebugMessage("METER %d = %d.%03d", meter_index, (int)value, abs((int)(1000*value)%1000));
+    for (led = 0; led < LED_METER_SIZE; led++)
+    {
+        // The lower area of the relative meter is darker.
+        float brightness = led < dim_led_count ? LED_BRIGHTNESS / 2.75f : LED_BRIGHTNESS;
 
-    if (is_peak_meter)
-        value = value + 3.0f;
+        scale->off_level[led] = (s16)(led_val_list[led] * 100);
+        scale->full_level[led] = (s16)(led_val_list[led + 1] * 100);
+        scale->ramp_width[led] = scale->full_level[led] - scale->off_level[led];
 
-    if (is_peak_meter && !is_1db_scale)
-    {
-        led_hue_list = peak_3db_meter_hue;
-        led_val_list = peak_3db_meter_vals;
-    }
-    else if (is_peak_meter && is_1db_scale)
-    {
-        led_hue_list = peak_1db_meter_hue;
-        led_val_list = peak_1db_meter_vals;
-    }
-    else if (!is_peak_meter && !is_lufs_relative)
-    {
-        led_hue_list = lufs_abs_meter_hue;
-        led_val_list = lufs_abs_meter_vals;
-    }
-    else if (!is_peak_meter && is_lufs_relative)
-    {
-        led_hue_list = lufs_rel_meter_hue;
-        led_val_list = lufs_rel_meter_vals;
+        for (step = 0; step <= LED_RAMP_STEPS; step++)
+            scale->rgb[led][step] = DC_METERS_PackHue((float)led_hue_list[led], brightness * step / LED_RAMP_STEPS);
     }
 
+    scale->max_rgb = DC_METERS_PackHue(0.0f, LED_BRIGHTNESS / 2.0f);
+}
+
+void DC_METERS_UpdateLedMeter(char meter_index, dc_meter_data_index_t data_index, bool is_peak_meter)
+{
+    const dc_led_scale_t *scale = is_peak_meter ? &peak_scale : &lufs_scale;
+    u32 rgb[LED_METER_SIZE];
+    int led;
+
+    s32 value = meter_state.centi_db[data_index];
+    if (!is_peak_meter && is_lufs_relative)
+        value -= meter_state.centi_db[LUFS_TARGET];
+
     // We calculate LED values from the bottom of the meter (0 is bottom LED)
     for (led = 0; led < LED_METER_SIZE; led++)
     {
-        //if ((data_index == PEAK_L && max_l > 0.0f) || (data_index == PEAK_R && max_r > 0.0f))
-        //    h = 0.0f; // If max above 0, make entire meter red.
-        //else
-            h = (float)led_hue_list[led];
-
-        if (value >= led_val_list[led + 1])
-            v = LED_BRIGHTNESS;
-        else if (value > led_val_list[led])
-            v = (1.0f - ((float)(led_val_list[led + 1] - value) / (float)(led_val_list[led + 1] - led_val_list[led]))) * LED_BRIGHTNESS;
+        if (value >= scale->full_level[led])
+            rgb[led] = scale->rgb[led][LED_RAMP_STEPS];
+        else if (value > scale->off_level[led])
+            rgb[led] = scale->rgb[led][(value - scale->off_level[led]) * LED_RAMP_STEPS / scale->ramp_width[led]];
         else
-            v = 0.0;
-
-        if (!is_peak_meter && is_lufs_relative && led < 8)
-            v = v / 2.75f; // Lower area of relative meter darker.
-
-        WS2812_LED_SetHSV(LED_METER_START_INDEX + (LED_METER_SIZE * meter_index) + LED_METER_SIZE - 1 - led, h, 1.0, v);
+            rgb[led] = 0;
     }
 
     if (is_peak_meter)
     {
-        for (led = 0; led < LED_METER_SIZE; led++)
-        {
-            float max = data_index == PEAK_L ? max_l : data_index == PEAK_R ? max_r : max_l;
+        s32 max = meter_state.centi_db[data_index == PEAK_R ? MAX_R : MAX_L];
 
-            if (led > 0 && max > led_val_list[led - 1] && max <= led_val_list[led])
-                WS2812_LED_SetHSV(LED_METER_START_INDEX + (LED_METER_SIZE * meter_index) + LED_METER_SIZE - 1 - led, 0, 1.0, LED_BRIGHTNESS / 2.0f);
+        for (led = 1; led < LED_METER_SIZE; led++)
+        {
+            if (max > scale->off_level[led - 1] && max <= scale->off_level[led])
+                rgb[led] = scale->max_rgb;
         }
     }
+
+    // Only write the LEDs that changed since the last render.
+    for (led = 0; led < LED_METER_SIZE; led++)
+    {
+        int index = (LED_METER_SIZE * meter_index) + LED_METER_SIZE - 1 - led;
+
+        if (is_led_drawn[index] && drawn_led_rgb[index] == rgb[led])
+            continue;
+
+        // Colour 0, 1, 2 is red, green, blue.
+        WS2812_LED_SetRGB(LED_METER_START_INDEX + index, 0, (u8)(rgb[led] >> 16));
+        WS2812_LED_SetRGB(LED_METER_START_INDEX + index, 1, (u8)(rgb[led] >> 8));
+        WS2812_LED_SetRGB(LED_METER_START_INDEX + index, 2, (u8)rgb[led]);
+        drawn_led_rgb[index] = rgb[led];
+        is_led_drawn[index] = true;
+    }
 }
 
 void DC_METERS_SetMeterMode(bool isLufs)
 {
     is_lufs_mode = isLufs;
+    is_redraw_needed = true;
 }
 
 void DC_METERS_SetPeak3rdMeterMode(bool isMomentary)
 {
     is_peak_with_momentary = isMomentary;
+    is_redraw_needed = true;
 }
 
 void DC_METERS_SetRelativeMode(bool isRelative)
 {
     is_lufs_relative = isRelative;
+    is_led_scale_stale = true;
+    is_redraw_needed = true;
 }
 
 void DC_METERS_Set1dBScaleMode(bool isActive)
 {
     is_1db_scale = isActive;
+    is_led_scale_stale = true;
+    is_redraw_needed = true;
 }
 
 void DC_METERS_Test()
@@ -262,4 +442,7 @@ void DC_METERS_Test()
     int i;
     for (i = LED_METER_START_INDEX; i < (LED_METER_SIZE * LED_METER_COUNT); i++)
         WS2812_LED_SetHSV(i, 0, 0, LED_BRIGHTNESS);
+
+    for (i = 0; i < LED_METER_TOTAL; i++)
+        is_led_drawn[i] = false;
 }
\ No newline at end of file
@@ -18,27 +18,43 @@
 // global definitions
 /////////////////////////////////////////////////////////////////////////////
 
+// Meter frame format, must match MeterFrameEncoder in the plugin.
+// Data: version, field mask (2 x 7 bits), then each field in the mask in order:
+// levels are 14 bits (MSB first) of centi-dB + METER_FRAME_LEVEL_OFFSET, clip flags are 1 byte.
+#define METER_FRAME_VERSION 1
+#define METER_FRAME_LEVEL_OFFSET 12800
+#define METER_FRAME_CLIP_L 0x01
+#define METER_FRAME_CLIP_R 0x02
+
 /////////////////////////////////////////////////////////////////////////////
 // Type definitions
 /////////////////////////////////////////////////////////////////////////////
 
 typedef enum {
     LUFS_S = 0,
-    LUFS_M = 2,
-    LUFS_I = 4,
-    LUFS_MIN = 6,
-    LUFS_MAX = 8,
-    LUFS_RANGE = 10,
-    LUFS_TARGET = 12,
-    PEAK_L = 14,
-    PEAK_R = 16,
-    MAX_L = 18,
-    MAX_R = 20,
-    MAX_TOTAL = 22,
-    CLIP_L = 24,
-    CLIP_R = 26
+    LUFS_M,
+    LUFS_I,
+    LUFS_MIN,
+    LUFS_MAX,
+    LUFS_RANGE,
+    LUFS_TARGET,
+    PEAK_L,
+    PEAK_R,
+    MAX_L,
+    MAX_R,
+    MAX_TOTAL,
+    METER_LEVEL_COUNT,
+    METER_CLIP_FLAGS = METER_LEVEL_COUNT     // Field after the levels in the frame mask
 } dc_meter_data_index_t;
 
+// Meter values received from the plugin, in dB (true peak in dBTP).
+typedef struct {
+    float level[METER_LEVEL_COUNT];
+    s16 centi_db[METER_LEVEL_COUNT];    // Same levels as received, in 1/100 dB, for the LED meters.
+    bool clip_l;
+    bool clip_r;
+} dc_meter_state_t;
+
 /////////////////////////////////////////////////////////////////////////////
 // Prototypes
 /////////////////////////////////////////////////////////////////////////////
@@ -46,14 +62,16 @@ typedef enum {
 extern void DC_METERS_Init();
 extern void DC_METERS_Test();
 extern void DC_METERS_MIDI_NotifyPackage(mios32_midi_port_t port, mios32_midi_package_t midi_package);
-extern void DC_METERS_Update(char* meter_data);
+extern void DC_METERS_Update(const char* frame_data, u8 frame_length);
+extern void DC_METERS_Render();
 extern void DC_METERS_SetMeterMode(bool isLufs);
 extern void DC_METERS_SetPeak3rdMeterMode(bool isMomentary);
 extern void DC_METERS_SetRelativeMode(bool isRelative);
 extern void DC_METERS_Set1dBScaleMode(bool isActive);
 
-void DC_METERS_GetLevelStringFromMeterData(char* output_string, char *meter_data, dc_meter_data_index_t index, bool is_true_peak);
-void DC_METERS_UpdateLedMeter(char meter_index, char *meter_data, dc_meter_data_index_t index, bool is_true_peak);
+bool DC_METERS_DecodeFrame(const char* frame_data, u8 frame_length);
+void DC_METERS_GetLevelStringFromMeterData(char* output_string, dc_meter_data_index_t index, bool is_true_peak);
+void DC_METERS_UpdateLedMeter(char meter_index, dc_meter_data_index_t index, bool is_true_peak);
 
 /////////////////////////////////////////////////////////////////////////////
 // Exported variables
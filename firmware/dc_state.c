@@ -0,0 +1,163 @@
+/*
+ * Surface state synchronisation for DreamControl
+ *
+ * The plugin sends the button LEDs, knob and fader as sequenced snapshots and deltas.
+ * A gap in the sequence means a message was lost, so we ask for a new snapshot.
+ *
+ * ==========================================================================
+ *
+ *  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+ *  Licensed for personal non-commercial use only. All other rights reserved.
+ * 
+ * ==========================================================================
+ */
+
+/////////////////////////////////////////////////////////////////////////////
+// Include files
+/////////////////////////////////////////////////////////////////////////////
+
+#include <mios32.h>
+#include <stdbool.h>
+
+#include "app.h"
+#include "dc_state.h"
+#include "dc_sysex.h"
+#include "dc_buttons.h"
+#include "dc_knob.h"
+#include "dc_fader.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// Local definitions
+/////////////////////////////////////////////////////////////////////////////
+
+#define STATE_SNAPSHOT_RETRY_MS 500     // A snapshot request is repeated if no snapshot arrived in this time.
+
+/////////////////////////////////////////////////////////////////////////////
+// local variables
+/////////////////////////////////////////////////////////////////////////////
+
+// Messages are received and ticks run in the MIDI task, so no locking is needed.
+static s16 last_sequence = -1;                  // -1 until the first snapshot.
+static bool is_snapshot_requested = false;
+static u16 ms_since_snapshot_request = 0;
+static u8 note_states[STATE_NOTE_BYTES];        // Last applied LED state of each note, same layout as the snapshot.
+static bool is_note_state_known = false;
+
+void DC_STATE_Init()
+{
+    // Ask the plugin for everything.
+    DC_STATE_RequestSnapshot();
+}
+
+void DC_STATE_Tick()
+{
+    // Called each mS from the MIDI task.
+    if (!is_snapshot_requested)
+        return;
+
+    if (++ms_since_snapshot_request >= STATE_SNAPSHOT_RETRY_MS)
+        DC_STATE_RequestSnapshot();
+}
+
+void DC_STATE_RequestSnapshot()
+{
+    is_snapshot_requested = true;
+    ms_since_snapshot_request = 0;
+    DC_SYSEX_SendCommand(PLUGIN_USB_PORT, SYSEX_COMMAND_SYNC_BUTTONS, "");
+}
+
+void DC_STATE_CheckSequence(u8 sequence, bool is_snapshot)
+{
+    bool is_gap = !is_snapshot && (last_sequence < 0 || sequence != ((last_sequence + 1) & 0x7f));
+    last_sequence = sequence;
+
+    if (is_snapshot)
+        is_snapshot_requested = false;
+    else if (is_gap && !is_snapshot_requested)
+        DC_STATE_RequestSnapshot();
+}
+
+void DC_STATE_SetNote(u8 note, bool state)
+{
+    if (note >= STATE_NOTE_COUNT)
+        return;
+
+    u8 bit = 1 << (note % 7);
+    bool was_on = (note_states[note / 7] & bit) != 0;
+
+    if (is_note_state_known && was_on == state)
+        return;
+
+    if (state)
+        note_states[note / 7] |= bit;
+    else
+        note_states[note / 7] &= ~bit;
+
+    DC_BUTTONS_SetNoteState(PLUGIN_USB_PORT, note, state);
+}
+
+void DC_STATE_ReceiveSnapshot(const char *data, u8 length)
+{
+    if (length < 2 + STATE_NOTE_BYTES + 3)
+        return;
+
+    DC_STATE_CheckSequence((u8)data[0], true);
+    u8 flags = (u8)data[1];
+    const char *notes = &data[2];
+    int note;
+
+    // Only notes that changed are applied. Offs first, so e.g. the knob ring colour ends up with the mode that is on.
+    for (note = 0; note < STATE_NOTE_COUNT; note++)
+        if (!(notes[note / 7] & (1 << (note % 7))))
+            DC_STATE_SetNote(note, false);
+
+    for (note = 0; note < STATE_NOTE_COUNT; note++)
+        if (notes[note / 7] & (1 << (note % 7)))
+            DC_STATE_SetNote(note, true);
+
+    is_note_state_known = true;
+
+    u8 pos = 2 + STATE_NOTE_BYTES;
+
+    if (flags & STATE_FLAG_KNOB)
+        DC_KNOB_SetKnobPosition(0, (u8)data[pos]);
+
+    if (flags & STATE_FLAG_FADER)
+        DC_FADER_SetDawValue(((u16)(u8)data[pos + 1] << 7) | (u8)data[pos + 2]);
+}
+
+void DC_STATE_ReceiveDelta(const char *data, u8 length)
+{
+    if (length < 1)
+        return;
+
+    DC_STATE_CheckSequence((u8)data[0], false);
+    u8 pos = 1;
+
+    // Values in a delta are absolute, so they are applied even after a gap.
+    while (pos + 2 <= length)
+    {
+        u8 type = (u8)data[pos];
+
+        if (type == STATE_DELTA_NOTE_ON || type == STATE_DELTA_NOTE_OFF)
+        {
+            DC_STATE_SetNote((u8)data[pos + 1], type == STATE_DELTA_NOTE_ON);
+            pos += 2;
+        }
+        else if (type == STATE_DELTA_KNOB)
+        {
+            DC_KNOB_SetKnobPosition(0, (u8)data[pos + 1]);
+            pos += 2;
+        }
+        else if (type == STATE_DELTA_FADER && pos + 3 <= length)
+        {
+            DC_FADER_SetDawValue(((u16)(u8)data[pos + 1] << 7) | (u8)data[pos + 2]);
+            pos += 3;
+        }
+        else
+        {
+            // Unknown or truncated entry, the rest can't be parsed.
+            return;
+        }
+    }
+}
@@ -0,0 +1,55 @@
+/*
+ * Surface state synchronisation for DreamControl
+ *
+ * ==========================================================================
+ *
+ *  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+ *  Licensed for personal non-commercial use only. All other rights reserved.
+ * 
+ * ==========================================================================
+ */
+
+#ifndef _DC_STATE_H
+#define _DC_STATE_H
+
+#include <stdbool.h>
+
+/////////////////////////////////////////////////////////////////////////////
+// global definitions
+/////////////////////////////////////////////////////////////////////////////
+
+// State message format, must match SurfaceStateEncoder in the plugin.
+// Snapshot: sequence, flags, STATE_NOTE_BYTES of LED states (7 notes per byte, bit n of byte b is note b * 7 + n),
+// knob position, fader as 14 bits (MSB first). Knob and fader are only valid if their flag is set.
+// Delta: sequence, then entries: STATE_DELTA_NOTE_ON/OFF + note, STATE_DELTA_KNOB + position, STATE_DELTA_FADER + 14 bits.
+#define STATE_NOTE_COUNT 128
+#define STATE_NOTE_BYTES ((STATE_NOTE_COUNT + 6) / 7)
+#define STATE_FLAG_KNOB 0x01
+#define STATE_FLAG_FADER 0x02
+#define STATE_DELTA_NOTE_ON 0
+#define STATE_DELTA_NOTE_OFF 1
+#define STATE_DELTA_KNOB 2
+#define STATE_DELTA_FADER 3
+
+/////////////////////////////////////////////////////////////////////////////
+// Type definitions
+/////////////////////////////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////////////////////////////
+// Prototypes
+/////////////////////////////////////////////////////////////////////////////
+
+extern void DC_STATE_Init();
+extern void DC_STATE_Tick();
+extern void DC_STATE_RequestSnapshot();
+extern void DC_STATE_ReceiveSnapshot(const char* data, u8 length);
+extern void DC_STATE_ReceiveDelta(const char* data, u8 length);
+
+void DC_STATE_CheckSequence(u8 sequence, bool is_snapshot);
+void DC_STATE_SetNote(u8 note, bool state);
+
+/////////////////////////////////////////////////////////////////////////////
+// Exported variables
+/////////////////////////////////////////////////////////////////////////////
+
+#endif
@@ -20,6 +20,8 @@
 #include "app.h"
 #include "dc_sysex.h"
 #include "dc_meters.h"
+#include "dc_lcd.h"
+#include "dc_state.h"
 
 /////////////////////////////////////////////////////////////////////////////
 // local variables
@@ -32,6 +34,7 @@ static const u8 sysex_header[4] = { 0xf0, 0x00, 0x21, 0x69 };
 static u8 is_receiving_sysex = 0;
 static u8 sysex_counter = 0;
 static dc_sysex_command_t sysex_command = 0;
+static u8 sysex_data_length = 0;
 char sysex_data[64];
 
 
@@ -86,6 +89,7 @@ s32 DC_SYSEX_Parser(mios32_midi_port_t port, u8 midi_in)
         {
             // End byte received or our input buffer is full, so stop receiving and execute command.
             is_receiving_sysex = 0;
+            sysex_data_length = sysex_counter > 0 ? sysex_counter - 1 : 0;
             sysex_counter = 0;
 
             DC_SYSEX_ReceiveCommand();
@@ -99,20 +103,37 @@ void DC_SYSEX_ReceiveCommand()
 {
     switch (sysex_command)
     {
-        case SYSEX_COMMAND_METER_DATA:
-            DC_METERS_Update(sysex_data);
+        case SYSEX_COMMAND_METER_FRAME:
+            DC_METERS_Update(sysex_data, sysex_data_length);
+            break;
+
+        case SYSEX_COMMAND_DSP_LOAD:
+            DC_LCD_PopupDspLoad(sysex_data, sysex_data_length);
+            break;
+
+        case SYSEX_COMMAND_STATE_SNAPSHOT:
+            DC_STATE_ReceiveSnapshot(sysex_data, sysex_data_length);
+            break;
+
+        case SYSEX_COMMAND_STATE_DELTA:
+            DC_STATE_ReceiveDelta(sysex_data, sysex_data_length);
             break;
     }
 }
 
 void DC_SYSEX_SendCommand(mios32_midi_port_t port, u8 sysex_command_code, const char *sysex_data)
 {
-    // Build our sysex message to send.
-    char data_to_send[sizeof(sysex_data) + sizeof(sysex_header) + 2];
+    // Build our sysex message to send: header, command, the data up to its terminator (7 bit bytes), end byte.
+    // sysex_data here is the parameter, so its size is that of a pointer: the length is taken with strlen.
+    u8 data_length = (u8)strlen(sysex_data);
+    if (data_length > 64)
+        data_length = 64;
+
+    u8 data_to_send[sizeof(sysex_header) + 64 + 2];
     memcpy(&data_to_send[0], &sysex_header[0], sizeof(sysex_header));
     data_to_send[sizeof(sysex_header)] = sysex_command_code;
-    memcpy(&data_to_send[sizeof(sysex_header) + 1], &sysex_data[0], sizeof(sysex_data));
-    data_to_send[sizeof(data_to_send) - 1] = 0xF7;      // Sysex end byte
+    memcpy(&data_to_send[sizeof(sysex_header) + 1], sysex_data, data_length);
+    data_to_send[sizeof(sysex_header) + 1 + data_length] = 0xF7;      // Sysex end byte
 
-    MIOS32_MIDI_SendSysEx(port, data_to_send, sizeof(data_to_send));
+    MIOS32_MIDI_SendSysEx(port, data_to_send, sizeof(sysex_header) + 2 + data_length);
 }
\ No newline at end of file
@@ -17,8 +17,12 @@
 /////////////////////////////////////////////////////////////////////////////
 
 typedef enum {
-    SYSEX_COMMAND_METER_DATA = 1,
-    SYSEX_COMMAND_SYNC_BUTTONS = 2
+    SYSEX_COMMAND_METER_DATA = 1,       // Obsolete fixed frame, replaced by SYSEX_COMMAND_METER_FRAME
+    SYSEX_COMMAND_SYNC_BUTTONS = 2,
+    SYSEX_COMMAND_METER_FRAME = 3,
+    SYSEX_COMMAND_DSP_LOAD = 4,         // Plugin processing load, reply to BUTTON_DSP_LOAD
+    SYSEX_COMMAND_STATE_SNAPSHOT = 5,   // Button LEDs, knob and fader, reply to SYSEX_COMMAND_SYNC_BUTTONS (see dc_state.h)
+    SYSEX_COMMAND_STATE_DELTA = 6       // What changed since the last snapshot or delta
 } dc_sysex_command_t;
 
 /////////////////////////////////////////////////////////////////////////////
@@ -16,6 +16,8 @@
 /////////////////////////////////////////////////////////////////////////////
 
 #include <mios32.h>
+#include <stdbool.h>
+#include <string.h>
 
 #include "app.h"
 
@@ -27,10 +29,39 @@
 // Local definitions
 /////////////////////////////////////////////////////////////////////////////
 
+#define OUTPUT_COUNT 4                  // Relay groups, on J10A pins 0,2,4,6.
+#define RELAY_RELEASE_MS 4              // Time for the previous relay group to open, before the next one is engaged.
+#define RELAY_OPERATE_MS 6              // Time for a relay group to close, including contact bounce.
+
+// SysEx commands, must match MonitorSwitch in the plugin.
+// SWITCHER_COMMAND_SELECT: command ID, output (0 = all off, 1-4).
+// SWITCHER_COMMAND_SWITCHED: command ID, output, settle time in mS as 14 bits (MSB first): the nominal
+// relay delay waited for that output, not a measurement. Sent once it has passed, so the plugin can open up again.
+#define SWITCHER_COMMAND_SELECT 1
+#define SWITCHER_COMMAND_SWITCHED 2
+
 /////////////////////////////////////////////////////////////////////////////
 // Local variables
 /////////////////////////////////////////////////////////////////////////////
 
+// SysEx start byte and our manufacturer ID.
+static const u8 sysex_header[4] = { 0xf0, 0x00, 0x21, 0x69 };
+
+static u8 is_receiving_sysex = 0;
+static u8 sysex_counter = 0;
+static u8 sysex_data[8];
+
+// Switching in progress. Messages are received and ticks run in the MIDI task, so no locking is needed.
+static bool is_switching = false;
+static u8 switch_command_id = 0;
+static u8 switch_output = 0;
+static u16 ms_since_select = 0;
+
+static s32 APP_SysExParser(mios32_midi_port_t port, u8 midi_in);
+static u16 APP_GetSettleMs(u8 output);
+static void APP_SetRelays(u8 output);
+static void APP_SendSwitched(void);
+
 /////////////////////////////////////////////////////////////////////////////
 // This hook is called after startup to initialize the application
 /////////////////////////////////////////////////////////////////////////////
@@ -48,6 +79,9 @@ void APP_Init(void)
         MIOS32_BOARD_J10_PinSet(i, 1);
     }
 
+    // Install SysEx callback.
+    MIOS32_MIDI_SysExCallback_Init(APP_SysExParser);
+
     // Blue LED on CPU board to show Init was completed successfully.
     MIOS32_BOARD_LED_Set(0x0008, 0x0008);  
 }
@@ -73,7 +107,107 @@ void APP_Tick(void)
 /////////////////////////////////////////////////////////////////////////////
 void APP_MIDI_Tick(void)
 {
+    if (!is_switching)
+        return;
 
+    // Break before make: all relays were opened when the select was received.
+    ms_since_select++;
+
+    if (ms_since_select == RELAY_RELEASE_MS && switch_output > 0)
+        MIOS32_BOARD_J10_PinSet((switch_output - 1) * 2, 0);
+
+    if (ms_since_select >= APP_GetSettleMs(switch_output))
+    {
+        is_switching = false;
+        APP_SendSwitched();
+    }
+}
+
+static s32 APP_SysExParser(mios32_midi_port_t port, u8 midi_in)
+{
+    // Ignore 'realtime' messages.
+    if (midi_in >= 0xf8)
+        return 0;
+
+    if (!is_receiving_sysex)
+    {
+        // Are we receiving the sysex header?
+        if (midi_in == sysex_header[sysex_counter])
+        {
+            if (++sysex_counter == sizeof(sysex_header))
+            {
+                sysex_counter = 0;
+                is_receiving_sysex = 1;
+            }
+        }
+        else
+        {
+            sysex_counter = 0;
+        }
+    }
+    else if (midi_in != 0xf7)
+    {
+        if (sysex_counter < sizeof(sysex_data))
+            sysex_data[sysex_counter++] = midi_in;
+    }
+    else
+    {
+        // End byte received: command, then its data.
+        is_receiving_sysex = 0;
+
+        if (sysex_counter >= 3 && sysex_data[0] == SWITCHER_COMMAND_SELECT && sysex_data[2] <= OUTPUT_COUNT)
+        {
+            // A select while switching just takes over, the acknowledgement is for the latest one.
+            switch_command_id = sysex_data[1];
+            switch_output = sysex_data[2];
+            ms_since_select = 0;
+            is_switching = true;
+            APP_SetRelays(0);
+        }
+
+        sysex_counter = 0;
+    }
+
+    return 0;
+}
+
+// Nominal time from a select to the output being settled. There is no contact sensing, so it is not measured.
+static u16 APP_GetSettleMs(u8 output)
+{
+    return RELAY_RELEASE_MS + (output > 0 ? RELAY_OPERATE_MS : 0);
+}
+
+static void APP_SetRelays(u8 output)
+{
+    // Pins are low to engage a relay group, 0 = all off.
+    int i;
+    for (i = 0; i < 8; i++)
+    {
+        MIOS32_BOARD_J10_PinSet(i, 1);
+    }
+
+    if (output > 0)
+    {
+        MIOS32_BOARD_J10_PinSet((output - 1) * 2, 0);
+    }
+}
+
+static void APP_SendSwitched(void)
+{
+    u8 message[sizeof(sysex_header) + 6];
+    memcpy(message, sysex_header, sizeof(sysex_header));
+
+    const u16 settle_ms = APP_GetSettleMs(switch_output);
+
+    u8 pos = sizeof(sysex_header);
+    message[pos++] = SWITCHER_COMMAND_SWITCHED;
+    message[pos++] = switch_command_id;
+    message[pos++] = switch_output;
+    message[pos++] = (settle_ms >> 7) & 0x7f;
+    message[pos++] = settle_ms & 0x7f;
+    message[pos++] = 0xf7;
+
+    MIOS32_MIDI_SendSysEx(USB0, message, pos);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -87,18 +221,11 @@ void APP_MIDI_NotifyPackage(mios32_midi_port_t port, mios32_midi_package_t midi_
     if (port == USB0 
         && midi_package.chn == Chn1 
         && midi_package.type == NoteOn 
-        && midi_package.note < 5)
+        && midi_package.note <= OUTPUT_COUNT)
     {
-        int i;
-        for (i = 0; i < 8; i++)
-        {
-            MIOS32_BOARD_J10_PinSet(i, 1);
-        }
-
-        if (midi_package.note > 0) 
-        {
-            MIOS32_BOARD_J10_PinSet((midi_package.note - 1) * 2, 0);
-        }
+        // Immediate switch, without acknowledgement. The plugin uses SWITCHER_COMMAND_SELECT.
+        is_switching = false;
+        APP_SetRelays(midi_package.note);
     }
 }
 
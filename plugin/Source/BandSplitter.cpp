@@ -0,0 +1,323 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include <cmath>
+
+#include "BandSplitter.h"
+
+BandSplitter::BandSplitter() : currentSampleRate(0.0), rampStep(numRampSteps), activeSections(0)
+{
+	for (int i = 0; i < numCrossovers; i++)
+		crossoverFrequencies[i] = 0.0f;
+
+	zerostruct(currentSet);
+	setCurrentCoefficients(currentSet);
+}
+
+void BandSplitter::prepare(double sampleRate, int numChannels)
+{
+	laneGroups.resize((size_t) (numChannels + Vec::SIMDNumElements - 1) / Vec::SIMDNumElements);
+
+	// SIMD registers are loaded directly from the state.
+	jassert(laneGroups.empty() || (reinterpret_cast<pointer_sized_uint>(laneGroups.data()) % alignof(Vec)) == 0);
+
+	const ScopedLock sl(writerLock);
+
+	currentSampleRate = sampleRate;
+	calculateCoefficients(currentSet);
+	setCurrentCoefficients(currentSet);
+	rampStep = numRampSteps;
+
+	// Replace anything still pending for the previous sample rate.
+	pendingCoefficients.getWriteBuffer() = currentSet;
+	pendingCoefficients.publish();
+
+	reset();
+}
+
+void BandSplitter::setCrossoverFrequencies(const float* frequencies)
+{
+	const ScopedLock sl(writerLock);
+
+	bool changed = false;
+
+	for (int i = 0; i < numCrossovers; i++)
+	{
+		if (frequencies[i] != crossoverFrequencies[i])
+		{
+			crossoverFrequencies[i] = frequencies[i];
+			changed = true;
+		}
+	}
+
+	if (! changed || currentSampleRate <= 0.0)
+		return;
+
+	calculateCoefficients(pendingCoefficients.getWriteBuffer());
+	pendingCoefficients.publish();
+}
+
+void BandSplitter::reset() noexcept
+{
+	for (auto& group : laneGroups)
+		for (auto& s : group)
+			s.clear();
+
+	activeSections = 0;
+}
+
+void BandSplitter::calculateCoefficients(CoefficientSet& set) const
+{
+	double f[numCrossovers];
+	for (int i = 0; i < numCrossovers; i++)
+		f[i] = jlimit(10.0, currentSampleRate * 0.45, (double) crossoverFrequencies[i]);
+
+	SectionCoefficients* c = set.sections;
+
+	// LR4 = 2 cascaded Butterworth sections.
+	c[lowA] = c[lowB] = makeButterworth(f[1], currentSampleRate, false);
+	c[highA] = c[highB] = makeButterworth(f[1], currentSampleRate, true);
+
+	c[band1A] = c[band1B] = makeButterworth(f[0], currentSampleRate, false);
+	c[band2A] = c[band2B] = makeButterworth(f[0], currentSampleRate, true);
+	c[allpass1Low] = c[allpass1High] = makeAllpass(f[0], currentSampleRate);
+
+	c[band3A] = c[band3B] = makeButterworth(f[2], currentSampleRate, false);
+	c[band4A] = c[band4B] = makeButterworth(f[2], currentSampleRate, true);
+	c[allpass3High] = c[allpass3Low] = makeAllpass(f[2], currentSampleRate);
+}
+
+void BandSplitter::setCurrentCoefficients(const CoefficientSet& set) noexcept
+{
+	for (int i = 0; i < numSections; i++)
+	{
+		const SectionCoefficients& source = set.sections[i];
+		coefficients[i].set(source.b0, source.b1, source.b2, source.a1, source.a2);
+	}
+}
+
+void BandSplitter::advanceRamp() noexcept
+{
+	rampStep++;
+	const double alpha = (double) rampStep / (double) numRampSteps;
+
+	for (int i = 0; i < numSections; i++)
+	{
+		const SectionCoefficients& from = rampStart.sections[i];
+		const SectionCoefficients& to = rampTarget.sections[i];
+		SectionCoefficients& c = currentSet.sections[i];
+
+		c.b0 = from.b0 + alpha * (to.b0 - from.b0);
+		c.b1 = from.b1 + alpha * (to.b1 - from.b1);
+		c.b2 = from.b2 + alpha * (to.b2 - from.b2);
+		c.a1 = from.a1 + alpha * (to.a1 - from.a1);
+		c.a2 = from.a2 + alpha * (to.a2 - from.a2);
+	}
+
+	if (rampStep == numRampSteps)
+		currentSet = rampTarget;	// exact final values
+
+	setCurrentCoefficients(currentSet);
+}
+
+// Bilinear transform of a 2nd order Butterworth section, as previously used by CrossoverFilter.
+BandSplitter::SectionCoefficients BandSplitter::makeButterworth(double frequency, double sampleRate, bool highpass)
+{
+	const double q = std::sqrt(2.0);
+	const double wd1 = 1.0 / std::tan(MathConstants<double>::pi * (frequency / sampleRate));
+	const double wd2 = wd1 * wd1;
+	const double n0 = 1.0 / (1.0 + q * wd1 + wd2);
+
+	SectionCoefficients c;
+	c.a1 = -2.0 * (wd2 - 1.0) * n0;
+	c.a2 = (1.0 - q * wd1 + wd2) * n0;
+
+	if (highpass)
+	{
+		c.b0 = n0 * wd2;
+		c.b1 = -2.0 * n0 * wd2;
+		c.b2 = n0 * wd2;
+	}
+	else
+	{
+		c.b0 = n0;
+		c.b1 = 2.0 * n0;
+		c.b2 = n0;
+	}
+
+	return c;
+}
+
+// The sum of the LR4 lowpass and highpass at a frequency is the 2nd order allpass with the Butterworth poles.
+BandSplitter::SectionCoefficients BandSplitter::makeAllpass(double frequency, double sampleRate)
+{
+	SectionCoefficients c = makeButterworth(frequency, sampleRate, false);
+	c.b0 = c.a2;
+	c.b1 = c.a1;
+	c.b2 = 1.0;
+	return c;
+}
+
+void BandSplitter::process(AudioSampleBuffer& buffer, int numChannels, const bool* bandSolo) noexcept
+{
+	numChannels = jmin(numChannels, buffer.getNumChannels(), (int) (laneGroups.size() * Vec::SIMDNumElements));
+	const int numSamples = buffer.getNumSamples();
+
+	// New coefficients from setCrossoverFrequencies(): ramp from where we are.
+	if (pendingCoefficients.update())
+	{
+		rampStart = currentSet;
+		rampTarget = pendingCoefficients.getReadBuffer();
+		rampStep = 0;
+	}
+
+	// Silence in, with decayed state, is silence out. A pending ramp carries on with the signal.
+	if (BiquadCascade<float>::isSilent(buffer.getArrayOfReadPointers(), numChannels, numSamples) && hasDecayed())
+		return;
+
+	const bool useLow = bandSolo[0] || bandSolo[1];
+	const bool useHigh = bandSolo[2] || bandSolo[3];
+	const bool compensate = useLow && useHigh;
+
+	// Select the sections that will run.
+	uint32 sections = 0;
+	if (useLow)
+	{
+		sections |= (1u << lowA) | (1u << lowB);
+		if (bandSolo[0] && bandSolo[1])	sections |= (1u << allpass1Low);
+		else if (bandSolo[0])			sections |= (1u << band1A) | (1u << band1B);
+		else							sections |= (1u << band2A) | (1u << band2B);
+		if (compensate)					sections |= (1u << allpass3Low);
+	}
+	if (useHigh)
+	{
+		sections |= (1u << highA) | (1u << highB);
+		if (bandSolo[2] && bandSolo[3])	sections |= (1u << allpass3High);
+		else if (bandSolo[2])			sections |= (1u << band3A) | (1u << band3B);
+		else							sections |= (1u << band4A) | (1u << band4B);
+		if (compensate)					sections |= (1u << allpass1High);
+	}
+
+	// Sections that were not running have old state: start them from silence.
+	uint32 started = sections & ~activeSections;
+	activeSections = sections;
+
+	float** channels = buffer.getArrayOfWritePointers();
+	int startSample = 0;
+
+	// While ramping, coefficients move every rampStepSamples.
+	while (rampStep < numRampSteps && startSample < numSamples)
+	{
+		advanceRamp();
+
+		const int stepSamples = jmin((int) rampStepSamples, numSamples - startSample);
+		processSamples(channels, numChannels, startSample, stepSamples, bandSolo, started);
+		started = 0;
+		startSample += stepSamples;
+	}
+
+	if (startSample < numSamples)
+		processSamples(channels, numChannels, startSample, numSamples - startSample, bandSolo, started);
+}
+
+bool BandSplitter::hasDecayed() const noexcept
+{
+	// Sections that aren't running are cleared when they start.
+	for (auto& group : laneGroups)
+		for (int i = 0; i < numSections; i++)
+			if ((activeSections & (1u << i)) != 0 && ! group[(size_t) i].isZero())
+				return false;
+
+	return true;
+}
+
+void BandSplitter::processSamples(float** channels, int numChannels, int startSample, int numSamples, const bool* bandSolo, uint32 started) noexcept
+{
+	const bool useLow = bandSolo[0] || bandSolo[1];
+	const bool useHigh = bandSolo[2] || bandSolo[3];
+	const bool compensate = useLow && useHigh;
+
+	const Section lowSplit1 = bandSolo[0] ? band1A : band2A;
+	const Section lowSplit2 = bandSolo[0] ? band1B : band2B;
+	const Section highSplit1 = bandSolo[2] ? band3A : band4A;
+	const Section highSplit2 = bandSolo[2] ? band3B : band4B;
+	const bool lowAllpass = bandSolo[0] && bandSolo[1];
+	const bool highAllpass = bandSolo[2] && bandSolo[3];
+
+	const int numLanes = (int) Vec::SIMDNumElements;
+
+	for (size_t g = 0; g < laneGroups.size(); g++)
+	{
+		LaneGroupState& s = laneGroups[g];
+		const int firstChannel = (int) g * numLanes;
+		const int groupChannels = jmin(numLanes, numChannels - firstChannel);
+
+		if (groupChannels <= 0)
+			break;
+
+		for (int i = 0; i < numSections; i++)
+			if (started & (1u << i))
+				s[(size_t) i].clear();
+
+		alignas(sizeof(Vec)) double lanes[Vec::SIMDNumElements] = {};
+
+		for (int sample = startSample; sample < startSample + numSamples; sample++)
+		{
+			for (int lane = 0; lane < numLanes; lane++)
+				lanes[lane] = lane < groupChannels ? channels[firstChannel + lane][sample] : 0.0;
+
+			const Vec x = Vec::fromRawArray(lanes);
+			Vec out = Vec::expand(0.0);
+
+			if (useLow)
+			{
+				Vec low = tick(coefficients[lowB], s[lowB], tick(coefficients[lowA], s[lowA], x));
+
+				if (lowAllpass)
+					low = tick(coefficients[allpass1Low], s[allpass1Low], low);
+				else
+					low = tick(coefficients[lowSplit2], s[lowSplit2], tick(coefficients[lowSplit1], s[lowSplit1], low));
+
+				if (compensate)
+					low = tick(coefficients[allpass3Low], s[allpass3Low], low);
+
+				out = low;
+			}
+
+			if (useHigh)
+			{
+				Vec high = tick(coefficients[highB], s[highB], tick(coefficients[highA], s[highA], x));
+
+				if (highAllpass)
+					high = tick(coefficients[allpass3High], s[allpass3High], high);
+				else
+					high = tick(coefficients[highSplit2], s[highSplit2], tick(coefficients[highSplit1], s[highSplit1], high));
+
+				if (compensate)
+					high = tick(coefficients[allpass1High], s[allpass1High], high);
+
+				out = out + high;
+			}
+
+			out.copyToRawArray(lanes);
+
+			for (int lane = 0; lane < groupChannels; lane++)
+				channels[firstChannel + lane][sample] = (float) lanes[lane];
+		}
+
+		for (auto& section : s)
+			section.snapToZero();
+	}
+}
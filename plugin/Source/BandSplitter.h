@@ -0,0 +1,128 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include <JuceHeader.h>
+#include "TripleBuffer.h"
+#include "BiquadCascade.h"
+
+//==============================================================================
+/**
+	4-band Linkwitz-Riley (LR4) crossover for band solo.
+
+	The signal is split once at the middle crossover, then each branch is split
+	at its own crossover. When bands of both branches are solo'd, each branch is
+	delayed by the allpass of the other branch's crossover so the bands sum flat.
+	Only the sections needed for the solo'd bands are run, and two adjacent solo'd
+	bands of the same split collapse to a single allpass.
+
+	Channels are processed together, one channel per SIMD lane, in double precision.
+	Silent blocks are skipped once the state of the running sections has decayed.
+
+	Coefficients are calculated by setCrossoverFrequencies() on the caller's thread,
+	handed to the audio thread through a TripleBuffer, and reached with a short
+	linear ramp. Filter state is never reset by a frequency change. Interpolating
+	the denominators linearly keeps the sections stable, as the set of stable
+	(a1, a2) pairs is convex.
+*/
+class BandSplitter
+{
+public:
+	enum { numCrossovers = 3, numBands = numCrossovers + 1 };
+
+	BandSplitter();
+
+	// Allocates filter state and applies the current frequencies without ramp. Call outside the audio thread.
+	void prepare(double sampleRate, int numChannels);
+
+	// Frequencies in Hz, low to high. Does nothing unless a frequency changed. Call outside the audio thread.
+	void setCrossoverFrequencies(const float* frequencies);
+
+	// Replaces the first numChannels channels of buffer with the sum of the solo'd bands.
+	void process(AudioSampleBuffer& buffer, int numChannels, const bool* bandSolo) noexcept;
+
+	void reset() noexcept;
+
+private:
+	// Sections are run through the BiquadCascade kernel, but in a tree rather than a chain.
+	typedef BiquadCascade<double> Cascade;
+	typedef Cascade::Vec Vec;
+	typedef Cascade::Coefficients Coefficients;
+	typedef Cascade::State State;
+
+	// Same as Coefficients, one value for all lanes.
+	struct SectionCoefficients
+	{
+		double b0, b1, b2, a1, a2;
+	};
+
+	enum Section
+	{
+		// middle crossover
+		lowA, lowB, highA, highB,
+		// low branch: band 1 / band 2
+		band1A, band1B, band2A, band2B, allpass1Low,
+		// high branch: band 3 / band 4
+		band3A, band3B, band4A, band4B, allpass3High,
+		// phase compensation between branches
+		allpass3Low, allpass1High,
+		numSections
+	};
+
+	typedef std::array<State, numSections> LaneGroupState;
+
+	struct CoefficientSet
+	{
+		SectionCoefficients sections[numSections];
+	};
+
+	enum
+	{
+		rampStepSamples = 32,	// coefficients are interpolated every rampStepSamples
+		numRampSteps = 8
+	};
+
+	static SectionCoefficients makeButterworth(double frequency, double sampleRate, bool highpass);
+	static SectionCoefficients makeAllpass(double frequency, double sampleRate);
+
+	static inline Vec tick(const Coefficients& c, State& s, const Vec x) noexcept { return Cascade::tick(c, s, x); }
+
+	void calculateCoefficients(CoefficientSet& set) const;
+	void setCurrentCoefficients(const CoefficientSet& set) noexcept;
+	void advanceRamp() noexcept;
+	bool hasDecayed() const noexcept;
+	void processSamples(float** channels, int numChannels, int startSample, int numSamples, const bool* bandSolo, uint32 started) noexcept;
+
+	// Writer side, guarded by writerLock as prepare() and setCrossoverFrequencies() may be called from different threads.
+	CriticalSection writerLock;
+	double currentSampleRate;
+	float crossoverFrequencies[numCrossovers];
+	TripleBuffer<CoefficientSet> pendingCoefficients;
+
+	// Audio thread side.
+	CoefficientSet currentSet;
+	CoefficientSet rampStart;
+	CoefficientSet rampTarget;
+	int rampStep;	// numRampSteps when not ramping
+	Coefficients coefficients[numSections];
+	std::vector<LaneGroupState> laneGroups;	  // one state per SIMD-width group of channels
+	uint32 activeSections;
+
+	JUCE_DECLARE_NON_COPYABLE(BandSplitter)
+};
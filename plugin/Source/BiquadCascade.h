@@ -0,0 +1,274 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+	Multi-channel cascade of biquad sections.
+
+	Structure of arrays: the block is copied into frames of all channels, frameBlockSize
+	frames at a time, and each section runs over them with the inner loop over channels.
+	The state of each section is two contiguous arrays with one value per channel, so the
+	inner loop has no per-sample gather or scatter and the compiler vectorises it across
+	channels. State is snapped to zero at the end of each block so that decaying signals
+	don't end up in denormals. Once it has, silent channels are passed through as silence
+	without running the sections.
+
+	Vec, Coefficients, State and tick() are the SIMD-lane kernel used by BandSplitter.
+
+	Sections use transposed direct form II with normalised coefficients:
+	y = b0 x + b1 x[-1] + b2 x[-2] - a1 y[-1] - a2 y[-2].
+*/
+template <typename FloatType>
+class BiquadCascade
+{
+public:
+	typedef dsp::SIMDRegister<FloatType> Vec;
+
+	struct Coefficients
+	{
+		Vec b0, b1, b2, a1, a2;
+
+		void set(double nb0, double nb1, double nb2, double na1, double na2) noexcept
+		{
+			b0 = Vec::expand((FloatType) nb0);
+			b1 = Vec::expand((FloatType) nb1);
+			b2 = Vec::expand((FloatType) nb2);
+			a1 = Vec::expand((FloatType) na1);
+			a2 = Vec::expand((FloatType) na2);
+		}
+	};
+
+	struct State
+	{
+		Vec s1, s2;
+
+		void clear() noexcept { s1 = s2 = Vec::expand(0); }
+
+		void snapToZero() noexcept
+		{
+			BiquadCascade::snapToZero(s1);
+			BiquadCascade::snapToZero(s2);
+		}
+
+		bool isZero() const noexcept { return BiquadCascade::isZero(s1) && BiquadCascade::isZero(s2); }
+	};
+
+	static inline Vec tick(const Coefficients& c, State& s, const Vec x) noexcept
+	{
+		const Vec y = c.b0 * x + s.s1;
+		s.s1 = c.b1 * x - c.a1 * y + s.s2;
+		s.s2 = c.b2 * x - c.a2 * y;
+		return y;
+	}
+
+	static void snapToZero(Vec& v) noexcept
+	{
+		alignas(sizeof(Vec)) FloatType lanes[Vec::SIMDNumElements];
+		v.copyToRawArray(lanes);
+
+		for (size_t i = 0; i < Vec::SIMDNumElements; i++)
+			if (! (lanes[i] < (FloatType) -1.0e-15 || lanes[i] > (FloatType) 1.0e-15))
+				lanes[i] = 0;
+
+		v = Vec::fromRawArray(lanes);
+	}
+
+	static bool isZero(const Vec& v) noexcept
+	{
+		alignas(sizeof(Vec)) FloatType lanes[Vec::SIMDNumElements];
+		v.copyToRawArray(lanes);
+
+		for (size_t i = 0; i < Vec::SIMDNumElements; i++)
+			if (lanes[i] != 0)
+				return false;
+
+		return true;
+	}
+
+	static void snapToZero(FloatType& v) noexcept
+	{
+		if (! (v < (FloatType) -1.0e-15 || v > (FloatType) 1.0e-15))
+			v = 0;
+	}
+
+	// True when all numSamples of the channels, from startSample, are exactly zero.
+	template <typename SampleType>
+	static bool isSilent(const SampleType* const* channels, int numChannels, int numSamples, int startSample = 0) noexcept
+	{
+		for (int ch = 0; ch < numChannels; ch++)
+		{
+			const Range<SampleType> range = FloatVectorOperations::findMinAndMax(channels[ch] + startSample, numSamples);
+			if (range.getStart() != 0 || range.getEnd() != 0)
+				return false;
+		}
+
+		return true;
+	}
+
+	//==============================================================================
+	enum
+	{
+		frameBlockSize = 64		// frames filtered per pass, stays in L1 for any channel count
+	};
+
+	BiquadCascade() : numChannels(0), numSections(0) {}
+
+	// Allocates coefficients, state and frames, all sections pass through. Call outside the audio thread.
+	void prepare(int newNumChannels, int newNumSections)
+	{
+		numChannels = newNumChannels;
+		numSections = newNumSections;
+
+		sections.resize((size_t) numSections);
+		for (int section = 0; section < numSections; section++)
+			setCoefficients(section, 1.0, 0.0, 0.0, 0.0, 0.0);
+
+		s1.resize((size_t) (numSections * numChannels));
+		s2.resize((size_t) (numSections * numChannels));
+		frames.resize((size_t) (frameBlockSize * numChannels));
+
+		reset();
+	}
+
+	// Normalised coefficients (a0 = 1).
+	void setCoefficients(int section, double b0, double b1, double b2, double a1, double a2) noexcept
+	{
+		jassert(section < numSections);
+		SectionCoefficients& c = sections[(size_t) section];
+		c.b0 = (FloatType) b0;
+		c.b1 = (FloatType) b1;
+		c.b2 = (FloatType) b2;
+		c.a1 = (FloatType) a1;
+		c.a2 = (FloatType) a2;
+	}
+
+	void setCoefficients(int section, const IIRCoefficients& c) noexcept
+	{
+		setCoefficients(section, c.coefficients[0], c.coefficients[1], c.coefficients[2], c.coefficients[3], c.coefficients[4]);
+	}
+
+	void reset() noexcept
+	{
+		std::fill(s1.begin(), s1.end(), (FloatType) 0);
+		std::fill(s2.begin(), s2.end(), (FloatType) 0);
+	}
+
+	// Filters numSamples of the first channels of input, from inputStart, to output at outputStart.
+	// input and output may be the same buffer.
+	void process(const AudioBuffer<FloatType>& input, int inputStart, AudioBuffer<FloatType>& output, int outputStart,
+				 int numChannelsToProcess, int numSamples) noexcept
+	{
+		const int nc = jmin(numChannelsToProcess, numChannels, input.getNumChannels(), output.getNumChannels());
+		if (nc <= 0)
+			return;
+
+		// Silence in, with decayed state, is silence out.
+		if (isSilent(input.getArrayOfReadPointers(), nc, numSamples, inputStart) && hasDecayed(nc))
+		{
+			for (int ch = 0; ch < nc; ch++)
+				if (output.getWritePointer(ch, outputStart) != input.getReadPointer(ch, inputStart))
+					FloatVectorOperations::clear(output.getWritePointer(ch, outputStart), numSamples);
+
+			return;
+		}
+
+		FloatType* const frame = frames.data();
+
+		for (int start = 0; start < numSamples; start += frameBlockSize)
+		{
+			const int numFrames = jmin((int) frameBlockSize, numSamples - start);
+
+			for (int ch = 0; ch < nc; ch++)
+			{
+				const FloatType* in = input.getReadPointer(ch, inputStart + start);
+				for (int i = 0; i < numFrames; i++)
+					frame[i * nc + ch] = in[i];
+			}
+
+			for (int section = 0; section < numSections; section++)
+			{
+				const SectionCoefficients c = sections[(size_t) section];
+				FloatType* const z1 = s1.data() + section * numChannels;
+				FloatType* const z2 = s2.data() + section * numChannels;
+
+				for (int i = 0; i < numFrames; i++)
+				{
+					FloatType* const x = frame + i * nc;
+
+					for (int ch = 0; ch < nc; ch++)
+					{
+						const FloatType y = c.b0 * x[ch] + z1[ch];
+						z1[ch] = c.b1 * x[ch] - c.a1 * y + z2[ch];
+						z2[ch] = c.b2 * x[ch] - c.a2 * y;
+						x[ch] = y;
+					}
+				}
+			}
+
+			for (int ch = 0; ch < nc; ch++)
+			{
+				FloatType* out = output.getWritePointer(ch, outputStart + start);
+				for (int i = 0; i < numFrames; i++)
+					out[i] = frame[i * nc + ch];
+			}
+		}
+
+		for (int section = 0; section < numSections; section++)
+		{
+			for (int ch = 0; ch < nc; ch++)
+			{
+				snapToZero(s1[(size_t) (section * numChannels + ch)]);
+				snapToZero(s2[(size_t) (section * numChannels + ch)]);
+			}
+		}
+	}
+
+	// In place.
+	void process(AudioBuffer<FloatType>& buffer, int numChannelsToProcess) noexcept
+	{
+		process(buffer, 0, buffer, 0, numChannelsToProcess, buffer.getNumSamples());
+	}
+
+private:
+	struct SectionCoefficients
+	{
+		FloatType b0, b1, b2, a1, a2;
+	};
+
+	bool hasDecayed(int numChannelsToCheck) const noexcept
+	{
+		for (int section = 0; section < numSections; section++)
+			for (int ch = 0; ch < numChannelsToCheck; ch++)
+				if (s1[(size_t) (section * numChannels + ch)] != 0 || s2[(size_t) (section * numChannels + ch)] != 0)
+					return false;
+
+		return true;
+	}
+
+	int numChannels;
+	int numSections;
+	std::vector<SectionCoefficients> sections;
+	std::vector<FloatType> s1, s2;		// [section][channel]
+	std::vector<FloatType> frames;		// [frame][channel], frameBlockSize frames
+
+	JUCE_DECLARE_NON_COPYABLE(BiquadCascade)
+};
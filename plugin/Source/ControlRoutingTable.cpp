@@ -0,0 +1,121 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include "ControlRoutingTable.h"
+
+ControlRoutingTable::ControlRoutingTable()
+{
+	// By default each button's LED is the note of the button itself.
+	for (int i = 0; i < numButtons; i++)
+		buttons[i].feedbackNote = i;
+}
+
+void ControlRoutingTable::setParameter(int button, AudioParameterBoolNotify* param)
+{
+	jassert(isValidButton(button));
+	buttons[button].param = param;
+	rebuildLookups();
+}
+
+void ControlRoutingTable::setOscAddress(int button, const String& address)
+{
+	jassert(isValidButton(button));
+	buttons[button].oscAddress = address;
+	rebuildLookups();
+}
+
+void ControlRoutingTable::setFeedbackNote(int button, int note)
+{
+	jassert(isValidButton(button));
+	buttons[button].feedbackNote = note;
+}
+
+int ControlRoutingTable::getButtonForParameter(const String& paramID) const
+{
+	return buttonsByParameter.contains(paramID) ? buttonsByParameter[paramID] : -1;
+}
+
+int ControlRoutingTable::getButtonForOscFeedback(const String& address) const
+{
+	return buttonsByOscFeedback.contains(address) ? buttonsByOscFeedback[address] : -1;
+}
+
+void ControlRoutingTable::rebuildLookups()
+{
+	buttonsByParameter.clear();
+	buttonsByOscFeedback.clear();
+
+	// Lowest button wins if several share a parameter or address.
+	for (int i = numButtons - 1; i >= 0; i--)
+	{
+		if (buttons[i].param != nullptr)
+			buttonsByParameter.set(buttons[i].param->paramID, i);
+
+		const String& address = buttons[i].oscAddress;
+		if (address.isNotEmpty() && !address.startsWith("/action"))
+			buttonsByOscFeedback.set(address, i);
+	}
+}
+
+File ControlRoutingTable::getUserRoutingFile()
+{
+	return File::getSpecialLocation(File::userApplicationDataDirectory).getChildFile("DreamControl").getChildFile("routing.json");
+}
+
+Result ControlRoutingTable::loadFromFile(const File& file, std::function<AudioParameterBoolNotify*(const String& paramID)> findParameter)
+{
+	var json;
+	Result result = JSON::parse(file.loadFileAsString(), json);
+	if (result.failed())
+		return result;
+
+	const Array<var>* entries = json["buttons"].getArray();
+	if (entries == nullptr)
+		return Result::fail("No \"buttons\" array in " + file.getFullPathName());
+
+	Button newButtons[numButtons];
+	for (int i = 0; i < numButtons; i++)
+		newButtons[i] = buttons[i];
+
+	for (const var& entry : *entries)
+	{
+		const int button = entry.getProperty("note", -1);
+		if (!isValidButton(button))
+			return Result::fail("Invalid button note " + entry.getProperty("note", var()).toString());
+
+		if (entry.hasProperty("parameter"))
+		{
+			const String paramID = entry["parameter"].toString();
+			AudioParameterBoolNotify* param = paramID.isNotEmpty() ? findParameter(paramID) : nullptr;
+
+			if (param == nullptr && paramID.isNotEmpty())
+				return Result::fail("Unknown button parameter \"" + paramID + "\"");
+
+			newButtons[button].param = param;
+		}
+
+		if (entry.hasProperty("osc"))
+			newButtons[button].oscAddress = entry["osc"].toString();
+
+		if (entry.hasProperty("feedback"))
+			newButtons[button].feedbackNote = entry["feedback"];
+	}
+
+	for (int i = 0; i < numButtons; i++)
+		buttons[i] = newButtons[i];
+
+	rebuildLookups();
+	return Result::ok();
+}
@@ -0,0 +1,90 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "AudioParameterBoolNotify.h"
+
+//==============================================================================
+/**
+	Maps hardware buttons (MIDI note numbers) to plugin parameters, REAPER OSC
+	addresses and the note that lights the button's LED.
+
+	Lookups are by array index for notes and by hash for parameter IDs and OSC
+	addresses, so nothing is scanned per message. The defaults are set in code
+	and can be overridden by a JSON file, e.g.
+
+		{ "buttons": [ { "note": 0, "parameter": "loudMode" },
+		               { "note": 12, "osc": "/action/40632", "feedback": 12 } ] }
+
+	An empty "parameter" or "osc" removes that mapping from the button.
+*/
+class ControlRoutingTable
+{
+public:
+	enum { numButtons = 128 };
+
+	ControlRoutingTable();
+
+	// Building the table, call before any lookups happen.
+	void setParameter(int button, AudioParameterBoolNotify* param);
+	void setOscAddress(int button, const String& address);
+	void setFeedbackNote(int button, int note);
+
+	// Applies a JSON file on top of the current mappings, or leaves them unchanged if the file has an error.
+	// findParameter returns the parameter for an ID, or nullptr.
+	Result loadFromFile(const File& file, std::function<AudioParameterBoolNotify*(const String& paramID)> findParameter);
+
+	// Default location of the user's routing file.
+	static File getUserRoutingFile();
+
+	//==============================================================================
+	AudioParameterBoolNotify* getParameter(int button) const { return isValidButton(button) ? buttons[button].param : nullptr; }
+	String getOscAddress(int button) const { return isValidButton(button) ? buttons[button].oscAddress : String(); }
+	int getFeedbackNote(int button) const { return isValidButton(button) ? buttons[button].feedbackNote : -1; }
+
+	// Returns -1 if no button is mapped.
+	int getButtonForParameter(const String& paramID) const;
+
+	// Only addresses that REAPER sends back as feedback, i.e. not /action addresses. Returns -1 if no button is mapped.
+	int getButtonForOscFeedback(const String& address) const;
+
+	// Calls f(button, param) for each button mapped to a parameter.
+	template <typename Function>
+	void forEachParameter(Function f) const
+	{
+		for (int i = 0; i < numButtons; i++)
+			if (buttons[i].param != nullptr)
+				f(i, buttons[i].param);
+	}
+
+private:
+	struct Button
+	{
+		AudioParameterBoolNotify* param = nullptr;
+		String oscAddress;
+		int feedbackNote = -1;
+	};
+
+	static bool isValidButton(int button) { return button >= 0 && button < numButtons; }
+	void rebuildLookups();
+
+	Button buttons[numButtons];
+	HashMap<String, int> buttonsByParameter;
+	HashMap<String, int> buttonsByOscFeedback;
+
+	JUCE_DECLARE_NON_COPYABLE(ControlRoutingTable)
+};
@@ -0,0 +1,431 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include <string>
+
+#include "DeviceHub.h"
+
+#define MIDI_OUT_PORT_NAME "MIDIOUT2 (DreamControl)"				// Direct MIDI connection to our hardware.
+#define MIDI_IN_PORT_NAME "MIDIIN2 (DreamControl)"
+#define MIDI_OUT_VOL_CONTROL_PORT_NAME "Loopback (DreamControl)"	// MIDI connection to an external volume control, currently RME TotalMix
+#define MIDI_OUT_SWITCHER_PORT_NAME "DreamControlSwitcher"			// MIDI connection to our monitor switcher relay unit
+#define MIDI_IN_SWITCHER_PORT_NAME "DreamControlSwitcher"			// Acknowledgements from the switcher when its relays have settled
+
+#define REAPER_OSC_SEND_IP "127.0.0.1"
+#define REAPER_OSC_SEND_PORT 8000
+#define REAPER_OSC_RECEIVE_PORT 9000
+
+#define DEVICE_DISCOVERY_STOP_TIMEOUT_MS 2000
+
+DeviceHub::DeviceHub()
+	: Thread("DreamControl device discovery")
+	, surfaceOwner(nullptr)
+	, hardwareMidiOutput(nullptr)
+	, switcherMidiOutput(nullptr)
+	, volControlMidiOutput(nullptr)
+	, hardwareMidiInput(nullptr)
+	, switcherMidiInput(nullptr)
+	, isHardwareOutputOpen(false)
+	, isSwitcherOutputOpen(false)
+	, isVolControlOutputOpen(false)
+	, isVolControlWanted(false)
+	, isRescanRequested(false)
+	, hardwareOutput("DreamControl hardware MIDI output")
+	, switcherOutput("DreamControl switcher MIDI output")
+	, volControlOutput("DreamControl volume control MIDI output")
+	, reaperOscOutput("DreamControl REAPER OSC output")
+{
+	updateStatusText();
+
+	startTimer(tickIntervalMs);
+	startThread();
+}
+
+DeviceHub::~DeviceHub()
+{
+	// Clients hold the hub, so they have all gone by now.
+	jassert(clients.isEmpty());
+
+	signalThreadShouldExit();
+	notify();
+	stopThread(DEVICE_DISCOVERY_STOP_TIMEOUT_MS);
+	stopTimer();
+
+	closeDevices();
+
+	this->OSCReceiver::removeListener(this);
+	this->OSCReceiver::disconnect();
+	reaperOscOutput.disconnect();
+}
+
+//==============================================================================
+void DeviceHub::addClient(Client* client)
+{
+	const ScopedLock sl(clientLock);
+
+	clients.addIfNotAlreadyThere(client);
+	if (surfaceOwner == nullptr)
+		setSurfaceOwner(client);
+}
+
+void DeviceHub::removeClient(Client* client)
+{
+	setTicking(client, false);
+	setVolControlEnabled(client, false);
+	setReaperOscEnabled(client, false);
+
+	{
+		const ScopedLock sl(clientLock);
+
+		clients.removeFirstMatchingValue(client);
+		if (surfaceOwner == client)
+		{
+			// Nothing is said to a client that is going away.
+			surfaceOwner = nullptr;
+			setSurfaceOwner(clients.getFirst());
+		}
+	}
+
+	// Waits for input callbacks that were made before it was removed.
+	callbackLock.enterWrite();
+	callbackLock.exitWrite();
+}
+
+void DeviceHub::setTicking(Client* client, bool isTicking)
+{
+	{
+		const ScopedLock sl(clientLock);
+
+		if (isTicking)
+			tickingClients.addIfNotAlreadyThere(client);
+		else
+			tickingClients.removeFirstMatchingValue(client);
+	}
+
+	// Waits for a tick in progress.
+	if (!isTicking)
+	{
+		callbackLock.enterWrite();
+		callbackLock.exitWrite();
+	}
+}
+
+void DeviceHub::takeSurface(Client* client)
+{
+	const ScopedLock sl(clientLock);
+
+	if (clients.contains(client))
+		setSurfaceOwner(client);
+}
+
+void DeviceHub::releaseSurface(Client* client)
+{
+	const ScopedLock sl(clientLock);
+
+	if (surfaceOwner != client)
+		return;
+
+	for (auto* other : clients)
+	{
+		if (other != client)
+		{
+			setSurfaceOwner(other);
+			return;
+		}
+	}
+
+	// Nobody to pass it to, so it stays.
+	client->surfaceOwnerChanged(true);
+}
+
+bool DeviceHub::isSurfaceOwner(Client* client) const
+{
+	return getSurfaceOwner() == client;
+}
+
+DeviceHub::Client* DeviceHub::getSurfaceOwner() const
+{
+	const ScopedLock sl(clientLock);
+	return surfaceOwner;
+}
+
+// Called with the client lock held.
+void DeviceHub::setSurfaceOwner(Client* newOwner)
+{
+	if (newOwner == surfaceOwner)
+		return;
+
+	Client* oldOwner = surfaceOwner;
+	surfaceOwner = newOwner;
+
+	if (oldOwner != nullptr)
+		oldOwner->surfaceOwnerChanged(false);
+	if (newOwner != nullptr)
+		newOwner->surfaceOwnerChanged(true);
+}
+
+//==============================================================================
+void DeviceHub::setVolControlEnabled(Client* client, bool isEnabled)
+{
+	const ScopedLock sl(clientLock);
+
+	if (isEnabled)
+		volControlClients.addIfNotAlreadyThere(client);
+	else
+		volControlClients.removeFirstMatchingValue(client);
+
+	// The discovery thread opens or closes it.
+	if (isVolControlWanted.exchange(!volControlClients.isEmpty()) != !volControlClients.isEmpty())
+	{
+		isRescanRequested = true;
+		notify();
+	}
+}
+
+void DeviceHub::setReaperOscEnabled(Client* client, bool isEnabled)
+{
+	const ScopedLock sl(clientLock);
+
+	const bool wasEnabled = !reaperOscClients.isEmpty();
+	if (isEnabled)
+		reaperOscClients.addIfNotAlreadyThere(client);
+	else
+		reaperOscClients.removeFirstMatchingValue(client);
+
+	if (reaperOscClients.isEmpty() == !wasEnabled)
+		return;
+
+	// UDP sockets open without waiting, so this is done here.
+	String status;
+	if (!wasEnabled)
+	{
+		// Enable OSC send/receive.
+		if (!reaperOscOutput.connect(REAPER_OSC_SEND_IP, REAPER_OSC_SEND_PORT))
+		{
+			std::string send_ip(REAPER_OSC_SEND_IP);
+			status << "REAPER OSC: failed to open send port (" << send_ip << ":" << std::to_string(REAPER_OSC_SEND_PORT) << ")\n";
+		}
+
+		if (connect(REAPER_OSC_RECEIVE_PORT))
+			this->OSCReceiver::addListener(this);
+		else
+			status << "REAPER OSC: failed to open receive port (" << std::to_string(REAPER_OSC_RECEIVE_PORT) << ")\n";
+
+		if (status.isEmpty())
+			status = "REAPER OSC: connected\n";
+	}
+	else
+	{
+		// Frees the receive port for other applications.
+		this->OSCReceiver::removeListener(this);
+		this->OSCReceiver::disconnect();
+		reaperOscOutput.disconnect();
+	}
+
+	const ScopedLock statusSl(statusLock);
+	oscStatus = status;
+}
+
+String DeviceHub::getStatusText() const
+{
+	const ScopedLock sl(statusLock);
+	return deviceStatus + oscStatus;
+}
+
+//==============================================================================
+// Every client's 10ms callback, on the one timer thread.
+void DeviceHub::hiResTimerCallback()
+{
+	const ScopedReadLock rl(callbackLock);
+
+	Client* owner;
+	{
+		// Keeps its storage, so this doesn't allocate once the clients are registered.
+		const ScopedLock sl(clientLock);
+		tickClients.clearQuick();
+		tickClients.addArray(tickingClients);
+		owner = surfaceOwner;
+	}
+
+	for (auto* client : tickClients)
+		client->deviceHubTick(client == owner);
+}
+
+void DeviceHub::handleIncomingMidiMessage(MidiInput* source, const MidiMessage& m)
+{
+	const ScopedReadLock rl(callbackLock);
+
+	Client* owner = getSurfaceOwner();
+	if (owner == nullptr)
+		return;
+
+	if (source == switcherMidiInput.load())
+		owner->switcherMidiReceived(m);
+	else
+		owner->surfaceMidiReceived(m);
+}
+
+void DeviceHub::oscMessageReceived(const OSCMessage& message)
+{
+	const ScopedReadLock rl(callbackLock);
+
+	if (Client* owner = getSurfaceOwner())
+		owner->reaperOscReceived(message);
+}
+
+void DeviceHub::oscBundleReceived(const OSCBundle& bundle)
+{
+	for (auto it = bundle.begin(); it != bundle.end(); it++)
+		if (it->isMessage())
+			oscMessageReceived(it->getMessage());
+}
+
+//==============================================================================
+// Discovery thread: looks for missing ports with backoff, and closes ports that have gone.
+void DeviceHub::run()
+{
+	int retryMs = firstRetryMs;
+
+	while (!threadShouldExit())
+	{
+		const bool isChanged = updateDevices();
+		const bool isAllOpen = isHardwareOutputOpen && hardwareMidiInput.load() != nullptr
+			&& isSwitcherOutputOpen && switcherMidiInput.load() != nullptr
+			&& isVolControlOutputOpen == isVolControlWanted;
+
+		// Something was plugged in or out, more may follow soon.
+		if (isChanged || isRescanRequested.exchange(false))
+			retryMs = firstRetryMs;
+		else
+			retryMs = jmin(retryMs * 2, (int)maxRetryMs);
+
+		wait(isAllOpen ? (int)maxRetryMs : retryMs);
+	}
+}
+
+// Returns true if any port was opened or closed.
+bool DeviceHub::updateDevices()
+{
+	const StringArray outputDevices = MidiOutput::getDevices();
+	const StringArray inputDevices = MidiInput::getDevices();
+
+	// Init MIDI ports to our hardware, for sending meter values and receiving commands.
+	// We use independent ports instead of our DAW port for better SysEx support.
+	const bool wasHardwareOpen = isHardwareOutputOpen;
+	bool isChanged = updateOutput(outputDevices, MIDI_OUT_PORT_NAME, true, hardwareMidiOutput, hardwareOutput);
+	isHardwareOutputOpen = hardwareMidiOutput != nullptr;
+	isChanged |= updateInput(inputDevices, MIDI_IN_PORT_NAME, hardwareMidiInput);
+
+	// Also try and connect to our DreamControlSwitcher unit if it's available.
+	// Without the switcher's input, switches still fade but open up again after a timeout.
+	isChanged |= updateOutput(outputDevices, MIDI_OUT_SWITCHER_PORT_NAME, true, switcherMidiOutput, switcherOutput);
+	isSwitcherOutputOpen = switcherMidiOutput != nullptr;
+	isChanged |= updateInput(inputDevices, MIDI_IN_SWITCHER_PORT_NAME, switcherMidiInput);
+
+	// We support an optional RME volume control (TotalMix) on a loopback MIDI port.
+	isChanged |= updateOutput(outputDevices, MIDI_OUT_VOL_CONTROL_PORT_NAME, isVolControlWanted, volControlMidiOutput, volControlOutput);
+	isVolControlOutputOpen = volControlMidiOutput != nullptr;
+
+	updateStatusText();
+
+	// The hardware may have missed everything while it was away.
+	if (isHardwareOutputOpen && !wasHardwareOpen)
+	{
+		const ScopedReadLock rl(callbackLock);
+		if (Client* owner = getSurfaceOwner())
+			owner->surfaceConnected();
+	}
+
+	return isChanged;
+}
+
+bool DeviceHub::updateOutput(const StringArray& devices, const char* name, bool isWanted, MidiOutput*& device, MidiOutputThread& thread)
+{
+	const int deviceId = devices.indexOf(name);
+
+	if (device == nullptr && isWanted && deviceId > -1)
+	{
+		device = MidiOutput::openDevice(deviceId);
+		thread.setOutput(device);
+		return device != nullptr;
+	}
+
+	if (device != nullptr && (!isWanted || deviceId < 0))
+	{
+		// Waits for any send in progress before the device is closed.
+		thread.setOutput(nullptr);
+		delete device;
+		device = nullptr;
+		return true;
+	}
+
+	return false;
+}
+
+bool DeviceHub::updateInput(const StringArray& devices, const char* name, std::atomic<MidiInput*>& device)
+{
+	const int deviceId = devices.indexOf(name);
+
+	if (device.load() == nullptr && deviceId > -1)
+	{
+		MidiInput* newDevice = MidiInput::openDevice(deviceId, this);
+		if (newDevice == nullptr)
+			return false;
+
+		device = newDevice;
+		newDevice->start();
+		return true;
+	}
+
+	if (device.load() != nullptr && deviceId < 0)
+	{
+		MidiInput* oldDevice = device.exchange(nullptr);
+		oldDevice->stop();
+		delete oldDevice;
+		return true;
+	}
+
+	return false;
+}
+
+void DeviceHub::closeDevices()
+{
+	const StringArray none;
+	const bool isVolControlWantedBefore = isVolControlWanted;
+	isVolControlWanted = false;
+
+	updateInput(none, MIDI_IN_PORT_NAME, hardwareMidiInput);
+	updateInput(none, MIDI_IN_SWITCHER_PORT_NAME, switcherMidiInput);
+	updateOutput(none, MIDI_OUT_PORT_NAME, false, hardwareMidiOutput, hardwareOutput);
+	updateOutput(none, MIDI_OUT_SWITCHER_PORT_NAME, false, switcherMidiOutput, switcherOutput);
+	updateOutput(none, MIDI_OUT_VOL_CONTROL_PORT_NAME, false, volControlMidiOutput, volControlOutput);
+
+	isHardwareOutputOpen = isSwitcherOutputOpen = isVolControlOutputOpen = false;
+	isVolControlWanted = isVolControlWantedBefore;
+}
+
+void DeviceHub::updateStatusText()
+{
+	String status;
+	status << "Hardware: " << (!isHardwareOutputOpen ? "output '" MIDI_OUT_PORT_NAME "' not found"
+		: hardwareMidiInput.load() == nullptr ? "input '" MIDI_IN_PORT_NAME "' not found" : "connected") << "\n";
+	status << "Switcher: " << (isSwitcherOutputOpen ? "connected" : "not found") << "\n";
+
+	if (isVolControlWanted)
+		status << "TotalMix: " << (isVolControlOutputOpen ? "connected" : "port '" MIDI_OUT_VOL_CONTROL_PORT_NAME "' not found") << "\n";
+
+	const ScopedLock sl(statusLock);
+	deviceStatus = status;
+}
@@ -0,0 +1,166 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <atomic>
+
+#include <JuceHeader.h>
+#include "OutputThread.h"
+
+//==============================================================================
+/**
+	The hardware MIDI ports, the switcher's ports, the TotalMix loopback port and REAPER
+	OSC, shared by every plugin instance in the process through a SharedResourcePointer.
+	It also runs the one timer that ticks every instance.
+
+	MIDI ports are found and opened by a discovery thread, never by the caller, so
+	constructing the hub or preparing an instance doesn't wait on MIDI enumeration.
+	While a port is missing it looks again after firstRetryMs, backing off to
+	maxRetryMs, so a surface plugged in later is picked up, and one unplugged is
+	closed. Missing ports are shown by getStatusText(), not in message boxes.
+
+	Each instance registers as a client. One client, the surface owner, drives the
+	hardware: it alone receives surface, switcher and OSC input, and it is told so in
+	its tick so only it sends meters and state. The first client to register becomes
+	the owner, another one can take over with takeSurface().
+
+	Client callbacks are made outside the client lock, to a copy of the clients taken
+	under it, so a tick doesn't hold up MIDI input or registration. They hold the callback
+	lock for reading, which removeClient() and setTicking(false) take for writing once the
+	client is out of the lists: when they have returned, no callback to it is running or
+	will start.
+*/
+class DeviceHub : private HighResolutionTimer,
+				  private Thread,
+				  private MidiInputCallback,
+				  private OSCReceiver,
+				  private OSCReceiver::Listener<OSCReceiver::MessageLoopCallback>
+{
+public:
+	enum
+	{
+		tickIntervalMs = 10,
+		firstRetryMs = 250,
+		maxRetryMs = 8000		// also how often open ports are checked for being unplugged
+	};
+
+	class Client
+	{
+	public:
+		virtual ~Client() {}
+
+		// Hub timer, every tickIntervalMs while ticking is enabled.
+		virtual void deviceHubTick(bool isSurfaceOwner) = 0;
+
+		// Surface owner only. MIDI input thread.
+		virtual void surfaceMidiReceived(const MidiMessage& m) = 0;
+		virtual void switcherMidiReceived(const MidiMessage& m) = 0;
+
+		// Surface owner only. Message thread.
+		virtual void reaperOscReceived(const OSCMessage& message) = 0;
+
+		// The thread that changed the owner.
+		virtual void surfaceOwnerChanged(bool isSurfaceOwner) = 0;
+
+		// Surface owner only, when the hardware has been plugged in. Discovery thread.
+		virtual void surfaceConnected() = 0;
+	};
+
+	DeviceHub();
+	~DeviceHub();
+
+	//==============================================================================
+	void addClient(Client* client);
+	void removeClient(Client* client);
+
+	// Ticks are off until enabled. Disabling waits for a tick in progress.
+	void setTicking(Client* client, bool isTicking);
+
+	// A client giving up the surface passes it to another one, if there is one.
+	void takeSurface(Client* client);
+	void releaseSurface(Client* client);
+	bool isSurfaceOwner(Client* client) const;
+
+	//==============================================================================
+	// Messages sent while a device isn't connected are dropped.
+	bool isHardwareConnected() const { return isHardwareOutputOpen; }
+	MidiOutputThread& getHardwareOutput() { return hardwareOutput; }
+
+	bool isSwitcherConnected() const { return isSwitcherOutputOpen; }
+	MidiOutputThread& getSwitcherOutput() { return switcherOutput; }
+
+	// The loopback port is opened while any client has it enabled.
+	void setVolControlEnabled(Client* client, bool isEnabled);
+	bool isVolControlConnected() const { return isVolControlOutputOpen; }
+	MidiOutputThread& getVolControlOutput() { return volControlOutput; }
+
+	// REAPER OSC is connected while any client has it enabled.
+	void setReaperOscEnabled(Client* client, bool isEnabled);
+	OscOutputThread& getReaperOscOutput() { return reaperOscOutput; }
+
+	// What is connected and what isn't, one line each. Any thread.
+	String getStatusText() const;
+
+private:
+	void hiResTimerCallback() override;
+	void run() override;
+	void handleIncomingMidiMessage(MidiInput* source, const MidiMessage& m) override;
+	void oscMessageReceived(const OSCMessage& message) override;
+	void oscBundleReceived(const OSCBundle& bundle) override;
+	void setSurfaceOwner(Client* newOwner);
+
+	// Discovery thread
+	bool updateDevices();
+	bool updateOutput(const StringArray& devices, const char* name, bool isWanted, MidiOutput*& device, MidiOutputThread& thread);
+	bool updateInput(const StringArray& devices, const char* name, std::atomic<MidiInput*>& device);
+	void closeDevices();
+	void updateStatusText();
+
+	ReadWriteLock callbackLock;
+	CriticalSection clientLock;
+	Array<Client*> clients;
+	Array<Client*> tickingClients;
+	Array<Client*> volControlClients;
+	Array<Client*> reaperOscClients;
+	Client* surfaceOwner;
+	Array<Client*> tickClients;		// timer thread, copy of tickingClients for the tick in progress
+	Client* getSurfaceOwner() const;
+
+	// Opened and closed by the discovery thread only
+	MidiOutput* hardwareMidiOutput;
+	MidiOutput* switcherMidiOutput;
+	MidiOutput* volControlMidiOutput;
+	std::atomic<MidiInput*> hardwareMidiInput;
+	std::atomic<MidiInput*> switcherMidiInput;
+
+	std::atomic<bool> isHardwareOutputOpen;
+	std::atomic<bool> isSwitcherOutputOpen;
+	std::atomic<bool> isVolControlOutputOpen;
+	std::atomic<bool> isVolControlWanted;
+	std::atomic<bool> isRescanRequested;
+
+	CriticalSection statusLock;
+	String deviceStatus;
+	String oscStatus;
+
+	// All MIDI output goes through these, one thread per device
+	MidiOutputThread hardwareOutput;
+	MidiOutputThread switcherOutput;
+	MidiOutputThread volControlOutput;
+	OscOutputThread reaperOscOutput;
+
+	JUCE_DECLARE_NON_COPYABLE(DeviceHub)
+};
@@ -0,0 +1,96 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include "DspLoadMeter.h"
+
+const char* DspLoad::getName(int entry)
+{
+	static const char* const names[numEntries] = { "Band solo", "Mid/side", "Loud EQ", "Meters", "Gain", "Total" };
+	return isPositiveAndBelow(entry, (int)numEntries) ? names[entry] : "";
+}
+
+DspLoadMeter::DspLoadMeter()
+{
+	prepare(44100.0);
+}
+
+void DspLoadMeter::prepare(double sampleRate)
+{
+	ticksPerSample = (double)Time::getHighResolutionTicksPerSecond() / sampleRate;
+	publishIntervalTicks = Time::getHighResolutionTicksPerSecond() * publishIntervalMs / 1000;
+
+	blockStartTicks = lastMarkTicks = 0;
+	blockBudgetTicks = 1;
+	sumBudgetTicks = 0;
+	for (int i = 0; i < DspLoad::numEntries; i++)
+	{
+		stageTicks[i] = 0;
+		sumTicks[i] = 0;
+		worstPercent[i] = 0.0f;
+	}
+}
+
+void DspLoadMeter::startBlock(int numSamples) noexcept
+{
+	blockStartTicks = lastMarkTicks = Time::getHighResolutionTicks();
+	blockBudgetTicks = jmax((int64)1, (int64)(numSamples * ticksPerSample));
+}
+
+void DspLoadMeter::endStage(DspLoad::Stage stage) noexcept
+{
+	const int64 now = Time::getHighResolutionTicks();
+	stageTicks[stage] += now - lastMarkTicks;
+	lastMarkTicks = now;
+}
+
+void DspLoadMeter::endBlock() noexcept
+{
+	stageTicks[DspLoad::total] = lastMarkTicks - blockStartTicks;
+
+	for (int i = 0; i < DspLoad::numEntries; i++)
+	{
+		sumTicks[i] += stageTicks[i];
+		worstPercent[i] = jmax(worstPercent[i], 100.0f * (float)stageTicks[i] / (float)blockBudgetTicks);
+		stageTicks[i] = 0;
+	}
+	sumBudgetTicks += blockBudgetTicks;
+
+	if (sumBudgetTicks >= publishIntervalTicks)
+		publish();
+}
+
+void DspLoadMeter::publish() noexcept
+{
+	DspLoad& load = published.getWriteBuffer();
+
+	for (int i = 0; i < DspLoad::numEntries; i++)
+	{
+		load.average[i] = 100.0f * (float)sumTicks[i] / (float)sumBudgetTicks;
+		load.worst[i] = worstPercent[i];
+
+		sumTicks[i] = 0;
+		worstPercent[i] = 0.0f;
+	}
+	sumBudgetTicks = 0;
+
+	published.publish();
+}
+
+bool DspLoadMeter::getLatestLoad(DspLoad& load) noexcept
+{
+	const bool isNew = published.update();
+	load = published.getReadBuffer();
+	return isNew;
+}
@@ -0,0 +1,91 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "TripleBuffer.h"
+
+//==============================================================================
+/** Time spent in each processBlock stage, as a percentage of the block's duration. */
+struct DspLoad
+{
+	enum Stage
+	{
+		bandSolo = 0,
+		midSide,
+		loudEq,
+		metering,
+		gain,
+		numStages,
+		total = numStages,	// whole processBlock
+		numEntries
+	};
+
+	float average[numEntries] = {};
+	float worst[numEntries] = {};
+
+	static const char* getName(int entry);
+};
+
+//==============================================================================
+/**
+	Always-on timing of the processBlock stages.
+
+	The audio thread marks the end of each stage, which costs one high resolution
+	tick read. Average and worst load over publishIntervalMs of audio are published
+	through a TripleBuffer; nothing on the audio thread waits or allocates.
+*/
+class DspLoadMeter
+{
+public:
+	enum { publishIntervalMs = 500 };
+
+	DspLoadMeter();
+
+	// Call outside the audio thread, before processing starts.
+	void prepare(double sampleRate);
+
+	//==============================================================================
+	// Audio thread. Call endStage() for every stage, whether it ran or not, so each
+	// stage is only charged for its own time. A stage ended more than once in a block,
+	// e.g. once per chunk, is charged for all of its times.
+	void startBlock(int numSamples) noexcept;
+	void endStage(DspLoad::Stage stage) noexcept;
+	void endBlock() noexcept;
+
+	//==============================================================================
+	// Single reader thread. Returns true when newer values were published.
+	bool getLatestLoad(DspLoad& load) noexcept;
+
+private:
+	void publish() noexcept;
+
+	double ticksPerSample;
+	int64 publishIntervalTicks;
+
+	// Audio thread side
+	int64 blockStartTicks;
+	int64 lastMarkTicks;
+	int64 blockBudgetTicks;
+	int64 stageTicks[DspLoad::numEntries];
+	int64 sumTicks[DspLoad::numEntries];
+	int64 sumBudgetTicks;
+	float worstPercent[DspLoad::numEntries];
+
+	TripleBuffer<DspLoad> published;
+
+	JUCE_DECLARE_NON_COPYABLE(DspLoadMeter)
+};
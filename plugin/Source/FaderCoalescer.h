@@ -0,0 +1,67 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <atomic>
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+	Latest-value-wins coalescing for one fader destination.
+
+	Any thread can set the value as often as it arrives. The sending side takes
+	it at most once per interval, always getting the newest value, or straight
+	away with takeValue(), e.g. when the fader is released.
+*/
+class FaderCoalescer
+{
+public:
+	FaderCoalescer() : pendingValue(0.0f), isPending(false), lastSendMs(0) {}
+
+	void setValue(float value) noexcept
+	{
+		pendingValue.store(value);
+		isPending.store(true);
+	}
+
+	// Returns true with the latest value if one is waiting and intervalMs has passed since the last one was taken.
+	bool getValueToSend(int intervalMs, float& value) noexcept
+	{
+		if (!isPending.load() || Time::getMillisecondCounter() - lastSendMs.load() < (uint32)intervalMs)
+			return false;
+
+		return takeValue(value);
+	}
+
+	// Returns true with the latest value if one is waiting, regardless of the interval.
+	bool takeValue(float& value) noexcept
+	{
+		if (!isPending.exchange(false))
+			return false;
+
+		value = pendingValue.load();
+		lastSendMs.store(Time::getMillisecondCounter());
+		return true;
+	}
+
+private:
+	std::atomic<float> pendingValue;
+	std::atomic<bool> isPending;
+	std::atomic<uint32> lastSendMs;
+
+	JUCE_DECLARE_NON_COPYABLE(FaderCoalescer)
+};
@@ -0,0 +1,211 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include "LoudnessHistory.h"
+#include "LufsProcessor.h"
+
+// LufsHistoryArray keeps all chunks but the one it may be recycling.
+static_assert(LoudnessHistory::maxValues == (LUFS_HISTORY_MAX_CHUNKS - 1) * LUFS_HISTORY_CHUNK_SIZE, "History spans differ");
+
+LoudnessHistory::LoudnessHistory()
+	: firstPosition(0)
+	, endPosition(0)
+	, revision(0)
+	, isEnabled(false)
+	, source(nullptr)
+	, sourceGeneration(0)
+{
+}
+
+void LoudnessHistory::update(const LufsProcessor& lufs)
+{
+	if (!isEnabled)
+	{
+		if (source != nullptr)
+			release();
+
+		return;
+	}
+
+	const int validSize = lufs.getValidSize();
+
+	if (&lufs != source || lufs.getHistoryGeneration() != sourceGeneration || validSize < endPosition)
+	{
+		// From the first top level entry the processor still has all values of.
+		const int oldestPosition = jmax(0, validSize - (int)maxValues);
+		clear((oldestPosition + topSpan - 1) / topSpan * topSpan);
+
+		const ScopedLock sl(lock);
+		source = &lufs;
+		sourceGeneration = lufs.getHistoryGeneration();
+	}
+
+	const int lastPosition = jmin(validSize, endPosition + (int)maxAppendPerUpdate);
+	if (lastPosition <= endPosition)
+		return;
+
+	const ScopedLock sl(lock);
+
+	for (int position = endPosition; position < lastPosition; position++)
+	{
+		float values[numSeries];
+		for (int series = 0; series < numSeries; series++)
+			values[series] = getSourceValue(lufs, (Series)series, position);
+
+		append(values);
+	}
+
+	revision++;
+}
+
+// Adds one value of each series at endPosition, and to the entries above it. Drops the oldest
+// top level entry once there are more values than the processor keeps. Called with the lock held.
+void LoudnessHistory::append(const float* values)
+{
+	const int position = endPosition;
+	const int first = firstPosition;
+
+	for (int series = 0; series < numSeries; series++)
+	{
+		const Range value = { values[series], values[series] };
+
+		for (int level = 1; level <= numLevels; level++)
+		{
+			std::vector<Range>& entries = levels[series][level - 1];
+			const size_t index = (size_t)((position >> level) - (first >> level));
+
+			if (index == entries.size())
+			{
+				entries.push_back(value);
+			}
+			else
+			{
+				Range& entry = entries[index];
+				entry.min = jmin(entry.min, value.min);
+				entry.max = jmax(entry.max, value.max);
+			}
+		}
+	}
+
+	endPosition = position + 1;
+
+	if (endPosition - first > (int)maxValues + (int)topSpan)
+	{
+		for (int series = 0; series < numSeries; series++)
+		{
+			for (int level = 1; level <= numLevels; level++)
+			{
+				std::vector<Range>& entries = levels[series][level - 1];
+				entries.erase(entries.begin(), entries.begin() + (topSpan >> level));
+			}
+		}
+
+		firstPosition = first + (int)topSpan;
+	}
+}
+
+// Keeps the memory, a reset session grows back to the same size.
+void LoudnessHistory::clear(int newFirstPosition)
+{
+	const ScopedLock sl(lock);
+
+	for (int series = 0; series < numSeries; series++)
+		for (int level = 0; level < numLevels; level++)
+			levels[series][level].clear();
+
+	firstPosition = newFirstPosition;
+	endPosition = newFirstPosition;
+	revision++;
+}
+
+void LoudnessHistory::release()
+{
+	const ScopedLock sl(lock);
+
+	for (int series = 0; series < numSeries; series++)
+		for (int level = 0; level < numLevels; level++)
+			std::vector<Range>().swap(levels[series][level]);
+
+	firstPosition = 0;
+	endPosition = 0;
+	source = nullptr;
+	revision++;
+}
+
+float LoudnessHistory::getSourceValue(const LufsProcessor& lufs, Series series, int position)
+{
+	switch (series)
+	{
+		case momentary:		return lufs.getMomentaryVolumeArray()[position];
+		case shortTerm:		return lufs.getShortTermVolumeArray()[position];
+		case integrated:	return lufs.getIntegratedVolumeArray()[position];
+		default:			return lufs.getTruePeakArray()[position];
+	}
+}
+
+bool LoudnessHistory::getColumns(Series series, int numColumns, Range* columns) const
+{
+	const ScopedLock sl(lock);
+
+	const int first = firstPosition;
+	const int numValues = endPosition - first;
+	if (numValues == 0 || numColumns <= 0)
+		return false;
+
+	for (int column = 0; column < numColumns; column++)
+	{
+		const int start = first + (int)((int64)column * numValues / numColumns);
+		const int end = jmax(start + 1, first + (int)((int64)(column + 1) * numValues / numColumns));
+		Range& range = columns[column];
+
+		if (start >= first + numValues)
+		{
+			range.min = 1.0f;
+			range.max = 0.0f;
+			continue;
+		}
+
+		// Highest level with entries no wider than the column. The column's span is covered by
+		// two or three entries, which may reach a little beyond it: less than a column's width.
+		int level = 0;
+		while (level < numLevels && (1 << (level + 1)) <= end - start)
+			level++;
+
+		// Narrower than two values: the processor's own values, while it still has them.
+		if (level == 0)
+		{
+			if (source != nullptr && start >= source->getValidSize() - (int)maxValues)
+			{
+				range.min = range.max = getSourceValue(*source, series, start);
+				continue;
+			}
+
+			level = 1;
+		}
+
+		const std::vector<Range>& entries = levels[series][level - 1];
+		const int firstIndex = (start >> level) - (first >> level);
+		const int lastIndex = jmin(((end - 1) >> level) - (first >> level), (int)entries.size() - 1);
+
+		range = entries[(size_t)firstIndex];
+		for (int index = firstIndex + 1; index <= lastIndex; index++)
+		{
+			range.min = jmin(range.min, entries[(size_t)index].min);
+			range.max = jmax(range.max, entries[(size_t)index].max);
+		}
+	}
+
+	return true;
+}
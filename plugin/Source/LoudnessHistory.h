@@ -0,0 +1,110 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include <JuceHeader.h>
+
+class LufsProcessor;
+
+//==============================================================================
+/**
+	The 100 ms loudness values of the processor's history as a min/max pyramid, for drawing.
+
+	Level 1 holds the min and max of two values, each level above the min and max of two
+	entries of the level below. Values are added to every level as they arrive, so reading
+	the min/max of any number of columns costs a few entries per column, however long the
+	session is. Columns narrower than two values read the processor's history arrays, the
+	pyramid doesn't copy them.
+
+	It covers what those arrays keep, about 7 hours, and is only built while an editor shows
+	it: memory is released when the editor closes, and the pyramid built again from the
+	processor's arrays when one opens.
+*/
+class LoudnessHistory
+{
+public:
+	enum Series
+	{
+		momentary = 0,
+		shortTerm,
+		integrated,
+		truePeak,
+		numSeries
+	};
+
+	enum
+	{
+		numLevels = 14,				// levels 1 to 14, 2^14 values at the top, about 27 minutes
+		maxValues = 255 * 1024,		// as many as the processor's history arrays keep
+		maxAppendPerUpdate = 6000	// a restored session is added 10 minutes at a time
+	};
+
+	struct Range
+	{
+		float min;
+		float max;
+	};
+
+	LoudnessHistory();
+
+	// Timer thread. Adds the values the processor has measured since the last call. Starts
+	// again after the processor's history has, e.g. after a reset or restore. Does nothing
+	// while disabled.
+	void update(const LufsProcessor& lufs);
+
+	// Releases the memory and forgets the processor: before it is deleted, and when disabled.
+	// Not while update() may run.
+	void release();
+
+	// Message thread. Shown by an editor or not.
+	void setEnabled(bool shouldBeEnabled) { isEnabled = shouldBeEnabled; }
+
+	//==============================================================================
+	// Any thread. Changes whenever values are added or cleared.
+	int getRevision() const { return revision; }
+
+	int getNumValues() const { return endPosition - firstPosition; }
+
+	// Any thread. Splits the history into numColumns equal spans and returns the min and max of
+	// each, or false if there are no values yet. Columns beyond the values are empty, max < min.
+	bool getColumns(Series series, int numColumns, Range* columns) const;
+
+private:
+	enum
+	{
+		topSpan = 1 << numLevels	// values in an entry of the top level, the oldest are dropped this many at a time
+	};
+
+	void append(const float* values);
+	void clear(int newFirstPosition);
+	static float getSourceValue(const LufsProcessor& lufs, Series series, int position);
+
+	CriticalSection lock;
+	std::vector<Range> levels[numSeries][numLevels];	// [series][level - 1]
+	std::atomic<int> firstPosition;						// processor position of the oldest value, a multiple of topSpan
+	std::atomic<int> endPosition;						// one past the newest
+	std::atomic<int> revision;
+	std::atomic<bool> isEnabled;
+
+	// What the values come from, to notice when it starts again. Set with the lock held.
+	const LufsProcessor* source;
+	int sourceGeneration;
+
+	JUCE_DECLARE_NON_COPYABLE(LoudnessHistory)
+};
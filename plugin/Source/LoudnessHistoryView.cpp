@@ -0,0 +1,146 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include "LoudnessHistoryView.h"
+
+#define HISTORY_VIEW_MIN_DB -60.0f
+#define HISTORY_VIEW_MAX_DB 0.0f
+
+LoudnessHistoryView::LoudnessHistoryView(const LoudnessHistory& history)
+	: history(history)
+	, viewWidth(0)
+	, viewHeight(0)
+	, target(-16.0f)
+	, lastRevision(-1)
+	, isRepaintNeeded(true)
+{
+	setOpaque(true);
+
+	context.setRenderer(this);
+	context.setContinuousRepainting(false);
+	context.setComponentPaintingEnabled(false);
+	context.attachTo(*this);
+
+	startTimerHz(frameRateHz);
+}
+
+LoudnessHistoryView::~LoudnessHistoryView()
+{
+	stopTimer();
+	context.detach();
+}
+
+void LoudnessHistoryView::setTarget(float lufsTarget)
+{
+	if (lufsTarget != target)
+	{
+		target = lufsTarget;
+		isRepaintNeeded = true;
+	}
+}
+
+void LoudnessHistoryView::resized()
+{
+	viewWidth = getWidth();
+	viewHeight = getHeight();
+	isRepaintNeeded = true;
+}
+
+void LoudnessHistoryView::timerCallback()
+{
+	const int revision = history.getRevision();
+
+	if (revision != lastRevision || isRepaintNeeded)
+	{
+		lastRevision = revision;
+		isRepaintNeeded = false;
+		context.triggerRepaint();
+	}
+}
+
+//==============================================================================
+void LoudnessHistoryView::newOpenGLContextCreated()
+{
+}
+
+void LoudnessHistoryView::openGLContextClosing()
+{
+}
+
+void LoudnessHistoryView::renderOpenGL()
+{
+	const float scale = (float)context.getRenderingScale();
+	const int width = roundToInt(scale * viewWidth);
+	const int height = roundToInt(scale * viewHeight);
+
+	OpenGLHelpers::clear(Colours::black);
+	if (width <= 0 || height <= 0)
+		return;
+
+	// One column per physical pixel
+	if ((int)columns.size() < width)
+		columns.resize((size_t)width);
+
+	ScopedPointer<LowLevelGraphicsContext> glRenderer(createOpenGLGraphicsContext(context, width, height));
+	if (glRenderer == nullptr)
+		return;
+
+	Graphics g(*glRenderer);
+
+	// 6 dB grid
+	g.setColour(Colours::darkgrey.darker());
+	for (float db = HISTORY_VIEW_MAX_DB; db > HISTORY_VIEW_MIN_DB; db -= 6.0f)
+		g.fillRect(0.0f, getY(db, height), (float)width, 1.0f);
+
+	drawBands(g, LoudnessHistory::momentary, Colours::steelblue.withAlpha(0.6f), false, width, height);
+	drawBands(g, LoudnessHistory::shortTerm, Colours::lightskyblue, false, width, height);
+	drawBands(g, LoudnessHistory::integrated, Colours::white, true, width, height);
+	drawBands(g, LoudnessHistory::truePeak, Colours::orange, true, width, height);
+
+	g.setColour(Colours::green);
+	g.fillRect(0.0f, getY(target, height), (float)width, scale);
+}
+
+// One rectangle per column from min to max, or at max only for a line. Columns without values are left empty.
+void LoudnessHistoryView::drawBands(Graphics& g, LoudnessHistory::Series series, Colour colour, bool isLine, int width, int height)
+{
+	// Less values than pixels: columns are as wide as a value
+	const int numColumns = jmin(width, history.getNumValues());
+	if (!history.getColumns(series, numColumns, columns.data()))
+		return;
+
+	const float columnWidth = (float)width / numColumns;
+	const float lineHeight = jmax(1.0f, (float)context.getRenderingScale());
+
+	g.setColour(colour);
+
+	for (int column = 0; column < numColumns; column++)
+	{
+		const LoudnessHistory::Range& range = columns[(size_t)column];
+		if (range.max < range.min || range.max <= HISTORY_VIEW_MIN_DB)
+			continue;
+
+		const float top = getY(range.max, height);
+		const float bottom = isLine ? top + lineHeight : jmax(top + lineHeight, getY(range.min, height));
+
+		g.fillRect(column * columnWidth, top, columnWidth, bottom - top);
+	}
+}
+
+float LoudnessHistoryView::getY(float db, int height) const
+{
+	const float proportion = (jlimit(HISTORY_VIEW_MIN_DB, HISTORY_VIEW_MAX_DB, db) - HISTORY_VIEW_MAX_DB) / (HISTORY_VIEW_MIN_DB - HISTORY_VIEW_MAX_DB);
+	return proportion * (height - 1);
+}
@@ -0,0 +1,76 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include <JuceHeader.h>
+#include "LoudnessHistory.h"
+
+//==============================================================================
+/**
+	The session's loudness, up to the last 7 hours, drawn by OpenGL: min/max bands of
+	momentary and short term, the integrated value, the true peak and the target.
+
+	Each frame reads one min/max per pixel column from the LoudnessHistory, so drawing
+	costs the same for a minute or an album. Frames are drawn on the GL thread, only
+	when the history, the size or the target have changed, checked frameRateHz times
+	a second, independently of the processor's timer and of the editor's repaints.
+*/
+class LoudnessHistoryView : public Component,
+							private OpenGLRenderer,
+							private Timer
+{
+public:
+	enum
+	{
+		frameRateHz = 30
+	};
+
+	LoudnessHistoryView(const LoudnessHistory& history);
+	~LoudnessHistoryView();
+
+	// Message thread
+	void setTarget(float lufsTarget);
+	void resized() override;
+
+private:
+	void timerCallback() override;
+
+	// GL thread
+	void newOpenGLContextCreated() override;
+	void renderOpenGL() override;
+	void openGLContextClosing() override;
+	void drawBands(Graphics& g, LoudnessHistory::Series series, Colour colour, bool isLine, int width, int height);
+	float getY(float db, int height) const;
+
+	const LoudnessHistory& history;
+	OpenGLContext context;
+
+	std::atomic<int> viewWidth;
+	std::atomic<int> viewHeight;
+	std::atomic<float> target;
+
+	// Message thread: what the last frame was triggered for
+	int lastRevision;
+	bool isRepaintNeeded;
+
+	// GL thread
+	std::vector<LoudnessHistory::Range> columns;
+
+	JUCE_DECLARE_NON_COPYABLE(LoudnessHistoryView)
+};
@@ -23,8 +23,6 @@
 
 #include "LufsProcessor.h"
 
-#define LUFS_PROCESSOR_NB_MEMORY_VALUES 4
-
 void DEBUGPLUGIN_output( const char * _text, ...);
 
 double LufsProcessor::ms_log10 = log( 10.0 );
@@ -33,7 +31,7 @@ float getDecibelVolumeFromLinearVolume(float _linearVolume )
 {
     static const float log10dividedBy20 = 0.1151292546497f;
 
-    if ( _linearVolume < 0.00001f )
+    if ( _linearVolume < TRUE_PEAK_MIN_LINEAR_VALUE )
         return DEFAULT_MIN_VOLUME;
 
     return logf( _linearVolume ) / log10dividedBy20;
@@ -44,132 +42,137 @@ float LufsProcessor::testTruePeak(const juce::File & input , const double sample
     juce::AudioFormatManager audioFormatManager;
     audioFormatManager.registerBasicFormats();
 
-    juce::AudioFormatReader * reader = audioFormatManager.createReaderFor( input );
+    std::unique_ptr<juce::AudioFormatReader> reader( audioFormatManager.createReaderFor( input ) );
 
     float truePeakDecibelValue = -100.f; 
 
-    if ( reader != nullptr )
+    if ( reader != nullptr && bufferSize > 0 )
     {
-        // read file
-        juce::AudioSampleBuffer buffer( (int)reader->numChannels, (int)reader->lengthInSamples );
-        reader->read( &buffer, 0, (int)reader->lengthInSamples, 0, true, true );
+        const int numChannels = juce::jmin( (int)reader->numChannels, LUFS_TP_MAX_NB_CHANNELS );
 
-        LufsProcessor processor(reader->numChannels);
+        LufsProcessor processor( numChannels );
         processor.prepareToPlay(sampleRate, bufferSize);
 
-        int offset = 0;
-        while (offset + bufferSize < (int)reader->lengthInSamples)
+        // stream file, so that memory doesn't depend on file length
+        juce::AudioSampleBuffer buffer( numChannels, bufferSize );
+
+        for ( juce::int64 offset = 0 ; offset < reader->lengthInSamples ; offset += bufferSize )
         {
-            juce::AudioSampleBuffer calcBuffer( buffer.getArrayOfWritePointers(), reader->numChannels, offset, bufferSize );
+            const int numSamples = (int)juce::jmin( (juce::int64)bufferSize, reader->lengthInSamples - offset );
+            buffer.setSize( numChannels, numSamples, false, false, true );
+            reader->read( &buffer, 0, numSamples, offset, true, true );
 
-            processor.processBlock(calcBuffer);
-            offset += bufferSize;
+            processor.processBlock(buffer);
+            processor.update();
 
-            for (int i = 0 ; i < calcBuffer.getNumChannels() ; ++i)
+            for (int i = 0 ; i < numChannels ; ++i)
             {
                 if (truePeakDecibelValue < processor.getTruePeakChannelMax(i))
                     truePeakDecibelValue = processor.getTruePeakChannelMax(i);
             }
         }
-
-        delete reader;
     }
 
     return truePeakDecibelValue;
 }
 
 LufsProcessor::LufsProcessor( const int nbChannels )
-    : m_block( nbChannels, 0 )
-    , m_volumeMemory( nbChannels, 0 )
+    : m_volumeMemory( nbChannels, 0 )
     , m_truePeakMemory( nbChannels, 0 )
     , m_sampleRate( 0.0 )
-    , m_nbChannels( nbChannels )
-    , m_maxSize( 0 )
+    , m_nbChannels( juce::jmin( nbChannels, LUFS_TP_MAX_NB_CHANNELS ) )
     , m_processSize( 0 )
     , m_validSize( 0 )
+    , m_historyGeneration( 0 )
     , m_memorySize( 0 )
     , m_sampleSize100ms( 0 ) 
-    , m_squaredInputArray( NULL )
-    , m_momentaryVolumeArray( NULL )
-    , m_shortTermVolumeArray( NULL )
-    , m_integratedVolumeArray( NULL )
-    , m_truePeakArray( NULL )
-    , m_tempBlock( 1, 4096 )
+    , m_measurementFifo( LUFS_MEASUREMENT_FIFO_SIZE )
+    , m_measurements( LUFS_MEASUREMENT_FIFO_SIZE )
+    , m_resetGeneration( 0 )
+    , m_processResetGeneration( 0 )
+    , m_updateResetGeneration( 0 )
+    , m_truePeakEarlyOutLevel( TRUE_PEAK_MIN_LINEAR_VALUE )
+    , m_isLogFileRequested( false )
+    , m_isLogRestoreRequested( false )
+    , m_queuedLogSampleRate( 0.0 )
+    , m_isQueuedLogRestored( false )
+    , m_isLogOpenQueued( false )
+    , m_isLogOpened( false )
+    , m_openedLogNumRecords( 0 )
+    , m_logThread( *this )
+    , m_isLogOpening( false )
+    , m_loggingSampleRate( 0.0 )
+    , m_numLoggedRecords( 0 )
+    , m_isNewSessionRequested( false )
+    , m_sampleFifo( 1 )
+    , m_analysisWakeSize( 1 )
+    , m_isBackgroundAnalysisRequested( false )
+    , m_isRingAnalysis( false )
+    , m_isRingDraining( false )
     , m_paused( false )
 {
     DEBUGPLUGIN_output("LufsProcessor::LufsProcessor %d channels", nbChannels);
 
-    for ( int i = 0 ; i < nbChannels ; ++i )
-    {
-        m_shelveFilterArray.add( BiquadProcessor() );
-        m_highPassFilterArray.add( BiquadProcessor() );
-    }
-
-    m_maxSize = 256 * 1024; // more than 7 hours
-    jassert( m_maxSize * 4 < 0x80000000 );
-    m_squaredInputArray = (float*)malloc( m_maxSize * sizeof( float ) );
-    m_momentaryVolumeArray = (float*)malloc( m_maxSize * sizeof( float ) );
-    m_shortTermVolumeArray = (float*)malloc( m_maxSize * sizeof( float ) );
-    m_integratedVolumeArray = (float*)malloc( m_maxSize * sizeof( float ) );
-    m_truePeakArray = (float*)malloc( m_maxSize * sizeof( float ) );
+    jassert( nbChannels <= LUFS_TP_MAX_NB_CHANNELS );
 
-    m_memArray = (float**)malloc( nbChannels * sizeof( float* ) );
+    memset( m_truePeakMaxPerChannelArray, 0, LUFS_TP_MAX_NB_CHANNELS * sizeof( float ) );
 
-    for ( int i = 0 ; i < nbChannels ; ++i )
-    {
-        m_memArray[ i ] = (float*)malloc( LUFS_PROCESSOR_NB_MEMORY_VALUES * sizeof( float ) );
-        memset( m_memArray[ i ], 0, LUFS_PROCESSOR_NB_MEMORY_VALUES * sizeof( float ) );
+    // host layout is not known yet: default to the usual speaker order for this number of channels
+    setChannelLayout( juce::AudioChannelSet::canonicalChannelSet( m_nbChannels ) );
 
-        m_truePeakPerChannelArray[ i ] = (float*)malloc( m_maxSize * sizeof( float ) );
-        memset( m_truePeakPerChannelArray[ i ], 0, m_maxSize * sizeof( float ) );
-    }
-    memset( m_maxLinArray, 0, nbChannels * sizeof( float ) );
-
-    memset( m_truePeakMaxPerChannelArray, 0, nbChannels * sizeof( float ) );
-
-    reset();
+    resetVolumes();
 }
 
 LufsProcessor::~LufsProcessor()
 {
     DEBUGPLUGIN_output("LufsProcessor::~LufsProcessor");
 
-    free( m_squaredInputArray );
-    free( m_momentaryVolumeArray );
-    free( m_shortTermVolumeArray );
-    free( m_integratedVolumeArray );
-    free( m_truePeakArray );
+    stopAnalysisThread();
 
-    for ( int i = 0 ; i < m_nbChannels ; ++i )
-    {
-        free( m_memArray[ i ] );
-        free( m_truePeakPerChannelArray[ i ] );
-    }
-    free( m_memArray );
+    m_logThread.signalThreadShouldExit();
+    m_logThread.notify();
+    m_logThread.stopThread( LUFS_LOG_STOP_TIMEOUT_MS );
 }
 
 void LufsProcessor::reset()
 {
     DEBUGPLUGIN_output("LufsProcessor::reset");
 
-    const juce::SpinLock::ScopedLockType scopedLock( m_locker );
+    // acted on by processBlock and update, so that no lock is needed on audio thread
+    ++m_resetGeneration;
+}
 
+void LufsProcessor::startNewSession()
+{
+    m_isNewSessionRequested = true;
+    reset();
+}
+
+void LufsProcessor::resetVolumes()
+{
     m_processSize = 0;
-    m_validSize = 0;
-    m_memorySize = 0;
+    m_validSize.store( 0, std::memory_order_release );
+    ++m_historyGeneration;
 
     m_integratedVolume = DEFAULT_MIN_VOLUME;
     m_rangeMin = DEFAULT_MIN_VOLUME;
     m_rangeMax = DEFAULT_MIN_VOLUME;
     m_maxTruePeak = DEFAULT_MIN_VOLUME;
-    m_truePeakProcessor.reset();
 
-    m_sum400ms70.reset();
-    m_sum3s70.reset();
+    m_momentaryHistogram.reset();
+    m_shortTermHistogram.reset();
+    m_momentaryWindowSum = 0.0;
+    m_shortTermWindowSum = 0.0;
 
-    for ( int i = 0 ; i < m_nbChannels ; ++i )
+    m_squaredInputArray.clear();
+    m_momentaryVolumeArray.clear();
+    m_shortTermVolumeArray.clear();
+    m_integratedVolumeArray.clear();
+    m_truePeakArray.clear();
+
+    for ( int i = 0 ; i < LUFS_TP_MAX_NB_CHANNELS ; ++i )
     {
-        m_maxLinArray[ i ]  = 0.f;
+        m_truePeakPerChannelArray[ i ].clear();
         m_truePeakMaxPerChannelArray[ i ] = DEFAULT_MIN_VOLUME;
     }
 
@@ -182,301 +185,1116 @@ void LufsProcessor::reset()
 #endif 
 }
 
-void LufsProcessor::prepareToPlay(const double sampleRate, int samplesPerBlock)
+float LufsProcessor::getChannelWeight( const juce::AudioChannelSet::ChannelType type )
 {
-    DEBUGPLUGIN_output("LufsProcessor::prepareToPlay sampleRate %.1f samplesPerBlock %d", (float)sampleRate, samplesPerBlock);
+    // BS.1770-4: 1.41 (~ +1.5 dB) for channels between 60 and 120 degrees azimuth below 30 degrees elevation,
+    // 0 for low frequency effects, 1 for all other channels (front, rear, height)
+    switch ( type )
+    {
+    case juce::AudioChannelSet::LFE:
+    case juce::AudioChannelSet::LFE2:
+        return 0.f;
+
+    case juce::AudioChannelSet::leftSurround:
+    case juce::AudioChannelSet::rightSurround:
+    case juce::AudioChannelSet::leftSurroundSide:
+    case juce::AudioChannelSet::rightSurroundSide:
+    case juce::AudioChannelSet::wideLeft:
+    case juce::AudioChannelSet::wideRight:
+        return 1.414213f;
 
-    for ( int i = 0 ; i < m_nbChannels ; ++i )
+    default:
+        return 1.f;
+    }
+}
+
+void LufsProcessor::setChannelLayout( const juce::AudioChannelSet & layout )
+{
+    for ( int ch = 0 ; ch < LUFS_TP_MAX_NB_CHANNELS ; ++ch )
     {
-        m_shelveFilterArray.getReference( i ).setFilterParams( (float)sampleRate, BiquadProcessor::HighShelf, 1500.f, 0.5f, 4.f );
-        m_highPassFilterArray.getReference( i ).setFilterParams( (float)sampleRate, BiquadProcessor::HighPass, 60.f, 0.5f, 0.f );
+        m_channelWeights[ ch ] = ch < layout.size() ? getChannelWeight( layout.getTypeOfChannel( ch ) ) : 1.f;
     }
+}
+
+void LufsProcessor::prepareToPlay(const double sampleRate, int samplesPerBlock)
+{
+    DEBUGPLUGIN_output("LufsProcessor::prepareToPlay sampleRate %.1f samplesPerBlock %d", (float)sampleRate, samplesPerBlock);
+
+    // analysis thread uses the memories reallocated below
+    stopAnalysisThread();
+
+    BiquadProcessor shelveFilter;
+    BiquadProcessor highPassFilter;
+    shelveFilter.setFilterParams( (float)sampleRate, BiquadProcessor::HighShelf, 1500.f, 0.5f, 4.f );
+    highPassFilter.setFilterParams( (float)sampleRate, BiquadProcessor::HighPass, 60.f, 0.5f, 0.f );
+
+    m_kWeightingFilter.prepare( m_nbChannels, 2 );
+    shelveFilter.setCascadeSection( m_kWeightingFilter, 0 );
+    highPassFilter.setCascadeSection( m_kWeightingFilter, 1 );
 
-    m_block.setSize( m_nbChannels, 2 * samplesPerBlock );
-    m_volumeMemory.setSize( m_nbChannels, 2 * (int)sampleRate );
-    m_truePeakMemory.setSize( m_nbChannels, 2 * (int)sampleRate );
     m_sampleRate = sampleRate;
     m_sampleSize100ms = (int)( m_sampleRate / 10.0 );
-    reset();
+
+    // the memories hold exactly one 100 ms chunk: write position wraps to 0 each time a chunk is processed
+    m_volumeMemory.setSize( m_nbChannels, m_sampleSize100ms );
+    m_truePeakMemory.setSize( m_nbChannels, m_sampleSize100ms );
+    m_truePeakProcessor.setOversamplingFactor( AudioProcessing::TruePeak::getOversamplingFactor( sampleRate ) );
+    m_truePeakProcessor.prepare( m_nbChannels, m_sampleSize100ms );
+
+    m_sampleRing.setSize( m_nbChannels, juce::jmax( samplesPerBlock, (int)sampleRate * LUFS_SAMPLE_RING_SECONDS ) );
+    m_sampleFifo.setTotalSize( m_sampleRing.getNumSamples() );
+    m_analysisWakeSize = juce::jmax( 1, m_sampleSize100ms / LUFS_ANALYSIS_WAKES_PER_CHUNK );
+
+    // processing is stopped: the partial chunk is dropped here, measurements waiting for update() are kept.
+    // Records are 100 ms whatever the sample rate, so the history goes on too. update() moves the log to a new
+    // session file, whose header has the new sample rate
+    m_memorySize = 0;
+    m_truePeakProcessor.reset();
+
+    // processBlock isn't running, so it starts in the requested mode, with an empty ring
+    m_sampleFifo.reset();
+    m_analysisConfig.update();
+    m_isRingAnalysis = m_isBackgroundAnalysisRequested;
+    m_isRingDraining = false;
+
+    if ( m_isBackgroundAnalysisRequested )
+    {
+        m_analysisThread.reset( new AnalysisThread( *this ) );
+        m_analysisThread->startThread();
+    }
+}
+
+void LufsProcessor::setBackgroundAnalysis( const bool enabled )
+{
+    if ( enabled == m_isBackgroundAnalysisRequested )
+        return;
+
+    DEBUGPLUGIN_output("LufsProcessor::setBackgroundAnalysis %d", (int)enabled);
+
+    m_isBackgroundAnalysisRequested = enabled;
+
+    // the thread is left waiting when disabled, processBlock may still be handing the ring back to itself
+    if ( enabled && m_analysisThread == nullptr )
+    {
+        m_analysisThread.reset( new AnalysisThread( *this ) );
+        m_analysisThread->startThread();
+    }
+
+    m_analysisConfig.getWriteBuffer().m_isBackground = enabled;
+    m_analysisConfig.publish();
+}
+
+void LufsProcessor::stopAnalysisThread()
+{
+    if ( m_analysisThread != nullptr )
+    {
+        m_analysisThread->signalThreadShouldExit();
+        m_analysisThread->notify();
+        m_analysisThread->stopThread( 1000 );
+        m_analysisThread = nullptr;
+    }
+}
+
+void LufsProcessor::AnalysisThread::run()
+{
+    // same floating point mode as the audio thread
+    juce::ScopedNoDenormals noDenormals;
+
+    while ( ! threadShouldExit() )
+    {
+        m_owner.analyseSampleRing();
+
+        // processBlock notifies when the ring reaches m_analysisWakeSize, see writeToSampleRing
+        if ( m_owner.m_sampleFifo.getNumReady() < m_owner.m_analysisWakeSize )
+            wait( -1 );
+    }
+}
+
+void LufsProcessor::updateAnalysisMode()
+{
+    if ( m_analysisConfig.update() )
+    {
+        const bool isBackground = m_analysisConfig.getReadBuffer().m_isBackground;
+
+        if ( isBackground )
+        {
+            // the analysis thread owns the state from here, or still does if the ring wasn't handed back yet
+            m_isRingAnalysis = true;
+            m_isRingDraining = false;
+        }
+        else if ( m_isRingAnalysis )
+        {
+            m_isRingAnalysis = false;
+            m_isRingDraining = true;
+            m_analysisThread->notify();
+        }
+    }
+
+    // the analysis thread is done with the analysis state once it has taken every sample
+    if ( m_isRingDraining && m_sampleFifo.getNumReady() == 0 )
+        m_isRingDraining = false;
 }
 
 void LufsProcessor::processBlock( juce::AudioSampleBuffer& buffer )
+{
+    processBlock( buffer, 0, buffer.getNumSamples() );
+}
+
+void LufsProcessor::processBlock( const juce::AudioSampleBuffer& buffer, const int startSample, const int numSamples )
 {
     jassert( buffer.getNumChannels() <= m_nbChannels );
+    jassert( startSample + numSamples <= buffer.getNumSamples() );
     //DEBUGPLUGIN_output("LufsProcessor::processBlock buffer size %.d", buffer.getNumSamples());
 
     if ( m_paused )
         return;
 
-    const juce::SpinLock::ScopedLockType scopedLock( m_locker );
+    const int numChannels = juce::jmin( buffer.getNumChannels(), m_nbChannels );
+
+    updateAnalysisMode();
 
-    // copy to internal buffer m_block to apply filters, and then copy at the end of m_volumeMemory
-    bool keepExistingContent = false;
-    bool clearExtraSpace = false;
-    bool avoidReallocating = true;
-    m_block.setSize( m_nbChannels, buffer.getNumSamples(), keepExistingContent, clearExtraSpace, avoidReallocating );
+    if ( m_isRingAnalysis )
+        writeToSampleRing( buffer, startSample, numSamples, numChannels );
+    else if ( ! m_isRingDraining )
+        analyseBlock( buffer, startSample, numSamples, numChannels );
+}
+
+void LufsProcessor::writeToSampleRing( const juce::AudioSampleBuffer & buffer, const int startSample, const int numSamples, const int numChannels )
+{
+    // nothing waits on the audio thread: if the analysis thread is late and the ring full, samples are dropped
+    const int numReadyBefore = m_sampleFifo.getNumReady();
+    int start1, size1, start2, size2;
+    m_sampleFifo.prepareToWrite( numSamples, start1, size1, start2, size2 );
 
     for ( int i = 0 ; i < m_nbChannels ; ++i )
     {
-        if ( i >= buffer.getNumChannels() )
-            continue;
+        if ( i < numChannels )
+        {
+            if ( size1 > 0 ) m_sampleRing.copyFrom( i, start1, buffer, i, startSample, size1 );
+            if ( size2 > 0 ) m_sampleRing.copyFrom( i, start2, buffer, i, startSample + size1, size2 );
+        }
+        else
+        {
+            if ( size1 > 0 ) m_sampleRing.clear( i, start1, size1 );
+            if ( size2 > 0 ) m_sampleRing.clear( i, start2, size2 );
+        }
+    }
 
-        // copy to internal buffer
-        m_block.copyFrom( i, 0, buffer, i, 0, buffer.getNumSamples() );
+    m_sampleFifo.finishedWrite( size1 + size2 );
 
-        // apply high shelf
-        m_shelveFilterArray.getReference( i ).process( m_block.getWritePointer( i ), m_block.getNumSamples() );
-        
-        // apply high pass
-        m_highPassFilterArray.getReference( i ).process( m_block.getWritePointer( i ), m_block.getNumSamples() );
+    // woken once each time the ring reaches the wake size, the analysis thread then takes all of it
+    if ( numReadyBefore < m_analysisWakeSize && numReadyBefore + size1 + size2 >= m_analysisWakeSize )
+        m_analysisThread->notify();
+}
+
+void LufsProcessor::analyseSampleRing()
+{
+    int start1, size1, start2, size2;
+    m_sampleFifo.prepareToRead( m_sampleFifo.getNumReady(), start1, size1, start2, size2 );
 
-        // copy block at the end of m_volumeMemory 
-        m_volumeMemory.copyFrom( i, m_memorySize, m_block, i, 0, m_block.getNumSamples() );
+    if ( size1 > 0 )
+        analyseBlock( m_sampleRing, start1, size1, m_nbChannels );
+    if ( size2 > 0 )
+        analyseBlock( m_sampleRing, start2, size2, m_nbChannels );
+
+    m_sampleFifo.finishedRead( size1 + size2 );
+}
+
+void LufsProcessor::analyseBlock( const juce::AudioSampleBuffer & buffer, const int startSample, const int numSamples, const int numChannels )
+{
+    // reset requested from another thread
+    const int resetGeneration = m_resetGeneration.get();
+    if ( resetGeneration != m_processResetGeneration )
+    {
+        m_processResetGeneration = resetGeneration;
+        m_memorySize = 0;
+        m_truePeakProcessor.reset();
     }
 
-    // copy buffer to m_truePeakMemory 
+    jassert( m_sampleSize100ms > 0 ); // prepareToPlay not called
+    if ( m_sampleSize100ms <= 0 )
+        return;
 
-    for ( int i = 0 ; i < m_nbChannels ; ++i )
+    const int endSample = startSample + numSamples;
+    int offset = startSample;
+
+    while ( offset < endSample )
+    {
+        // fill memories up to the end of current 100 ms chunk
+        const int size = juce::jmin( endSample - offset, m_sampleSize100ms - m_memorySize );
+
+        // apply high shelf and high pass, written directly to m_volumeMemory
+        m_kWeightingFilter.process( buffer, offset, m_volumeMemory, m_memorySize, numChannels, size );
+
+        for ( int i = 0 ; i < numChannels ; ++i )
+        {
+            m_truePeakMemory.copyFrom( i, m_memorySize, buffer, i, offset, size );
+        }
+
+        m_memorySize += size;
+        offset += size;
+
+        if ( m_memorySize == m_sampleSize100ms )
+        {
+            processChunk100ms( numChannels );
+            m_memorySize = 0;
+        }
+    }
+}
+
+double LufsProcessor::getSumOfSquares( const float * data, const int numSamples )
+{
+    // independent partial sums, so that successive multiply-adds don't wait for each other
+    float sum0 = 0.f, sum1 = 0.f, sum2 = 0.f, sum3 = 0.f;
+
+    const int numBlockSamples = numSamples & ~3;
+    for ( int s = 0 ; s < numBlockSamples ; s += 4 )
     {
-        if ( i >= buffer.getNumChannels() )
-            continue;
+        sum0 += data[ s ] * data[ s ];
+        sum1 += data[ s + 1 ] * data[ s + 1 ];
+        sum2 += data[ s + 2 ] * data[ s + 2 ];
+        sum3 += data[ s + 3 ] * data[ s + 3 ];
+    }
+    for ( int s = numBlockSamples ; s < numSamples ; ++s )
+    {
+        sum0 += data[ s ] * data[ s ];
+    }
+
+    return double( sum0 ) + double( sum1 ) + double( sum2 ) + double( sum3 );
+}
+
+void LufsProcessor::processChunk100ms( const int numChannels )
+{
+    double sum = 0.0;
 
-        m_truePeakMemory.copyFrom( i, m_memorySize, buffer, i, 0, buffer.getNumSamples() );
+    // weights come from the channel layout, see setChannelLayout
+    for ( int i = 0 ; i < numChannels ; ++i )
+    {
+        const float weightingCoef = m_channelWeights[ i ];
+
+        if ( weightingCoef != 0.f )
+            sum += weightingCoef * getSumOfSquares( m_volumeMemory.getReadPointer( i ), m_sampleSize100ms );
     }
 
-    m_memorySize += buffer.getNumSamples();
+    // process peak
+    m_truePeakProcessor.setEarlyOutLevel( m_truePeakEarlyOutLevel.load( std::memory_order_relaxed ) );
+    AudioProcessing::TruePeak::LinearValue truePeakValue = m_truePeakProcessor.process( m_truePeakMemory );
+
+    pushMeasurement( float( sum / m_sampleSize100ms ), truePeakValue, numChannels );
+}
 
-    if ( m_memorySize < m_sampleSize100ms )
+void LufsProcessor::pushMeasurement( const float squaredInput, const AudioProcessing::TruePeak::LinearValue& value, const int numChannels )
+{
+    int start1, size1, start2, size2;
+    m_measurementFifo.prepareToWrite( 1, start1, size1, start2, size2 );
+
+    if ( size1 + size2 == 0 )
     {
-        // we don't have enough data in m_volumeMemory/m_truePeakMemory to process 100 ms
+        // update() not called for a long time, measurement is lost
         return;
     }
 
+    Measurement & measurement = m_measurements[ size1 ? start1 : start2 ];
+    measurement.m_squaredInput = squaredInput;
+    measurement.m_truePeak = value;
+    measurement.m_numChannels = numChannels;
+    measurement.m_resetGeneration = m_processResetGeneration;
+
+    m_measurementFifo.finishedWrite( 1 );
+}
+
+void LufsProcessor::addSquaredInputAndTruePeak( const float squaredInput, const AudioProcessing::TruePeak::LinearValue& value, const int numChannels )
+{
+    m_squaredInputArray.set( m_processSize, squaredInput );
 
-    // process chunks of 100 ms of data 
+    float decibelTruePeak = getDecibelVolumeFromLinearVolume( value.getMax() ); 
+    m_truePeakArray.set( m_processSize, decibelTruePeak );
 
-    int sizeDone = 0 ;
+    if ( decibelTruePeak > m_maxTruePeak )
+        m_maxTruePeak = decibelTruePeak;
 
-    int nbChannels = m_nbChannels > 6 ? 6 : m_nbChannels;
-    while ( m_memorySize - sizeDone >= m_sampleSize100ms )
+    const int numTruePeakChannels = juce::jmin( numChannels, LUFS_TP_MAX_NB_CHANNELS );
+    for ( int ch = 0 ; ch < numTruePeakChannels ; ++ch )
     {
-        float sum = 0.f;
-        
-        for ( int i = 0 ; i < nbChannels ; ++i )
-        {
-            if ( i >= buffer.getNumChannels() )
-                continue;
+        float channelLinearTruePeak = value.m_channelArray[ch];
+        float channelDecibelTruePeak = getDecibelVolumeFromLinearVolume( channelLinearTruePeak ); 
 
-            float weightingCoef = 0.f; 
-            
-            // kSpeakerArr51 is "L R C Lfe Ls Rs";
-            switch ( i )
-            {
-            case 0: // L
-            case 1: // R
-            case 2: // C
-                weightingCoef = 1.f;
-                break;
-            case 3: // Lfe
-                weightingCoef = 0.f;
-                break;
-            case 4: // Ls
-            case 5: // Rs
-                weightingCoef = 1.414213f; // 1.41 (~ +1.5 dB) for left and right surround channels 
-                break;
-            }
+        m_truePeakPerChannelArray[ch].set( m_processSize, channelDecibelTruePeak );
 
-            const float * data = &( m_volumeMemory.getReadPointer( i )[ sizeDone ] );
+        if ( channelDecibelTruePeak > m_truePeakMaxPerChannelArray[ch] )
+            m_truePeakMaxPerChannelArray[ch] = channelDecibelTruePeak;
+    }
+    for ( int ch = numTruePeakChannels ; ch < m_nbChannels ; ++ch )
+    {
+        m_truePeakPerChannelArray[ch].set( m_processSize, DEFAULT_MIN_VOLUME );
+    }
 
-            for ( int s = 0 ; s < m_sampleSize100ms ; ++s )
-            {
-                const float value = *data;
-                sum += value * value * weightingCoef;
-                ++data;
-            }
-        }
+    ++m_processSize;
+}
 
-        // process peak
-        const juce::AudioSampleBuffer hundredMillisecondBuffer( m_truePeakMemory.getArrayOfWritePointers(), m_truePeakMemory.getNumChannels(), sizeDone, m_sampleSize100ms );
-        AudioProcessing::TruePeak::LinearValue truePeakValue = m_truePeakProcessor.process( hundredMillisecondBuffer );
+void LufsProcessor::update()
+{
+    //DEBUGPLUGIN_output("LufsProcessor::update");
 
-        addSquaredInputAndTruePeak( sum / m_sampleSize100ms, truePeakValue, buffer.getNumChannels() );
+    // while the log thread opens the file and restores its records, volumes and history are its own: measurements
+    // wait in the fifo, so that none are left out of the log, and a reset waits too
+    if ( m_isLogOpening )
+    {
+        if ( ! takeOpenedLog() )
+            return;
 
-        sizeDone += m_sampleSize100ms;
+        m_isLogOpening = false;
+    }
 
-        if ( ( sizeDone + m_sampleSize100ms ) > m_memorySize )
-            break;
+    const int resetGeneration = m_resetGeneration.get();
+    if ( resetGeneration != m_updateResetGeneration )
+    {
+        m_updateResetGeneration = resetGeneration;
+        resetVolumes();
+
+        // the user's reset: the log of the measurement that was reset is kept
+        if ( m_isNewSessionRequested.exchange( false ) && m_loggingFile != juce::File() && m_numLoggedRecords > 0 )
+            requestLogFile( juce::File(), m_loggingFile.getParentDirectory(), false );
     }
 
-    // copy remaining samples to beginning of m_volumeMemory 
+    // the header holds the sample rate: after a change, logging goes on in a new session file, history is kept
+    if ( m_loggingFile != juce::File() && m_sampleSize100ms > 0 && m_sampleRate != m_loggingSampleRate )
+        requestLogFile( juce::File(), m_loggingFile.getParentDirectory(), false );
 
-    const int remaining = m_memorySize - sizeDone;
-    jassert( remaining >= 0 );
+    // log file requested from another thread, once the sample rate is known
+    if ( m_sampleSize100ms > 0 )
+        queueLogFile();
 
-    for ( int i = 0 ; i < m_nbChannels ; ++i )
+    if ( m_isLogOpening )
+        return;
+
+    // read measurements sent by processBlock
+    int start1, size1, start2, size2;
+    m_measurementFifo.prepareToRead( m_measurementFifo.getNumReady(), start1, size1, start2, size2 );
+
+    for ( int i = 0 ; i < size1 + size2 ; ++i )
     {
-        float * dest = m_volumeMemory.getWritePointer( i );
-        float * src = &dest[ sizeDone ];
+        const Measurement & measurement = m_measurements[ i < size1 ? start1 + i : start2 + i - size1 ];
 
-        for ( int s = 0 ; s < remaining ; ++s )
-        {
-            *dest++ = *src++;
-        }
+        if ( measurement.m_resetGeneration == m_updateResetGeneration )
+            addSquaredInputAndTruePeak( measurement.m_squaredInput, measurement.m_truePeak, measurement.m_numChannels );
     }
 
-    // copy remaining samples to beginning of m_truePeakMemory too
+    m_measurementFifo.finishedRead( size1 + size2 );
 
-    for ( int i = 0 ; i < m_nbChannels ; ++i )
+    const bool isLogging = m_loggingFile != juce::File();
+    const bool hasNewPositions = m_validSize < m_processSize;
+
+    while ( m_validSize < m_processSize )
     {
-        float * dest = m_truePeakMemory.getWritePointer( i );
-        float * src = &dest[ sizeDone ];
+        updatePosition( m_validSize );
 
-        for ( int s = 0 ; s < remaining ; ++s )
-        {
-            *dest++ = *src++;
-        }
+        if ( isLogging )
+            appendToLog( m_validSize );
+
+        m_validSize.store( m_validSize.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
     }
 
-    m_memorySize = remaining;
+    if ( isLogging && hasNewPositions )
+        m_logThread.notify();
 }
 
-void LufsProcessor::addSquaredInputAndTruePeak( const float squaredInput, const AudioProcessing::TruePeak::LinearValue& value, const int numChannels )
+void LufsProcessor::setLogFile( const juce::File & file )
+{
+    requestLogFile( file, juce::File(), true );
+}
+
+void LufsProcessor::startLogSession( const juce::File & directory )
+{
+    requestLogFile( juce::File(), directory, true );
+}
+
+void LufsProcessor::requestLogFile( const juce::File & file, const juce::File & directory, const bool restoreRecords )
+{
+    const juce::ScopedLock lock( m_logLock );
+    m_logFile = file;
+    m_logDirectory = directory;
+    m_isLogRestoreRequested = restoreRecords;
+    m_isLogFileRequested = true;
+}
+
+juce::File LufsProcessor::getLogFile() const
+{
+    const juce::ScopedLock lock( m_logLock );
+    return m_logFile;
+}
+
+// update() thread: hands a requested log file to the log thread
+void LufsProcessor::queueLogFile()
 {
-    if ( m_processSize < m_maxSize )
     {
-        m_squaredInputArray[ m_processSize ] = squaredInput;
+        const juce::ScopedLock lock( m_logLock );
 
-        float decibelTruePeak = getDecibelVolumeFromLinearVolume( value.getMax() ); 
-        m_truePeakArray[ m_processSize ] = decibelTruePeak;
+        if ( ! m_isLogFileRequested )
+            return;
 
-        if ( decibelTruePeak > m_maxTruePeak )
-            m_maxTruePeak = decibelTruePeak;
+        m_isLogFileRequested = false;
+        m_queuedLogFile = m_logFile;
+        m_queuedLogDirectory = m_logDirectory;
+        m_queuedLogSampleRate = m_sampleRate;
+        m_isQueuedLogRestored = m_isLogRestoreRequested;
+        m_isLogOpenQueued = true;
+    }
 
-        for ( int ch = 0 ; ch < numChannels ; ++ch )
-        {
-            float channelLinearTruePeak = value.m_channelArray[ch];
-            float channelDecibelTruePeak = getDecibelVolumeFromLinearVolume( channelLinearTruePeak ); 
+    m_isLogOpening = true;
+    m_loggingSampleRate = m_sampleRate;
 
-            m_truePeakPerChannelArray[ch][ m_processSize ] = channelDecibelTruePeak;
+    if ( ! m_logThread.isThreadRunning() )
+        m_logThread.startThread();
 
-            if ( channelDecibelTruePeak > m_truePeakMaxPerChannelArray[ch] )
-                m_truePeakMaxPerChannelArray[ch] = channelDecibelTruePeak;
-        }
-        for ( int ch = numChannels ; ch < LUFS_TP_MAX_NB_CHANNELS ; ++ch )
+    m_logThread.notify();
+}
+
+// update() thread: true once the log thread has opened the queued file, or failed to, and restored its records
+bool LufsProcessor::takeOpenedLog()
+{
+    const juce::ScopedLock lock( m_logLock );
+
+    if ( ! m_isLogOpened )
+        return false;
+
+    m_isLogOpened = false;
+    m_loggingFile = m_openedLogFile;
+    m_numLoggedRecords = m_openedLogNumRecords;
+    return true;
+}
+
+void LufsProcessor::LogThread::run()
+{
+    // records queued before the processor is deleted are written too
+    for ( ;; )
+    {
+        const bool shouldExit = threadShouldExit();
+        m_owner.writeLog();
+
+        if ( shouldExit )
         {
-            m_truePeakPerChannelArray[ch][ m_processSize ] = DEFAULT_MIN_VOLUME;
+            // the write lock is released by the thread that took it
+            m_owner.m_log.close();
+            return;
         }
 
-        ++m_processSize;
+        wait( -1 );
     }
 }
 
-void LufsProcessor::update()
+// log thread: appends the records queued so far, which belong to the current file, then opens the queued file
+void LufsProcessor::writeLog()
 {
-    //DEBUGPLUGIN_output("LufsProcessor::update");
+    bool isOpenQueued;
+    bool restoreRecords;
+    juce::File file;
+    juce::File directory;
+    double sampleRate;
+    {
+        const juce::ScopedLock lock( m_logLock );
+        m_logRecords.swap( m_logQueue );
+        isOpenQueued = m_isLogOpenQueued;
+        m_isLogOpenQueued = false;
+        restoreRecords = m_isQueuedLogRestored;
+        file = m_queuedLogFile;
+        directory = m_queuedLogDirectory;
+        sampleRate = m_queuedLogSampleRate;
+    }
 
-    int size = m_processSize;
+    const size_t recordSize = (size_t)( 2 + m_nbChannels );
 
-    while ( m_validSize < size )
+    for ( size_t record = 0 ; record + recordSize <= m_logRecords.size() && m_log.isOpen() ; record += recordSize )
     {
-        updatePosition( m_validSize );
-        ++m_validSize;
+        m_log.append( m_logRecords[ record ], m_logRecords[ record + 1 ], &m_logRecords[ record + 2 ] );
+    }
+
+    // capacity is kept, the vectors are swapped again next time
+    m_logRecords.clear();
+
+    if ( isOpenQueued )
+    {
+        openLog( file, directory, sampleRate );
+
+        // update() doesn't touch volumes or history until m_isLogOpened is set: the records are replayed here,
+        // and update() takes over finished histograms and history
+        if ( restoreRecords && m_log.isOpen() )
+            restore( m_log );
+
+        const juce::ScopedLock lock( m_logLock );
+        if ( ! m_isLogFileRequested )
+            m_logFile = m_log.getFile();
+        m_openedLogFile = m_log.getFile();
+        m_openedLogNumRecords = m_log.getNumRecords();
+        m_isLogOpened = true;
+    }
+}
+
+// log thread: an empty file and directory just close the log
+void LufsProcessor::openLog( const juce::File & file, const juce::File & directory, const double sampleRate )
+{
+    DEBUGPLUGIN_output("LufsProcessor::openLog %s", file.getFullPathName().toRawUTF8());
+
+    m_log.close();
+
+    juce::File logFile = file;
+
+    if ( logFile == juce::File() && directory != juce::File() )
+        logFile = LufsLog::createSessionFile( directory );
+
+    if ( logFile != juce::File() && ! m_log.openForWriting( logFile, m_nbChannels, sampleRate ) )
+    {
+        // other layout or sample rate, not a log, or written by another instance: it's kept, and a new session starts beside it
+        m_log.openForWriting( LufsLog::createSessionFile( logFile.getParentDirectory() ), m_nbChannels, sampleRate );
+    }
+}
+
+// update() thread: queued for the log thread, which is notified once all new positions are queued
+void LufsProcessor::appendToLog( const int position )
+{
+    const juce::ScopedLock lock( m_logLock );
+
+    m_logQueue.push_back( m_squaredInputArray[ position ] );
+    m_logQueue.push_back( m_integratedVolumeArray[ position ] );
+
+    for ( int ch = 0 ; ch < m_nbChannels ; ++ch )
+    {
+        m_logQueue.push_back( m_truePeakPerChannelArray[ ch ][ position ] );
     }
+
+    ++m_numLoggedRecords;
 }
 
-void LufsProcessor::updatePosition( int position )
+void LufsProcessor::restore( const LufsLog & log )
+{
+    resetVolumes();
+
+    const int numChannels = juce::jmin( log.getNumChannels(), m_nbChannels );
+    const int numRecords = log.getNumRecords();
+
+    // same values as update() gave when the records were written, but gating is evaluated once, at the end
+    for ( int position = 0 ; position < numRecords ; ++position )
+    {
+        float truePeak = DEFAULT_MIN_VOLUME;
+
+        for ( int ch = 0 ; ch < m_nbChannels ; ++ch )
+        {
+            const float channelTruePeak = ch < numChannels ? log.getTruePeak( position, ch ) : DEFAULT_MIN_VOLUME;
+
+            m_truePeakPerChannelArray[ ch ].set( position, channelTruePeak );
+
+            if ( channelTruePeak > m_truePeakMaxPerChannelArray[ ch ] )
+                m_truePeakMaxPerChannelArray[ ch ] = channelTruePeak;
+
+            truePeak = juce::jmax( truePeak, channelTruePeak );
+        }
+
+        m_truePeakArray.set( position, truePeak );
+
+        if ( truePeak > m_maxTruePeak )
+            m_maxTruePeak = truePeak;
+
+        m_squaredInputArray.set( position, log.getSquaredInput( position ) );
+
+        updatePosition( position, false );
+        m_integratedVolumeArray.set( position, log.getIntegratedVolume( position ) );
+    }
+
+    m_processSize = numRecords;
+    m_validSize.store( numRecords, std::memory_order_release );
+
+    if ( numRecords > 0 )
+    {
+        updateIntegratedVolume( numRecords - 1 );
+        updateRange();
+    }
+}
+
+void LufsProcessor::updatePosition( int position, const bool updateGating )
 {
     //DEBUGPLUGIN_output("LufsProcessor::updatePosition position %d", position);
 
+    // update running windows: sums of the 4 and 30 values before position
+
+    if ( position >= 1 )
+    {
+        m_momentaryWindowSum += m_squaredInputArray[ position - 1 ];
+        m_shortTermWindowSum += m_squaredInputArray[ position - 1 ];
+    }
+    if ( position >= 5 )
+        m_momentaryWindowSum -= m_squaredInputArray[ position - 5 ];
+    if ( position >= 31 )
+        m_shortTermWindowSum -= m_squaredInputArray[ position - 31 ];
+
     // m_momentaryVolume 
-    m_integratedVolumeArray[ position ] = DEFAULT_MIN_VOLUME;
+    m_integratedVolumeArray.set( position, DEFAULT_MIN_VOLUME );
 
     if ( position >= 4 )
     {
         // momentary, abbreviated M (400 ms)
 
-        float sum = 0.f;
-        for ( int i = position - 4 ; i < position ; ++i )
-        {
-            sum += m_squaredInputArray[ i ];
-        }
-        sum /= 4;
+        const float sum = float( juce::jmax( m_momentaryWindowSum, 0.0 ) / 4 );
 
-        m_momentaryVolumeArray[ position ] = juce::jmax( float(-0.691 + 10.*std::log10( sum ) ), DEFAULT_MIN_VOLUME );
+        const float momentaryVolume = juce::jmax( float(-0.691 + 10.*std::log10( sum ) ), DEFAULT_MIN_VOLUME );
+        m_momentaryVolumeArray.set( position, momentaryVolume );
         
-        if ( m_momentaryVolumeArray[ position ] > -70.f )
+        if ( momentaryVolume > -70.f )
         {
-            //DBG( juce::String( "Adding 1 " ) + juce::String( sum ) );
-            m_sum400ms70.addLufs( sum );
+            m_momentaryHistogram.add( momentaryVolume, sum );
         }
 
-        if ( m_sum400ms70.size() )
-        {
-            const float absoluteSum = m_sum400ms70.getSum() / (float) m_sum400ms70.size();
-            const float absoluteThresholdVolume = getLufsVolume( absoluteSum ) -10.f;
-            const float thresholdSum = getLufsSum( absoluteThresholdVolume );
+        if ( updateGating )
+            updateIntegratedVolume( position );
+    }
+    else
+    {
+        m_momentaryVolumeArray.set( position, DEFAULT_MIN_VOLUME );
+    }
 
-            const int index = m_sum400ms70.findIndexAfterValue( thresholdSum );
 
-            float relativeSum = 0.f;
-            for ( int i = index ; i < m_sum400ms70.size() ; ++i )
-            {
-                //DBG( juce::String( "relativeSum adding " ) + juce::String( m_sum400ms70.getUnchecked( i ) ) );
-                relativeSum += m_sum400ms70.getUnchecked( i );
-            }
+    // short term, abbreviated S (3 s)
 
-            if ( m_sum400ms70.size() - index )
-                relativeSum /= ( m_sum400ms70.size() - index );
+    if ( position >= 30 )
+    {
+        const float sum = float( juce::jmax( m_shortTermWindowSum, 0.0 ) / 30 );
+        const float shortTermVolume = juce::jmax( float(-0.691 + 10.*std::log10( sum ) ), DEFAULT_MIN_VOLUME );
+        m_shortTermVolumeArray.set( position, shortTermVolume );
 
-            //DBG( juce::String( "relativeSum " ) + juce::String( relativeSum ) );
-            
-            m_integratedVolume = getLufsVolume( relativeSum );
-            m_integratedVolumeArray[ position ] = m_integratedVolume;
+        if ( shortTermVolume > -70.f )
+        {
+            m_shortTermHistogram.add( shortTermVolume, sum );
         }
+
+        if ( updateGating )
+            updateRange();
     }
     else
     {
-        m_momentaryVolumeArray[ position ] = DEFAULT_MIN_VOLUME;
+        m_shortTermVolumeArray.set( position, DEFAULT_MIN_VOLUME );
     }
+}
 
+void LufsProcessor::updateIntegratedVolume( const int position )
+{
+    if ( m_momentaryHistogram.size() )
+    {
+        const float absoluteSum = float( m_momentaryHistogram.getSum() / (double) m_momentaryHistogram.size() );
+        const float absoluteThresholdVolume = getLufsVolume( absoluteSum ) -10.f;
 
-    // short term, abbreviated S (3 s)
+        const float relativeSum = float( m_momentaryHistogram.getMeanAboveVolume( absoluteThresholdVolume ) );
+        
+        m_integratedVolume = getLufsVolume( relativeSum );
+        m_integratedVolumeArray.set( position, m_integratedVolume );
+    }
+}
 
-    if ( position >= 30 )
+void LufsProcessor::updateRange()
+{
+    if ( m_shortTermHistogram.size() )
     {
-        float sum = 0.f;
-        for ( int i = position - 30 ; i < position ; ++i )
-        {
-            sum += m_squaredInputArray[ i ];
-        }
-        sum /= 30;
-        m_shortTermVolumeArray[ position ] = juce::jmax( float(-0.691 + 10.*std::log10( sum ) ), DEFAULT_MIN_VOLUME );
+        const float absoluteSum = float( m_shortTermHistogram.getSum() / (double) m_shortTermHistogram.size() );
+        const float absoluteThresholdVolume = getLufsVolume( absoluteSum ) -20.f;
+
+        m_rangeMin = m_shortTermHistogram.getPercentileVolumeAboveVolume( absoluteThresholdVolume, 0.1f );
+        m_rangeMax = m_shortTermHistogram.getPercentileVolumeAboveVolume( absoluteThresholdVolume, 0.95f );
+    }
+}
+
+
+// LufsLog implementation 
+
+// files open for writing by a LufsLog of this process, guarded by s_writingLogFilesLock
+static juce::Array<juce::File> s_writingLogFiles;
+static juce::CriticalSection s_writingLogFilesLock;
+
+LufsLog::LufsLog()
+    : m_header( nullptr )
+    , m_recordSize( 0 )
+    , m_capacity( 0 )
+    , m_isWritable( false )
+{
+}
+
+LufsLog::~LufsLog()
+{
+    close();
+}
 
-        if ( m_shortTermVolumeArray[ position ] > -70.f )
+bool LufsLog::openForWriting( const juce::File & file, const int numChannels, const double sampleRate )
+{
+    close();
+
+    // one writer per file: another instance, in this host or another process, starts its own session
+    if ( ! claim( file ) )
+        return false;
+
+    // getSize() is 0 when the file doesn't exist
+    const bool isNewFile = file.getSize() == 0;
+    Header header;
+
+    if ( isNewFile )
+    {
+        if ( file.create().failed() )
         {
-            m_sum3s70.addLufs( sum );
+            close();
+            return false;
         }
+    }
+    else if ( ! readHeader( file, header ) || header.m_numChannels != numChannels || header.m_sampleRate != sampleRate )
+    {
+        close();
+        return false;
+    }
 
-        if ( m_sum3s70.size() )
-        {
-            const float absoluteSum = m_sum3s70.getSum() / (float) m_sum3s70.size();
-            const float absoluteThresholdVolume = getLufsVolume( absoluteSum ) -20.f;
-            const float thresholdSum = getLufsSum( absoluteThresholdVolume );
+    m_file = file;
+    m_recordSize = 2 + numChannels;
+    m_isWritable = true;
 
-            const int index = m_sum3s70.findIndexAfterValue( thresholdSum );
+    if ( ! map( ( isNewFile ? 0 : header.m_numRecords ) + LUFS_LOG_GROW_RECORDS, juce::MemoryMappedFile::readWrite ) )
+    {
+        close();
+        return false;
+    }
 
-            const float sumPercentile10 = m_sum3s70.getPercentileValue( index, 0.1f );
-            const float sumPercentile95 = m_sum3s70.getPercentileValue( index, 0.95f );
+    if ( isNewFile )
+    {
+        memcpy( m_header->m_magic, "DCLL", 4 );
+        m_header->m_version = LUFS_LOG_VERSION;
+        m_header->m_numChannels = numChannels;
+        m_header->m_reserved = 0;
+        m_header->m_sampleRate = sampleRate;
+        m_header->m_numRecords = 0;
+    }
 
-            m_rangeMin = getLufsVolume( sumPercentile10 );
-            m_rangeMax = getLufsVolume( sumPercentile95 );
-        }
+    return true;
+}
 
+bool LufsLog::openForReading( const juce::File & file )
+{
+    close();
+
+    Header header;
+    if ( ! readHeader( file, header ) )
+        return false;
+
+    m_file = file;
+    m_recordSize = 2 + header.m_numChannels;
+
+    if ( ! map( header.m_numRecords, juce::MemoryMappedFile::readOnly ) )
+    {
+        close();
+        return false;
     }
-    else
+
+    return true;
+}
+
+void LufsLog::close()
+{
+    // records are in the page cache already, the system writes them to disk
+    m_map = nullptr;
+    m_header = nullptr;
+    m_file = juce::File();
+    m_capacity = 0;
+    m_isWritable = false;
+
+    release();
+}
+
+bool LufsLog::claim( const juce::File & file )
+{
+    const juce::ScopedLock lock( s_writingLogFilesLock );
+
+    if ( s_writingLogFiles.contains( file ) )
+        return false;
+
+    // system wide, for instances in other processes. Per process on some systems, hence s_writingLogFiles
+    std::unique_ptr<juce::InterProcessLock> writeLock( new juce::InterProcessLock( "DreamControl_lufslog_" + juce::String::toHexString( file.getFullPathName().hashCode64() ) ) );
+    if ( ! writeLock->enter( 0 ) )
+        return false;
+
+    s_writingLogFiles.add( file );
+    m_writeLock = std::move( writeLock );
+    m_claimedFile = file;
+    return true;
+}
+
+void LufsLog::release()
+{
+    if ( m_writeLock == nullptr )
+        return;
+
+    const juce::ScopedLock lock( s_writingLogFilesLock );
+
+    s_writingLogFiles.removeFirstMatchingValue( m_claimedFile );
+    m_writeLock->exit();
+    m_writeLock = nullptr;
+    m_claimedFile = juce::File();
+}
+
+int LufsLog::getNumChannels() const
+{
+    return m_header != nullptr ? m_header->m_numChannels : 0;
+}
+
+double LufsLog::getSampleRate() const
+{
+    return m_header != nullptr ? m_header->m_sampleRate : 0.0;
+}
+
+int LufsLog::getNumRecords() const
+{
+    return m_header != nullptr ? (int)m_header->m_numRecords : 0;
+}
+
+void LufsLog::append( const float squaredInput, const float integratedVolume, const float * truePeaks )
+{
+    jassert( m_isWritable );
+
+    if ( m_header == nullptr || ! m_isWritable )
+        return;
+
+    const juce::int64 record = m_header->m_numRecords;
+
+    if ( record >= m_capacity && ! map( m_capacity + LUFS_LOG_GROW_RECORDS, juce::MemoryMappedFile::readWrite ) )
     {
-        m_shortTermVolumeArray[ position ] = DEFAULT_MIN_VOLUME;
+        // disk full or file removed: logging stops, records written so far are kept
+        close();
+        return;
     }
+
+    float * values = getRecord( record );
+    values[ 0 ] = squaredInput;
+    values[ 1 ] = integratedVolume;
+    memcpy( values + 2, truePeaks, ( m_recordSize - 2 ) * sizeof( float ) );
+
+    m_header->m_numRecords = record + 1;
+}
+
+juce::File LufsLog::createSessionFile( const juce::File & directory )
+{
+    directory.createDirectory();
+
+    const juce::String name = juce::Time::getCurrentTime().formatted( "%Y-%m-%d %H-%M-%S" );
+    const juce::File file = directory.getNonexistentChildFile( name, LUFS_LOG_FILE_EXTENSION, false );
+
+    // created empty, so that an instance starting a session in the same second gets another name
+    file.create();
+    return file;
+}
+
+bool LufsLog::readHeader( const juce::File & file, Header & header )
+{
+    juce::FileInputStream stream( file );
+
+    if ( ! stream.openedOk() || stream.read( &header, sizeof( Header ) ) != (int)sizeof( Header ) )
+        return false;
+
+    return memcmp( header.m_magic, "DCLL", 4 ) == 0
+        && header.m_version == LUFS_LOG_VERSION
+        && header.m_numChannels > 0 && header.m_numChannels <= LUFS_TP_MAX_NB_CHANNELS
+        && header.m_numRecords >= 0
+        && file.getSize() >= LUFS_LOG_HEADER_SIZE + header.m_numRecords * ( 2 + header.m_numChannels ) * (juce::int64)sizeof( float );
+}
+
+bool LufsLog::map( const juce::int64 capacity, const juce::MemoryMappedFile::AccessMode mode )
+{
+    m_map = nullptr;
+    m_header = nullptr;
+
+    const juce::int64 size = LUFS_LOG_HEADER_SIZE + capacity * m_recordSize * (juce::int64)sizeof( float );
+
+    if ( mode == juce::MemoryMappedFile::readWrite && m_file.getSize() < size )
+    {
+        // extends the file, records read as zeros until written
+        juce::FileOutputStream stream( m_file );
+
+        if ( ! stream.openedOk() || ! stream.setPosition( size - 1 ) || ! stream.writeByte( 0 ) )
+            return false;
+    }
+
+    m_map.reset( new juce::MemoryMappedFile( m_file, juce::Range<juce::int64>( 0, size ), mode ) );
+
+    if ( m_map->getData() == nullptr || (juce::int64)m_map->getSize() < size )
+    {
+        m_map = nullptr;
+        return false;
+    }
+
+    m_header = (Header*)m_map->getData();
+    m_capacity = capacity;
+    return true;
+}
+
+
+// LufsHistoryArray implementation 
+
+LufsHistoryArray::LufsHistoryArray()
+    : m_size( 0 )
+{
+    for ( int i = 0 ; i < LUFS_HISTORY_MAX_CHUNKS ; ++i )
+    {
+        m_chunks[ i ].set( nullptr );
+        m_chunkIndices[ i ].set( -1 );
+    }
+}
+
+LufsHistoryArray::~LufsHistoryArray()
+{
+    for ( int i = 0 ; i < LUFS_HISTORY_MAX_CHUNKS ; ++i )
+        free( m_chunks[ i ].get() );
+}
+
+float LufsHistoryArray::operator[]( const int position ) const
+{
+    // only positions published by set(), and not in the oldest chunk, which set() may be recycling
+    const int size = m_size.load( std::memory_order_acquire );
+    if ( position < 0 || position >= size || position < size - ( LUFS_HISTORY_MAX_CHUNKS - 1 ) * LUFS_HISTORY_CHUNK_SIZE )
+        return DEFAULT_MIN_VOLUME;
+
+    const int chunkIndex = position / LUFS_HISTORY_CHUNK_SIZE;
+    const int slot = chunkIndex % LUFS_HISTORY_MAX_CHUNKS;
+
+    if ( m_chunkIndices[ slot ].get() != chunkIndex )
+        return DEFAULT_MIN_VOLUME;
+
+    return m_chunks[ slot ].get()[ position % LUFS_HISTORY_CHUNK_SIZE ];
+}
+
+void LufsHistoryArray::set( const int position, const float value )
+{
+    jassert( position >= 0 );
+
+    const int chunkIndex = position / LUFS_HISTORY_CHUNK_SIZE;
+    const int slot = chunkIndex % LUFS_HISTORY_MAX_CHUNKS;
+
+    float * chunk = getChunk( slot );
+
+    chunk[ position % LUFS_HISTORY_CHUNK_SIZE ] = value;
+
+    // first value of a new chunk: recycles slot (oldest chunk when history is full)
+    if ( m_chunkIndices[ slot ].get() != chunkIndex )
+        m_chunkIndices[ slot ].set( chunkIndex );
+
+    // publishes the value
+    if ( position >= m_size.load( std::memory_order_relaxed ) )
+        m_size.store( position + 1, std::memory_order_release );
+}
+
+void LufsHistoryArray::clear()
+{
+    // readers stop reading before the chunks are released
+    m_size.store( 0, std::memory_order_release );
+
+    for ( int i = 0 ; i < LUFS_HISTORY_MAX_CHUNKS ; ++i )
+        m_chunkIndices[ i ].set( -1 );
+}
+
+float * LufsHistoryArray::getChunk( const int slot )
+{
+    float * chunk = m_chunks[ slot ].get();
+
+    if ( chunk == nullptr )
+    {
+        chunk = (float*)malloc( LUFS_HISTORY_CHUNK_SIZE * sizeof( float ) );
+        m_chunks[ slot ].set( chunk );
+    }
+
+    return chunk;
+}
+
+
+// LufsHistogram implementation 
+
+LufsHistogram::LufsHistogram()
+    : m_binCounts( numBins )
+    , m_binSums( numBins )
+    , m_count( 0 )
+    , m_sum( 0.0 )
+{
+    reset();
+}
+
+void LufsHistogram::add( const float volume, const double sum )
+{
+    const int index = getBinIndex( volume );
+
+    ++m_binCounts[ index ];
+    m_binSums[ index ] += sum;
+
+    ++m_count;
+    m_sum += sum;
+}
+
+double LufsHistogram::getMeanAboveVolume( const float volume ) const
+{
+    int count = 0;
+    double sum = 0.0;
+
+    for ( int i = getBinIndex( volume ) ; i < numBins ; ++i )
+    {
+        count += m_binCounts[ i ];
+        sum += m_binSums[ i ];
+    }
+
+    return count ? sum / count : 0.0;
+}
+
+float LufsHistogram::getPercentileVolumeAboveVolume( const float volume, const float percentile ) const
+{
+    jassert( percentile >= 0.f );
+    jassert( percentile <= 1.f );
+
+    if ( m_count == 0 )
+        return DEFAULT_MIN_VOLUME;
+
+    int beginIndex = getBinIndex( volume );
+
+    // with less than 3 blocks, lowest block is used (as the former sorted array did)
+    if ( m_count <= 2 )
+        beginIndex = 0;
+
+    int count = 0;
+    for ( int i = beginIndex ; i < numBins ; ++i )
+        count += m_binCounts[ i ];
+
+    if ( count == 0 )
+        return DEFAULT_MIN_VOLUME;
+
+    const int rank = m_count <= 2 ? 0 : (int)( percentile * (float)( count - 1 ) );
+
+    int cumulatedCount = 0;
+    for ( int i = beginIndex ; i < numBins ; ++i )
+    {
+        cumulatedCount += m_binCounts[ i ];
+        if ( cumulatedCount > rank )
+            return getBinVolume( i );
+    }
+
+    jassertfalse;
+    return DEFAULT_MIN_VOLUME;
+}
+
+void LufsHistogram::reset()
+{
+    memset( m_binCounts.getData(), 0, numBins * sizeof( int ) );
+    memset( m_binSums.getData(), 0, numBins * sizeof( double ) );
+
+    m_count = 0;
+    m_sum = 0.0;
+}
+
+int LufsHistogram::getBinIndex( const float volume )
+{
+    const int index = (int)std::floor( ( volume - LUFS_HISTOGRAM_MIN_VOLUME ) * LUFS_HISTOGRAM_BINS_PER_LU );
+
+    return juce::jlimit( 0, (int)numBins - 1, index );
+}
+
+float LufsHistogram::getBinVolume( const int index )
+{
+    // center of bin
+    return LUFS_HISTOGRAM_MIN_VOLUME + ( (float)index + 0.5f ) / LUFS_HISTOGRAM_BINS_PER_LU;
 }
 
 
@@ -552,11 +1370,7 @@ void DEBUGPLUGIN_output( const char * /*_text*/, ...)
 // BiquadProcessor implementation 
 
 BiquadProcessor::BiquadProcessor()
-    : m_X_1( 0.f )
-    , m_X_2( 0.f )
-    , m_Y_1( 0.f )
-    , m_Y_2( 0.f )
-    , m_B0( 0.f )
+    : m_B0( 1.f )
     , m_B1( 0.f )
     , m_B2( 0.f )
     , m_A1( 0.f )
@@ -564,40 +1378,14 @@ BiquadProcessor::BiquadProcessor()
 {
 }
 
-void BiquadProcessor::process( float * _data, const int _sampleSize )
+void BiquadProcessor::setCascadeSection( BiquadCascade<float> & _cascade, const int _section ) const
 {
-    float * data = _data;
-
-    for ( int sample = 0 ; sample < _sampleSize ; ++sample )
-    {
-        float x = *data;
-
-        float y = x * m_B0;
-        y += m_X_1 * m_B1;
-        y += m_X_2 * m_B2;
-        y += m_Y_1 * m_A1;
-        y += m_Y_2 * m_A2;
-
-        m_X_2 = m_X_1;
-        m_X_1 = x;
-
-        m_Y_2 = m_Y_1;
-        m_Y_1 = y;
-
-        *data = y;
-
-        ++data;
-    }
+    // m_A1 and m_A2 are stored negated
+    _cascade.setCoefficients( _section, m_B0, m_B1, m_B2, -m_A1, -m_A2 );
 }
 
 void BiquadProcessor::setFilterParams( const float _samplingRate, const FilterType _filterType, const float _frequency, const float _quality, const float _decibelGain )
 {
-    m_X_2 = 0.f;
-    m_X_1 = 0.f;
-
-    m_Y_2 = 0.f;
-    m_Y_1 = 0.f;
-
     jassert( _quality > 0.001f );
     jassert( _frequency > 1.f );
     jassert( _filterType != Off );
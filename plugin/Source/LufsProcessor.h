@@ -21,12 +21,17 @@
 
 #pragma once 
 
-#include "../JuceLibraryCode/JuceHeader.h"
+#include <atomic>
+#include <vector>
+#include <JuceHeader.h>
 #include "TruePeakProcessor.h"
+#include "BiquadCascade.h"
+#include "TripleBuffer.h"
 
 #define DEFAULT_MIN_VOLUME ( -100.f )
 #define DEFAULT_ACCEPTABLE_MAX_TRUE_PEAK ( -1.f )
-#define LUFS_TP_MAX_NB_CHANNELS 2
+
+// Biquad coefficients calculation, filtering is done by BiquadCascade
 
 class BiquadProcessor
 {
@@ -45,113 +50,177 @@ public:
 
     BiquadProcessor();
 
-    void process( float * _data, const int _sampleSize );
-
     void setFilterParams( const float _samplingRate, const FilterType _filterType, const float _frequency, const float _quality, const float _decibelGain );
 
+    // sets normalised coefficients to section of cascade
+    void setCascadeSection( BiquadCascade<float> & _cascade, const int _section ) const;
+
 private:
-    float m_X_1;
-    float m_X_2;
-    float m_Y_1;
-    float m_Y_2;
     float m_B0, m_B1, m_B2, m_A1, m_A2;
 };
 
-class LufsFloatArray : public juce::Array<float>
+// Fixed-bin loudness histogram, as used by EBU Tech 3341/3342 implementations.
+// Memory and update cost don't depend on the number of blocks added, so gating costs the same
+// at the end of a long session as at the beginning. Each bin keeps the exact sum of its blocks,
+// only the gate position and percentiles are quantized to the bin size.
+
+#define LUFS_HISTOGRAM_MIN_VOLUME ( -70.f )
+#define LUFS_HISTOGRAM_MAX_VOLUME ( 10.f )
+#define LUFS_HISTOGRAM_BINS_PER_LU 100
+
+class LufsHistogram
 {
 public:
 
-    LufsFloatArray() : m_sum( 0.f ) {}
-    
-    void addLufs( float element ) 
-    { 
-        m_sum += element; 
+    LufsHistogram();
 
-        addSorted( *this, element ); 
-    }
+    // adds a block with its loudness and mean squared value
+    void add( const float volume, const double sum );
 
-    static int compareElements( const float first, const float second ) noexcept
-    {
-        const int result = (int)( 1000000000.f * ( first - second ) );
+    int size() const { return m_count; }
+    double getSum() const { return m_sum; }
 
-        return result;
-    }
+    // mean of squared values of blocks at or above volume, 0 if none 
+    double getMeanAboveVolume( const float volume ) const;
 
-    float getPercentileValue( const int beginIndex, const float percentile ) const
-    {
-        jassert( beginIndex < size() );
-        jassert( percentile >= 0.f );
-        jassert( percentile <= 1.f );
-
-        switch( size() )
-        {
-        case 0:
-            return 0.f;
-        case 1:
-        case 2:
-            return getUnchecked( 0 );
-        }
-
-        const int indexBefore = beginIndex + (int)( percentile * (float)( size() - beginIndex - 1 ) );
-        return getUnchecked( indexBefore );
-    }
+    // volume of percentile (0..1) of blocks at or above volume 
+    float getPercentileVolumeAboveVolume( const float volume, const float percentile ) const;
 
-    int findIndexAfterValue_( float value )
-    {
-        // to be optimized
-        jassert( size() );
-
-        for ( int i = 0 ; i < size() ; ++i )
-        {
-            if ( getUnchecked( i ) > value )
-            {
-                return i;
-            }
-        }
-
-        return size() - 1;
-    }
+    void reset();
 
-    int findIndexAfterValue( float value )
-    {
-        // could be optimized
-        jassert( size() );
-
-        if ( getUnchecked( 0 ) > value ) 
-        {
-            return 0;
-        }
-
-        int indexBefore = 0; 
-        int indexAfter = size() - 1;
-
-        while ( indexAfter - indexBefore > 1 )
-        {
-            int index = ( indexAfter + indexBefore ) >> 1;
-            if ( getUnchecked( index ) > value )
-                indexAfter = index;
-            else
-                indexBefore = index;
-        }
-
-        return indexAfter;
-    }
+private:
 
-    float getSum() const 
-    {
-        return m_sum;
-    }
+    static int getBinIndex( const float volume );
+    static float getBinVolume( const int index );
+
+    enum { numBins = (int)( LUFS_HISTOGRAM_MAX_VOLUME - LUFS_HISTOGRAM_MIN_VOLUME ) * LUFS_HISTOGRAM_BINS_PER_LU };
+
+    juce::HeapBlock<int> m_binCounts;
+    juce::HeapBlock<double> m_binSums;
+    int m_count;
+    double m_sum;
+};
+
+
+// History of 100 ms values, stored in chunks allocated as the session grows.
+// Only the last LUFS_HISTORY_MAX_CHUNKS chunks are kept: the oldest chunk is recycled when a new one
+// is needed, so metering never stops and memory stays bounded, whatever the session length.
+// set() is called from one thread only, operator[] can be called from another one.
+// The number of positions written is published with release ordering after each value, and readers
+// only read below it, so they never see a value before it is written, nor a cleared one.
+
+#define LUFS_HISTORY_CHUNK_SIZE 1024 // 102.4 s of 100 ms values per chunk
+#define LUFS_HISTORY_MAX_CHUNKS 256 // about 7 hours of history kept
+
+#define LUFS_MEASUREMENT_FIFO_SIZE 256 // 100 ms measurements waiting for update(), 25.6 s
+
+#define LUFS_SAMPLE_RING_SECONDS 1 // samples waiting for the analysis thread, when used
+#define LUFS_ANALYSIS_WAKES_PER_CHUNK 4 // processBlock wakes the analysis thread each time a quarter of 100 ms is in the ring
+#define LUFS_LOG_STOP_TIMEOUT_MS 5000 // log thread writes the last queued records before it stops
+
+class LufsHistoryArray
+{
+public:
+
+    LufsHistoryArray();
+    ~LufsHistoryArray();
+
+    // value at position, DEFAULT_MIN_VOLUME if position was not written or has been recycled
+    float operator[]( const int position ) const;
+
+    // number of positions written since the last clear()
+    inline int getSize() const { return m_size.load( std::memory_order_acquire ); }
+
+    void set( const int position, const float value );
+
+    // forgets all values, but keeps allocated chunks
+    void clear();
+
+private:
+
+    float * getChunk( const int slot );
+
+    juce::Atomic<float*> m_chunks[ LUFS_HISTORY_MAX_CHUNKS ];
+    juce::Atomic<int> m_chunkIndices[ LUFS_HISTORY_MAX_CHUNKS ]; // chunk index stored in each slot, -1 if none
+    std::atomic<int> m_size; // one past the highest position written, stored after the value
+
+    JUCE_DECLARE_NON_COPYABLE( LufsHistoryArray )
+};
+
+
+// Log of the 100 ms values of a session, memory mapped: appending a record is a page cache write,
+// and records already written survive a host crash. Records hold the squared input, integrated volume
+// and true peak of each channel in decibels; momentary, short term and range are computed again from them.
+// Opened for writing by the update() thread of a LufsProcessor, or read only by the analyzer.
 
-    void reset()
+#define LUFS_LOG_FILE_EXTENSION ".lufslog"
+#define LUFS_LOG_VERSION 1
+#define LUFS_LOG_HEADER_SIZE 64 // bytes before the first record
+#define LUFS_LOG_GROW_RECORDS 36000 // the file grows by one hour of records at a time
+
+class LufsLog
+{
+public:
+
+    LufsLog();
+    ~LufsLog();
+
+    // creates the file if it doesn't exist or is empty, appends to it if it holds records of numChannels at sampleRate.
+    // Returns false for any other file, which is left as it is, and for a file another LufsLog is writing, in any process
+    bool openForWriting( const juce::File & file, const int numChannels, const double sampleRate );
+    bool openForReading( const juce::File & file );
+    void close();
+
+    inline bool isOpen() const { return m_header != nullptr; }
+    inline const juce::File & getFile() const { return m_file; }
+    int getNumChannels() const;
+    double getSampleRate() const;
+    int getNumRecords() const;
+
+    // truePeaks has one decibel value per channel
+    void append( const float squaredInput, const float integratedVolume, const float * truePeaks );
+
+    inline float getSquaredInput( const int record ) const { return getRecord( record )[ 0 ]; }
+    inline float getIntegratedVolume( const int record ) const { return getRecord( record )[ 1 ]; }
+    inline float getTruePeak( const int record, const int channel ) const { return getRecord( record )[ 2 + channel ]; }
+
+    // new empty file named after the current time in directory, which is created if needed
+    static juce::File createSessionFile( const juce::File & directory );
+
+private:
+
+    struct Header
     {
-        clearQuick();
+        char m_magic[ 4 ]; // "DCLL"
+        juce::int32 m_version;
+        juce::int32 m_numChannels;
+        juce::int32 m_reserved;
+        double m_sampleRate;
+        juce::int64 m_numRecords; // written after the record, so that a crash never exposes a partial record
+    };
+
+    static bool readHeader( const juce::File & file, Header & header );
+    bool map( const juce::int64 capacity, const juce::MemoryMappedFile::AccessMode mode );
 
-        m_sum = 0.f;
+    // takes and releases the right to write file, false if another LufsLog has it
+    bool claim( const juce::File & file );
+    void release();
+
+    inline float * getRecord( const juce::int64 record ) const
+    {
+        return (float*)( (char*)m_map->getData() + LUFS_LOG_HEADER_SIZE ) + record * m_recordSize;
     }
 
-private:
+    juce::File m_file;
+    std::unique_ptr<juce::MemoryMappedFile> m_map;
+    Header * m_header; // in m_map, nullptr when closed
+    int m_recordSize; // floats per record
+    juce::int64 m_capacity; // records that fit in m_map
+    bool m_isWritable;
+    std::unique_ptr<juce::InterProcessLock> m_writeLock; // held while writing m_claimedFile
+    juce::File m_claimedFile;
 
-    float m_sum;
+    JUCE_DECLARE_NON_COPYABLE( LufsLog )
 };
 
 
@@ -165,81 +234,228 @@ public:
 
     ~LufsProcessor();
 
+    // consumes measurements sent by processBlock, and updates volumes. To be called from a single thread
     void update();
 
+    // session log, opened by the log thread once update() has seen the request: its records are restored
+    // by the log thread, and new measurements appended. A file that can't be used, or that another instance
+    // writes, is left as it is, and a new session file is created next to it. An empty file stops logging.
+    // Can be called from any thread
+    void setLogFile( const juce::File & file );
+    // as setLogFile, with a new session file in directory, created by the log thread
+    void startLogSession( const juce::File & directory );
+    juce::File getLogFile() const;
+
+    // replaces volumes and history with the records of log. To be called from the thread that updates volumes:
+    // the update() thread, or the log thread while update() waits for the log to open
+    void restore( const LufsLog & log );
+
+    // can be called from any thread: processBlock and update reset their own state on their next call
     void reset();
+    // reset(), and logging goes on in a new session file next to the current one, so the log of the
+    // measurement that was reset is kept. For the user's reset, can be called from any thread
+    void startNewSession();
+
+    // the 100 ms measurement in progress starts again, history and log are kept
     void prepareToPlay(const double sampleRate, int samplesPerBlock);
+
+    // sets the BS.1770 weight of each channel from its speaker position, call before prepareToPlay
+    void setChannelLayout( const juce::AudioChannelSet & layout );
+    static float getChannelWeight( const juce::AudioChannelSet::ChannelType type );
+    inline int getNbChannels() const { return m_nbChannels; }
     void processBlock( juce::AudioSampleBuffer& buffer );
 
+    // measures part of a block, so the output stage can hand over each chunk while it is in cache
+    void processBlock( const juce::AudioSampleBuffer& buffer, const int startSample, const int numSamples );
+
+    // when enabled, processBlock only copies samples to a ring, and K weighting, 100 ms integration
+    // and true peak oversampling are done by an analysis thread. Any thread but the audio thread, one at
+    // a time: processBlock switches at its next block. When disabled, samples the analysis thread hasn't
+    // taken yet are dropped, at most a few ms. prepareToPlay keeps the current mode
+    void setBackgroundAnalysis( const bool enabled );
+    inline bool isBackgroundAnalysis() const { return m_isBackgroundAnalysisRequested; }
+
+    // true peak values below linearLevel are only needed as far as they don't beat it: channels whose true peak
+    // can't reach it are measured as their sample peak, without oversampling. For the held maximum of a meter,
+    // levels below TRUE_PEAK_MIN_LINEAR_VALUE are raised to it. Any thread, applied from the next 100 ms
+    void setTruePeakEarlyOutLevel( const float linearLevel ) { m_truePeakEarlyOutLevel = juce::jmax( linearLevel, TRUE_PEAK_MIN_LINEAR_VALUE ); }
+
     inline void pause() { m_paused = true; }
     inline void resume() { m_paused = false; }
     inline bool isPaused() { return m_paused; }
 
-    inline float * getMomentaryVolumeArray() const { return m_momentaryVolumeArray; } 
-    inline float * getShortTermVolumeArray() const { return m_shortTermVolumeArray; } 
-    inline float * getIntegratedVolumeArray() const { return m_integratedVolumeArray; }
-    inline float * getTruePeakArray() const { return m_truePeakArray; }
+    inline const LufsHistoryArray & getMomentaryVolumeArray() const { return m_momentaryVolumeArray; } 
+    inline const LufsHistoryArray & getShortTermVolumeArray() const { return m_shortTermVolumeArray; } 
+    inline const LufsHistoryArray & getIntegratedVolumeArray() const { return m_integratedVolumeArray; }
+    inline const LufsHistoryArray & getTruePeakArray() const { return m_truePeakArray; }
     inline float getTruePeak() const { return m_maxTruePeak; }
-    inline float * getTruePeakChannelArray(int ch) const { return m_truePeakPerChannelArray[ch]; }
+    inline const LufsHistoryArray & getTruePeakChannelArray(int ch) const { return m_truePeakPerChannelArray[ch]; }
     inline float getTruePeakChannelMax(int ch) const { return m_truePeakMaxPerChannelArray[ch]; }
 
     inline float getIntegratedVolume() { return m_integratedVolume; }
     inline float getRangeMinVolume() { return m_rangeMin; }
     inline float getRangeMaxVolume() { return m_rangeMax; }
 
-    inline int getValidSize() const { return m_validSize; }
-    inline int getMaxSize() const { return m_maxSize; }
+    // measurements whose history values are all written, any thread
+    inline int getValidSize() const { return m_validSize.load( std::memory_order_acquire ); }
+
+    // changes each time the history arrays start again, after a reset or a restore
+    inline int getHistoryGeneration() const { return m_historyGeneration; }
 
     inline int getSeconds() const { return m_processSize / 10; }
 
 private:
 
+    // one 100 ms measurement, sent by the audio thread to update()
+    struct Measurement
+    {
+        float m_squaredInput;
+        AudioProcessing::TruePeak::LinearValue m_truePeak;
+        int m_numChannels;
+        int m_resetGeneration; // measurements made before last reset() are dropped
+    };
+
+    // analysis mode, from setBackgroundAnalysis to processBlock
+    struct AnalysisConfig
+    {
+        bool m_isBackground;
+    };
+
+    // waits for samples written to m_sampleRing by processBlock, which wakes it
+    class AnalysisThread : public juce::Thread
+    {
+    public:
+        AnalysisThread( LufsProcessor & owner ) : juce::Thread( "Loudness analysis" ), m_owner( owner ) {}
+        void run() override;
+
+    private:
+        LufsProcessor & m_owner;
+    };
+
+    // writes m_log, so that creating, growing and mapping the file never hold up update()
+    class LogThread : public juce::Thread
+    {
+    public:
+        LogThread( LufsProcessor & owner ) : juce::Thread( "Loudness log" ), m_owner( owner ) {}
+        void run() override;
+
+    private:
+        LufsProcessor & m_owner;
+    };
+
+    void analyseBlock( const juce::AudioSampleBuffer & buffer, const int startSample, const int numSamples, const int numChannels );
+    void writeToSampleRing( const juce::AudioSampleBuffer & buffer, const int startSample, const int numSamples, const int numChannels );
+    void analyseSampleRing();
+    void updateAnalysisMode();
+    void stopAnalysisThread();
+
     void addSquaredInputAndTruePeak( const float squaredInput, const AudioProcessing::TruePeak::LinearValue& value, const int numChannels );
-    void updatePosition( int position );
+    void updatePosition( int position, const bool updateGating = true );
+    void updateIntegratedVolume( const int position );
+    void updateRange();
+    void requestLogFile( const juce::File & file, const juce::File & directory, const bool restoreRecords );
+    void queueLogFile();
+    bool takeOpenedLog();
+    void writeLog();
+    void openLog( const juce::File & file, const juce::File & directory, const double sampleRate );
+    void appendToLog( const int position );
+    void processChunk100ms( const int numChannels );
+    void pushMeasurement( const float squaredInput, const AudioProcessing::TruePeak::LinearValue& value, const int numChannels );
+    void resetVolumes();
+    static double getSumOfSquares( const float * data, const int numSamples );
 
     static double ms_log10;
     float getLufsVolume( const float sum ) { return float( juce::jmax( float(-0.691 + 10.0 * log( sum ) / ms_log10 ), DEFAULT_MIN_VOLUME ) ); }
     float getLufsSum( const float volume ) { return float( exp( ( volume + 0.691 ) * ms_log10 / 10.0 ) ); }
 
-    juce::AudioSampleBuffer m_block; // data is copied to this buffer then filtered
-    juce::AudioSampleBuffer m_volumeMemory; // samples not processed from previous callback, filtered for volume 
-    juce::AudioSampleBuffer m_truePeakMemory; // samples not processed from previous callback, not filtered, for true peak 
+    juce::AudioSampleBuffer m_volumeMemory; // current 100 ms chunk, filtered for volume 
+    juce::AudioSampleBuffer m_truePeakMemory; // current 100 ms chunk, not filtered, for true peak 
     double m_sampleRate;
     int m_nbChannels;
+    float m_channelWeights[LUFS_TP_MAX_NB_CHANNELS]; // BS.1770 weight of each channel, 0 for Lfe
 
-    juce::Array<BiquadProcessor> m_shelveFilterArray;
-    juce::Array<BiquadProcessor> m_highPassFilterArray;
+    BiquadCascade<float> m_kWeightingFilter; // high shelf then high pass, all channels
 
-    int m_maxSize;
-    volatile int m_processSize;
-    int m_validSize; // process size as seen by client, in main update 
-    int m_memorySize;
+    int m_processSize; // number of measurements received by update()
+    std::atomic<int> m_validSize; // number of measurements processed by update(), stored after their values
+    int m_historyGeneration; // incremented by resetVolumes()
+    int m_memorySize; // write position in m_volumeMemory/m_truePeakMemory
     int m_sampleSize100ms;
 
-    float * m_squaredInputArray; // squared input for 100 ms, summed for all channels, after K weighting filtration
-    float * m_momentaryVolumeArray;
-    float * m_shortTermVolumeArray;
-    float * m_integratedVolumeArray;
-    float * m_truePeakArray; // max true peak linear volume for 100 ms
-    float * m_truePeakPerChannelArray[LUFS_TP_MAX_NB_CHANNELS]; // true peak decibel volume for 100 ms, per channel
+    // audio thread to update() handoff, single producer / single consumer
+    juce::AbstractFifo m_measurementFifo;
+    juce::HeapBlock<Measurement> m_measurements;
+
+    // incremented by reset(), processBlock and update compare it with their last handled value
+    juce::Atomic<int> m_resetGeneration;
+    int m_processResetGeneration; // analysis thread only: audio thread, or m_analysisThread when used
+    int m_updateResetGeneration; // update() thread only
+
+    LufsHistoryArray m_squaredInputArray; // squared input for 100 ms, summed for all channels, after K weighting filtration
+    LufsHistoryArray m_momentaryVolumeArray;
+    LufsHistoryArray m_shortTermVolumeArray;
+    LufsHistoryArray m_integratedVolumeArray;
+    LufsHistoryArray m_truePeakArray; // max true peak decibel volume for 100 ms
+    LufsHistoryArray m_truePeakPerChannelArray[LUFS_TP_MAX_NB_CHANNELS]; // true peak decibel volume for 100 ms, per channel
     float m_truePeakMaxPerChannelArray[LUFS_TP_MAX_NB_CHANNELS]; // true peak max decibel volume for 100 ms, per channel
     float m_maxTruePeak;
     float m_integratedVolume;
     float m_rangeMin;
     float m_rangeMax;
 
-    // 4 samples to calculate min/max, per channel
-    float ** m_memArray;
-    // linear max, per channel 
-    float m_maxLinArray[LUFS_TP_MAX_NB_CHANNELS];
-    juce::AudioSampleBuffer m_tempBlock; // to process min max;
-
-    juce::SpinLock m_locker;
+    LufsHistogram m_momentaryHistogram; // momentary blocks above absolute gate, for integrated loudness
+    LufsHistogram m_shortTermHistogram; // short term blocks above absolute gate, for loudness range
 
-    LufsFloatArray m_sum400ms70;
-    LufsFloatArray m_sum3s70;
+    // running sums of squared inputs for the momentary (4 values) and short term (30 values) windows
+    double m_momentaryWindowSum;
+    double m_shortTermWindowSum;
 
     AudioProcessing::TruePeak m_truePeakProcessor;
+    std::atomic<float> m_truePeakEarlyOutLevel; // applied to m_truePeakProcessor by the analysis thread
+
+    // session log, opened, restored and written by m_logThread. update() never reads it: the thread hands over
+    // the file and its number of records. Everything shared with other threads is guarded by m_logLock
+    LufsLog m_log;
+    juce::CriticalSection m_logLock;
+    juce::File m_logFile; // file of m_log, or requested file
+    juce::File m_logDirectory; // for a new session file, when the requested file is empty
+    bool m_isLogFileRequested;
+    bool m_isLogRestoreRequested; // false for a new session that goes on from the current volumes
+
+    // update() to m_logThread
+    std::vector<float> m_logQueue; // records not written yet, 2 + m_nbChannels floats each
+    std::vector<float> m_logRecords; // m_logThread only, records being written
+    juce::File m_queuedLogFile;
+    juce::File m_queuedLogDirectory;
+    double m_queuedLogSampleRate;
+    bool m_isQueuedLogRestored;
+    bool m_isLogOpenQueued;
+    bool m_isLogOpened; // set by m_logThread once the queued file is open and restored, or has failed
+    juce::File m_openedLogFile;
+    int m_openedLogNumRecords;
+    LogThread m_logThread;
+
+    // update() thread only
+    bool m_isLogOpening; // measurements wait in m_measurementFifo until the log is open and restored
+    juce::File m_loggingFile; // file of m_log, empty if not logging
+    double m_loggingSampleRate; // in the header of m_loggingFile
+    int m_numLoggedRecords;
+    std::atomic<bool> m_isNewSessionRequested;
+
+    // audio thread to m_analysisThread handoff, single producer / single consumer
+    juce::AbstractFifo m_sampleFifo;
+    juce::AudioSampleBuffer m_sampleRing;
+    int m_analysisWakeSize; // samples in the ring that wake m_analysisThread
+    std::unique_ptr<AnalysisThread> m_analysisThread; // started on first use, waits while not used
+
+    // setBackgroundAnalysis to audio thread handoff. The analysis thread is started before a config
+    // that uses it is published, and only stopped while processBlock can't run
+    TripleBuffer<AnalysisConfig> m_analysisConfig;
+    bool m_isBackgroundAnalysisRequested; // setBackgroundAnalysis thread
+
+    // audio thread only
+    bool m_isRingAnalysis; // samples go to the ring, the analysis thread owns the analysis state
+    bool m_isRingDraining; // switching back: processBlock skips metering until the ring is empty
 
     bool m_paused;
 };
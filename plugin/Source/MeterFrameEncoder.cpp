@@ -0,0 +1,80 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include "MeterFrameEncoder.h"
+
+MeterFrameEncoder::MeterFrameEncoder(const int* manufacturerId, uint8 command)
+	: framesSinceFullFrame(fullFrameInterval)
+{
+	for (int i = 0; i < 3; i++)
+		frame[i] = (uint8)manufacturerId[i];
+	frame[3] = command;
+
+	for (int i = 0; i < numFields; i++)
+	{
+		values[i] = 0;
+		sentValues[i] = -1;
+	}
+}
+
+void MeterFrameEncoder::setLevel(Field field, float decibels)
+{
+	jassert(field < numLevels);
+
+	// Clamp to what 14 bits can carry.
+	values[field] = jlimit(0, 0x3fff, roundToInt(decibels * 100.0f) + (int)levelOffset);
+}
+
+void MeterFrameEncoder::setClip(bool left, bool right)
+{
+	values[clipFlags] = (left ? clipLeft : 0) | (right ? clipRight : 0);
+}
+
+int MeterFrameEncoder::buildFrame()
+{
+	const bool isFullFrame = framesSinceFullFrame >= fullFrameInterval;
+	framesSinceFullFrame = isFullFrame ? 1 : framesSinceFullFrame + 1;
+
+	int mask = 0;
+	int size = headerSize + 3;
+
+	for (int i = 0; i < numFields; i++)
+	{
+		if (!isFullFrame && values[i] == sentValues[i])
+			continue;
+
+		mask |= 1 << i;
+		sentValues[i] = values[i];
+
+		if (i < numLevels)
+		{
+			frame[size++] = (uint8)((values[i] >> 7) & 0x7f);
+			frame[size++] = (uint8)(values[i] & 0x7f);
+		}
+		else
+		{
+			frame[size++] = (uint8)(values[i] & 0x7f);
+		}
+	}
+
+	if (mask == 0)
+		return 0;
+
+	frame[headerSize] = (uint8)version;
+	frame[headerSize + 1] = (uint8)(mask & 0x7f);
+	frame[headerSize + 2] = (uint8)((mask >> 7) & 0x7f);
+
+	return size;
+}
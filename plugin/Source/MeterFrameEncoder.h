@@ -0,0 +1,87 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+	Builds the meter SysEx frames sent to the hardware.
+
+	Version 1 frame, after the manufacturer ID and command byte:
+	  version, field mask (2 bytes, 7 bits each), then for each field in the mask, in field order:
+	  levels as 14 bits (2 bytes, MSB first) of centi-dB plus levelOffset, i.e. -128.00 to +35.83 dB,
+	  clip flags as 1 byte.
+
+	Only fields that changed since the last frame are sent, with a full frame every
+	fullFrameInterval frames so the hardware catches up after connecting. The frame is
+	built in a fixed buffer, so building it never allocates.
+
+	Must match the decoder in firmware/dc_meters.c.
+*/
+class MeterFrameEncoder
+{
+public:
+	enum Field
+	{
+		lufsShort = 0,
+		lufsMomentary,
+		lufsIntegrated,
+		lufsRangeMin,
+		lufsRangeMax,
+		lufsRange,
+		lufsTarget,
+		peakLeft,
+		peakRight,
+		maxPeakLeft,
+		maxPeakRight,
+		maxPeakTotal,
+		numLevels,
+		clipFlags = numLevels,
+		numFields
+	};
+
+	enum
+	{
+		version = 1,
+		levelOffset = 12800,
+		clipLeft = 0x01,
+		clipRight = 0x02,
+		fullFrameInterval = 100,
+		headerSize = 4,		// manufacturer ID and command
+		maxFrameSize = headerSize + 3 + (numLevels * 2) + 1
+	};
+
+	MeterFrameEncoder(const int* manufacturerId, uint8 command);
+
+	void setLevel(Field field, float decibels);
+	void setClip(bool left, bool right);
+
+	// Next frame carries all fields.
+	void forceFullFrame() { framesSinceFullFrame = fullFrameInterval; }
+
+	// Builds a frame with the changed fields. Returns its size, or 0 if there is nothing to send.
+	int buildFrame();
+	const uint8* getFrameData() const { return frame; }
+
+private:
+	int values[numFields];
+	int sentValues[numFields];
+	int framesSinceFullFrame;
+	uint8 frame[maxFrameSize];
+
+	JUCE_DECLARE_NON_COPYABLE(MeterFrameEncoder)
+};
@@ -0,0 +1,46 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include "TripleBuffer.h"
+#include "DspLoadMeter.h"
+
+//==============================================================================
+/**
+	Meter values for one timer tick, in dB (true peak in dBTP).
+
+	Written by the processor timer and read by the editor through a TripleBuffer,
+	so reading never waits for the meters or notifies the host.
+*/
+struct MeterSnapshot
+{
+	float lufsShort = -100.0f;
+	float lufsMomentary = -100.0f;
+	float lufsIntegrated = -100.0f;
+	float lufsRangeMin = -100.0f;
+	float lufsRangeMax = -100.0f;
+	float lufsTarget = -16.0f;
+	float peakLeft = -100.0f;
+	float peakRight = -100.0f;
+	float maxPeakLeft = -100.0f;		// Held for the peak hold time
+	float maxPeakRight = -100.0f;
+	bool clipLeft = false;				// Held max peak is above 0 dBTP
+	bool clipRight = false;
+	int seconds = 0;					// Time measured since LUFS reset
+	DspLoad dspLoad;					// Latest processBlock load, published every DspLoadMeter::publishIntervalMs
+};
+
+typedef TripleBuffer<MeterSnapshot> MeterSnapshotBuffer;
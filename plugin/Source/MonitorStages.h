@@ -0,0 +1,192 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "BiquadCascade.h"
+
+//==============================================================================
+/**
+	Per-sample linear ramp to a new gain, like LinearSmoothedValue, but filled a chunk at
+	a time so every channel of the chunk uses the same values.
+*/
+class GainRamp
+{
+public:
+	GainRamp() : current(1.0f), target(1.0f), step(0.0f), rampSamples(1), countdown(0) {}
+
+	// Call outside the audio thread. Jumps to the target.
+	void prepare(double sampleRate, double rampSeconds) noexcept
+	{
+		rampSamples = jmax(1, (int)(sampleRate * rampSeconds));
+		current = target;
+		countdown = 0;
+	}
+
+	void setTarget(float newTarget) noexcept
+	{
+		if (newTarget == target)
+			return;
+
+		target = newTarget;
+		countdown = rampSamples;
+		step = (target - current) / (float)countdown;
+	}
+
+	bool isRamping() const noexcept { return countdown > 0; }
+	float getCurrent() const noexcept { return current; }
+
+	// The next numSamples gains, ending at the target once the ramp is done.
+	void fill(float* gains, int numSamples) noexcept
+	{
+		for (int i = 0; i < numSamples; i++)
+		{
+			if (countdown > 0)
+				current = --countdown > 0 ? current + step : target;
+			gains[i] = current;
+		}
+	}
+
+	void skip(int numSamples) noexcept
+	{
+		countdown -= jmin(countdown, numSamples);
+		current = countdown > 0 ? target - step * countdown : target;
+	}
+
+private:
+	float current;
+	float target;
+	float step;
+	int rampSamples;
+	int countdown;
+};
+
+//==============================================================================
+/**
+	Monitor processing stages of processBlock that don't keep any state of their own,
+	so the benchmark target runs exactly the code the plugin does.
+
+	The output stage (mid/side, meters, gain) takes a range of the block, see outputChunkSize.
+
+	Channel pairs are the left/right pairs of the bus layout, see updateChannelPairs().
+*/
+struct MonitorStages
+{
+	typedef int ChannelPair[2];
+
+	enum { numLoudnessEqBands = 7 };
+
+	// Loud mode: an inverted equal loudness curve, 7 peak filters.
+	static void prepareLoudnessEq(BiquadCascade<float>& eq, int numChannels, double sampleRate)
+	{
+		eq.prepare(numChannels, numLoudnessEqBands);
+
+		// EQ parameters taken from https://www.hometheatershack.com/forums/av-home-theater/23077-equal-loudness-db-phons-contours-eq-you-will-want-give-listen.html
+		// TODO: This needs to be checked and has scope for improvement.
+		eq.setCoefficients(0, IIRCoefficients::makePeakFilter(sampleRate, 20.0, 4.45, Decibels::decibelsToGain(-38.9)));
+		eq.setCoefficients(1, IIRCoefficients::makePeakFilter(sampleRate, 1130.0, 0.65, Decibels::decibelsToGain(3.85)));
+		eq.setCoefficients(2, IIRCoefficients::makePeakFilter(sampleRate, 1490.0, 2.20, Decibels::decibelsToGain(-8.15)));
+		eq.setCoefficients(3, IIRCoefficients::makePeakFilter(sampleRate, 3290.0, 0.59, Decibels::decibelsToGain(6.55)));
+		eq.setCoefficients(4, IIRCoefficients::makePeakFilter(sampleRate, 8850.0, 1.78, Decibels::decibelsToGain(-12.88)));
+		eq.setCoefficients(5, IIRCoefficients::makePeakFilter(sampleRate, 12300.0, 4.50, Decibels::decibelsToGain(5.44)));
+		eq.setCoefficients(6, IIRCoefficients::makePeakFilter(sampleRate, 20000.0, 3.50, Decibels::decibelsToGain(-10.50)));
+	}
+
+	enum MidSideMode { stereo = 0, midSolo, sideSolo };
+
+	// The output stage works through the block in chunks of this many samples: mid/side, the
+	// meters, then the gain, so each chunk is read from memory once and stays in cache.
+	enum { outputChunkSize = 256 };
+
+	static void applyMidSide(AudioSampleBuffer& buffer, int startSample, int numSamples, MidSideMode mode,
+		const ChannelPair* pairs, int numPairs, const bool* isPaired, int numChannels) noexcept
+	{
+		if (mode == midSolo)
+			applyMidSolo(buffer, startSample, numSamples, pairs, numPairs);
+		else if (mode == sideSolo)
+			applySideSolo(buffer, startSample, numSamples, pairs, numPairs, isPaired, numChannels);
+	}
+
+	// Mid solo. Unpaired channels (centre, LFE) are mid only, so pass through.
+	static void applyMidSolo(AudioSampleBuffer& buffer, int startSample, int numSamples, const ChannelPair* pairs, int numPairs) noexcept
+	{
+		for (int pair = 0; pair < numPairs; pair++)
+		{
+			float* left = buffer.getWritePointer(pairs[pair][0], startSample);
+			float* right = buffer.getWritePointer(pairs[pair][1], startSample);
+
+			for (int sample = 0; sample < numSamples; ++sample)
+			{
+				const float mid = (left[sample] + right[sample]) / 2.0f;
+				left[sample] = mid;
+				right[sample] = mid;
+			}
+		}
+	}
+
+	// Side solo, computed in place: side = R - L on both channels of each pair.
+	// Unpaired channels have no side content, so are cleared.
+	static void applySideSolo(AudioSampleBuffer& buffer, int startSample, int numSamples, const ChannelPair* pairs, int numPairs, const bool* isPaired, int numChannels) noexcept
+	{
+		for (int pair = 0; pair < numPairs; pair++)
+		{
+			float* left = buffer.getWritePointer(pairs[pair][0], startSample);
+			float* right = buffer.getWritePointer(pairs[pair][1], startSample);
+
+			for (int sample = 0; sample < numSamples; ++sample)
+			{
+				const float side = right[sample] - left[sample];
+				left[sample] = side;
+				right[sample] = side;
+			}
+		}
+
+		for (int channel = 0; channel < numChannels; channel++)
+		{
+			if (!isPaired[channel])
+				buffer.clear(channel, startSample, numSamples);
+		}
+	}
+
+	// Monitor/dim/ref gain and mute, ramped per sample. numSamples must not be more than outputChunkSize.
+	static void applyGain(AudioSampleBuffer& buffer, int startSample, int numSamples, int numChannels, GainRamp& gain) noexcept
+	{
+		jassert(numSamples <= outputChunkSize);
+
+		if (!gain.isRamping())
+		{
+			const float value = gain.getCurrent();
+			if (value == 1.0f)
+				return;
+
+			for (int channel = 0; channel < numChannels; channel++)
+			{
+				float* data = buffer.getWritePointer(channel, startSample);
+				if (value == 0.0f)
+					FloatVectorOperations::clear(data, numSamples);
+				else
+					FloatVectorOperations::multiply(data, value, numSamples);
+			}
+			return;
+		}
+
+		float gains[outputChunkSize];
+		gain.fill(gains, numSamples);
+
+		for (int channel = 0; channel < numChannels; channel++)
+			FloatVectorOperations::multiply(buffer.getWritePointer(channel, startSample), gains, numSamples);
+	}
+};
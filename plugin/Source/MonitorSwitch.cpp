@@ -0,0 +1,260 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include "MonitorSwitch.h"
+
+// The timer runs while a switch is in progress.
+#define MONITOR_SWITCH_TIMER_MS 1
+// Until the audio thread has started the fade, assume a block of this length is in flight.
+#define MONITOR_SWITCH_BLOCK_ESTIMATE_MS 20.0
+// Weight of a new measurement in the learned times.
+#define MONITOR_SWITCH_LEARNING_RATE 0.25f
+
+MonitorSwitch::MonitorSwitch(const int* manufacturerId)
+	: output(nullptr)
+	, selectedOutput(-1)
+	, commandId(0)
+	, isCommandSent(false)
+	, commandSentMs(0.0)
+	, isMuteRequested(false)
+	, muteCompleteMs(0.0)
+	, gain(1.0f)
+	, wasMuteRequested(false)
+{
+	for (int i = 0; i < 3; i++)
+		this->manufacturerId[i] = (uint8)manufacturerId[i];
+
+	for (int i = 0; i <= numOutputs; i++)
+		transportMs[i] = settleMs[i] = -1.0f;
+
+	prepare(44100.0);
+}
+
+MonitorSwitch::~MonitorSwitch()
+{
+	const ScopedLock tl(timerLock);
+	stopTimer();
+}
+
+void MonitorSwitch::setOutput(MidiOutputThread* newOutput)
+{
+	{
+		const ScopedLock sl(lock);
+
+		output = newOutput;
+		if (output == nullptr)
+			finishSwitch();
+	}
+
+	if (newOutput == nullptr)
+	{
+		const ScopedLock tl(timerLock);
+		stopTimer();
+	}
+}
+
+void MonitorSwitch::select(int newOutput)
+{
+	{
+		const ScopedLock sl(lock);
+
+		if (output == nullptr || !isPositiveAndBelow(newOutput + 1, (int)numOutputs + 1))
+			return;
+
+		// A select while switching takes over, only the latest command's acknowledgement opens up again.
+		selectedOutput = newOutput;
+		commandId = (commandId + 1) & 0x7f;
+		isCommandSent = false;
+
+		if (!isMuteRequested.load())
+		{
+			muteCompleteMs = Time::getMillisecondCounterHiRes() + fadeMs + MONITOR_SWITCH_BLOCK_ESTIMATE_MS;
+			isMuteRequested = true;
+		}
+	}
+
+	startSwitchTimer();
+}
+
+void MonitorSwitch::startSwitchTimer()
+{
+	const ScopedLock tl(timerLock);
+
+	if (!isTimerRunning())
+		startTimer(MONITOR_SWITCH_TIMER_MS);
+}
+
+void MonitorSwitch::tick()
+{
+	if (isMuteRequested.load())
+		return;
+
+	// A select() that starts a switch meanwhile waits for the lock, and starts the timer again.
+	const ScopedLock tl(timerLock);
+
+	if (!isMuteRequested.load() && isTimerRunning())
+		stopTimer();
+}
+
+void MonitorSwitch::handleMessage(const MidiMessage& m)
+{
+	if (!m.isSysEx() || m.getSysExDataSize() < 8)
+		return;
+
+	const uint8* data = m.getSysExData();
+	if (data[0] != manufacturerId[0] || data[1] != manufacturerId[1] || data[2] != manufacturerId[2] || data[3] != commandSwitched)
+		return;
+
+	const ScopedLock sl(lock);
+
+	// Only the latest command counts, an earlier one's relays have been switched again since.
+	if (!isCommandSent || data[4] != commandId || data[5] != selectedOutput + 1)
+		return;
+
+	const double now = Time::getMillisecondCounterHiRes();
+	const float settle = (float)((data[6] << 7) | data[7]);
+	const float transport = jmax(0.0f, (float)(now - commandSentMs) - settle) / 2.0f;
+	const int index = selectedOutput + 1;
+
+	// The settle time is the switcher's fixed delay, there is nothing to average.
+	transportMs[index] = transportMs[index] < 0.0f ? transport : transportMs[index] + (transport - transportMs[index]) * MONITOR_SWITCH_LEARNING_RATE;
+	settleMs[index] = settle;
+
+	finishSwitch();
+}
+
+void MonitorSwitch::hiResTimerCallback()
+{
+	if (!isMuteRequested.load())
+		return;
+
+	const ScopedLock sl(lock);
+
+	// Finished while waiting for the lock
+	if (!isMuteRequested.load())
+		return;
+
+	const double now = Time::getMillisecondCounterHiRes();
+
+	if (!isCommandSent)
+	{
+		// Send so the command arrives as the mute completes.
+		const float transport = jmax(0.0f, transportMs[selectedOutput + 1]);
+		if (now >= muteCompleteMs.load() - transport)
+			sendSelect(now);
+	}
+	else if (now - commandSentMs >= getAckTimeoutMs())
+	{
+		// No acknowledgement, e.g. older switcher firmware or a lost message.
+		finishSwitch();
+	}
+}
+
+void MonitorSwitch::sendSelect(double now)
+{
+	if (output == nullptr)
+		return;
+
+	const uint8 data[6] = { manufacturerId[0], manufacturerId[1], manufacturerId[2], (uint8)commandSelect, (uint8)commandId, (uint8)(selectedOutput + 1) };
+	output->sendMessage(MidiMessage::createSysExMessage(data, sizeof(data)));
+
+	isCommandSent = true;
+	commandSentMs = now;
+}
+
+// Opens up again, the next tick() stops the timer. Called with the lock held.
+void MonitorSwitch::finishSwitch()
+{
+	isCommandSent = false;
+	isMuteRequested = false;
+}
+
+double MonitorSwitch::getAckTimeoutMs() const
+{
+	const int index = selectedOutput + 1;
+	if (settleMs[index] < 0.0f)
+		return ackTimeoutMs;
+
+	// Well beyond the usual round trip, but far shorter than a fixed worst case.
+	return 2.0 * (settleMs[index] + 2.0f * transportMs[index]) + 20.0;
+}
+
+//==============================================================================
+void MonitorSwitch::prepare(double newSampleRate)
+{
+	sampleRate = newSampleRate;
+	fadeStep = 1.0f / jmax(1.0f, (float)(sampleRate * fadeMs / 1000.0));
+	gain = isMuteRequested.load() ? 0.0f : 1.0f;
+	wasMuteRequested = isMuteRequested.load();
+}
+
+void MonitorSwitch::process(AudioSampleBuffer& buffer, int numChannels) noexcept
+{
+	const bool isMute = isMuteRequested.load();
+	const int numSamples = buffer.getNumSamples();
+
+	// When the fade starts, the faded audio has left the plugin after the rest of the fade and this block.
+	if (isMute && !wasMuteRequested)
+		muteCompleteMs = Time::getMillisecondCounterHiRes() + 1000.0 * (gain / fadeStep + numSamples) / sampleRate;
+	wasMuteRequested = isMute;
+
+	if (!isMute && gain >= 1.0f)
+		return;
+
+	if (isMute && gain <= 0.0f)
+	{
+		for (int ch = 0; ch < numChannels; ch++)
+			buffer.clear(ch, 0, numSamples);
+		return;
+	}
+
+	// Ramp to the target, the rest of the block is at the target gain.
+	const float target = isMute ? 0.0f : 1.0f;
+	const int rampSamples = jmin(numSamples, (int)std::ceil(std::abs(target - gain) / fadeStep));
+	const float endGain = isMute ? jmax(0.0f, gain - rampSamples * fadeStep) : jmin(1.0f, gain + rampSamples * fadeStep);
+
+	for (int ch = 0; ch < numChannels; ch++)
+	{
+		buffer.applyGainRamp(ch, 0, rampSamples, gain, endGain);
+		if (isMute && rampSamples < numSamples)
+			buffer.clear(ch, rampSamples, numSamples - rampSamples);
+	}
+
+	gain = endGain;
+}
+
+//==============================================================================
+float MonitorSwitch::getTransportMs(int output) const
+{
+	const ScopedLock sl(lock);
+	return isPositiveAndBelow(output + 1, (int)numOutputs + 1) ? transportMs[output + 1] : -1.0f;
+}
+
+float MonitorSwitch::getSettleMs(int output) const
+{
+	const ScopedLock sl(lock);
+	return isPositiveAndBelow(output + 1, (int)numOutputs + 1) ? settleMs[output + 1] : -1.0f;
+}
+
+void MonitorSwitch::setLearnedTimes(int output, float transport, float settle)
+{
+	const ScopedLock sl(lock);
+
+	if (!isPositiveAndBelow(output + 1, (int)numOutputs + 1))
+		return;
+
+	transportMs[output + 1] = transport >= 0.0f ? jmin(transport, 1000.0f) : -1.0f;
+	settleMs[output + 1] = settle >= 0.0f && transport >= 0.0f ? jmin(settle, 1000.0f) : -1.0f;
+}
@@ -0,0 +1,118 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <atomic>
+
+#include <JuceHeader.h>
+#include "OutputThread.h"
+
+//==============================================================================
+/**
+	Click-free monitor switching with the DreamControlSwitcher relay unit.
+
+	On select(), the audio thread fades the output down over fadeMs. The select command
+	is sent so that it arrives as the mute completes, then the output stays muted until
+	the switcher acknowledges that the relays have settled, and fades back up.
+
+	Switcher SysEx, after the manufacturer ID, must match monitor switcher/app.c:
+	  commandSelect: command ID, output (0 = all off, 1 to numOutputs)
+	  commandSwitched: command ID, output, settle time in ms as 14 bits (MSB first)
+
+	The settle time is the switcher's nominal relay delay for that output, which it waits
+	before acknowledging; it isn't measured. The transport time (half the round trip, less
+	the settle time) is learned for each output and lets the command go out early. The
+	last settle time each output reported sets how long to wait for an acknowledgement
+	that doesn't come. Both are saved with the plugin state.
+
+	The 1 ms timer only runs while a switch is in progress, so only in the instance that
+	drives the hardware: select() starts it, and tick(), from the hub's timer, stops it
+	once the switch has finished. It is never started or stopped with the lock held:
+	stopping waits for a callback in progress, and the callback takes the lock.
+*/
+class MonitorSwitch : private HighResolutionTimer
+{
+public:
+	enum
+	{
+		numOutputs = 4,
+		fadeMs = 5,
+		ackTimeoutMs = 250,		// until an output's settle time is known
+		commandSelect = 1,
+		commandSwitched = 2
+	};
+
+	MonitorSwitch(const int* manufacturerId);
+	~MonitorSwitch();
+
+	// Output isn't owned, nullptr if there is no switcher. Set to nullptr before deleting it.
+	void setOutput(MidiOutputThread* newOutput);
+
+	// Any thread. output is 0 to numOutputs - 1, or -1 for all off.
+	void select(int output);
+
+	// Hub timer. Stops the 1 ms timer after a switch.
+	void tick();
+
+	// MIDI input thread, for messages from the switcher.
+	void handleMessage(const MidiMessage& m);
+
+	//==============================================================================
+	// Call outside the audio thread, before processing starts.
+	void prepare(double sampleRate);
+
+	// Audio thread. Applies the switching fade and mute.
+	void process(AudioSampleBuffer& buffer, int numChannels) noexcept;
+
+	//==============================================================================
+	// Learned transport and reported settle times in ms, output as for select(), -1 if not known yet.
+	float getTransportMs(int output) const;
+	float getSettleMs(int output) const;
+	void setLearnedTimes(int output, float transportMs, float settleMs);
+
+private:
+	void hiResTimerCallback() override;
+	void startSwitchTimer();
+	void sendSelect(double now);
+	void finishSwitch();
+	double getAckTimeoutMs() const;
+
+	CriticalSection lock;
+	CriticalSection timerLock;	// start and stop come from different threads, never taken by the callback
+	MidiOutputThread* output;
+	uint8 manufacturerId[3];
+
+	int selectedOutput;		// as for select()
+	int commandId;
+	bool isCommandSent;
+	double commandSentMs;
+
+	// Indexed by output + 1, so all off is 0.
+	float transportMs[numOutputs + 1];
+	float settleMs[numOutputs + 1];
+
+	// Shared with the audio thread and the timer. Set while a switch is in progress, cleared when it has finished.
+	std::atomic<bool> isMuteRequested;
+	std::atomic<double> muteCompleteMs;		// when the faded audio has left the plugin
+
+	// Audio thread side
+	double sampleRate;
+	float fadeStep;
+	float gain;
+	bool wasMuteRequested;
+
+	JUCE_DECLARE_NON_COPYABLE(MonitorSwitch)
+};
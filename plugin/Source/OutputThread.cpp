@@ -0,0 +1,225 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include "OutputThread.h"
+
+#define OUTPUT_THREAD_STOP_TIMEOUT_MS 2000
+#define OSC_MAX_BUNDLE_SIZE 16			// Keeps bundles well inside a UDP packet.
+
+//==============================================================================
+MidiOutputThread::MidiOutputThread(const String& threadName)
+	: Thread(threadName), firstPendingBlock(0), numPendingBlocks(0), output(nullptr)
+{
+	for (int i = 0; i < numLatestSlots; i++)
+		isLatestPending[i] = false;
+
+	startThread();
+}
+
+MidiOutputThread::~MidiOutputThread()
+{
+	signalThreadShouldExit();
+	notify();
+	stopThread(OUTPUT_THREAD_STOP_TIMEOUT_MS);
+}
+
+void MidiOutputThread::setOutput(MidiOutput* newOutput)
+{
+	const ScopedLock sl(outputLock);
+	output = newOutput;
+}
+
+void MidiOutputThread::sendMessage(const MidiMessage& message)
+{
+	{
+		const ScopedLock sl(queueLock);
+		addPendingBlock().addEvent(message, 0);
+	}
+	notify();
+}
+
+void MidiOutputThread::sendBlockOfMessages(const MidiBuffer& messages)
+{
+	{
+		const ScopedLock sl(queueLock);
+		addPendingBlock().addEvents(messages, 0, -1, 0);
+	}
+	notify();
+}
+
+MidiBuffer& MidiOutputThread::addPendingBlock()
+{
+	// The device isn't keeping up. The oldest block goes, the newer ones carry the current state.
+	if (numPendingBlocks == maxPendingBlocks)
+	{
+		firstPendingBlock = (firstPendingBlock + 1) % maxPendingBlocks;
+		numPendingBlocks--;
+	}
+
+	// Blocks are cleared but keep their memory, so a queue that has been full once doesn't allocate again.
+	MidiBuffer& block = pendingBlocks[(firstPendingBlock + numPendingBlocks) % maxPendingBlocks];
+	block.clear();
+	numPendingBlocks++;
+	return block;
+}
+
+void MidiOutputThread::sendLatestMessage(int slot, const MidiMessage& message)
+{
+	jassert(slot >= 0 && slot < numLatestSlots);
+	{
+		const ScopedLock sl(queueLock);
+		pendingLatestMessages[slot] = message;
+		isLatestPending[slot] = true;
+	}
+	notify();
+}
+
+bool MidiOutputThread::isLatestMessagePending(int slot) const
+{
+	const ScopedLock sl(queueLock);
+	return isLatestPending[slot];
+}
+
+void MidiOutputThread::run()
+{
+	MidiBuffer messages;
+	MidiMessage latestMessages[numLatestSlots];
+	bool hasLatest[numLatestSlots];
+
+	while (!threadShouldExit())
+	{
+		wait(-1);
+
+		// Take everything queued so far, then send outside the queue lock so callers never wait for the device.
+		{
+			const ScopedLock sl(queueLock);
+			for (int i = 0; i < numPendingBlocks; i++)
+				messages.addEvents(pendingBlocks[(firstPendingBlock + i) % maxPendingBlocks], 0, -1, 0);
+
+			firstPendingBlock = 0;
+			numPendingBlocks = 0;
+
+			for (int i = 0; i < numLatestSlots; i++)
+			{
+				hasLatest[i] = isLatestPending[i];
+				if (hasLatest[i])
+					latestMessages[i] = pendingLatestMessages[i];
+				isLatestPending[i] = false;
+			}
+		}
+
+		{
+			const ScopedLock sl(outputLock);
+			if (output != nullptr)
+			{
+				if (!messages.isEmpty())
+					output->sendBlockOfMessagesNow(messages);
+
+				for (int i = 0; i < numLatestSlots; i++)
+					if (hasLatest[i])
+						output->sendMessageNow(latestMessages[i]);
+			}
+		}
+
+		messages.clear();
+	}
+}
+
+//==============================================================================
+OscOutputThread::OscOutputThread(const String& threadName)
+	: Thread(threadName), isConnected(false)
+{
+	pendingMessages.reserve(maxPendingMessages);
+	startThread();
+}
+
+OscOutputThread::~OscOutputThread()
+{
+	signalThreadShouldExit();
+	notify();
+	stopThread(OUTPUT_THREAD_STOP_TIMEOUT_MS);
+	disconnect();
+}
+
+bool OscOutputThread::connect(const String& targetHostName, int targetPortNumber)
+{
+	const ScopedLock sl(senderLock);
+	isConnected = sender.connect(targetHostName, targetPortNumber);
+	return isConnected;
+}
+
+void OscOutputThread::disconnect()
+{
+	const ScopedLock sl(senderLock);
+	if (isConnected)
+		sender.disconnect();
+	isConnected = false;
+}
+
+void OscOutputThread::sendMessage(const OSCMessage& message)
+{
+	{
+		const ScopedLock sl(queueLock);
+
+		// The destination isn't keeping up, the oldest message goes.
+		if (pendingMessages.size() == maxPendingMessages)
+			pendingMessages.erase(pendingMessages.begin());
+
+		pendingMessages.push_back(message);
+	}
+	notify();
+}
+
+void OscOutputThread::run()
+{
+	// Swapped with the queue, so both keep the reserved size.
+	std::vector<OSCMessage> messages;
+	messages.reserve(maxPendingMessages);
+
+	while (!threadShouldExit())
+	{
+		wait(-1);
+
+		{
+			const ScopedLock sl(queueLock);
+			messages.swap(pendingMessages);
+		}
+
+		{
+			const ScopedLock sl(senderLock);
+			if (isConnected)
+			{
+				for (size_t first = 0; first < messages.size(); first += OSC_MAX_BUNDLE_SIZE)
+				{
+					const size_t last = jmin(first + OSC_MAX_BUNDLE_SIZE, messages.size());
+
+					if (last - first == 1)
+					{
+						sender.send(messages[first]);
+					}
+					else
+					{
+						OSCBundle bundle;
+						for (size_t i = first; i < last; i++)
+							bundle.addElement(messages[i]);
+						sender.send(bundle);
+					}
+				}
+			}
+		}
+
+		messages.clear();
+	}
+}
@@ -0,0 +1,115 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <vector>
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+	Sends MIDI to one output device on its own thread, so a slow driver doesn't
+	hold up the timer, MIDI input or parameter callbacks that queue messages.
+
+	Messages queued with sendMessage() are all sent, in order, as one block each
+	time the thread wakes. Messages queued with sendLatestMessage() replace any
+	message still waiting in the same slot, so only the newest one is sent.
+
+	At most maxPendingBlocks calls to sendMessage() or sendBlockOfMessages() wait
+	at a time. If the device stalls the oldest are dropped whole, so a block is
+	never sent in part, and the surface asks for a state snapshot when it sees the
+	gap in the sequence numbers.
+*/
+class MidiOutputThread : public Thread
+{
+public:
+	enum
+	{
+		numLatestSlots = 4,
+		maxPendingBlocks = 128
+	};
+
+	MidiOutputThread(const String& threadName);
+	~MidiOutputThread();
+
+	// Output isn't owned. Set to nullptr before deleting it, this waits for any send in progress.
+	void setOutput(MidiOutput* newOutput);
+
+	void sendMessage(const MidiMessage& message);
+	void sendBlockOfMessages(const MidiBuffer& messages);
+	void sendLatestMessage(int slot, const MidiMessage& message);
+
+	// True if the last message queued in this slot hasn't been taken by the thread yet.
+	bool isLatestMessagePending(int slot) const;
+
+	void run() override;
+
+private:
+	// The slot for a new block, at the end of the ring. Call with queueLock held.
+	MidiBuffer& addPendingBlock();
+
+	CriticalSection queueLock;
+	MidiBuffer pendingBlocks[maxPendingBlocks];	// ring, oldest at firstPendingBlock
+	int firstPendingBlock;
+	int numPendingBlocks;
+	MidiMessage pendingLatestMessages[numLatestSlots];
+	bool isLatestPending[numLatestSlots];
+
+	CriticalSection outputLock;
+	MidiOutput* output;
+
+	JUCE_DECLARE_NON_COPYABLE(MidiOutputThread)
+};
+
+//==============================================================================
+/**
+	Sends OSC to one destination on its own thread. Messages queued since the
+	thread last woke are sent together as a bundle.
+
+	At most maxPendingMessages wait at a time, if the destination stalls the
+	oldest are dropped.
+*/
+class OscOutputThread : public Thread
+{
+public:
+	enum { maxPendingMessages = 256 };
+
+	OscOutputThread(const String& threadName);
+	~OscOutputThread();
+
+	bool connect(const String& targetHostName, int targetPortNumber);
+	void disconnect();
+
+	void sendMessage(const OSCMessage& message);
+
+	template <typename... Args>
+	void send(const OSCAddressPattern& address, Args&&... args)
+	{
+		sendMessage(OSCMessage(address, std::forward<Args>(args)...));
+	}
+
+	void run() override;
+
+private:
+	CriticalSection queueLock;
+	std::vector<OSCMessage> pendingMessages;	// reserved for maxPendingMessages, oldest first
+
+	CriticalSection senderLock;
+	OSCSender sender;
+	bool isConnected;
+
+	JUCE_DECLARE_NON_COPYABLE(OscOutputThread)
+};
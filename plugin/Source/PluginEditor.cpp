@@ -13,15 +13,40 @@
 
 //==============================================================================
 DawcAudioProcessorEditor::DawcAudioProcessorEditor (DreamControlAudioProcessor& p)
-    : AudioProcessorEditor (&p), processor (p)
+    : AudioProcessorEditor (&p), processor (p), historyView (p.getLoudnessHistory()), parameterEditor (&p)
 {
+    processor.setLoudnessHistoryShown (true);
+
+    addAndMakeVisible (historyView);
+    addAndMakeVisible (parameterEditor);
+
     // Make sure that before the constructor has finished, you've set the
     // editor's size to whatever you need it to be.
-    setSize (400, 300);
+    setSize (1000, 520);
+
+    startTimerHz (30);
 }
 
 DawcAudioProcessorEditor::~DawcAudioProcessorEditor()
 {
+    stopTimer();
+    processor.setLoudnessHistoryShown (false);
+}
+
+void DawcAudioProcessorEditor::timerCallback()
+{
+    bool isChanged = processor.getLatestMeterSnapshot (meters);
+    historyView.setTarget (meters.lufsTarget);
+
+    const String status = processor.getDeviceStatus();
+    if (status != deviceStatus)
+    {
+        deviceStatus = status;
+        isChanged = true;
+    }
+
+    if (isChanged)
+        repaint();
 }
 
 //==============================================================================
@@ -30,13 +55,57 @@ void DawcAudioProcessorEditor::paint (Graphics& g)
     // (Our component is opaque, so we must completely fill the background with a solid colour)
     g.fillAll (getLookAndFeel().findColour (ResizableWindow::backgroundColourId));
 
+    g.setColour (Colours::grey);
+    g.setFont (12.0f);
+    g.drawFittedText (deviceStatus.trimEnd(), statusArea, Justification::topLeft, 4);
+
     g.setColour (Colours::white);
     g.setFont (15.0f);
-    g.drawFittedText ("Hello World!", getLocalBounds(), Justification::centred, 1);
+    g.drawFittedText ("Integrated " + String (meters.lufsIntegrated, 1) + " LUFS\n"
+                        + "Short " + String (meters.lufsShort, 1) + " LUFS\n"
+                        + "True peak " + String (meters.maxPeakLeft, 1) + " / " + String (meters.maxPeakRight, 1) + " dBTP",
+                      meterArea, Justification::centredLeft, 3);
+
+    paintDspLoad (g, loadArea);
+}
+
+// One row per processBlock stage: bar for the average load, tick for the worst block, as % of the block's duration.
+void DawcAudioProcessorEditor::paintDspLoad (Graphics& g, Rectangle<int> area)
+{
+    g.setFont (12.0f);
+
+    for (int i = 0; i < DspLoad::numEntries; ++i)
+    {
+        auto row = area.removeFromTop (16);
+        auto label = row.removeFromLeft (70);
+        auto values = row.removeFromRight (90);
+        auto bar = row.reduced (0, 4).toFloat();
+
+        const float average = meters.dspLoad.average[i];
+        const float worst = meters.dspLoad.worst[i];
+
+        g.setColour (Colours::grey);
+        g.drawText (DspLoad::getName (i), label, Justification::centredLeft);
+        g.drawText (String (average, 1) + " / " + String (worst, 1) + " %", values, Justification::centredRight);
+
+        g.setColour (Colours::darkgrey);
+        g.fillRect (bar);
+
+        g.setColour (worst >= 50.0f ? Colours::red : Colours::green);
+        g.fillRect (bar.withWidth (bar.getWidth() * jlimit (0.0f, 1.0f, average / 100.0f)));
+
+        g.setColour (Colours::white);
+        const float worstX = bar.getX() + bar.getWidth() * jlimit (0.0f, 1.0f, worst / 100.0f);
+        g.drawLine (worstX, bar.getY(), worstX, bar.getBottom());
+    }
 }
 
 void DawcAudioProcessorEditor::resized()
 {
-    // This is generally where you'll want to lay out the positions of any
-    // subcomponents in your editor..
+    auto area = getLocalBounds();
+    parameterEditor.setBounds (area.removeFromRight (400).reduced (0, 5));
+    statusArea = area.removeFromTop (60).reduced (10, 5);
+    loadArea = area.removeFromBottom (DspLoad::numEntries * 16 + 10).reduced (10, 5);
+    meterArea = area.removeFromBottom (70).reduced (10, 5);
+    historyView.setBounds (area.reduced (10, 0));
 }
@@ -10,13 +10,15 @@
 
 #pragma once
 
-#include "../JuceLibraryCode/JuceHeader.h"
+#include <JuceHeader.h>
 #include "PluginProcessor.h"
+#include "LoudnessHistoryView.h"
 
 //==============================================================================
 /**
 */
-class DawcAudioProcessorEditor  : public AudioProcessorEditor
+class DawcAudioProcessorEditor  : public AudioProcessorEditor,
+                                  private Timer
 {
 public:
     DawcAudioProcessorEditor (DreamControlAudioProcessor&);
@@ -27,9 +29,26 @@ public:
     void resized() override;
 
 private:
+    void timerCallback() override;
+    void paintDspLoad (Graphics&, Rectangle<int> area);
+
     // This reference is provided as a quick way for your editor to
     // access the processor object that created it.
     DreamControlAudioProcessor& processor;
 
+    // Meter values read directly from the processor, not from host parameters
+    MeterSnapshot meters;
+
+    // Connected and missing ports, found in the background
+    String deviceStatus;
+
+    // Drawn by OpenGL at its own rate, not by paint()
+    LoudnessHistoryView historyView;
+
+    // All parameters, the surface owner toggle among them, beside the views
+    GenericAudioProcessorEditor parameterEditor;
+
+    Rectangle<int> statusArea, meterArea, loadArea;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DawcAudioProcessorEditor)
 };
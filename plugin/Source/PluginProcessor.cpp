@@ -25,31 +25,67 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
 #include "LufsProcessor.h"
-#include "CrossoverFilter.h"
+#include "BandSplitter.h"
 #include "RmeTotalMixFaderCurve.h"
+#include "RealtimeAllocationGuard.h"
 
-#define CALLBACK_TIMER_PERIOD_MS 10									// How often parameters, meters etc are updated.
+#define CALLBACK_TIMER_PERIOD_MS DeviceHub::tickIntervalMs			// How often parameters, meters etc are updated.
 #define LOWEST_TRUE_PEAK_VALUE -125.0f
 #define LOWEST_LUFS_VALUE -64.0f
 #define LOWEST_VOLUME_VALUE -48.0f
 #define VOLUME_CONTROL_MIDI_RANGE 96.0f
 #define HIGHEST_TRUE_PEAK_VALUE 3.0f
+#define HOST_METER_CHANGE_THRESHOLD 0.001f							// Normalised change needed to notify the host of a meter value.
+#define OUTPUT_GAIN_RAMP_SECONDS 0.02								// Gain changes are ramped over this, so the volume knob doesn't zipper.
 
-#define MIDI_OUT_PORT_NAME "MIDIOUT2 (DreamControl)"				// Direct MIDI connection to our hardware.
-#define MIDI_IN_PORT_NAME "MIDIIN2 (DreamControl)"					
-#define MIDI_OUT_VOL_CONTROL_PORT_NAME "Loopback (DreamControl)"	// MIDI connection to an external volume control, currently RME TotalMix
-#define MIDI_OUT_SWITCHER_PORT_NAME "DreamControlSwitcher"			// MIDI connection to our monitor switcher relay unit
 #define MIDI_FADER_TOUCH_SENSE_CC 47
-
-#define REAPER_OSC_SEND_IP "127.0.0.1"
-#define REAPER_OSC_SEND_PORT 8000
-#define REAPER_OSC_RECEIVE_PORT 9000
+#define MIDI_FADER_NRPN 1											// Track fader, 14 bit
+#define MIDI_VOLUME_NRPN 2											// Monitor level knob, 14 bit. CC 7 is still accepted from older firmware.
+#define MIDI_NRPN_RANGE 16383.0f
+#define TRUE_PEAK_HOLD_LOOKAHEAD_MS 500.0f								// Measurements reach the tick this much after their block, at most.
+#define HARDWARE_METER_FRAME_SLOT 0									// Latest-value output slot for meter frames, stale frames are dropped
 
 const int sysexManufacturerId[3] = { 0x00, 0x21, 0x69 };			// Our SysEx manufacturer ID.
 
 enum sysexCommand {
-	SYSEX_COMMAND_METER_DATA = 1,
-	SYSEX_COMMAND_SYNC_BUTTONS = 2
+	SYSEX_COMMAND_METER_DATA = 1,		// Obsolete fixed frame, replaced by SYSEX_COMMAND_METER_FRAME
+	SYSEX_COMMAND_SYNC_BUTTONS = 2,
+	SYSEX_COMMAND_METER_FRAME = 3,
+	SYSEX_COMMAND_DSP_LOAD = 4,
+	SYSEX_COMMAND_STATE_SNAPSHOT = 5,	// All button LEDs, knob and fader, see SurfaceStateEncoder
+	SYSEX_COMMAND_STATE_DELTA = 6		// What changed since the last snapshot or delta
+};
+
+// Tags of the values in the plugin state, see StateChunk. Never reuse or renumber a tag, only add new ones.
+#define STATE_VERSION 1
+
+enum stateTag {
+	STATE_MONITOR_LEVEL = 1,
+	STATE_MUTE_MODE = 2,
+	STATE_DIM_MODE = 3,
+	STATE_REF_MODE = 4,
+	STATE_MID_SOLO = 5,
+	STATE_SIDE_SOLO = 6,
+	STATE_LOUDNESS_MODE = 7,
+	STATE_LUFS_TARGET = 8,
+	STATE_LUFS_MODE = 9,
+	STATE_PEAK_WITH_MOMENTARY_MODE = 10,
+	STATE_RELATIVE_MODE = 11,
+	STATE_1DB_PEAK_SCALE = 12,
+	STATE_DIM_LEVEL = 13,
+	STATE_REF_LEVEL = 14,
+	STATE_PEAK_HOLD_SECONDS = 15,
+	STATE_VOL_MOD_MODE = 16,
+	STATE_USE_RME_VOL_CONTROL = 17,
+	STATE_USE_REAPER_OSC = 18,
+	STATE_HOST_METERS = 19,
+	STATE_HOST_METER_RATE = 20,
+	STATE_FADER_INTERVAL = 21,
+	STATE_METER_WORKER = 22,
+	STATE_LOUDNESS_LOG = 23,
+	STATE_LOUDNESS_LOG_FILE = 24,
+	STATE_SWITCHER_TIMES = 25,			// Transport and settle ms of each output, from all off
+	STATE_SURFACE_OWNER = 26
 };
 
 enum midiNoteCommand {
@@ -101,7 +137,8 @@ enum midiNoteCommand {
 	BUTTON_READ_ALL = 46,
 	BUTTON_WRITE_ALL = 47,
 	BUTTON_3RD_METER_IS_MOMENTARY = 48,
-	BUTTON_1DB_PEAK_SCALE = 49
+	BUTTON_1DB_PEAK_SCALE = 49,
+	BUTTON_DSP_LOAD = 57
 };
 
 // RME TotalMix monitor output assignments, corresponds to index of hardware output in TotalMix. { MAIN, ALT1, ALT2, ALT3 }
@@ -123,59 +160,33 @@ DreamControlAudioProcessor::DreamControlAudioProcessor()
 #endif
 	)
 #endif
-	, MidiInputCallback()
+	, hardwareOutput(deviceHub->getHardwareOutput())
+	, reaperOscOutput(deviceHub->getReaperOscOutput())
+	, monitorSwitch(sysexManufacturerId)
+	, meterFrame(sysexManufacturerId, SYSEX_COMMAND_METER_FRAME)
+	, surfaceState(sysexManufacturerId, SYSEX_COMMAND_STATE_SNAPSHOT, SYSEX_COMMAND_STATE_DELTA, SYSEX_COMMAND_SYNC_BUTTONS)
 {
 	numChannels = getNumInputChannels();
 	msSinceLastPeakReset = 0;
-
-	// Init MIDI ports to our hardware, for sending meter values and receiving commands.
-	// We use independent ports instead of our DAW port for better SysEx support.
-	int outputDeviceId = MidiOutput::getDevices().indexOf(MIDI_OUT_PORT_NAME);
-	if (outputDeviceId > -1)
-	{
-		midiOutput = MidiOutput::openDevice(outputDeviceId);
-	}
-	else
-	{
-		NativeMessageBox::showMessageBox(AlertWindow::AlertIconType::WarningIcon, "DreamControl", "Failed to open output port to hardware.");
-		midiOutput = NULL;
-	}
-
-	int inputDeviceId = MidiInput::getDevices().indexOf(MIDI_IN_PORT_NAME);
-	if (inputDeviceId > -1)
-	{
-		midiInput = MidiInput::openDevice(inputDeviceId, this);
-		if (midiInput == NULL)
-			NativeMessageBox::showMessageBox(AlertWindow::AlertIconType::WarningIcon, "DreamControl", "Failed to open input port from hardware.");
-		else
-			midiInput->start();
-	}
-	else
-	{
-		NativeMessageBox::showMessageBox(AlertWindow::AlertIconType::WarningIcon, "DreamControl", "Failed to open input port from hardware.");
-		midiInput = NULL;
-	}
-
-	// Also try and connect to our DreamControlSwitcher unit if it's available.
-	int switcherOutputDeviceId = MidiOutput::getDevices().indexOf(MIDI_OUT_SWITCHER_PORT_NAME);
-	if (switcherOutputDeviceId > -1)
-	{
-		midiOutputToSwitcher = MidiOutput::openDevice(switcherOutputDeviceId);
-	}
-	else
-	{
-		midiOutputToSwitcher = NULL;
-	}
+	meteredSignal = -1;
+	msSinceHostMeterUpdate = 0;
+	dspLoadRequested = false;
+	isRestoringState = false;
+	wasVolControlConnected = false;
+	resetSentTotalMixValues();
+	lastMaxLeft = LOWEST_TRUE_PEAK_VALUE;
+	lastMaxRight = LOWEST_TRUE_PEAK_VALUE;
+	updateChannelPairs(getChannelLayoutOfBus(true, 0));
+
+	// The hub opens the ports in the background, every instance shares them.
+	monitorSwitch.setOutput(&deviceHub->getSwitcherOutput());
 
 	// Lambda for handling when a mode toggle changes.
 	auto modeChangedFunction = [this](const String& paramName, bool newValue)
 	{
-		// We always reset LUFS meters when a mode changes, so the time-based values are accurate.
-		// TODO: Make this an option!
-		if (paramName != "dimMode" && paramName != "refMode" && paramName != "muteMode" && paramName != "volModMode")
-		{
-			lufsProcessor->reset();
-		}
+		// A restored state is applied in one go by applyRestoredState.
+		if (isRestoringState)
+			return;
 
 		// Mid/side solo is exclusive.
 		if (newValue && (paramName == "midSolo"))
@@ -191,85 +202,43 @@ DreamControlAudioProcessor::DreamControlAudioProcessor()
 		if (newValue && (paramName == "refMode"))
 			dimMode->setValueNotifyingHost(false);
 		
-		int button = 0;
-
-		auto& params = this->getParameters();
-		for (auto p : params)
-		{
-			if (auto* param = dynamic_cast<AudioParameterBoolNotify*> (p))
-				if (param->paramID.compare(paramName) == 0)
-					for (auto &keyval : this->buttonParamMap)
-						if (keyval.second == param)
-						{
-							button = keyval.first;
-							goto found_button;
-						}
-		}
+		// Light the button's LED, if the parameter has one.
+		int button = this->routingTable.getButtonForParameter(paramName);
+		int feedbackNote = this->routingTable.getFeedbackNote(button);
 
-	found_button:
-		if (midiOutput != nullptr)
-			midiOutput->sendMessageNow(MidiMessage::noteOn(1, button, newValue ? 1.0f : 0.0f));
+		if (feedbackNote >= 0)
+			this->surfaceState.setLed(feedbackNote, newValue);
 	};
 
 	// Lambda for handling when Reaper OSC integration is enabled/disabled.
 	auto reaperOscChangedFunction = [this](const String& paramName, bool newValue)
 	{
-		if (newValue == true)
-		{
-			// Enable OSC send/receive.
-			if (!this->reaperOscSender.connect(REAPER_OSC_SEND_IP, REAPER_OSC_SEND_PORT))
-			{
-				std::string send_ip(REAPER_OSC_SEND_IP);
-
-				NativeMessageBox::showMessageBox(AlertWindow::AlertIconType::WarningIcon, "DreamControl",
-					"Failed to open REAPER OSC send port (" + send_ip + ":" + std::to_string(REAPER_OSC_SEND_PORT) + ").");
-			}
+		if (isRestoringState)
+			return;
 
-			if (this->connect(REAPER_OSC_RECEIVE_PORT))
-			{
-				this->OSCReceiver::addListener(this);
-				oscConnected = true;
-			}
-			else
-			{
-				NativeMessageBox::showMessageBox(AlertWindow::AlertIconType::WarningIcon, "DreamControl",
-					"Failed to open REAPER OSC receive port (" + std::to_string(REAPER_OSC_RECEIVE_PORT) + ").");
-			}
-		}
-		else
-		{
-			this->OSCReceiver::removeListener(this);
-			this->reaperOscSender.disconnect();
-			//if (oscConnected) this->disconnect();
-			oscConnected = false;
-		}
+		this->deviceHub->setReaperOscEnabled(this, newValue);
 	};
 
 	// Lambda for handling when RME volume control is enabled/disabled.
 	auto rmeVolControlChangedFunction = [this](const String& paramName, bool newValue)
 	{
-		// We support an optional RME volume control (TotalMix) on a loopback MIDI port.
-		if (newValue == true)
-		{
-			auto devs = MidiOutput::getDevices();
-			int volControlDeviceId = devs.indexOf(MIDI_OUT_VOL_CONTROL_PORT_NAME);
-			if (volControlDeviceId > -1)
-			{
-				this->midiOutputToVolControl.reset(MidiOutput::openDevice(volControlDeviceId));
-			}
-			else
-			{
-				NativeMessageBox::showMessageBox(AlertWindow::AlertIconType::WarningIcon, "DreamControl", "Failed to open loopback MIDI port (must be named 'Loopback (DreamControl)'.");
-				this->midiOutputToVolControl = nullptr;
-			}
-		}
+		if (isRestoringState)
+			return;
+
+		this->deviceHub->setVolControlEnabled(this, newValue);
+		this->resetSentTotalMixValues();
+	};
+
+	// Lambda for handling when the user chooses this instance to drive the hardware, or gives it up.
+	auto surfaceOwnerChangedFunction = [this](const String& paramName, bool newValue)
+	{
+		if (isRestoringState)
+			return;
+
+		if (newValue)
+			this->deviceHub->takeSurface(this);
 		else
-		{
-			if (this->midiOutputToVolControl != nullptr)
-			{
-				this->midiOutputToVolControl.reset();
-			}
-		}
+			this->deviceHub->releaseSurface(this);
 	};
 
 	faderRpnDetector = new MidiRPNDetector();
@@ -342,8 +311,27 @@ DreamControlAudioProcessor::DreamControlAudioProcessor()
 	addParameter(useRMEMonitorSwitch = new AudioParameterBool("useRMEMonitorSwitch", "RME TotalMix monitor switch", false));
 	addParameter(useReaperOsc = new AudioParameterBoolNotify("useReaperOsc", "REAPER OSC integration", false, reaperOscChangedFunction));
 
-	// Our map of button note numbers to plugin parameters.
-	buttonParamMap = {
+	// Meter outputs to the host, off by default as hosts record and redraw every change.
+	// Added last so the indices of the parameters above don't change.
+	addParameter(hostMeters = new AudioParameterBool("hostMeters", "Send meters to host", false));
+	addParameter(hostMeterRate = new AudioParameterFloat("hostMeterRate", "Host meter rate (Hz)", 1.0f, 50.0f, 10.0f));
+	addParameter(lufsMomentary);
+	addParameter(lufsShort);
+	addParameter(lufsIntegrated);
+	addParameter(peakMeterLeft);
+	addParameter(peakMeterRight);
+	addParameter(peakMeterMaxLeft);
+	addParameter(peakMeterMaxRight);
+	addParameter(clipMeterLeft);
+	addParameter(clipMeterRight);
+
+	addParameter(faderInterval = new AudioParameterInt("faderInterval", "Fader update interval (ms)", 0, 100, 20));
+	addParameter(meterWorker = new AudioParameterBool("meterWorker", "Meter analysis on worker thread", false));
+	addParameter(loudnessLog = new AudioParameterBool("loudnessLog", "Loudness log", false));
+	addParameter(surfaceOwner = new AudioParameterBoolNotify("surfaceOwner", "Drives the hardware", false, surfaceOwnerChangedFunction));
+
+	// Default button routing: button note numbers to plugin parameters.
+	const std::pair<int, AudioParameterBoolNotify*> buttonParameters[] = {
 		{ BUTTON_LOUD, loudnessMode },
 		{ BUTTON_MONO, midSolo },
 		{ BUTTON_SIDE, sideSolo },
@@ -362,8 +350,11 @@ DreamControlAudioProcessor::DreamControlAudioProcessor()
 		{ BUTTON_1DB_PEAK_SCALE, is1dbPeakScale }
 	};
 
-	// OSC address to button map, for REAPER integration.
-	reaperOscButtonMap = {
+	for (auto& button : buttonParameters)
+		routingTable.setParameter(button.first, button.second);
+
+	// Button to OSC address, for REAPER integration.
+	const std::pair<int, const char*> buttonOscAddresses[] = {
 		{ BUTTON_RETURN, "/action/40632" },
 		{ BUTTON_LOOP, "/repeat" },
 		{ BUTTON_BACK, "/action/40084" },
@@ -394,33 +385,54 @@ DreamControlAudioProcessor::DreamControlAudioProcessor()
 		{ BUTTON_EXT2, "/track/6/solo" }
 	};
 
-	if (midiOutput != nullptr && useRMEVolControl->get())
+	for (auto& button : buttonOscAddresses)
+		routingTable.setOscAddress(button.first, button.second);
+
+	// The user can remap buttons with a routing file.
+	File routingFile = ControlRoutingTable::getUserRoutingFile();
+	if (routingFile.existsAsFile())
 	{
-		midiOutput->sendMessageNow(MidiMessage::noteOn(1, BUTTON_MAIN, 1.0f));
-		updateRMEVolumeControl();
+		auto findParameter = [this](const String& paramID) -> AudioParameterBoolNotify*
+		{
+			for (auto* p : this->getParameters())
+				if (auto* param = dynamic_cast<AudioParameterBoolNotify*> (p))
+					if (param->paramID == paramID)
+						return param;
+			return nullptr;
+		};
+
+		// The table is left as it was if the file fails to load, the default routing stays.
+		Result result = routingTable.loadFromFile(routingFile, findParameter);
+		if (result.failed())
+		{
+			routingFileStatus = "Routing: " + result.getErrorMessage() + ", using the default\n";
+			Logger::writeToLog("DreamControl: failed to load button routing file: " + result.getErrorMessage());
+		}
 	}
 
-	if (midiOutput != nullptr)
+	if (deviceHub->isHardwareConnected() && useRMEVolControl->get())
 	{
-		midiOutput->sendMessageNow(MidiMessage::noteOn(1, BUTTON_MIX, 1.0f));
-		for (int i = BUTTON_CUE1; i <= BUTTON_EXT2; i++)
-			midiOutput->sendMessageNow(MidiMessage::noteOn(1, i, 0.0f));
+		surfaceState.setLed(BUTTON_MAIN, true);
+		updateRMEVolumeControl();
 	}
+
+	surfaceState.setLed(BUTTON_MIX, true);
+	for (int i = BUTTON_CUE1; i <= BUTTON_EXT2; i++)
+		surfaceState.setLed(i, false);
+
+	// The first snapshot goes out with the first timer tick. If no other instance has the hardware, this one takes it.
+	syncSurfaceState();
+	deviceHub->addClient(this);
 }
 
 DreamControlAudioProcessor::~DreamControlAudioProcessor()
 {
-	if (midiInput != nullptr) midiInput->stop();
-	stopTimer();
+	// No hub callbacks after this, the hardware passes to another instance if there is one.
+	deviceHub->removeClient(this);
+	cancelPendingUpdate();
+	monitorSwitch.setOutput(nullptr);
+	loudnessHistory.release();
 	delete lufsProcessor;
-	if (midiInput != nullptr) delete midiInput;
-	if (midiOutput != nullptr) delete midiOutput;
-	if (midiOutputToSwitcher != nullptr) delete midiOutputToSwitcher;
-	if (midiOutputToVolControl != nullptr) midiOutputToVolControl.reset();
-
-	this->OSCReceiver::removeListener(this);
-	reaperOscSender.disconnect();
-	//if (oscConnected) this->disconnect();
 }
 
 //==============================================================================
@@ -491,67 +503,108 @@ void DreamControlAudioProcessor::prepareToPlay(double sampleRate, int samplesPer
 	numChannels = getNumInputChannels();
 	int bufferSize = getBlockSize();
 
+	// The layout may have changed since last time. The timer reads the LUFS processor, so stop it first.
+	deviceHub->setTicking(this, false);
+
+	const AudioChannelSet layout = getChannelLayoutOfBus(true, 0);
+	updateChannelPairs(layout);
+
 	//////////////////////////////////////////////////////////////////////////
 	// Crossover filter initialisation
 	//////////////////////////////////////////////////////////////////////////
 
-	// Allocate memory for filter objects
-	crossoverFilters.resize(numChannels);
-	for (auto &it : crossoverFilters)
-		it.resize(numCrossovers * 4);		// * 4 for duplicated filters for Linkwitz-Riley implementation
-
-	if (crossoverFilters.size() != 0) {
-		std::vector<std::vector<std::unique_ptr<CrossoverFilter>>>::iterator row;
-		std::vector<std::unique_ptr<CrossoverFilter>>::iterator col;
-		for (row = crossoverFilters.begin(); row != crossoverFilters.end(); row++) {
-			for (col = row->begin(); col != row->end(); col++) {
-				*col = std::make_unique<CrossoverFilter>(false, true);
-			}
-		}
-	}
+	bandSplitter.prepare(sampleRate, numChannels);
 
 	// Update the filter settings to work with the current parameters and sample rate
-	updateFilters(sampleRate);
+	updateFilters();
 
 	//////////////////////////////////////////////////////////////////////////
 	// Loudness EQ initialisation
 	//////////////////////////////////////////////////////////////////////////
 
-	loudnessEqFilters.resize(numChannels);
-	for (auto &it : loudnessEqFilters)
-		it.resize(7);						// 7 bands of EQ for our loudness EQ
+	MonitorStages::prepareLoudnessEq(loudnessEq, numChannels, sampleRate);
 
-	if (loudnessEqFilters.size() != 0) {
-		std::vector<std::vector<std::unique_ptr<IIRFilter>>>::iterator row;
-		std::vector<std::unique_ptr<IIRFilter>>::iterator col;
-		for (row = loudnessEqFilters.begin(); row != loudnessEqFilters.end(); row++) {
-			for (col = row->begin(); col != row->end(); col++) {
-				*col = std::make_unique<IIRFilter>(IIRFilter());
-			}
-		}
+	//////////////////////////////////////////////////////////////////////////
+	// Loudness meter initialisation
+	//////////////////////////////////////////////////////////////////////////
+
+	if (lufsProcessor->getNbChannels() != jmin(numChannels, LUFS_TP_MAX_NB_CHANNELS))
+	{
+		// The log can't take the new layout, so the new processor starts a session beside it.
+		const File logFile = lufsProcessor->getLogFile();
+
+		loudnessHistory.release();
+		delete lufsProcessor;
+		lufsProcessor = new LufsProcessor(numChannels);
+
+		if (logFile != File())
+			lufsProcessor->setLogFile(logFile);
 	}
+	lufsProcessor->setChannelLayout(layout);
+	lufsProcessor->setBackgroundAnalysis(meterWorker->get());
+	lufsProcessor->prepareToPlay(sampleRate, samplesPerBlock);
 
-	for (int chan = 0; chan < numChannels; chan++)
+	dspLoadMeter.prepare(sampleRate);
+	monitorSwitch.prepare(sampleRate);
+	outputGain.prepare(sampleRate, OUTPUT_GAIN_RAMP_SECONDS);
+
+	deviceHub->setTicking(this, true);
+}
+
+void DreamControlAudioProcessor::updateChannelPairs(const AudioChannelSet& layout)
+{
+	const int numLayoutChannels = jmin(layout.size(), LUFS_TP_MAX_NB_CHANNELS);
+
+	numChannelPairs = 0;
+	for (int channel = 0; channel < LUFS_TP_MAX_NB_CHANNELS; channel++)
+		isPairedChannel[channel] = false;
+
+	if (layout.isDiscreteLayout())
 	{
-		// EQ parameters taken from https://www.hometheatershack.com/forums/av-home-theater/23077-equal-loudness-db-phons-contours-eq-you-will-want-give-listen.html
-		// TODO: This needs to be checked and has scope for improvement.
-		loudnessEqFilters[chan][0]->setCoefficients(IIRCoefficients::makePeakFilter(sampleRate, 20.0, 4.45, Decibels::decibelsToGain(-38.9)));
-		loudnessEqFilters[chan][1]->setCoefficients(IIRCoefficients::makePeakFilter(sampleRate, 1130.0, 0.65, Decibels::decibelsToGain(3.85)));
-		loudnessEqFilters[chan][2]->setCoefficients(IIRCoefficients::makePeakFilter(sampleRate, 1490.0, 2.20, Decibels::decibelsToGain(-8.15)));
-		loudnessEqFilters[chan][3]->setCoefficients(IIRCoefficients::makePeakFilter(sampleRate, 3290.0, 0.59, Decibels::decibelsToGain(6.55)));
-		loudnessEqFilters[chan][4]->setCoefficients(IIRCoefficients::makePeakFilter(sampleRate, 8850.0, 1.78, Decibels::decibelsToGain(-12.88)));
-		loudnessEqFilters[chan][5]->setCoefficients(IIRCoefficients::makePeakFilter(sampleRate, 12300.0, 4.50, Decibels::decibelsToGain(5.44)));
-		loudnessEqFilters[chan][6]->setCoefficients(IIRCoefficients::makePeakFilter(sampleRate, 20000.0, 3.50, Decibels::decibelsToGain(-10.50)));
+		// No speaker positions, so assume consecutive pairs.
+		for (int channel = 0; channel + 1 < numLayoutChannels; channel += 2)
+		{
+			channelPairs[numChannelPairs][0] = channel;
+			channelPairs[numChannelPairs][1] = channel + 1;
+			numChannelPairs++;
+		}
 	}
+	else
+	{
+		static const AudioChannelSet::ChannelType pairTypes[][2] = {
+			{ AudioChannelSet::left, AudioChannelSet::right },
+			{ AudioChannelSet::leftCentre, AudioChannelSet::rightCentre },
+			{ AudioChannelSet::wideLeft, AudioChannelSet::wideRight },
+			{ AudioChannelSet::leftSurround, AudioChannelSet::rightSurround },
+			{ AudioChannelSet::leftSurroundSide, AudioChannelSet::rightSurroundSide },
+			{ AudioChannelSet::leftSurroundRear, AudioChannelSet::rightSurroundRear },
+			{ AudioChannelSet::topFrontLeft, AudioChannelSet::topFrontRight },
+			{ AudioChannelSet::topRearLeft, AudioChannelSet::topRearRight }
+		};
 
-	//////////////////////////////////////////////////////////////////////////
-	// Loudness meter initialisation
-	//////////////////////////////////////////////////////////////////////////
+		for (const auto& types : pairTypes)
+		{
+			const int left = layout.getChannelIndexForType(types[0]);
+			const int right = layout.getChannelIndexForType(types[1]);
 
-	lufsProcessor->prepareToPlay(sampleRate, samplesPerBlock);
-	lufsProcessor->reset();
+			if (left >= 0 && right >= 0 && left < numLayoutChannels && right < numLayoutChannels)
+			{
+				channelPairs[numChannelPairs][0] = left;
+				channelPairs[numChannelPairs][1] = right;
+				numChannelPairs++;
+			}
+		}
+	}
 
-	startTimer(CALLBACK_TIMER_PERIOD_MS);
+	for (int pair = 0; pair < numChannelPairs; pair++)
+	{
+		isPairedChannel[channelPairs[pair][0]] = true;
+		isPairedChannel[channelPairs[pair][1]] = true;
+	}
+
+	// The hardware has L/R meters: show the first pair, or the single channel of a mono layout.
+	meterLeftChannel = numChannelPairs > 0 ? channelPairs[0][0] : 0;
+	meterRightChannel = numChannelPairs > 0 ? channelPairs[0][1] : 0;
 }
 
 void DreamControlAudioProcessor::releaseResources()
@@ -566,10 +619,9 @@ bool DreamControlAudioProcessor::isBusesLayoutSupported(const BusesLayout& layou
 	ignoreUnused(layouts);
 	return true;
 #else
-	// This is the place where you check if the layout is supported.
-	// In this template code we only support mono or stereo.
-	if (layouts.getMainOutputChannelSet() != AudioChannelSet::mono()
-		&& layouts.getMainOutputChannelSet() != AudioChannelSet::stereo())
+	// Any layout up to the meter's channel limit: LUFS weights and M/S pairs come from the speaker positions.
+	const int numLayoutChannels = layouts.getMainOutputChannelSet().size();
+	if (numLayoutChannels < 1 || numLayoutChannels > LUFS_TP_MAX_NB_CHANNELS)
 		return false;
 
 	// This checks if the input layout matches the output layout
@@ -591,106 +643,117 @@ void DreamControlAudioProcessor::processBlock(AudioBuffer<float>& buffer, MidiBu
 
 	const int numInputChannels = getNumInputChannels();   
 	const int numOutputChannels = getNumOutputChannels();   
-	const int numSamples = buffer.getNumSamples();          												
 
-	// Perform band filtering if any of our band solos are engaged.
-	if (isAnyBandSolo()) 
-	{
-		AudioSampleBuffer inputBuffer;
-		AudioSampleBuffer chanBuffer = AudioSampleBuffer(1, numSamples);
-		inputBuffer.makeCopyOf(buffer);
-		buffer.clear();
-
-		// For each channel, for each band, perform LP and HP filtering on input, then sum to main output buffer.
-		// Lowest and highest bands have 1 L/HPF, and mid bands have 1 LPF + 1 HPF. These are also doubled in number to make Linkwitz-Riley filters.
-		for (int chan = 0; chan < numInputChannels; chan++)
-		{	
-			int filtIndex = 0;
-
-			for (int band = 0; band < numBands; band++)
-			{
-				int filtCount = (band > 0) && (band < numBands - 1) ? 4 : 2;
+	// Debug builds assert if anything below allocates.
+	RealtimeAllocationGuard noAllocations;
 
-				if (bandSolo[band]->get() == false)
-				{
-					// If band is not solo'd, skip this band.
-					filtIndex += filtCount;
-					continue;
-				}
+	// Flush denormals to zero (FTZ/DAZ) for the whole callback.
+	ScopedNoDenormals noDenormals;
 
-				for (int i = 0; i < filtCount; i++)
-				{
-					float* sourcePointer = (i == 0) ? inputBuffer.getWritePointer(chan) : chanBuffer.getWritePointer(0);
-					crossoverFilters[chan][filtIndex]->applyFilter(sourcePointer, chanBuffer.getWritePointer(0), numSamples);
-					filtIndex++;
-				}				
-
-				// Sum to output buffer
-				for (int sample = 0; sample < numSamples; ++sample)
-					buffer.getWritePointer(chan)[sample] += chanBuffer.getReadPointer(0)[sample];
-			}
-		}
-	}
+	dspLoadMeter.startBlock(buffer.getNumSamples());
 
-	// Mid/side solo
-	if (midSolo->get() == true)
-	{
-		for (int sample = 0; sample < numSamples; ++sample)
-		{
-			buffer.getWritePointer(0)[sample] = (buffer.getReadPointer(0)[sample] + buffer.getReadPointer(1)[sample]) / 2.0;
-			buffer.getWritePointer(1)[sample] = buffer.getReadPointer(0)[sample];
-		}
-	}
-	else if (sideSolo->get() == true)
+	// Perform band filtering if any of our band solos are engaged.
+	// All solo'd bands come out of a single pass of the crossover tree, in place.
+	if (isAnyBandSolo()) 
 	{
-		AudioSampleBuffer inputBuffer;
-		inputBuffer.makeCopyOf(buffer);
+		bool soloState[BandSplitter::numBands];
+		for (int band = 0; band < numBands; band++)
+			soloState[band] = bandSolo[band]->get();
 
-		for (int sample = 0; sample < numSamples; ++sample)
-		{
-			buffer.getWritePointer(0)[sample] = ((inputBuffer.getReadPointer(1)[sample] - inputBuffer.getReadPointer(0)[sample]) 
-				+ -(inputBuffer.getReadPointer(0)[sample] - inputBuffer.getReadPointer(1)[sample])) / 2.0;
-			buffer.getWritePointer(1)[sample] = buffer.getReadPointer(0)[sample];
-		}
+		bandSplitter.process(buffer, numInputChannels, soloState);
 	}
+	dspLoadMeter.endStage(DspLoad::bandSolo);
 
-	// Loudness EQ
+	// Loudness EQ. It is the same on every channel, so it can come before the mid/side matrix.
 	if (loudnessMode->get() == true)
 	{
-		for (int chan = 0; chan < numChannels; chan++)
-		{
-			for (int i = 0; i < 7; i++)
-				loudnessEqFilters[chan][i]->processSamples(buffer.getWritePointer(chan), numSamples);
-		}
+		// All 7 bands in one pass over the block.
+		loudnessEq.process(buffer, numChannels);
 	}
+	dspLoadMeter.endStage(DspLoad::loudEq);
+
+	// Filters skip silence themselves once their state has decayed. Checked after them, so their tails
+	// still go through mid/side and gain; the stateless stages just leave silence as it is.
+	// Metering still runs, so momentary and short term values fall to the floor.
+	const bool isSilentInput = BiquadCascade<float>::isSilent(buffer.getArrayOfReadPointers(), buffer.getNumChannels(), buffer.getNumSamples());
+
+	// Monitor/ref/dim gain, or mute. The external volume control does this itself.
+	const float currentGainDb = dimMode->get() ? dimLevel->get() : refMode->get() ? refLevel->get() : monitorLevel->get();
+	if (useRMEVolControl->get())
+		outputGain.setTarget(1.0f);
+	else if (muteMode->get() || currentGainDb <= LOWEST_VOLUME_VALUE)
+		outputGain.setTarget(0.0f);
+	else
+		outputGain.setTarget(Decibels::decibelsToGain(currentGainDb));
 
-	// Perform LUFS and True Peak measurements.
-	lufsProcessor->processBlock(buffer);
+	// Output stage, a chunk at a time: mid/side solo per left/right pair, LUFS and True Peak
+	// measurements of the chunk in place, then the gain ramp while the chunk is still in cache.
+	const MonitorStages::MidSideMode midSideMode = isSilentInput ? MonitorStages::stereo
+		: midSolo->get() ? MonitorStages::midSolo : sideSolo->get() ? MonitorStages::sideSolo : MonitorStages::stereo;
+	const int numSamples = buffer.getNumSamples();
 
-	if (!useRMEVolControl->get()) 
+	for (int start = 0; start < numSamples; start += MonitorStages::outputChunkSize)
 	{
-		// Monitor/ref/dim gain.
-		float currentGainDb = dimMode->get() ? dimLevel->get() : refMode->get() ? refLevel->get() : monitorLevel->get();
+		const int chunkSize = jmin((int)MonitorStages::outputChunkSize, numSamples - start);
 
-		// Set gain, or mute
-		if (muteMode->get() || currentGainDb <= LOWEST_VOLUME_VALUE)
-		{
-			buffer.clear();
-		}
+		MonitorStages::applyMidSide(buffer, start, chunkSize, midSideMode, channelPairs, numChannelPairs, isPairedChannel, jmin(numInputChannels, LUFS_TP_MAX_NB_CHANNELS));
+		dspLoadMeter.endStage(DspLoad::midSide);
+
+		lufsProcessor->processBlock(buffer, start, chunkSize);
+		dspLoadMeter.endStage(DspLoad::metering);
+
+		if (isSilentInput)
+			outputGain.skip(chunkSize);
 		else
-		{
-			float gain = Decibels::decibelsToGain(currentGainDb);
-			buffer.applyGain(gain);
-		}
+			MonitorStages::applyGain(buffer, start, chunkSize, numChannels, outputGain);
+		dspLoadMeter.endStage(DspLoad::gain);
 	}
+
+	// Monitor switching fade, also with external volume control.
+	monitorSwitch.process(buffer, numChannels);
+	dspLoadMeter.endStage(DspLoad::gain);
+
+	dspLoadMeter.endBlock();
+}
+
+//==============================================================================
+// The LUFS processor hands the new analysis mode to processBlock itself, so processing goes on.
+void DreamControlAudioProcessor::updateMeterWorker()
+{
+	lufsProcessor->setBackgroundAnalysis(meterWorker->get());
+}
+
+void DreamControlAudioProcessor::updateLoudnessLog()
+{
+	if (loudnessLog->get() == isLoudnessLogRequested)
+		return;
+
+	isLoudnessLogRequested = loudnessLog->get();
+
+	// The session file is created by the processor's log thread, not on the hub timer.
+	if (isLoudnessLogRequested)
+		lufsProcessor->startLogSession(getLoudnessLogDirectory());
+	else
+		lufsProcessor->setLogFile(File());
+}
+
+File DreamControlAudioProcessor::getLoudnessLogDirectory()
+{
+	return File::getSpecialLocation(File::userApplicationDataDirectory).getChildFile("DreamControl").getChildFile("Loudness logs");
 }
 
 //==============================================================================
-// Callback executed every 10ms.
-void DreamControlAudioProcessor::hiResTimerCallback()
+// Callback executed every 10ms, from the hub's timer.
+void DreamControlAudioProcessor::deviceHubTick(bool isSurfaceOwner)
 {
+	// The switch's 1 ms timer only runs while switching.
+	monitorSwitch.tick();
+
 	// LUFS meter.
+	updateMeterWorker();
+	updateLoudnessLog();
 	lufsProcessor->update();
+	loudnessHistory.update(*lufsProcessor);
 	const int validSize = lufsProcessor->getValidSize();
 
 	float lufsSval = lufsProcessor->getShortTermVolumeArray()[validSize - 1];
@@ -699,39 +762,32 @@ void DreamControlAudioProcessor::hiResTimerCallback()
 	float lufsMinVal = lufsProcessor->getRangeMinVolume();
 	float lufsMaxVal = lufsProcessor->getRangeMaxVolume();
 
-	lufsShort->setValueNotifyingHost(((lufsSval >= LOWEST_LUFS_VALUE ? lufsSval : LOWEST_LUFS_VALUE) - LOWEST_LUFS_VALUE) / -LOWEST_LUFS_VALUE);
-	lufsMomentary->setValueNotifyingHost(((lufsMval >= LOWEST_LUFS_VALUE ? lufsMval : LOWEST_LUFS_VALUE) - LOWEST_LUFS_VALUE) / -LOWEST_LUFS_VALUE);
-	lufsIntegrated->setValueNotifyingHost(((lufsIval >= LOWEST_LUFS_VALUE ? lufsIval : LOWEST_LUFS_VALUE) - LOWEST_LUFS_VALUE) / -LOWEST_LUFS_VALUE);
-	lufsRangeMin->setValueNotifyingHost(((lufsMinVal >= LOWEST_LUFS_VALUE ? lufsMinVal : LOWEST_LUFS_VALUE) - LOWEST_LUFS_VALUE) / -LOWEST_LUFS_VALUE);
-	lufsRangeMax->setValueNotifyingHost(((lufsMaxVal >= LOWEST_LUFS_VALUE ? lufsMaxVal : LOWEST_LUFS_VALUE) - LOWEST_LUFS_VALUE) / -LOWEST_LUFS_VALUE);
-
 	if (lufsReset->get() == true)
 	{
 		lufsReset->setValueNotifyingHost(false);
-		lufsProcessor->reset();
+		lufsProcessor->startNewSession();
 		msSinceLastPeakReset = 0;
 	}
 
+	// The meters tap after the band solos, loudness EQ and mid/side: another signal is another measurement.
+	// The log of the previous one is kept in its own session file.
+	if (!isRestoringState)
+	{
+		const int currentMeteredSignal = getMeteredSignal();
+		const int previousMeteredSignal = meteredSignal.exchange(currentMeteredSignal);
+		if (previousMeteredSignal >= 0 && previousMeteredSignal != currentMeteredSignal)
+			lufsProcessor->startNewSession();
+	}
+
 	// True Peak meter.
-	float truePeakRange = LOWEST_TRUE_PEAK_VALUE - HIGHEST_TRUE_PEAK_VALUE;
-	float peakLval = lufsProcessor->getTruePeakChannelArray(0)[validSize - 1] - HIGHEST_TRUE_PEAK_VALUE;
-	float peakRval = lufsProcessor->getTruePeakChannelArray(1)[validSize - 1] - HIGHEST_TRUE_PEAK_VALUE;
-	peakMeterLeft->setValueNotifyingHost(((peakLval >= truePeakRange ? peakLval : truePeakRange) - truePeakRange) / -truePeakRange);
-	peakMeterRight->setValueNotifyingHost(((peakRval >= truePeakRange ? peakRval : truePeakRange) - truePeakRange) / -truePeakRange);
+	float peakLval = lufsProcessor->getTruePeakChannelArray(meterLeftChannel)[validSize - 1] - HIGHEST_TRUE_PEAK_VALUE;
+	float peakRval = lufsProcessor->getTruePeakChannelArray(meterRightChannel)[validSize - 1] - HIGHEST_TRUE_PEAK_VALUE;
 
 	float peakHold = peakHoldSeconds->get();
 	if (peakHold == 0.0f || msSinceLastPeakReset >= peakHold * 1000.0f || peakLval > lastMaxLeft)
-	{
-		peakMeterMaxLeft->setValueNotifyingHost(((peakLval >= truePeakRange ? peakLval : truePeakRange) - truePeakRange) / -truePeakRange);
-		clipMeterLeft->setValueNotifyingHost(peakLval + HIGHEST_TRUE_PEAK_VALUE > 0.0f);
 		lastMaxLeft = peakLval;
-	}
 	if (peakHold == 0.0f || msSinceLastPeakReset >= peakHold * 1000.0f || peakRval > lastMaxRight)
-	{
-		peakMeterMaxRight->setValueNotifyingHost(((peakRval >= truePeakRange ? peakRval : truePeakRange) - truePeakRange) / -truePeakRange);
-		clipMeterRight->setValueNotifyingHost(peakRval + HIGHEST_TRUE_PEAK_VALUE > 0.0f);
 		lastMaxRight = peakRval;
-	}
 
 	if (peakHold == 0.0f || msSinceLastPeakReset >= peakHold * 1000.0f)
 		msSinceLastPeakReset = 0.0f;
@@ -739,101 +795,222 @@ void DreamControlAudioProcessor::hiResTimerCallback()
 	if (peakHold > 0.0f)
 		msSinceLastPeakReset += CALLBACK_TIMER_PERIOD_MS;
 
-	// Send MIDI SysEx packet to hardware with meter values.
-	// We send float values as 2 bytes, integral and fractional.
-	// This allows us a range of -99.99 to 0.00 dB, suitable for our meters. We could improve this.
-	if (midiOutput != nullptr) {
-		char* lufsSints = getMeterIntegralFractional(lufsSval);
-		char* lufsMints = getMeterIntegralFractional(lufsMval);
-		char* lufsIints = getMeterIntegralFractional(lufsIval);
-		char* lufsMinInts = getMeterIntegralFractional(lufsMinVal);
-		char* lufsMaxInts = getMeterIntegralFractional(lufsMaxVal);
-		float lufsRangeVal = lufsMaxVal - lufsMinVal;
-		char* lufsRangeInts = getMeterIntegralFractional(lufsRangeVal);
-		char* lufsTargetVal = getMeterIntegralFractional(lufsTarget->get());
-		char* peakLints = getMeterIntegralFractional(peakLval);
-		char* peakRints = getMeterIntegralFractional(peakRval);
-
-		char* lastMaxLeftInts = getMeterIntegralFractional(lastMaxLeft);
-		char* lastMaxRightInts = getMeterIntegralFractional(lastMaxRight);
-
-		float lastMaxTotalVal = lastMaxLeft > lastMaxRight ? lastMaxLeft : lastMaxRight;
-		char* lastMaxTotalInts = getMeterIntegralFractional(lastMaxTotalVal);
-
-		unsigned char sysexData[] = { 
-			sysexManufacturerId[0], sysexManufacturerId[1], sysexManufacturerId[2],
-			SYSEX_COMMAND_METER_DATA,
-			lufsSints[0], lufsSints[1],
-			lufsMints[0], lufsMints[1],
-			lufsIints[0], lufsIints[1],
-			lufsMinInts[0], lufsMinInts[1],
-			lufsMaxInts[0], lufsMaxInts[1],
-			lufsRangeInts[0], lufsRangeInts[1],
-			lufsTargetVal[0], lufsTargetVal[1],
-			peakLints[0], peakLints[1],
-			peakRints[0], peakRints[1],
-			lastMaxLeftInts[0], lastMaxLeftInts[1],
-			lastMaxRightInts[0], lastMaxRightInts[1],
-			lastMaxTotalInts[0], lastMaxTotalInts[1],
-			peakLval + HIGHEST_TRUE_PEAK_VALUE > 0.0f ? 1 : 0, peakRval + HIGHEST_TRUE_PEAK_VALUE > 0.0f ? 1 : 0
-		};
+	// A block that can't beat the held maximum doesn't change the reading, so it isn't oversampled.
+	// Not just before the hold starts again from the current value, which must be the block's true peak.
+	const bool isHoldEnding = peakHold == 0.0f || msSinceLastPeakReset + TRUE_PEAK_HOLD_LOOKAHEAD_MS >= peakHold * 1000.0f;
+	lufsProcessor->setTruePeakEarlyOutLevel(isHoldEnding ? 0.0f : Decibels::decibelsToGain(jmin(lastMaxLeft, lastMaxRight) + HIGHEST_TRUE_PEAK_VALUE));
+
+	// Publish this tick's values for the editor.
+	MeterSnapshot snapshot;
+	snapshot.lufsShort = lufsSval;
+	snapshot.lufsMomentary = lufsMval;
+	snapshot.lufsIntegrated = lufsIval;
+	snapshot.lufsRangeMin = lufsMinVal;
+	snapshot.lufsRangeMax = lufsMaxVal;
+	snapshot.lufsTarget = lufsTarget->get();
+	snapshot.peakLeft = peakLval + HIGHEST_TRUE_PEAK_VALUE;
+	snapshot.peakRight = peakRval + HIGHEST_TRUE_PEAK_VALUE;
+	snapshot.maxPeakLeft = lastMaxLeft + HIGHEST_TRUE_PEAK_VALUE;
+	snapshot.maxPeakRight = lastMaxRight + HIGHEST_TRUE_PEAK_VALUE;
+	snapshot.clipLeft = snapshot.maxPeakLeft > 0.0f;
+	snapshot.clipRight = snapshot.maxPeakRight > 0.0f;
+	snapshot.seconds = lufsProcessor->getSeconds();
+	dspLoadMeter.getLatestLoad(dspLoad);
+	snapshot.dspLoad = dspLoad;
+	meterSnapshots.getWriteBuffer() = snapshot;
+	meterSnapshots.publish();
+
+	updateHostMeters(snapshot);
+
+	// Send MIDI SysEx frame to hardware with the meter values that changed.
+	// True peak values are sent as dBTP, so they can go above 0.
+	if (isSurfaceOwner && deviceHub->isHardwareConnected()) {
+		meterFrame.setLevel(MeterFrameEncoder::lufsShort, snapshot.lufsShort);
+		meterFrame.setLevel(MeterFrameEncoder::lufsMomentary, snapshot.lufsMomentary);
+		meterFrame.setLevel(MeterFrameEncoder::lufsIntegrated, snapshot.lufsIntegrated);
+		meterFrame.setLevel(MeterFrameEncoder::lufsRangeMin, snapshot.lufsRangeMin);
+		meterFrame.setLevel(MeterFrameEncoder::lufsRangeMax, snapshot.lufsRangeMax);
+		meterFrame.setLevel(MeterFrameEncoder::lufsRange, snapshot.lufsRangeMax - snapshot.lufsRangeMin);
+		meterFrame.setLevel(MeterFrameEncoder::lufsTarget, snapshot.lufsTarget);
+		meterFrame.setLevel(MeterFrameEncoder::peakLeft, snapshot.peakLeft);
+		meterFrame.setLevel(MeterFrameEncoder::peakRight, snapshot.peakRight);
+		meterFrame.setLevel(MeterFrameEncoder::maxPeakLeft, snapshot.maxPeakLeft);
+		meterFrame.setLevel(MeterFrameEncoder::maxPeakRight, snapshot.maxPeakRight);
+		meterFrame.setLevel(MeterFrameEncoder::maxPeakTotal, jmax(snapshot.maxPeakLeft, snapshot.maxPeakRight));
+		meterFrame.setClip(snapshot.peakLeft > 0.0f, snapshot.peakRight > 0.0f);
+
+		// A frame still queued is replaced rather than sent, so make this one carry every field.
+		if (hardwareOutput.isLatestMessagePending(HARDWARE_METER_FRAME_SLOT))
+			meterFrame.forceFullFrame();
+
+		const int frameSize = meterFrame.buildFrame();
+		if (frameSize > 0)
+		{
+			MidiMessage msg = MidiMessage::createSysExMessage(meterFrame.getFrameData(), frameSize);
+			hardwareOutput.sendLatestMessage(HARDWARE_METER_FRAME_SLOT, msg);
+		}
+	}
+
+	// Hardware asked for the DSP load popup.
+	if (dspLoadRequested.exchange(false))
+		sendDspLoad();
 
-		MidiMessage msg = MidiMessage::createSysExMessage(sysexData, sizeof(sysexData));
-		midiOutput->sendMessageNow(msg);
+	// The loopback port has been opened again, TotalMix may show anything.
+	const bool isVolControlConnected = deviceHub->isVolControlConnected();
+	if (isVolControlConnected && !wasVolControlConnected)
+	{
+		resetSentTotalMixValues();
+		updateRMEVolumeControl();
 	}
+	wasVolControlConnected = isVolControlConnected;
+
+	sendCoalescedFaderValues();
+	sendSurfaceState(isSurfaceOwner);
 
 	// Update crossover filter coefficients.
-	updateFilters(getSampleRate());
+	updateFilters();
 }
 
-char* DreamControlAudioProcessor::getMeterIntegralFractional(float val)
+// Sends the latest fader positions, if there are any and the fader interval has passed.
+void DreamControlAudioProcessor::sendCoalescedFaderValues()
 {
-	// Get the integral and fractional of a floating point number, limited to 99 (-99.0dB is the lowest meter level we deal with).
-	float integral;
-	float fractional = modf(val, &integral);
-	fractional = std::abs(roundf(fractional * 100.0));
-	integral = std::abs(integral);
-	if (fractional > 99.0) fractional = 99.0;
-	if (integral > 99.0) integral = 99.0;
-	
-	char* output = new char[2];
-	output[0] = (char)integral;
-	output[1] = (char)fractional;
-	return output;
+	float value;
+
+	if (faderToReaper.getValueToSend(faderInterval->get(), value) && useReaperOsc->get())
+		reaperOscOutput.send("/track/volume", value);
+
+	if (faderFromReaper.getValueToSend(faderInterval->get(), value))
+		surfaceState.setFader(static_cast<int>(value * 16383));
+
+	// A burst of knob detents is applied once per tick, newest wins.
+	if (volumeFromSurface.takeValue(value))
+	{
+		monitorLevel->setValueNotifyingHost(value);
+		surfaceState.setKnob(roundToInt(value * VOLUME_CONTROL_MIDI_RANGE), true);
+		updateRMEVolumeControl();
+	}
 }
 
-// Update the coefficients of our crossover filters.
-void DreamControlAudioProcessor::updateFilters(float sampleRate)
+// The next update sends every TotalMix fader, e.g. after the loopback port has been opened again.
+void DreamControlAudioProcessor::resetSentTotalMixValues()
 {
-	// Iterate over each filter object and set coefficients from plugin params.
-	// Lowest and highest bands have 1 L/HPF, and mid bands have 1 LPF + 1 HPF. These are also doubled in number to make Linkwitz-Riley filters.
-	for (int chan = 0; chan < numChannels; chan++)
+	for (int& value : sentTotalMixValues)
+		value = -1;
+}
+
+// Copies every button LED into the surface state, and sends it all with the next tick.
+void DreamControlAudioProcessor::syncSurfaceState()
+{
+	routingTable.forEachParameter([this](int button, AudioParameterBoolNotify* param)
 	{
-		int filtIndex = 0;
+		const int feedbackNote = routingTable.getFeedbackNote(button);
+		if (feedbackNote >= 0)
+			surfaceState.setLed(feedbackNote, param->get());
+	});
 
-		for (int band = 0; band < numBands; band++)
-		{
-			for (int i = 0; i < 2; i++)		// Duplication of filters for Linkwitz-Riley.
-			{
-				if (band == 0)
-				{
-					crossoverFilters[chan][filtIndex]->makeCrossover(*crossoverFreq[band], sampleRate, true, false);
-					filtIndex++;
-				}
-				else if (band < numBands - 1)
-				{
-					crossoverFilters[chan][filtIndex]->makeCrossover(*crossoverFreq[band - 1], sampleRate, true, true);
-					crossoverFilters[chan][filtIndex + 1]->makeCrossover(*crossoverFreq[band], sampleRate, true, false);
-					filtIndex += 2;
-				}
-				else
-				{
-					crossoverFilters[chan][filtIndex]->makeCrossover(*crossoverFreq[band - 1], sampleRate, true, true);
-					filtIndex++;
-				}
-			}
-		}
+	surfaceState.requestSnapshot();
+}
+
+// Sends the surface state changes since the last tick, or a snapshot if the hardware asked for one.
+// An instance that doesn't drive the hardware only keeps its state, for when it takes over.
+void DreamControlAudioProcessor::sendSurfaceState(bool isSurfaceOwner)
+{
+	surfaceState.setKnob(roundToInt(monitorLevel->range.convertTo0to1(monitorLevel->get()) * VOLUME_CONTROL_MIDI_RANGE));
+
+	if (!isSurfaceOwner || !deviceHub->isHardwareConnected())
+		return;
+
+	const int size = surfaceState.buildMessage();
+	if (size > 0)
+		hardwareOutput.sendMessage(MidiMessage::createSysExMessage(surfaceState.getMessageData(), size));
+}
+
+// Sends average and worst load of each stage to the hardware, in whole percent.
+void DreamControlAudioProcessor::sendDspLoad()
+{
+	if (!deviceHub->isHardwareConnected())
+		return;
+
+	uint8 data[4 + DspLoad::numEntries * 2];
+	for (int i = 0; i < 3; i++)
+		data[i] = (uint8)sysexManufacturerId[i];
+	data[3] = SYSEX_COMMAND_DSP_LOAD;
+
+	for (int i = 0; i < DspLoad::numEntries; i++)
+	{
+		data[4 + i * 2] = (uint8)jlimit(0, 127, roundToInt(dspLoad.average[i]));
+		data[5 + i * 2] = (uint8)jlimit(0, 127, roundToInt(dspLoad.worst[i]));
 	}
+
+	hardwareOutput.sendMessage(MidiMessage::createSysExMessage(data, sizeof(data)));
+}
+
+String DreamControlAudioProcessor::getDeviceStatus() const
+{
+	return deviceHub->getStatusText() + routingFileStatus;
+}
+
+bool DreamControlAudioProcessor::getLatestMeterSnapshot(MeterSnapshot& snapshot)
+{
+	// The snapshot buffer has a single reader, which is the message thread.
+	jassert(MessageManager::existsAndIsCurrentThread());
+
+	const bool isNew = meterSnapshots.update();
+	snapshot = meterSnapshots.getReadBuffer();
+	return isNew;
+}
+
+static float lufsToNormalised(float lufs)
+{
+	return (jmax(lufs, LOWEST_LUFS_VALUE) - LOWEST_LUFS_VALUE) / -LOWEST_LUFS_VALUE;
+}
+
+static float truePeakToNormalised(float truePeak)
+{
+	return (jlimit(LOWEST_TRUE_PEAK_VALUE, HIGHEST_TRUE_PEAK_VALUE, truePeak) - LOWEST_TRUE_PEAK_VALUE) / (HIGHEST_TRUE_PEAK_VALUE - LOWEST_TRUE_PEAK_VALUE);
+}
+
+// Sends meter values to the host parameters, if enabled, at most at the host meter rate.
+void DreamControlAudioProcessor::updateHostMeters(const MeterSnapshot& snapshot)
+{
+	if (!hostMeters->get())
+		return;
+
+	msSinceHostMeterUpdate += CALLBACK_TIMER_PERIOD_MS;
+	if (msSinceHostMeterUpdate < 1000.0f / hostMeterRate->get())
+		return;
+	msSinceHostMeterUpdate = 0;
+
+	notifyHostMeter(lufsShort, lufsToNormalised(snapshot.lufsShort));
+	notifyHostMeter(lufsMomentary, lufsToNormalised(snapshot.lufsMomentary));
+	notifyHostMeter(lufsIntegrated, lufsToNormalised(snapshot.lufsIntegrated));
+	notifyHostMeter(lufsRangeMin, lufsToNormalised(snapshot.lufsRangeMin));
+	notifyHostMeter(lufsRangeMax, lufsToNormalised(snapshot.lufsRangeMax));
+	notifyHostMeter(peakMeterLeft, truePeakToNormalised(snapshot.peakLeft));
+	notifyHostMeter(peakMeterRight, truePeakToNormalised(snapshot.peakRight));
+	notifyHostMeter(peakMeterMaxLeft, truePeakToNormalised(snapshot.maxPeakLeft));
+	notifyHostMeter(peakMeterMaxRight, truePeakToNormalised(snapshot.maxPeakRight));
+	notifyHostMeter(clipMeterLeft, snapshot.clipLeft ? 1.0f : 0.0f);
+	notifyHostMeter(clipMeterRight, snapshot.clipRight ? 1.0f : 0.0f);
+}
+
+// Only notifies the host when the value has changed.
+void DreamControlAudioProcessor::notifyHostMeter(AudioProcessorParameter* param, float normalisedValue)
+{
+	if (std::abs(param->getValue() - normalisedValue) > HOST_METER_CHANGE_THRESHOLD)
+		param->setValueNotifyingHost(normalisedValue);
+}
+
+// Update the coefficients of our crossover filters.
+void DreamControlAudioProcessor::updateFilters()
+{
+	// Coefficients are only recalculated when a frequency has changed, on this thread,
+	// then picked up and ramped to by the audio thread.
+	float frequencies[BandSplitter::numCrossovers];
+	for (int i = 0; i < numCrossovers; i++)
+		frequencies[i] = *crossoverFreq[i];
+
+	bandSplitter.setCrossoverFrequencies(frequencies);
 }
 
 bool DreamControlAudioProcessor::isAnyBandSolo()
@@ -843,31 +1020,35 @@ bool DreamControlAudioProcessor::isAnyBandSolo()
 	return false;
 }
 
+int DreamControlAudioProcessor::getMeteredSignal() const
+{
+	int signal = (midSolo->get() ? 1 : 0) | (sideSolo->get() ? 2 : 0) | (loudnessMode->get() ? 4 : 0);
+
+	for (int b = 0; b < bandSolo.size(); b++)
+		if (bandSolo[b]->get() == true) signal |= 8 << b;
+
+	return signal;
+}
+
 //==============================================================================
-// MIDI Input handler.
-void DreamControlAudioProcessor::handleIncomingMidiMessage(MidiInput* source, const MidiMessage& m)
+// MIDI Input handlers, only called for the instance that drives the hardware.
+void DreamControlAudioProcessor::switcherMidiReceived(const MidiMessage& m)
+{
+	monitorSwitch.handleMessage(m);
+}
+
+void DreamControlAudioProcessor::surfaceMidiReceived(const MidiMessage& m)
 {
 	if (m.isSysEx())
 	{
-		// Incoming SysEx.
-		const juce::uint8 *data = m.getSysExData();
-		
-		if (data[0] == SYSEX_COMMAND_SYNC_BUTTONS)
-		{
-			// Send all button values out.
-			for (auto p : buttonParamMap)	
-				if (midiOutput != nullptr)
-					midiOutput->sendMessageNow(MidiMessage::noteOn(1, p.first, p.second->get() ? 1.0f : 0.0f));
-			
-		}
+		// The hardware has started, or missed a state message: send it everything.
+		if (surfaceState.isSnapshotRequest(m))
+			syncSurfaceState();
 	}
 	else if (m.isControllerOfType(7))
 	{
-		// Volume control.
-		float volume = ((m.getControllerValue()) / VOLUME_CONTROL_MIDI_RANGE);
-		monitorLevel->setValueNotifyingHost(volume);
-
-		updateRMEVolumeControl();
+		// Volume control, from older firmware. Applied by sendCoalescedFaderValues.
+		volumeFromSurface.setValue(m.getControllerValue() / VOLUME_CONTROL_MIDI_RANGE);
 	}
 	else if (m.isNoteOn(false) && m.getVelocity() == 127
 		&& (m.getNoteNumber() == BUTTON_MAIN || m.getNoteNumber() == BUTTON_ALT1 || m.getNoteNumber() == BUTTON_ALT2 || m.getNoteNumber() == BUTTON_ALT3))
@@ -876,7 +1057,7 @@ void DreamControlAudioProcessor::handleIncomingMidiMessage(MidiInput* source, co
 		int newMonitorSelect = m.getNoteNumber() - BUTTON_MAIN;
 
 		for (int i = BUTTON_MAIN; i <= BUTTON_ALT3; i++)
-			midiOutput->sendMessageNow(MidiMessage::noteOn(1, i, 0.0f));
+			surfaceState.setLed(i, false);
 
 		if (newMonitorSelect == currentMonitorSelect)
 		{
@@ -886,14 +1067,12 @@ void DreamControlAudioProcessor::handleIncomingMidiMessage(MidiInput* source, co
 		else
 		{
 			currentMonitorSelect = newMonitorSelect;
-			midiOutput->sendMessageNow(MidiMessage::noteOn(1, m.getNoteNumber(), 1.0f));
+			surfaceState.setLed(m.getNoteNumber(), true);
 		}
 
-		if (midiOutputToSwitcher != nullptr)
-		{
-			// If switcher unit present, send Note Ons to switch relays
-			midiOutputToSwitcher->sendMessageNow(MidiMessage::noteOn(1, currentMonitorSelect + 1, 127.0f));
-		}
+		// If switcher unit present, mutes while its relays switch
+		if (deviceHub->isSwitcherConnected())
+			monitorSwitch.select(currentMonitorSelect);
 
 		updateRMEVolumeControl();
 	}
@@ -902,57 +1081,57 @@ void DreamControlAudioProcessor::handleIncomingMidiMessage(MidiInput* source, co
 		// Toggle parameter value on button press.
 		int button = m.getNoteNumber();
 
-		if (this->buttonParamMap.count(button) > 0)
-			this->buttonParamMap[button]->setValueNotifyingHost(!this->buttonParamMap[button]->get());
+		if (auto* param = routingTable.getParameter(button))
+			param->setValueNotifyingHost(!param->get());
 
 		if (button >= BUTTON_MONMUTE && button <= BUTTON_REF)
 		{
 			updateRMEVolumeControl();
 		}
 
+		// Sent from the timer, which owns the load values.
+		if (button == BUTTON_DSP_LOAD)
+			dspLoadRequested = true;
+
 		// Send OSC to REAPER on button press.
 		if (useReaperOsc->get())
 		{
-			auto it = reaperOscButtonMap.find(button);
-			if (it != reaperOscButtonMap.end())
-			{
-				auto address = it->second;
+			auto address = routingTable.getOscAddress(button);
 
-				if (address != "")
+			if (address != "")
+			{
+				// Input select buttons.
+				if (button >= BUTTON_MIX && button <= BUTTON_EXT2)
 				{
-					// Input select buttons.
-					if (button >= BUTTON_MIX && button <= BUTTON_EXT2)
+					if (button == BUTTON_MIX || currentInputButton == button)
 					{
-						if (button == BUTTON_MIX || currentInputButton == button)
-						{
-							address = "/anysolo";
-						}
-						else 
-						{
-							reaperOscSender.send("/anysolo", 1.0f);
-						}
+						address = "/anysolo";
+					}
+					else 
+					{
+						reaperOscOutput.send("/anysolo", 1.0f);
 					}
-
-					// Special behaviour for automation read/write buttons, as REAPER has 4 different automation modes.
-					if (button == BUTTON_READ && isReadEnabled && isWriteEnabled)
-						reaperOscSender.send("/track/autowrite", 1.0f);
-					else if (button == BUTTON_READ && !isReadEnabled && isWriteEnabled)
-						reaperOscSender.send("/track/autotouch", 1.0f);
-					else if (button == BUTTON_READ && isReadEnabled && !isWriteEnabled)
-						reaperOscSender.send("/track/autotrim", 1.0f);
-					else if (button == BUTTON_READ && !isReadEnabled && !isWriteEnabled)
-						reaperOscSender.send("/track/autoread", 1.0f);
-					else if (button == BUTTON_WRITE && isReadEnabled && isWriteEnabled)
-						reaperOscSender.send("/track/autoread", 1.0f);
-					else if (button == BUTTON_WRITE && isReadEnabled && !isWriteEnabled)
-						reaperOscSender.send("/track/autotouch", 1.0f);
-					else if (button == BUTTON_WRITE && !isReadEnabled && isWriteEnabled)
-						reaperOscSender.send("/track/autotrim", 1.0f);
-					else if (button == BUTTON_WRITE && !isReadEnabled && !isWriteEnabled)
-						reaperOscSender.send("/track/autowrite", 1.0f);
-					else
-						reaperOscSender.send(address, 1.0f);
 				}
+
+				// Special behaviour for automation read/write buttons, as REAPER has 4 different automation modes.
+				if (button == BUTTON_READ && isReadEnabled && isWriteEnabled)
+					reaperOscOutput.send("/track/autowrite", 1.0f);
+				else if (button == BUTTON_READ && !isReadEnabled && isWriteEnabled)
+					reaperOscOutput.send("/track/autotouch", 1.0f);
+				else if (button == BUTTON_READ && isReadEnabled && !isWriteEnabled)
+					reaperOscOutput.send("/track/autotrim", 1.0f);
+				else if (button == BUTTON_READ && !isReadEnabled && !isWriteEnabled)
+					reaperOscOutput.send("/track/autoread", 1.0f);
+				else if (button == BUTTON_WRITE && isReadEnabled && isWriteEnabled)
+					reaperOscOutput.send("/track/autoread", 1.0f);
+				else if (button == BUTTON_WRITE && isReadEnabled && !isWriteEnabled)
+					reaperOscOutput.send("/track/autotouch", 1.0f);
+				else if (button == BUTTON_WRITE && !isReadEnabled && isWriteEnabled)
+					reaperOscOutput.send("/track/autotrim", 1.0f);
+				else if (button == BUTTON_WRITE && !isReadEnabled && !isWriteEnabled)
+					reaperOscOutput.send("/track/autowrite", 1.0f);
+				else
+					reaperOscOutput.send(address, 1.0f);
 			}
 		}
 
@@ -960,33 +1139,40 @@ void DreamControlAudioProcessor::handleIncomingMidiMessage(MidiInput* source, co
 		if (button >= BUTTON_MIX && button <= BUTTON_EXT2)
 		{
 			for (int i = BUTTON_MIX; i <= BUTTON_EXT2; i++)
-				midiOutput->sendMessageNow(MidiMessage::noteOn(1, i, 0.0f));
+				surfaceState.setLed(i, false);
 
 			if (button == BUTTON_MIX || currentInputButton == button)
 			{
 				currentInputButton = BUTTON_MIX;
-				midiOutput->sendMessageNow(MidiMessage::noteOn(1, BUTTON_MIX, 1.0f));
+				surfaceState.setLed(BUTTON_MIX, true);
 			}
 			else
 			{
 				currentInputButton = button;
-				midiOutput->sendMessageNow(MidiMessage::noteOn(1, button, 1.0f));
+				surfaceState.setLed(button, true);
 			}
 		}
 	}
 	else if (m.isControllerOfType(MIDI_FADER_TOUCH_SENSE_CC) && useReaperOsc->get())
 	{
-		// Pass fader touch sense to REAPER.
-		reaperOscSender.send("/track/volume/touch", m.getControllerValue() > 0 ? 1.0f : 0.0f);
+		// Pass fader touch sense to REAPER. On release, send the final position first so nothing is left waiting.
+		float value;
+		if (m.getControllerValue() == 0 && faderToReaper.takeValue(value))
+			reaperOscOutput.send("/track/volume", value);
+
+		reaperOscOutput.send("/track/volume/touch", m.getControllerValue() > 0 ? 1.0f : 0.0f);
 	}
 	else if (m.isController())
 	{
-		// Check all other controllers, parse to see if it is the track fader NRPN value.
+		// Check all other controllers, parse to see if it is the track fader or volume NRPN value.
 		MidiRPNMessage msg;
-		if (faderRpnDetector->parseControllerMessage(m.getChannel(), m.getControllerNumber(), m.getControllerValue(), msg))
+		if (faderRpnDetector->parseControllerMessage(m.getChannel(), m.getControllerNumber(), m.getControllerValue(), msg)
+			&& msg.isNRPN && msg.is14BitValue)
 		{
-			if (useReaperOsc->get() && msg.isNRPN && msg.is14BitValue)
-				reaperOscSender.send("/track/volume", (float)msg.value / 16383.0f);
+			if (msg.parameterNumber == MIDI_FADER_NRPN && useReaperOsc->get())
+				faderToReaper.setValue((float)msg.value / MIDI_NRPN_RANGE);
+			else if (msg.parameterNumber == MIDI_VOLUME_NRPN)
+				volumeFromSurface.setValue((float)msg.value / MIDI_NRPN_RANGE);
 		}
 	}
 }
@@ -994,16 +1180,14 @@ void DreamControlAudioProcessor::handleIncomingMidiMessage(MidiInput* source, co
 void DreamControlAudioProcessor::updateRMEVolumeControl()
 {
 	// If external volume control enabled, send MIDI.
-	if (midiOutputToVolControl != nullptr && useRMEVolControl->get())
+	if (deviceHub->isVolControlConnected() && useRMEVolControl->get())
 	{
 		// Monitor/mute/ref/dim value.
 		float level = dimMode->get() ? dimLevel->get() : refMode->get() ? refLevel->get() : monitorLevel->get();
 		if (muteMode->get()) level = LOWEST_VOLUME_VALUE;
 
-		// Look up RME TotalMix fader MIDI value using our curve vector.
-		std::vector<float>::const_iterator index = std::lower_bound(RME_TOTALMIX_FADER_CURVE.begin(), RME_TOTALMIX_FADER_CURVE.end(), level);
-		int levelMidiVal = (index - RME_TOTALMIX_FADER_CURVE.begin());
-		if (level <= LOWEST_VOLUME_VALUE + 0.5) levelMidiVal = 0;
+		// RME TotalMix fader MIDI value, 0 (off) at the lowest volume.
+		const int levelMidiVal = getRmeTotalMixFaderValue(level);
 
 		// Send volume control MIDI messages.
 		for (int i = 0; i < rmeTotalMixMidiChannelControllers.size(); i++)
@@ -1015,8 +1199,14 @@ void DreamControlAudioProcessor::updateRMEVolumeControl()
 			int midiChan = floor((rmeChan - 1) / 8) + 9;
 			int midiCC = (((rmeChan - 1) % 8) * 2) + 102;
 
-			MidiMessage msg = MidiMessage::controllerEvent(midiChan, midiCC, (currentMonitorSelect == i || useRMEMonitorSwitch->get() == false) ? levelMidiVal : 0);
-			midiOutputToVolControl->sendMessageNow(msg);
+			// Only faders that change are sent.
+			const int value = (currentMonitorSelect == i || useRMEMonitorSwitch->get() == false) ? levelMidiVal : 0;
+			if (value != sentTotalMixValues[i])
+			{
+				MidiMessage msg = MidiMessage::controllerEvent(midiChan, midiCC, value);
+				deviceHub->getVolControlOutput().sendMessage(msg);
+				sentTotalMixValues[i] = value;
+			}
 
 			if (useRMEMonitorSwitch->get() == false && i > 0)
 				return;
@@ -1025,51 +1215,51 @@ void DreamControlAudioProcessor::updateRMEVolumeControl()
 }
 
 //==============================================================================
-// OSC Input handler.
-void DreamControlAudioProcessor::oscMessageReceived(const OSCMessage& message)
+// OSC Input handler, only called for the instance that drives the hardware.
+void DreamControlAudioProcessor::reaperOscReceived(const OSCMessage& message)
 {
 	auto pattern = message.getAddressPattern().toString();
 	float value = message[0].getFloat32();
 
-	if (midiOutput != nullptr)
+	if (deviceHub->isHardwareConnected())
 	{
 		if (pattern == "/track/volume")
 		{
-			// Track volume fader.
-			midiOutput->sendBlockOfMessagesNow(MidiRPNGenerator::generate(1, 1, static_cast<int>(value * 16383), true, true));
+			// Track volume fader, sent to the motor fader by sendCoalescedFaderValues.
+			faderFromReaper.setValue(value);
 		}
 		else if (pattern == "/anysolo" && value == 0.0f)
 		{
-			midiOutput->sendMessageNow(MidiMessage::noteOn(1, BUTTON_MIX, 1.0f));
+			surfaceState.setLed(BUTTON_MIX, true);
 			for (int btn = BUTTON_CUE1; btn <= BUTTON_EXT2; btn++)
-				midiOutput->sendMessageNow(MidiMessage::noteOn(1, btn, 0.0f));
+				surfaceState.setLed(btn, false);
 		}
 		else if (pattern == "/track/autotrim" && value == 1.0f)
 		{
 			// Special behaviour for read/write buttons.
-			midiOutput->sendMessageNow(MidiMessage::noteOn(1, BUTTON_READ, 0.0f));
-			midiOutput->sendMessageNow(MidiMessage::noteOn(1, BUTTON_WRITE, 0.0f));
+			surfaceState.setLed(BUTTON_READ, false);
+			surfaceState.setLed(BUTTON_WRITE, false);
 			isReadEnabled = false;
 			isWriteEnabled = false;
 		}
 		else if (pattern == "/track/autotouch" && value == 1.0f)
 		{
-			midiOutput->sendMessageNow(MidiMessage::noteOn(1, BUTTON_READ, 1.0f));
-			midiOutput->sendMessageNow(MidiMessage::noteOn(1, BUTTON_WRITE, 1.0f));
+			surfaceState.setLed(BUTTON_READ, true);
+			surfaceState.setLed(BUTTON_WRITE, true);
 			isReadEnabled = true;
 			isWriteEnabled = true;
 		}
 		else if (pattern == "/track/autoread" && value == 1.0f)
 		{
-			midiOutput->sendMessageNow(MidiMessage::noteOn(1, BUTTON_READ, 1.0f));
-			midiOutput->sendMessageNow(MidiMessage::noteOn(1, BUTTON_WRITE, 0.0f));
+			surfaceState.setLed(BUTTON_READ, true);
+			surfaceState.setLed(BUTTON_WRITE, false);
 			isReadEnabled = true;
 			isWriteEnabled = false;
 		}
 		else if (pattern == "/track/autowrite" && value == 1.0f)
 		{
-			midiOutput->sendMessageNow(MidiMessage::noteOn(1, BUTTON_READ, 0.0f));
-			midiOutput->sendMessageNow(MidiMessage::noteOn(1, BUTTON_WRITE, 1.0f));
+			surfaceState.setLed(BUTTON_READ, false);
+			surfaceState.setLed(BUTTON_WRITE, true);
 			isReadEnabled = false;
 			isWriteEnabled = true;
 		}
@@ -1077,29 +1267,41 @@ void DreamControlAudioProcessor::oscMessageReceived(const OSCMessage& message)
 		{
 			// Check for a matching button in our map, and send MIDI note on/off based on value argument (turn LED on or off).
 			// TODO: Useful OSC addresses for future: /track/number/str, /track/name
-			for (auto it = reaperOscButtonMap.begin(); it != reaperOscButtonMap.end(); it++)
-			{
-				if (it->second.startsWith("/action") || it->second == "")
-				{
-					continue;
-				}
-				else if (it->second == pattern)
-				{
-					int button = it->first;
-
-					midiOutput->sendMessageNow(MidiMessage::noteOn(1, button, value));
-					return;
-				}
-			}
+			const int feedbackNote = routingTable.getFeedbackNote(routingTable.getButtonForOscFeedback(pattern));
+			if (feedbackNote >= 0)
+				surfaceState.setLed(feedbackNote, value > 0.0f);
 		}
 	}
 }
 
-void DreamControlAudioProcessor::oscBundleReceived(const OSCBundle& bundle)
+// The hub calls this with its client lock held, from the thread that changed the owner.
+// The host is told later: it may call back into the hub, or wait on a thread that does.
+void DreamControlAudioProcessor::surfaceOwnerChanged(bool isSurfaceOwner)
+{
+	if (surfaceOwner->get() != isSurfaceOwner)
+		triggerAsyncUpdate();
+
+	// The hardware is still showing the last owner, so send it everything.
+	if (isSurfaceOwner)
+	{
+		syncSurfaceState();
+		resetSentTotalMixValues();
+		updateRMEVolumeControl();
+	}
+}
+
+// Reads the owner again, so several changes before this runs come down to the latest.
+void DreamControlAudioProcessor::handleAsyncUpdate()
 {
-	for (auto it = bundle.begin(); it != bundle.end(); it++)
-		if (it->isMessage())
-			oscMessageReceived(it->getMessage());
+	const bool isOwner = deviceHub->isSurfaceOwner(this);
+	if (surfaceOwner->get() != isOwner)
+		surfaceOwner->setValueNotifyingHost(isOwner);
+}
+
+// The hardware has just been plugged in, and may not ask for the state itself.
+void DreamControlAudioProcessor::surfaceConnected()
+{
+	syncSurfaceState();
 }
 
 //==============================================================================
@@ -1110,8 +1312,7 @@ bool DreamControlAudioProcessor::hasEditor() const
 
 AudioProcessorEditor* DreamControlAudioProcessor::createEditor()
 {
-	return new GenericAudioProcessorEditor(this);
-	//return new DreamControlAudioProcessorEditor(*this);
+	return new DawcAudioProcessorEditor(*this);
 }
 
 //==============================================================================
@@ -1120,53 +1321,231 @@ AudioProcessorEditor* DreamControlAudioProcessor::createEditor()
 
 void DreamControlAudioProcessor::getStateInformation(MemoryBlock& destData)
 {
-	MemoryOutputStream stream(destData, true);
-
-	stream.writeFloat(monitorLevel->get());
-	stream.writeBool(*muteMode);
-	stream.writeBool(*dimMode);
-	stream.writeBool(*refMode);
-	stream.writeBool(*midSolo);
-	stream.writeBool(*sideSolo);
-	stream.writeBool(*loudnessMode);
-	stream.writeFloat(lufsTarget->get());
-	stream.writeBool(*lufsMode);
-	stream.writeBool(*peakWithMomentaryMode);
-	stream.writeBool(*relativeMode);
-	stream.writeBool(*is1dbPeakScale);
-	stream.writeFloat(dimLevel->get());
-	stream.writeFloat(refLevel->get());
-	stream.writeFloat(peakHoldSeconds->get());
-	stream.writeBool(*volModMode);
-	stream.writeBool(*useRMEVolControl);
-	stream.writeBool(*useReaperOsc);
+	StateChunkWriter state(destData, STATE_VERSION);
+
+	state.writeFloat(STATE_MONITOR_LEVEL, monitorLevel->get());
+	state.writeBool(STATE_MUTE_MODE, *muteMode);
+	state.writeBool(STATE_DIM_MODE, *dimMode);
+	state.writeBool(STATE_REF_MODE, *refMode);
+	state.writeBool(STATE_MID_SOLO, *midSolo);
+	state.writeBool(STATE_SIDE_SOLO, *sideSolo);
+	state.writeBool(STATE_LOUDNESS_MODE, *loudnessMode);
+	state.writeFloat(STATE_LUFS_TARGET, lufsTarget->get());
+	state.writeBool(STATE_LUFS_MODE, *lufsMode);
+	state.writeBool(STATE_PEAK_WITH_MOMENTARY_MODE, *peakWithMomentaryMode);
+	state.writeBool(STATE_RELATIVE_MODE, *relativeMode);
+	state.writeBool(STATE_1DB_PEAK_SCALE, *is1dbPeakScale);
+	state.writeFloat(STATE_DIM_LEVEL, dimLevel->get());
+	state.writeFloat(STATE_REF_LEVEL, refLevel->get());
+	state.writeFloat(STATE_PEAK_HOLD_SECONDS, peakHoldSeconds->get());
+	state.writeBool(STATE_VOL_MOD_MODE, *volModMode);
+	state.writeBool(STATE_USE_RME_VOL_CONTROL, *useRMEVolControl);
+	state.writeBool(STATE_USE_REAPER_OSC, *useReaperOsc);
+	state.writeBool(STATE_HOST_METERS, *hostMeters);
+	state.writeFloat(STATE_HOST_METER_RATE, hostMeterRate->get());
+	state.writeInt(STATE_FADER_INTERVAL, faderInterval->get());
+	state.writeBool(STATE_METER_WORKER, *meterWorker);
+	state.writeBool(STATE_LOUDNESS_LOG, *loudnessLog);
+	state.writeString(STATE_LOUDNESS_LOG_FILE, lufsProcessor->getLogFile().getFullPathName());
+
+	float switcherTimes[(MonitorSwitch::numOutputs + 1) * 2];
+	for (int i = -1; i < MonitorSwitch::numOutputs; i++)
+	{
+		switcherTimes[(i + 1) * 2] = monitorSwitch.getTransportMs(i);
+		switcherTimes[(i + 1) * 2 + 1] = monitorSwitch.getSettleMs(i);
+	}
+	state.writeFloats(STATE_SWITCHER_TIMES, switcherTimes, numElementsInArray(switcherTimes));
+
+	state.writeBool(STATE_SURFACE_OWNER, *surfaceOwner);
 }
 
+// All values are set without notifying the host or running their change functions, then
+// applyRestoredState does what those would have, and the hardware gets one snapshot rather
+// than a message per button. The meters start again once, for the restored session.
 void DreamControlAudioProcessor::setStateInformation(const void* data, int sizeInBytes)
+{
+	// A versioned chunk that is cut short or corrupt isn't older state: the current values are kept.
+	StateChunkReader state;
+	const StateChunkReader::Result result = state.read(data, sizeInBytes);
+	if (result == StateChunkReader::badStateChunk)
+		return;
+
+	isRestoringState = true;
+
+	// Before the log is restored, which the reset would otherwise clear.
+	lufsProcessor->reset();
+
+	bool isSurfaceOwnerRestored;
+	if (result == StateChunkReader::ok)
+		isSurfaceOwnerRestored = restoreState(state);
+	else
+		isSurfaceOwnerRestored = restoreUnversionedState(data, sizeInBytes);
+
+	meteredSignal = -1;
+	isRestoringState = false;
+	applyRestoredState(isSurfaceOwnerRestored);
+}
+
+// Missing values keep their current value. Returns whether the surface owner was restored.
+bool DreamControlAudioProcessor::restoreState(const StateChunkReader& state)
+{
+	setSilently(monitorLevel, jmax(LOWEST_VOLUME_VALUE, state.getFloat(STATE_MONITOR_LEVEL, monitorLevel->get())));
+	setSilently(muteMode, state.getBool(STATE_MUTE_MODE, *muteMode));
+	setSilently(dimMode, state.getBool(STATE_DIM_MODE, *dimMode));
+	setSilently(refMode, state.getBool(STATE_REF_MODE, *refMode));
+	setSilently(midSolo, state.getBool(STATE_MID_SOLO, *midSolo));
+	setSilently(sideSolo, state.getBool(STATE_SIDE_SOLO, *sideSolo));
+	setSilently(loudnessMode, state.getBool(STATE_LOUDNESS_MODE, *loudnessMode));
+	setSilently(lufsTarget, state.getFloat(STATE_LUFS_TARGET, lufsTarget->get()));
+	setSilently(lufsMode, state.getBool(STATE_LUFS_MODE, *lufsMode));
+	setSilently(peakWithMomentaryMode, state.getBool(STATE_PEAK_WITH_MOMENTARY_MODE, *peakWithMomentaryMode));
+	setSilently(relativeMode, state.getBool(STATE_RELATIVE_MODE, *relativeMode));
+	setSilently(is1dbPeakScale, state.getBool(STATE_1DB_PEAK_SCALE, *is1dbPeakScale));
+	setSilently(dimLevel, state.getFloat(STATE_DIM_LEVEL, dimLevel->get()));
+	setSilently(refLevel, state.getFloat(STATE_REF_LEVEL, refLevel->get()));
+	setSilently(peakHoldSeconds, state.getFloat(STATE_PEAK_HOLD_SECONDS, peakHoldSeconds->get()));
+	setSilently(volModMode, state.getBool(STATE_VOL_MOD_MODE, *volModMode));
+	setSilently(useRMEVolControl, state.getBool(STATE_USE_RME_VOL_CONTROL, *useRMEVolControl));
+	setSilently(useReaperOsc, state.getBool(STATE_USE_REAPER_OSC, *useReaperOsc));
+	setSilently(hostMeters, state.getBool(STATE_HOST_METERS, *hostMeters));
+	setSilently(hostMeterRate, jlimit(1.0f, 50.0f, state.getFloat(STATE_HOST_METER_RATE, hostMeterRate->get())));
+	setSilently(faderInterval, jlimit(0, 100, state.getInt(STATE_FADER_INTERVAL, faderInterval->get())));
+	setSilently(meterWorker, state.getBool(STATE_METER_WORKER, *meterWorker));
+
+	if (state.hasTag(STATE_LOUDNESS_LOG))
+		restoreLoudnessLog(state.getBool(STATE_LOUDNESS_LOG, false), state.getString(STATE_LOUDNESS_LOG_FILE, String()));
+
+	float switcherTimes[(MonitorSwitch::numOutputs + 1) * 2];
+	if (state.getFloats(STATE_SWITCHER_TIMES, switcherTimes, numElementsInArray(switcherTimes)) == numElementsInArray(switcherTimes))
+	{
+		for (int i = -1; i < MonitorSwitch::numOutputs; i++)
+			monitorSwitch.setLearnedTimes(i, switcherTimes[(i + 1) * 2], switcherTimes[(i + 1) * 2 + 1]);
+	}
+
+	if (!state.hasTag(STATE_SURFACE_OWNER))
+		return false;
+
+	setSilently(surfaceOwner, state.getBool(STATE_SURFACE_OWNER, false));
+	return true;
+}
+
+// The state of versions before StateChunk: values in a fixed order, later additions appended.
+bool DreamControlAudioProcessor::restoreUnversionedState(const void* data, int sizeInBytes)
 {
 	MemoryInputStream stream(data, static_cast<size_t> (sizeInBytes), false);
 
-	float volLevel = stream.readFloat();
-	if (volLevel < LOWEST_VOLUME_VALUE) volLevel = LOWEST_VOLUME_VALUE;
-	*monitorLevel = volLevel;
-
-	muteMode->setValueNotifyingHost(stream.readBool());
-	dimMode->setValueNotifyingHost(stream.readBool());
-	refMode->setValueNotifyingHost(stream.readBool());
-	midSolo->setValueNotifyingHost(stream.readBool());
-	sideSolo->setValueNotifyingHost(stream.readBool());
-	loudnessMode->setValueNotifyingHost(stream.readBool());
-	*lufsTarget = stream.readFloat();
-	lufsMode->setValueNotifyingHost(stream.readBool());
-	peakWithMomentaryMode->setValueNotifyingHost(stream.readBool());
-	relativeMode->setValueNotifyingHost(stream.readBool());
-	is1dbPeakScale->setValueNotifyingHost(stream.readBool());
-	*dimLevel = stream.readFloat();
-	*refLevel = stream.readFloat();
-	*peakHoldSeconds = stream.readFloat();
-	volModMode->setValueNotifyingHost(stream.readBool());
-	useRMEVolControl->setValueNotifyingHost(stream.readBool());
-	useReaperOsc->setValueNotifyingHost(stream.readBool());
+	setSilently(monitorLevel, jmax(LOWEST_VOLUME_VALUE, stream.readFloat()));
+	setSilently(muteMode, stream.readBool());
+	setSilently(dimMode, stream.readBool());
+	setSilently(refMode, stream.readBool());
+	setSilently(midSolo, stream.readBool());
+	setSilently(sideSolo, stream.readBool());
+	setSilently(loudnessMode, stream.readBool());
+	setSilently(lufsTarget, stream.readFloat());
+	setSilently(lufsMode, stream.readBool());
+	setSilently(peakWithMomentaryMode, stream.readBool());
+	setSilently(relativeMode, stream.readBool());
+	setSilently(is1dbPeakScale, stream.readBool());
+	setSilently(dimLevel, stream.readFloat());
+	setSilently(refLevel, stream.readFloat());
+	setSilently(peakHoldSeconds, stream.readFloat());
+	setSilently(volModMode, stream.readBool());
+	setSilently(useRMEVolControl, stream.readBool());
+	setSilently(useReaperOsc, stream.readBool());
+
+	// Added later, older states end here.
+	if (!stream.isExhausted())
+	{
+		setSilently(hostMeters, stream.readBool());
+		setSilently(hostMeterRate, jlimit(1.0f, 50.0f, stream.readFloat()));
+	}
+	if (!stream.isExhausted())
+		setSilently(faderInterval, jlimit(0, 100, stream.readInt()));
+	if (!stream.isExhausted())
+		setSilently(meterWorker, stream.readBool());
+
+	if (!stream.isExhausted())
+	{
+		const bool isLogging = stream.readBool();
+		restoreLoudnessLog(isLogging, stream.readString());
+	}
+
+	// Learned switcher times, from all off to the last output.
+	if (!stream.isExhausted())
+	{
+		for (int i = -1; i < MonitorSwitch::numOutputs; i++)
+		{
+			const float transportMs = stream.readFloat();
+			const float settleMs = stream.readFloat();
+			monitorSwitch.setLearnedTimes(i, transportMs, settleMs);
+		}
+	}
+
+	if (stream.isExhausted())
+		return false;
+
+	setSilently(surfaceOwner, stream.readBool());
+	return true;
+}
+
+// Loudness log: the session goes on in its file, with the values measured before the reload.
+void DreamControlAudioProcessor::restoreLoudnessLog(bool isLogging, const String& logPath)
+{
+	if (!isLogging)
+		lufsProcessor->setLogFile(File());
+	else if (logPath.isNotEmpty())
+		lufsProcessor->setLogFile(File(logPath));
+	else
+		lufsProcessor->startLogSession(getLoudnessLogDirectory());
+
+	isLoudnessLogRequested = isLogging;
+	setSilently(loudnessLog, isLogging);
+}
+
+// What the change functions of the restored parameters would have done, once.
+void DreamControlAudioProcessor::applyRestoredState(bool isSurfaceOwnerRestored)
+{
+	// Mid/side solo and dim/ref are exclusive, whatever the state says.
+	if (*midSolo && *sideSolo)
+		setSilently(sideSolo, false);
+	if (*dimMode && *refMode)
+		setSilently(refMode, false);
+
+	deviceHub->setVolControlEnabled(this, *useRMEVolControl);
+	deviceHub->setReaperOscEnabled(this, *useReaperOsc);
+	resetSentTotalMixValues();
+
+	// Which instance drives the hardware, so a session reopens with the same one.
+	if (isSurfaceOwnerRestored)
+	{
+		if (*surfaceOwner)
+			deviceHub->takeSurface(this);
+		else
+			deviceHub->releaseSurface(this);
+	}
+
+	// All button LEDs in one snapshot, with the next tick.
+	syncSurfaceState();
+	updateRMEVolumeControl();
+
+	updateHostDisplay();
+}
+
+void DreamControlAudioProcessor::setSilently(AudioParameterFloat* param, float value)
+{
+	static_cast<AudioProcessorParameter*>(param)->setValue(param->range.convertTo0to1(param->range.snapToLegalValue(value)));
+}
+
+void DreamControlAudioProcessor::setSilently(AudioParameterBool* param, bool value)
+{
+	static_cast<AudioProcessorParameter*>(param)->setValue(value ? 1.0f : 0.0f);
+}
+
+void DreamControlAudioProcessor::setSilently(AudioParameterInt* param, int value)
+{
+	const Range<int> range = param->getRange();
+	const int limitedValue = range.clipValue(value);
+	static_cast<AudioProcessorParameter*>(param)->setValue(range.getLength() > 0 ? (float)(limitedValue - range.getStart()) / range.getLength() : 0.0f);
 }
 
 //==============================================================================
@@ -19,31 +19,39 @@
 #include <array>
 #include <map>
 
-#include "../JuceLibraryCode/JuceHeader.h"
+#include <JuceHeader.h>
 #include "AudioParameterBoolNotify.h"
 #include "LufsProcessor.h"
-#include "CrossoverFilter.h"
+#include "BandSplitter.h"
+#include "BiquadCascade.h"
+#include "MonitorStages.h"
+#include "MeterFrameEncoder.h"
+#include "SurfaceStateEncoder.h"
+#include "MonitorSwitch.h"
+#include "MeterSnapshot.h"
+#include "OutputThread.h"
+#include "ControlRoutingTable.h"
+#include "FaderCoalescer.h"
+#include "DspLoadMeter.h"
+#include "DeviceHub.h"
+#include "LoudnessHistory.h"
+#include "StateChunk.h"
 
 //==============================================================================
 /**
 */
 class DreamControlAudioProcessor :  public AudioProcessor,
-									public HighResolutionTimer,
-									public MidiInputCallback, 
-									public OSCReceiver,
-									public OSCReceiver::Listener<OSCReceiver::MessageLoopCallback>
+									public DeviceHub::Client,
+									private AsyncUpdater
 {
 public:
 	//==============================================================================
-	std::map<int, AudioParameterBoolNotify*> buttonParamMap;
-	std::map<int, String> reaperOscButtonMap;
+	ControlRoutingTable routingTable;
 
     //==============================================================================
     DreamControlAudioProcessor();
     ~DreamControlAudioProcessor();
 
-	std::unique_ptr<MidiOutput> midiOutputToVolControl;
-
     //==============================================================================
     void prepareToPlay (double sampleRate, int samplesPerBlock) override;
     void releaseResources() override;
@@ -53,14 +61,26 @@ public:
    #endif
 
     void processBlock (AudioBuffer<float>&, MidiBuffer&) override;
-	void hiResTimerCallback() override;
 	bool isAnyBandSolo();
-	void handleIncomingMidiMessage (MidiInput* source, const MidiMessage& m) override;
-	void oscMessageReceived(const OSCMessage& message) override;
-	void oscBundleReceived(const OSCBundle& bundle) override;
 
-	OSCSender reaperOscSender;
-	bool oscConnected;
+	// DeviceHub::Client
+	void deviceHubTick(bool isSurfaceOwner) override;
+	void surfaceMidiReceived(const MidiMessage& m) override;
+	void switcherMidiReceived(const MidiMessage& m) override;
+	void reaperOscReceived(const OSCMessage& message) override;
+	void surfaceOwnerChanged(bool isSurfaceOwner) override;
+	void surfaceConnected() override;
+
+	// Latest meter values, for the editor. Call from the message thread only.
+	bool getLatestMeterSnapshot(MeterSnapshot& snapshot);
+
+	// Which ports are connected, for the editor. Missing ports are shown here, not in message boxes.
+	String getDeviceStatus() const;
+
+	// The session's loudness at any zoom, for the editor's history view. Updated by the timer
+	// while the view is shown.
+	const LoudnessHistory& getLoudnessHistory() const { return loudnessHistory; }
+	void setLoudnessHistoryShown(bool isShown) { loudnessHistory.setEnabled(isShown); }
 
     //==============================================================================
     AudioProcessorEditor* createEditor() override;
@@ -88,9 +108,19 @@ public:
 private:
 	//==============================================================================
 	// Main
-	MidiOutput* midiOutput;
-	MidiInput* midiInput;
-	MidiOutput* midiOutputToSwitcher;
+	// Hardware and switcher ports, TotalMix, REAPER OSC and the timer, shared by all instances in the process
+	SharedResourcePointer<DeviceHub> deviceHub;
+	MidiOutputThread& hardwareOutput;
+	OscOutputThread& reaperOscOutput;
+
+	// Why the user's routing file wasn't loaded, empty if it was or there is none. Set in the constructor.
+	String routingFileStatus;
+
+	// Only one instance drives the hardware, the user chooses which
+	AudioParameterBoolNotify* surfaceOwner;
+
+	// Tells the host about ownership changes made by the hub, on the message thread without the hub's lock.
+	void handleAsyncUpdate() override;
 
     //==============================================================================
 	// Level
@@ -106,11 +136,28 @@ private:
 	AudioParameterBool* useRMEMonitorSwitch;
 	void updateRMEVolumeControl();
 	int currentMonitorSelect = 0;
+
+	// Knob moves from the hardware, applied once per tick however many detents arrive
+	FaderCoalescer volumeFromSurface;
+
+	// Last TotalMix fader value sent for each monitor output, -1 if unknown. Unchanged faders aren't sent again.
+	int sentTotalMixValues[MonitorSwitch::numOutputs];
+	bool wasVolControlConnected;
+	void resetSentTotalMixValues();
+
+	// Fades out, switches the relays and fades in again once they have settled
+	MonitorSwitch monitorSwitch;
 	int currentInputButton = 0;
 
 	AudioParameterBool* useReaperOsc;
 	MidiRPNDetector* faderRpnDetector;
 
+	// Fader moves in either direction are sent at most once per faderInterval, latest value wins
+	AudioParameterInt* faderInterval;
+	FaderCoalescer faderToReaper;
+	FaderCoalescer faderFromReaper;
+	void sendCoalescedFaderValues();
+
 	//==============================================================================
 	// Channel Strip
 	bool isReadEnabled;
@@ -119,6 +166,17 @@ private:
 	//==============================================================================
 	// Meters
 	LufsProcessor* lufsProcessor;
+	AudioParameterBool* meterWorker;	// loudness analysis on its own thread instead of the audio thread
+	void updateMeterWorker();
+
+	// Loudness log: 100 ms values of the session written to a file, so they survive a reload or a crash
+	AudioParameterBool* loudnessLog;
+	bool isLoudnessLogRequested = false;
+	void updateLoudnessLog();
+	static File getLoudnessLogDirectory();
+
+	// Min/max pyramid of the history arrays, so the editor draws hours of it per pixel, not per value
+	LoudnessHistory loudnessHistory;
 
 	AudioParameterFloat* lufsShort;
 	AudioParameterFloat* lufsMomentary;
@@ -128,6 +186,11 @@ private:
 	AudioParameterFloat* lufsRangeMax;
 	AudioParameterBoolNotify* lufsReset;
 
+	// Band solos, loudness EQ and mid/side solo, which change what the meters measure. -1 after a state
+	// restore: the restored measurement goes on with the restored settings.
+	std::atomic<int> meteredSignal;
+	int getMeteredSignal() const;
+
 	AudioParameterFloat* peakHoldSeconds;
 	int msSinceLastPeakReset;
 	float lastMaxLeft;
@@ -140,6 +203,20 @@ private:
 	AudioParameterBool* clipMeterLeft;
 	AudioParameterBool* clipMeterRight;
 
+	// Meter values are published every tick, host meter parameters only when enabled and at their own rate.
+	MeterSnapshotBuffer meterSnapshots;
+	AudioParameterBool* hostMeters;
+	AudioParameterFloat* hostMeterRate;
+	int msSinceHostMeterUpdate;
+	void updateHostMeters(const MeterSnapshot& snapshot);
+	void notifyHostMeter(AudioProcessorParameter* param, float normalisedValue);
+
+	// processBlock stage timings, read by the timer. The hardware asks for them with a button.
+	DspLoadMeter dspLoadMeter;
+	DspLoad dspLoad;
+	std::atomic<bool> dspLoadRequested;
+	void sendDspLoad();
+
 	AudioParameterBoolNotify* lufsMode;
 	AudioParameterBoolNotify* peakWithMomentaryMode;
 	AudioParameterBoolNotify* relativeMode;
@@ -147,13 +224,13 @@ private:
 
 	//==============================================================================
 	// Band solo
-	void updateFilters(float sampleRate);
+	void updateFilters();
 
 	int numChannels;
 	int numCrossovers;
 	int numBands;
 	bool aSoloButtonJustEngaged;
-	std::vector<std::vector<std::unique_ptr<CrossoverFilter>>> crossoverFilters;
+	BandSplitter bandSplitter;
 	std::vector<AudioParameterFloat*> crossoverFreq;
 	std::vector<AudioParameterBoolNotify*> bandSolo;
 
@@ -162,14 +239,42 @@ private:
 	AudioParameterBoolNotify* midSolo;
 	AudioParameterBoolNotify* sideSolo;
 	AudioParameterBoolNotify* loudnessMode;
-	std::vector<std::vector<std::unique_ptr<IIRFilter>>> loudnessEqFilters;
+	BiquadCascade<float> loudnessEq;
+
+	// Monitor/dim/ref gain and mute, applied by the output stage
+	GainRamp outputGain;
+
+	// Left/right pairs of the bus layout (front, surrounds, heights), for M/S and the L/R meters
+	void updateChannelPairs(const AudioChannelSet& layout);
+	int numChannelPairs;
+	int channelPairs[LUFS_TP_MAX_NB_CHANNELS / 2][2];
+	bool isPairedChannel[LUFS_TP_MAX_NB_CHANNELS];
+	int meterLeftChannel;
+	int meterRightChannel;
 
 	//==============================================================================
 	// For development use only
 	AudioParameterBoolNotify* volModMode;
 
 	//==============================================================================
-	char* getMeterIntegralFractional(float val);
+	// Meter telemetry to the hardware
+	MeterFrameEncoder meterFrame;
+
+	// Button LEDs, knob and fader of the hardware, sent as sequenced snapshots and deltas
+	SurfaceStateEncoder surfaceState;
+	void syncSurfaceState();
+	void sendSurfaceState(bool isSurfaceOwner);
+
+	//==============================================================================
+	// State restore: values are set silently, then their side effects are applied once
+	std::atomic<bool> isRestoringState;
+	bool restoreState(const StateChunkReader& state);
+	bool restoreUnversionedState(const void* data, int sizeInBytes);
+	void restoreLoudnessLog(bool isLogging, const String& logPath);
+	void applyRestoredState(bool isSurfaceOwnerRestored);
+	static void setSilently(AudioParameterFloat* param, float value);
+	static void setSilently(AudioParameterBool* param, bool value);
+	static void setSilently(AudioParameterInt* param, int value);
 
 	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DreamControlAudioProcessor)
 };
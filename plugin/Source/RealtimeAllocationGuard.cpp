@@ -0,0 +1,120 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include <cstdlib>
+#include <new>
+
+#include "RealtimeAllocationGuard.h"
+
+#if JUCE_WINDOWS
+ #include <malloc.h>
+#endif
+
+#if JUCE_DEBUG
+
+thread_local int RealtimeAllocationGuard::depth = 0;
+
+void RealtimeAllocationGuard::reportAllocation() noexcept
+{
+	// Logging the assertion allocates too, so disable the guard while reporting.
+	const int savedDepth = depth;
+	depth = 0;
+
+	// The audio callback allocated memory. Check the call stack.
+	jassertfalse;
+
+	depth = savedDepth;
+}
+
+static void* tryAllocate(std::size_t size) noexcept
+{
+	if (RealtimeAllocationGuard::isActive())
+		RealtimeAllocationGuard::reportAllocation();
+
+	return std::malloc(size != 0 ? size : 1);
+}
+
+static void* allocateChecked(std::size_t size)
+{
+	if (void* p = tryAllocate(size))
+		return p;
+
+	throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size) { return allocateChecked(size); }
+void* operator new[](std::size_t size) { return allocateChecked(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return tryAllocate(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return tryAllocate(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+
+// Over-aligned types, C++17. Aligned memory needs its own free on Windows.
+#if __cpp_aligned_new
+
+static void* tryAllocateAligned(std::size_t size, std::align_val_t alignment) noexcept
+{
+	if (RealtimeAllocationGuard::isActive())
+		RealtimeAllocationGuard::reportAllocation();
+
+	if (size == 0)
+		size = 1;
+
+   #if JUCE_WINDOWS
+	return _aligned_malloc(size, static_cast<std::size_t>(alignment));
+   #else
+	void* p = nullptr;
+	const std::size_t minAlignment = sizeof(void*);
+	if (posix_memalign(&p, jmax(static_cast<std::size_t>(alignment), minAlignment), size) != 0)
+		return nullptr;
+	return p;
+   #endif
+}
+
+static void* allocateAlignedChecked(std::size_t size, std::align_val_t alignment)
+{
+	if (void* p = tryAllocateAligned(size, alignment))
+		return p;
+
+	throw std::bad_alloc();
+}
+
+static void freeAligned(void* p) noexcept
+{
+   #if JUCE_WINDOWS
+	_aligned_free(p);
+   #else
+	std::free(p);
+   #endif
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) { return allocateAlignedChecked(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return allocateAlignedChecked(size, alignment); }
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return tryAllocateAligned(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return tryAllocateAligned(size, alignment); }
+void operator delete(void* p, std::align_val_t) noexcept { freeAligned(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { freeAligned(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { freeAligned(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { freeAligned(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { freeAligned(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { freeAligned(p); }
+
+#endif
+
+#endif
@@ -0,0 +1,45 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+	Debug builds only: asserts if operator new, in any form (array, nothrow,
+	aligned), is called on a thread while a RealtimeAllocationGuard exists on it.
+	Put one at the top of processBlock. In release builds this does nothing.
+*/
+class RealtimeAllocationGuard
+{
+public:
+#if JUCE_DEBUG
+	RealtimeAllocationGuard() noexcept { ++depth; }
+	~RealtimeAllocationGuard() noexcept { --depth; }
+
+	static bool isActive() noexcept { return depth > 0; }
+
+	// Called by operator new when the guard is active.
+	static void reportAllocation() noexcept;
+
+private:
+	static thread_local int depth;
+#else
+	RealtimeAllocationGuard() noexcept {}
+#endif
+
+	JUCE_DECLARE_NON_COPYABLE(RealtimeAllocationGuard)
+};
@@ -1,112 +1,90 @@
-#pragma once
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
 
-#include <vector>
+#pragma once
 
-const std::vector<float> RME_TOTALMIX_FADER_CURVE =
+// Level in dB of each TotalMix fader MIDI value, from 0. Values above the last one are above 0 dB.
+constexpr float RME_TOTALMIX_FADER_CURVE[] =
 {
-	-64.0f,
-	-63.2f,
-	-62.0f,
-	-60.9f,
-	-59.7f,
-	-58.6f,
-	-57.5f,
-	-56.3f,
-	-55.2f,
-	-54.1f,
-	-53.1f,
-	-52.0f,
-	-50.9f,
-	-49.9f,
-	-48.9f,
-	-47.8f,
-	-46.8f,
-	-45.8f,
-	-44.8f,
-	-43.8f,
-	-42.9f,
-	-41.9f,
-	-41.0f,
-	-40.1f,
-	-39.1f,
-	-38.2f,
-	-37.3f,
-	-36.4f,
-	-35.6f,
-	-34.7f,
-	-33.9f,
-	-33.0f,
-	-32.2f,
-	-31.4f,
-	-30.6f,
-	-29.8f,
-	-29.0f,
-	-28.2f,
-	-27.5f,
-	-26.7f,
-	-26.0f,
-	-25.3f,
-	-24.6f,
-	-23.9f,
-	-23.2f,
-	-22.5f,
-	-21.8f,
-	-21.2f,
-	-20.5f,
-	-19.9f,
-	-19.3f,
-	-18.7f,
-	-18.1f,
-	-17.5f,
-	-16.9f,
-	-16.4f,
-	-15.8f,
-	-15.3f,
-	-14.8f,
-	-14.3f,
-	-13.8f,
-	-13.3f,
-	-12.8f,
-	-12.3f,
-	-11.9f,
-	-11.4f,
-	-11.0f,
-	-10.6f,
-	-10.2f,
-	-9.8f,
-	-9.4f,
-	-9.0f,
-	-8.6f,
-	-8.3f,
-	-8.0f,
-	-7.6f,
-	-7.3f,
-	-7.0f,
-	-6.7f,
-	-6.4f,
-	-6.2f,
-	-5.9f,
-	-5.6f,
-	-5.4f,
-	-5.1f,
-	-4.9f,
-	-4.6f,
-	-4.4f,
-	-4.1f,
-	-3.9f,
-	-3.6f,
-	-3.3f,
-	-3.1f,
-	-2.8f,
-	-2.6f,
-	-2.3f,
-	-2.1f,
-	-1.8f,
-	-1.5f,
-	-1.3f,
-	-1.0f,
-	-0.75f,
-	-0.5f,
-	-0.3f,
+	-64.0f, -63.2f, -62.0f, -60.9f, -59.7f, -58.6f, -57.5f, -56.3f,
+	-55.2f, -54.1f, -53.1f, -52.0f, -50.9f, -49.9f, -48.9f, -47.8f,
+	-46.8f, -45.8f, -44.8f, -43.8f, -42.9f, -41.9f, -41.0f, -40.1f,
+	-39.1f, -38.2f, -37.3f, -36.4f, -35.6f, -34.7f, -33.9f, -33.0f,
+	-32.2f, -31.4f, -30.6f, -29.8f, -29.0f, -28.2f, -27.5f, -26.7f,
+	-26.0f, -25.3f, -24.6f, -23.9f, -23.2f, -22.5f, -21.8f, -21.2f,
+	-20.5f, -19.9f, -19.3f, -18.7f, -18.1f, -17.5f, -16.9f, -16.4f,
+	-15.8f, -15.3f, -14.8f, -14.3f, -13.8f, -13.3f, -12.8f, -12.3f,
+	-11.9f, -11.4f, -11.0f, -10.6f, -10.2f, -9.8f, -9.4f, -9.0f,
+	-8.6f, -8.3f, -8.0f, -7.6f, -7.3f, -7.0f, -6.7f, -6.4f,
+	-6.2f, -5.9f, -5.6f, -5.4f, -5.1f, -4.9f, -4.6f, -4.4f,
+	-4.1f, -3.9f, -3.6f, -3.3f, -3.1f, -2.8f, -2.6f, -2.3f,
+	-2.1f, -1.8f, -1.5f, -1.3f, -1.0f, -0.75f, -0.5f, -0.3f,
 	0.0f
-};
\ No newline at end of file
+};
+
+#define RME_TOTALMIX_FADER_TABLE_LOWEST_DB -48		// Table starts at the plugin's lowest volume
+#define RME_TOTALMIX_FADER_TABLE_STEPS_PER_DB 10
+#define RME_TOTALMIX_FADER_TABLE_SIZE 481
+#define RME_TOTALMIX_FADER_TABLE_OFF_STEPS 5			// Up to -47.5 dB the fader is off
+
+namespace RmeTotalMixFader
+{
+	constexpr int curveSize = sizeof(RME_TOTALMIX_FADER_CURVE) / sizeof(RME_TOTALMIX_FADER_CURVE[0]);
+
+	// First value from first to last (inclusive) with a level at or above levelDb, last if there is none.
+	// The curve rises, so this halves the range, and the recursion stays shallow.
+	constexpr int findValue(float levelDb, int first, int last)
+	{
+		return first == last ? first
+			: RME_TOTALMIX_FADER_CURVE[(first + last) / 2] >= levelDb ? findValue(levelDb, first, (first + last) / 2)
+			: findValue(levelDb, (first + last) / 2 + 1, last);
+	}
+
+	// The level of each step is the float nearest to it, as it would be written out.
+	constexpr unsigned char getTableValue(int index)
+	{
+		return index <= RME_TOTALMIX_FADER_TABLE_OFF_STEPS ? 0
+			: (unsigned char)findValue((float)(RME_TOTALMIX_FADER_TABLE_LOWEST_DB + index / (double)RME_TOTALMIX_FADER_TABLE_STEPS_PER_DB), 0, curveSize - 1);
+	}
+
+	template <int... Indices> struct IndexList {};
+	template <int Size, int... Indices> struct MakeIndexList : MakeIndexList<Size - 1, Size - 1, Indices...> {};
+	template <int... Indices> struct MakeIndexList<0, Indices...> { typedef IndexList<Indices...> Type; };
+
+	template <typename List> struct Table;
+	template <int... Indices> struct Table<IndexList<Indices...>>
+	{
+		static constexpr unsigned char values[] = { getTableValue(Indices)... };
+	};
+
+	template <int... Indices> constexpr unsigned char Table<IndexList<Indices...>>::values[];
+}
+
+// TotalMix fader MIDI value for each 0.1 dB from -48 dB to 0 dB: the first value of the curve at or above
+// the level, and 0 (off) up to -47.5 dB. Generated from RME_TOTALMIX_FADER_CURVE by the compiler, so a level
+// is looked up by index rather than searched for.
+typedef RmeTotalMixFader::Table<RmeTotalMixFader::MakeIndexList<RME_TOTALMIX_FADER_TABLE_SIZE>::Type> RmeTotalMixFaderTable;
+#define RME_TOTALMIX_FADER_TABLE RmeTotalMixFaderTable::values
+
+static_assert(RME_TOTALMIX_FADER_TABLE[RME_TOTALMIX_FADER_TABLE_OFF_STEPS + 1] == 16, "-47.4 dB is the curve's -46.8 dB");
+static_assert(RME_TOTALMIX_FADER_TABLE[RME_TOTALMIX_FADER_TABLE_SIZE - 1] == 104, "0 dB is the curve's last value");
+
+// TotalMix fader MIDI value for a level in dB, rounded to the nearest 0.1 dB.
+inline int getRmeTotalMixFaderValue(float levelDb)
+{
+	int index = (int)((levelDb - RME_TOTALMIX_FADER_TABLE_LOWEST_DB) * RME_TOTALMIX_FADER_TABLE_STEPS_PER_DB + 0.5f);
+	index = index < 0 ? 0 : index >= RME_TOTALMIX_FADER_TABLE_SIZE ? RME_TOTALMIX_FADER_TABLE_SIZE - 1 : index;
+	return RME_TOTALMIX_FADER_TABLE[index];
+}
@@ -0,0 +1,170 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include "StateChunk.h"
+
+StateChunkWriter::StateChunkWriter(MemoryBlock& destData, int version)
+	: stream(destData, true)
+{
+	stream.writeInt(StateChunkReader::magic);
+	stream.writeCompressedInt(version);
+}
+
+void StateChunkWriter::writeFloat(int tag, float value)
+{
+	MemoryOutputStream entry;
+	entry.writeFloat(value);
+	writeEntry(tag, entry);
+}
+
+void StateChunkWriter::writeBool(int tag, bool value)
+{
+	MemoryOutputStream entry;
+	entry.writeBool(value);
+	writeEntry(tag, entry);
+}
+
+void StateChunkWriter::writeInt(int tag, int value)
+{
+	MemoryOutputStream entry;
+	entry.writeCompressedInt(value);
+	writeEntry(tag, entry);
+}
+
+void StateChunkWriter::writeString(int tag, const String& value)
+{
+	MemoryOutputStream entry;
+	entry.writeString(value);
+	writeEntry(tag, entry);
+}
+
+void StateChunkWriter::writeFloats(int tag, const float* values, int numValues)
+{
+	MemoryOutputStream entry;
+	for (int i = 0; i < numValues; i++)
+		entry.writeFloat(values[i]);
+	writeEntry(tag, entry);
+}
+
+void StateChunkWriter::writeEntry(int tag, const MemoryOutputStream& value)
+{
+	stream.writeCompressedInt(tag);
+	stream.writeCompressedInt((int)value.getDataSize());
+	stream.write(value.getData(), value.getDataSize());
+}
+
+//==============================================================================
+// A JUCE compressed int, false if its size byte is invalid or its bytes are cut short.
+static bool readCompressedInt(MemoryInputStream& stream, int& value)
+{
+	if (stream.isExhausted())
+		return false;
+
+	const int64 start = stream.getPosition();
+	const int numBytes = (uint8)stream.readByte() & 0x7f;
+	if (numBytes > 4 || stream.getNumBytesRemaining() < numBytes)
+		return false;
+
+	stream.setPosition(start);
+	value = stream.readCompressedInt();
+	return true;
+}
+
+StateChunkReader::Result StateChunkReader::read(const void* data, int sizeInBytes)
+{
+	entries.clear();
+	version = 0;
+
+	MemoryInputStream stream(data, (size_t)jmax(0, sizeInBytes), false);
+	if (sizeInBytes < 5 || stream.readInt() != magic)
+		return notStateChunk;
+
+	if (!readCompressedInt(stream, version))
+		return badStateChunk;
+
+	while (!stream.isExhausted())
+	{
+		int tag, size;
+		if (!readCompressedInt(stream, tag) || !readCompressedInt(stream, size)
+			|| size < 0 || size > stream.getNumBytesRemaining())
+		{
+			entries.clear();
+			return badStateChunk;
+		}
+
+		MemoryBlock& value = entries[tag];
+		value.setSize((size_t)size);
+		stream.read(value.getData(), size);
+	}
+
+	return ok;
+}
+
+const MemoryBlock* StateChunkReader::findEntry(int tag) const
+{
+	auto entry = entries.find(tag);
+	return entry != entries.end() ? &entry->second : nullptr;
+}
+
+float StateChunkReader::getFloat(int tag, float defaultValue) const
+{
+	const MemoryBlock* entry = findEntry(tag);
+	if (entry == nullptr || entry->getSize() < sizeof(float))
+		return defaultValue;
+
+	return MemoryInputStream(*entry, false).readFloat();
+}
+
+bool StateChunkReader::getBool(int tag, bool defaultValue) const
+{
+	const MemoryBlock* entry = findEntry(tag);
+	if (entry == nullptr || entry->getSize() < 1)
+		return defaultValue;
+
+	return MemoryInputStream(*entry, false).readBool();
+}
+
+int StateChunkReader::getInt(int tag, int defaultValue) const
+{
+	const MemoryBlock* entry = findEntry(tag);
+	if (entry == nullptr || entry->getSize() < 1)
+		return defaultValue;
+
+	return MemoryInputStream(*entry, false).readCompressedInt();
+}
+
+String StateChunkReader::getString(int tag, const String& defaultValue) const
+{
+	const MemoryBlock* entry = findEntry(tag);
+	if (entry == nullptr)
+		return defaultValue;
+
+	return MemoryInputStream(*entry, false).readString();
+}
+
+int StateChunkReader::getFloats(int tag, float* values, int maxValues) const
+{
+	const MemoryBlock* entry = findEntry(tag);
+	if (entry == nullptr)
+		return 0;
+
+	const int numValues = jmin(maxValues, (int)(entry->getSize() / sizeof(float)));
+	MemoryInputStream stream(*entry, false);
+
+	for (int i = 0; i < numValues; i++)
+		values[i] = stream.readFloat();
+
+	return numValues;
+}
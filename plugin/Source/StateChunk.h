@@ -0,0 +1,90 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <map>
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+	Versioned plugin state: the magic number, the version, then entries of tag, size and
+	value, tag and size as JUCE compressed ints.
+
+	A reader skips tags it doesn't know and falls back to a default for tags that are
+	missing, so values can be added without a new version. The version only changes
+	when an existing tag's meaning does.
+
+	The magic number read as a float is far outside any volume, so it can't be mistaken
+	for the unversioned state of older versions, which starts with the monitor level.
+*/
+class StateChunkWriter
+{
+public:
+	StateChunkWriter(MemoryBlock& destData, int version);
+
+	void writeFloat(int tag, float value);
+	void writeBool(int tag, bool value);
+	void writeInt(int tag, int value);
+	void writeString(int tag, const String& value);
+	void writeFloats(int tag, const float* values, int numValues);
+
+private:
+	void writeEntry(int tag, const MemoryOutputStream& value);
+
+	MemoryOutputStream stream;
+
+	JUCE_DECLARE_NON_COPYABLE(StateChunkWriter)
+};
+
+class StateChunkReader
+{
+public:
+	enum
+	{
+		magic = 0x54534344		// "DCST"
+	};
+
+	enum Result
+	{
+		ok = 0,
+		notStateChunk,			// no magic number: the unversioned state of older versions
+		badStateChunk			// the magic number, then data that is cut short or corrupt
+	};
+
+	StateChunkReader() : version(0) {}
+
+	Result read(const void* data, int sizeInBytes);
+	int getVersion() const { return version; }
+	bool hasTag(int tag) const { return entries.find(tag) != entries.end(); }
+
+	// Return the default if the tag is missing.
+	float getFloat(int tag, float defaultValue) const;
+	bool getBool(int tag, bool defaultValue) const;
+	int getInt(int tag, int defaultValue) const;
+	String getString(int tag, const String& defaultValue) const;
+
+	// Returns how many values were read, up to maxValues.
+	int getFloats(int tag, float* values, int maxValues) const;
+
+private:
+	const MemoryBlock* findEntry(int tag) const;
+
+	int version;
+	std::map<int, MemoryBlock> entries;
+
+	JUCE_DECLARE_NON_COPYABLE(StateChunkReader)
+};
@@ -0,0 +1,172 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include "SurfaceStateEncoder.h"
+
+SurfaceStateEncoder::SurfaceStateEncoder(const int* manufacturerId, uint8 snapshotCommand, uint8 deltaCommand, uint8 requestCommand)
+	: knob(-1), sentKnob(-1)
+	, fader(-1), sentFader(-1)
+	, isSnapshotRequested(true)
+	, sequence(0)
+	, callsSinceMessage(0)
+	, snapshotCommand(snapshotCommand)
+	, deltaCommand(deltaCommand)
+	, requestCommand(requestCommand)
+{
+	for (int i = 0; i < 3; i++)
+		message[i] = (uint8)manufacturerId[i];
+
+	for (int i = 0; i < numNotes; i++)
+		leds[i] = sentLeds[i] = false;
+}
+
+void SurfaceStateEncoder::setLed(int note, bool isOn)
+{
+	if (!isPositiveAndBelow(note, (int)numNotes))
+		return;
+
+	const SpinLock::ScopedLockType sl(lock);
+	leds[note] = isOn;
+}
+
+void SurfaceStateEncoder::setKnob(int position, bool isFromHardware)
+{
+	const SpinLock::ScopedLockType sl(lock);
+	knob = jlimit(0, 127, position);
+
+	if (isFromHardware)
+		sentKnob = knob;
+}
+
+void SurfaceStateEncoder::setFader(int value)
+{
+	const SpinLock::ScopedLockType sl(lock);
+	fader = jlimit(0, 0x3fff, value);
+}
+
+bool SurfaceStateEncoder::isSnapshotRequest(const MidiMessage& m) const
+{
+	// getSysExData() starts after the F0: manufacturer ID, then the command.
+	if (!m.isSysEx() || m.getSysExDataSize() < headerSize)
+		return false;
+
+	const uint8* data = m.getSysExData();
+	return data[0] == message[0] && data[1] == message[1] && data[2] == message[2] && data[3] == requestCommand;
+}
+
+void SurfaceStateEncoder::requestSnapshot()
+{
+	const SpinLock::ScopedLockType sl(lock);
+	isSnapshotRequested = true;
+}
+
+int SurfaceStateEncoder::buildMessage()
+{
+	const SpinLock::ScopedLockType sl(lock);
+
+	int size = isSnapshotRequested ? 0 : buildDelta();
+
+	if (size < 0 || isSnapshotRequested)
+		size = buildSnapshot();
+
+	if (size == 0)
+		return 0;
+
+	callsSinceMessage = 0;
+	sequence = (sequence + 1) & 0x7f;
+	return size;
+}
+
+int SurfaceStateEncoder::buildSnapshot()
+{
+	message[3] = snapshotCommand;
+	message[headerSize] = (uint8)sequence;
+	message[headerSize + 1] = (uint8)((knob >= 0 ? flagKnob : 0) | (fader >= 0 ? flagFader : 0));
+
+	for (int b = 0; b < noteBytes; b++)
+	{
+		uint8 bits = 0;
+		for (int n = 0; n < 7 && b * 7 + n < numNotes; n++)
+			if (leds[b * 7 + n])
+				bits |= 1 << n;
+
+		message[headerSize + 2 + b] = bits;
+	}
+
+	int size = headerSize + 2 + noteBytes;
+	message[size++] = (uint8)jmax(0, knob);
+	message[size++] = (uint8)((jmax(0, fader) >> 7) & 0x7f);
+	message[size++] = (uint8)(jmax(0, fader) & 0x7f);
+	jassert(size == snapshotSize);
+
+	markAllSent();
+	isSnapshotRequested = false;
+	return size;
+}
+
+// Returns -1 if the changes don't fit in one message, so a snapshot is needed.
+int SurfaceStateEncoder::buildDelta()
+{
+	message[3] = deltaCommand;
+	message[headerSize] = (uint8)sequence;
+	int size = headerSize + 1;
+
+	for (int i = 0; i < numNotes; i++)
+	{
+		if (leds[i] == sentLeds[i])
+			continue;
+
+		if (size + 2 > maxMessageSize)
+			return -1;
+
+		message[size++] = leds[i] ? deltaNoteOn : deltaNoteOff;
+		message[size++] = (uint8)i;
+	}
+
+	if (knob != sentKnob)
+	{
+		if (size + 2 > maxMessageSize)
+			return -1;
+
+		message[size++] = deltaKnob;
+		message[size++] = (uint8)knob;
+	}
+
+	if (fader != sentFader)
+	{
+		if (size + 3 > maxMessageSize)
+			return -1;
+
+		message[size++] = deltaFader;
+		message[size++] = (uint8)((fader >> 7) & 0x7f);
+		message[size++] = (uint8)(fader & 0x7f);
+	}
+
+	// Nothing changed: only the heartbeat, when it is due.
+	if (size == headerSize + 1 && ++callsSinceMessage < heartbeatInterval)
+		return 0;
+
+	markAllSent();
+	return size;
+}
+
+void SurfaceStateEncoder::markAllSent()
+{
+	for (int i = 0; i < numNotes; i++)
+		sentLeds[i] = leds[i];
+
+	sentKnob = knob;
+	sentFader = fader;
+}
@@ -0,0 +1,104 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+	Keeps what the hardware should show - button LEDs, monitor level knob and track
+	fader - and builds the sequenced SysEx messages that bring the hardware up to date.
+
+	Snapshot, after the manufacturer ID and snapshot command:
+	  sequence, flags (flagKnob, flagFader: that value is known), noteBytes bytes of
+	  LED states, 7 notes per byte (bit n of byte b is note b * 7 + n), knob position,
+	  fader as 14 bits (2 bytes, MSB first).
+	Delta, after the manufacturer ID and delta command:
+	  sequence, then entries: deltaNoteOn/deltaNoteOff and a note, deltaKnob and the
+	  position, or deltaFader and 14 bits.
+
+	Each message carries the next 7 bit sequence number. The hardware asks for a snapshot
+	(SYSEX_COMMAND_SYNC_BUTTONS) when it sees a gap. When nothing has changed for
+	heartbeatInterval calls to buildMessage(), an empty delta is sent, so a lost last
+	delta is noticed too. A delta that wouldn't fit in maxMessageSize is sent as a
+	snapshot instead.
+
+	Setters may be called from any thread. buildMessage() is called from the timer.
+
+	Must match the decoder in firmware/dc_state.c.
+*/
+class SurfaceStateEncoder
+{
+public:
+	enum
+	{
+		numNotes = 128,
+		noteBytes = (numNotes + 6) / 7,
+		flagKnob = 0x01,
+		flagFader = 0x02,
+		deltaNoteOn = 0,
+		deltaNoteOff = 1,
+		deltaKnob = 2,
+		deltaFader = 3,
+		heartbeatInterval = 100,
+		headerSize = 4,		// manufacturer ID and command
+		snapshotSize = headerSize + 2 + noteBytes + 3,
+		maxMessageSize = 64	// the hardware's SysEx buffer, with the command
+	};
+
+	SurfaceStateEncoder(const int* manufacturerId, uint8 snapshotCommand, uint8 deltaCommand, uint8 requestCommand);
+
+	// True for the hardware's request for a snapshot: our manufacturer ID and requestCommand.
+	bool isSnapshotRequest(const MidiMessage& m) const;
+
+	void setLed(int note, bool isOn);
+
+	// A position the hardware sent itself is already showing there, so isn't sent back.
+	void setKnob(int position, bool isFromHardware = false);
+
+	// 0 to 16383
+	void setFader(int value);
+
+	// Next message is a snapshot.
+	void requestSnapshot();
+
+	// Builds a snapshot if one is due, otherwise a delta of the values that changed.
+	// Returns its size, or 0 if there is nothing to send.
+	int buildMessage();
+	const uint8* getMessageData() const { return message; }
+
+private:
+	int buildSnapshot();
+	int buildDelta();
+	void markAllSent();
+
+	SpinLock lock;
+
+	bool leds[numNotes];
+	bool sentLeds[numNotes];
+	int knob, sentKnob;		// -1 until known
+	int fader, sentFader;
+	bool isSnapshotRequested;
+	int sequence;
+	int callsSinceMessage;
+
+	uint8 snapshotCommand;
+	uint8 deltaCommand;
+	uint8 requestCommand;
+	uint8 message[maxMessageSize];
+
+	JUCE_DECLARE_NON_COPYABLE(SurfaceStateEncoder)
+};
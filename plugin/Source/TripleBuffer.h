@@ -0,0 +1,65 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <atomic>
+
+//==============================================================================
+/**
+	Lock-free latest-value handoff from one writer thread to one reader thread.
+
+	The writer fills getWriteBuffer() and calls publish(). The reader calls
+	update(), which returns true when a newer value was published since the last
+	call, and then reads getReadBuffer(). Neither side ever waits, and the reader
+	always sees a complete value. T should be cheap to copy and trivially
+	destructible, as values are reused rather than constructed.
+*/
+template <typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer() : writeIndex(0), middle(1), readIndex(2) {}
+
+	//==============================================================================
+	// Writer thread.
+	T& getWriteBuffer() noexcept { return buffers[writeIndex]; }
+
+	void publish() noexcept
+	{
+		writeIndex = middle.exchange(writeIndex | newValueFlag, std::memory_order_acq_rel) & indexMask;
+	}
+
+	//==============================================================================
+	// Reader thread.
+	bool update() noexcept
+	{
+		if ((middle.load(std::memory_order_relaxed) & newValueFlag) == 0)
+			return false;
+
+		readIndex = middle.exchange(readIndex, std::memory_order_acq_rel) & indexMask;
+		return true;
+	}
+
+	const T& getReadBuffer() const noexcept { return buffers[readIndex]; }
+
+private:
+	enum { indexMask = 3, newValueFlag = 4 };
+
+	T buffers[3];
+	int writeIndex;
+	std::atomic<int> middle;	// index of the buffer between writer and reader, with newValueFlag
+	int readIndex;
+};
@@ -26,6 +26,20 @@
 
 #include "TruePeakProcessor.h"
 
+#if JUCE_INTEL
+ #include <immintrin.h>
+ #if JUCE_MSVC
+  #define TRUE_PEAK_SSE2_TARGET
+  #define TRUE_PEAK_AVX_TARGET
+ #else
+  #define TRUE_PEAK_SSE2_TARGET __attribute__((target("sse2")))
+  #define TRUE_PEAK_AVX_TARGET __attribute__((target("avx")))
+ #endif
+#elif JUCE_ARM && ( defined( __ARM_NEON__ ) || defined( __ARM_NEON ) )
+ #include <arm_neon.h>
+ #define TRUE_PEAK_USE_NEON 1
+#endif
+
 const float filterPhase0[] =
 {
     0.0017089843750f, 0.0109863281250f, -0.0196533203125f, 0.0332031250000f,
@@ -58,6 +72,242 @@ const float * filterPhaseArray[] = { filterPhase0, filterPhase1, filterPhase2, f
 
 const int numCoeffs = sizeof(filterPhase0) / sizeof(float);
 
+const int numPhases = sizeof(filterPhaseArray) / sizeof(filterPhaseArray[0]);
+
+// Coefficients repeated on 8 lanes, so that SIMD kernels can load them directly
+struct SplattedCoefficients
+{
+    SplattedCoefficients()
+    {
+        for ( int p = 0 ; p < numPhases ; ++p )
+            for ( int j = 0 ; j < numCoeffs ; ++j )
+                for ( int lane = 0 ; lane < 8 ; ++lane )
+                    values[p][j][lane] = filterPhaseArray[p][j];
+    }
+
+    alignas( 32 ) float values[numPhases][numCoeffs][8];
+};
+
+static const SplattedCoefficients splattedCoefficients;
+
+// Largest gain of the phases used for any input: each output is a weighted sum of numCoeffs input samples,
+// so its absolute value can't exceed the sample peak of these samples times the sum of absolute weights
+static float getOvershootBound( const int numUsedPhases )
+{
+    if ( numUsedPhases == 1 )
+        return 1.f; // 1x is the sample peak itself
+
+    float bound = 0.f;
+
+    for ( int p = 0 ; p < numUsedPhases ; ++p )
+    {
+        float sum = 0.f;
+        for ( int j = 0 ; j < numCoeffs ; ++j )
+            sum += fabsf( filterPhaseArray[ p * ( numPhases / numUsedPhases ) ][ j ] );
+
+        bound = juce::jmax( bound, sum );
+    }
+
+    return bound; // about 2.02, from phase 2 (and phase 1 at 4x)
+}
+
+// True Peak kernels
+//
+// All kernels sum the taps in the same order as polyphase4ComputeSum (j = 0 first, separate multiply and add,
+// no fused multiply-add), so every polyphase output is bit-identical to the scalar version.
+// SIMD kernels compute 4 (or 8) consecutive output samples of one phase per register, which gives unaligned
+// loads of the input instead of shuffles, and no branch in the tap loop.
+//
+// Kernels are instantiated for each oversampling factor. 2x uses phases 0 and 2 of the 4x filter: outputs at
+// the same half sample positions, with a cutoff that is the same fraction of the input rate.
+
+template <int numUsedPhases>
+static void truePeakAbsMaxScalar( const float * const * inputs, const int numChannels, const int numSamples, float * channelMax )
+{
+    for ( int ch = 0 ; ch < numChannels ; ++ch )
+    {
+        const float * input = inputs[ ch ];
+        float maxValue = 0.f;
+
+        for ( int i = 0 ; i < numSamples ; ++i )
+        {
+            for ( int p = 0 ; p < numPhases ; p += numPhases / numUsedPhases )
+            {
+                float sum = 0.f;
+
+                for ( int j = 0 ; j < numCoeffs ; ++j )
+                    sum += input[ i - j ] * filterPhaseArray[ p ][ j ];
+
+                maxValue = juce::jmax( maxValue, fabsf( sum ) );
+            }
+        }
+
+        channelMax[ ch ] = maxValue;
+    }
+}
+
+#if JUCE_INTEL
+
+template <int numUsedPhases>
+TRUE_PEAK_SSE2_TARGET
+static void truePeakAbsMaxSse2( const float * const * inputs, const int numChannels, const int numSamples, float * channelMax )
+{
+    const __m128 absMask = _mm_castsi128_ps( _mm_set1_epi32( 0x7fffffff ) );
+    const int numVectorSamples = numSamples & ~3;
+
+    for ( int ch = 0 ; ch < numChannels ; ++ch )
+    {
+        const float * input = inputs[ ch ];
+        __m128 maxValue = _mm_setzero_ps();
+
+        for ( int i = 0 ; i < numVectorSamples ; i += 4 )
+        {
+            for ( int p = 0 ; p < numPhases ; p += numPhases / numUsedPhases )
+            {
+                __m128 sum = _mm_setzero_ps();
+
+                for ( int j = 0 ; j < numCoeffs ; ++j )
+                    sum = _mm_add_ps( sum, _mm_mul_ps( _mm_loadu_ps( input + i - j ), _mm_load_ps( splattedCoefficients.values[ p ][ j ] ) ) );
+
+                maxValue = _mm_max_ps( maxValue, _mm_and_ps( sum, absMask ) );
+            }
+        }
+
+        maxValue = _mm_max_ps( maxValue, _mm_shuffle_ps( maxValue, maxValue, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+        maxValue = _mm_max_ps( maxValue, _mm_shuffle_ps( maxValue, maxValue, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+
+        // remaining samples
+        const float * tail = input + numVectorSamples;
+        float tailMax = 0.f;
+        truePeakAbsMaxScalar<numUsedPhases>( &tail, 1, numSamples - numVectorSamples, &tailMax );
+
+        channelMax[ ch ] = juce::jmax( _mm_cvtss_f32( maxValue ), tailMax );
+    }
+}
+
+template <int numUsedPhases>
+TRUE_PEAK_AVX_TARGET
+static void truePeakAbsMaxAvx( const float * const * inputs, const int numChannels, const int numSamples, float * channelMax )
+{
+    const __m256 absMask = _mm256_castsi256_ps( _mm256_set1_epi32( 0x7fffffff ) );
+    const int numVectorSamples = numSamples & ~7;
+
+    __m256 maxValue[ LUFS_TP_MAX_NB_CHANNELS ];
+    for ( int ch = 0 ; ch < numChannels ; ++ch )
+        maxValue[ ch ] = _mm256_setzero_ps();
+
+    // channels are processed in the same pass, so the independent accumulations of each channel can overlap
+    for ( int i = 0 ; i < numVectorSamples ; i += 8 )
+    {
+        for ( int ch = 0 ; ch < numChannels ; ++ch )
+        {
+            const float * input = inputs[ ch ] + i;
+
+            for ( int p = 0 ; p < numPhases ; p += numPhases / numUsedPhases )
+            {
+                __m256 sum = _mm256_setzero_ps();
+
+                for ( int j = 0 ; j < numCoeffs ; ++j )
+                    sum = _mm256_add_ps( sum, _mm256_mul_ps( _mm256_loadu_ps( input - j ), _mm256_load_ps( splattedCoefficients.values[ p ][ j ] ) ) );
+
+                maxValue[ ch ] = _mm256_max_ps( maxValue[ ch ], _mm256_and_ps( sum, absMask ) );
+            }
+        }
+    }
+
+    for ( int ch = 0 ; ch < numChannels ; ++ch )
+    {
+        __m128 value = _mm_max_ps( _mm256_castps256_ps128( maxValue[ ch ] ), _mm256_extractf128_ps( maxValue[ ch ], 1 ) );
+        value = _mm_max_ps( value, _mm_shuffle_ps( value, value, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+        value = _mm_max_ps( value, _mm_shuffle_ps( value, value, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+
+        const float * tail = inputs[ ch ] + numVectorSamples;
+        float tailMax = 0.f;
+        truePeakAbsMaxScalar<numUsedPhases>( &tail, 1, numSamples - numVectorSamples, &tailMax );
+
+        channelMax[ ch ] = juce::jmax( _mm_cvtss_f32( value ), tailMax );
+    }
+
+    _mm256_zeroupper();
+}
+
+#elif TRUE_PEAK_USE_NEON
+
+template <int numUsedPhases>
+static void truePeakAbsMaxNeon( const float * const * inputs, const int numChannels, const int numSamples, float * channelMax )
+{
+    const int numVectorSamples = numSamples & ~3;
+
+    for ( int ch = 0 ; ch < numChannels ; ++ch )
+    {
+        const float * input = inputs[ ch ];
+        float32x4_t maxValue = vdupq_n_f32( 0.f );
+
+        for ( int i = 0 ; i < numVectorSamples ; i += 4 )
+        {
+            for ( int p = 0 ; p < numPhases ; p += numPhases / numUsedPhases )
+            {
+                float32x4_t sum = vdupq_n_f32( 0.f );
+
+                for ( int j = 0 ; j < numCoeffs ; ++j )
+                    sum = vaddq_f32( sum, vmulq_f32( vld1q_f32( input + i - j ), vld1q_f32( splattedCoefficients.values[ p ][ j ] ) ) );
+
+                maxValue = vmaxq_f32( maxValue, vabsq_f32( sum ) );
+            }
+        }
+
+        float32x2_t value = vpmax_f32( vget_low_f32( maxValue ), vget_high_f32( maxValue ) );
+        value = vpmax_f32( value, value );
+
+        const float * tail = input + numVectorSamples;
+        float tailMax = 0.f;
+        truePeakAbsMaxScalar<numUsedPhases>( &tail, 1, numSamples - numVectorSamples, &tailMax );
+
+        channelMax[ ch ] = juce::jmax( vget_lane_f32( value, 0 ), tailMax );
+    }
+}
+
+#endif
+
+// 1x: no oversampling, the sample peak
+static void samplePeakAbsMax( const float * const * inputs, const int numChannels, const int numSamples, float * channelMax )
+{
+    for ( int ch = 0 ; ch < numChannels ; ++ch )
+    {
+        const juce::Range<float> range = juce::FloatVectorOperations::findMinAndMax( inputs[ ch ], numSamples );
+        channelMax[ ch ] = juce::jmax( -range.getStart(), range.getEnd() );
+    }
+}
+
+template <int numUsedPhases>
+static AudioProcessing::TruePeak::AbsMaxKernel selectTruePeakKernel()
+{
+#if JUCE_INTEL
+    if ( juce::SystemStats::hasAVX() )
+        return truePeakAbsMaxAvx<numUsedPhases>;
+
+    if ( juce::SystemStats::hasSSE2() )
+        return truePeakAbsMaxSse2<numUsedPhases>;
+#elif TRUE_PEAK_USE_NEON
+    return truePeakAbsMaxNeon<numUsedPhases>;
+#endif
+
+    return truePeakAbsMaxScalar<numUsedPhases>;
+}
+
+static AudioProcessing::TruePeak::AbsMaxKernel selectTruePeakKernel( const int oversamplingFactor )
+{
+    switch ( oversamplingFactor )
+    {
+    case 1:
+        return samplePeakAbsMax;
+    case 2:
+        return selectTruePeakKernel<2>();
+    default:
+        return selectTruePeakKernel<numPhases>();
+    }
+}
+
 void AudioProcessing::TestOversampling( const juce::File & input )
 {
     juce::AudioFormatManager audioFormatManager;
@@ -100,32 +350,7 @@ float getDecibelVolumeFromLinearVolume(float _linearVolume );
 
 float AudioProcessing::ProcessTruePeak( const juce::File & input )
 {
-    juce::AudioFormatManager audioFormatManager;
-    audioFormatManager.registerBasicFormats();
-
-    juce::AudioFormatReader * reader = audioFormatManager.createReaderFor( input );
-
-    float truePeakValue = 0.f; 
-
-    if ( reader != nullptr )
-    {
-        // read file
-        juce::AudioSampleBuffer buffer( (int)reader->numChannels, (int)reader->lengthInSamples );
-        reader->read( &buffer, 0, (int)reader->lengthInSamples, 0, true, true );
-
-        AudioProcessing::TruePeak truePeak;
-        TruePeak::LinearValue value = truePeak.process(buffer);
-
-        for (int i = 0 ; i < (int)reader->numChannels ; ++i)
-        {
-            if (truePeakValue < value.m_channelArray[i])
-                truePeakValue = value.m_channelArray[i];
-        }
-
-        delete reader;
-    }
-
-    return getDecibelVolumeFromLinearVolume(truePeakValue);
+    return ProcessTruePeak( input, TRUE_PEAK_FILE_BLOCK_SIZE );
 }
 
 float AudioProcessing::ProcessTruePeak( const juce::File & input, const int bufferSize )
@@ -133,34 +358,35 @@ float AudioProcessing::ProcessTruePeak( const juce::File & input, const int buff
     juce::AudioFormatManager audioFormatManager;
     audioFormatManager.registerBasicFormats();
 
-    juce::AudioFormatReader * reader = audioFormatManager.createReaderFor( input );
+    std::unique_ptr<juce::AudioFormatReader> reader( audioFormatManager.createReaderFor( input ) );
 
     float truePeakValue = 0.f; 
 
-    if ( reader != nullptr )
+    if ( reader != nullptr && bufferSize > 0 )
     {
-        // read file
-        juce::AudioSampleBuffer buffer( (int)reader->numChannels, (int)reader->lengthInSamples );
-        reader->read( &buffer, 0, (int)reader->lengthInSamples, 0, true, true );
+        const int numChannels = (int)reader->numChannels;
 
         AudioProcessing::TruePeak truePeak;
+        truePeak.setOversamplingFactor( TruePeak::getOversamplingFactor( reader->sampleRate ) );
+        truePeak.prepare( numChannels, bufferSize );
 
-        int offset = 0;
-        while (offset + bufferSize < (int)reader->lengthInSamples)
+        // stream file, so that memory doesn't depend on file length
+        juce::AudioSampleBuffer buffer( numChannels, bufferSize );
+
+        for ( juce::int64 offset = 0 ; offset < reader->lengthInSamples ; offset += bufferSize )
         {
-            juce::AudioSampleBuffer calcBuffer( buffer.getArrayOfWritePointers(), reader->numChannels, offset, bufferSize );
+            const int numSamples = (int)juce::jmin( (juce::int64)bufferSize, reader->lengthInSamples - offset );
+            buffer.setSize( numChannels, numSamples, false, false, true );
+            reader->read( &buffer, 0, numSamples, offset, true, true );
 
-            TruePeak::LinearValue value = truePeak.process(calcBuffer);
-            offset += bufferSize;
+            TruePeak::LinearValue value = truePeak.process( buffer );
 
-            for (int i = 0 ; i < (int)reader->numChannels ; ++i)
+            for ( int i = 0 ; i < juce::jmin( numChannels, LUFS_TP_MAX_NB_CHANNELS ) ; ++i )
             {
-                if (truePeakValue < value.m_channelArray[i])
+                if ( truePeakValue < value.m_channelArray[i] )
                     truePeakValue = value.m_channelArray[i];
             }
         }
-
-        delete reader;
     }
 
     return getDecibelVolumeFromLinearVolume(truePeakValue);
@@ -243,66 +469,109 @@ float AudioProcessing::polyphase4ComputeSum( const float * input, int offset, in
 
 
 AudioProcessing::TruePeak::TruePeak()
+    : m_earlyOutLevel( TRUE_PEAK_MIN_LINEAR_VALUE )
 {
+    setOversamplingFactor( 4 );
+}
 
+int AudioProcessing::TruePeak::getOversamplingFactor( const double sampleRate )
+{
+    // BS.1770 needs at least 192 kHz after oversampling, 176.4 kHz and 88.2 kHz are handled as 192 and 96 kHz
+    if ( sampleRate >= 160000.0 )
+        return 1;
+    if ( sampleRate >= 80000.0 )
+        return 2;
+    return 4;
 }
 
-AudioProcessing::TruePeak::LinearValue AudioProcessing::TruePeak::process( const juce::AudioSampleBuffer & buffer )
+void AudioProcessing::TruePeak::setOversamplingFactor( const int factor )
 {
-    if (m_inputs.getNumSamples() >= numCoeffs)
-    {
-        // we have enough data from a previous process 
+    jassert( factor == 1 || factor == 2 || factor == 4 );
 
-        for ( int ch = 0 ; ch < buffer.getNumChannels() ; ++ch )
-        {
-            m_inputs.copyFrom( ch, 0, &m_inputs.getArrayOfReadPointers()[ch][m_inputs.getNumSamples() - numCoeffs], numCoeffs );
-        }
+    m_oversamplingFactor = factor == 1 || factor == 2 ? factor : 4;
+    m_kernel = selectTruePeakKernel( m_oversamplingFactor );
+    m_overshootBound = getOvershootBound( m_oversamplingFactor );
+}
 
-        // resize if necessary
-        if ( m_inputs.getNumSamples() != numCoeffs + buffer.getNumSamples() )
-            m_inputs.setSize( buffer.getNumChannels(), numCoeffs + buffer.getNumSamples(), true, false, true );
-    }
-    else
+void AudioProcessing::TruePeak::prepare( const int numChannels, const int maxBlockSize )
+{
+    m_inputs.setSize( numChannels, numCoeffs - 1 + maxBlockSize, false, true, false );
+    m_inputs.clear();
+}
+
+AudioProcessing::TruePeak::LinearValue AudioProcessing::TruePeak::process( const juce::AudioSampleBuffer & buffer )
+{
+    const int numHistory = numCoeffs - 1;
+    const int numChannels = juce::jmin( buffer.getNumChannels(), LUFS_TP_MAX_NB_CHANNELS );
+    const int numSamples = buffer.getNumSamples();
+
+    if ( m_inputs.getNumChannels() < numChannels || m_inputs.getNumSamples() < numHistory + numSamples )
     {
-        // setSize clears buffer content too
+        // not prepared for this size: keep previous samples, new channels start with silence
+        m_inputs.setSize( juce::jmax( numChannels, m_inputs.getNumChannels() ), numHistory + numSamples, true, true, true );
+    }
 
-        m_inputs.setSize( buffer.getNumChannels(), numCoeffs + buffer.getNumSamples(), false, true );
+    // copy buffer to inputs after previous samples
+    for ( int ch = 0 ; ch < numChannels ; ++ch )
+    {
+        m_inputs.copyFrom( ch, numHistory, buffer, ch, 0, numSamples );
     }
 
-    // copy buffer to inputs with numCoefs offset
-    for ( int ch = 0 ; ch < buffer.getNumChannels() ; ++ch )
+    LinearValue value = processPolyphase4AbsMax( m_inputs, numChannels, numSamples );
+
+    // keep last samples for next call
+    for ( int ch = 0 ; ch < numChannels ; ++ch )
     {
-        m_inputs.copyFrom( ch, numCoeffs, buffer, ch, 0, buffer.getNumSamples() );
+        float * data = m_inputs.getWritePointer( ch );
+        memmove( data, data + numSamples, numHistory * sizeof( float ) );
     }
 
-    return processPolyphase4AbsMax( m_inputs );
+    return value;
 }
 
 void AudioProcessing::TruePeak::reset()
 {
-    m_inputs.setSize(0, 0);
+    m_inputs.clear();
 }
 
-AudioProcessing::TruePeak::LinearValue AudioProcessing::TruePeak::processPolyphase4AbsMax( const juce::AudioSampleBuffer & buffer )
+AudioProcessing::TruePeak::LinearValue AudioProcessing::TruePeak::processPolyphase4AbsMax( const juce::AudioSampleBuffer & buffer, const int numChannels, const int numSamples )
 {
     LinearValue value;
 
-    int sampleSize = buffer.getNumSamples();
+    // only channels that could reach m_earlyOutLevel are oversampled. At the default level that skips
+    // silent channels only, at a held maximum every block below it
+    const float * inputs[ LUFS_TP_MAX_NB_CHANNELS ];
+    int channels[ LUFS_TP_MAX_NB_CHANNELS ];
+    int numOversampled = 0;
 
-    for ( int ch = 0 ; ch < buffer.getNumChannels() ; ++ch )
+    for ( int ch = 0 ; ch < numChannels ; ++ch )
     {
-        const float * input = buffer.getArrayOfReadPointers()[ ch ];
-
-        for ( int i = 0 ; i < sampleSize ; ++i )
+        // at 1x the kernel is as cheap as the test
+        if ( m_earlyOutLevel > 0.f && m_oversamplingFactor > 1 )
         {
-            for ( int j = 0 ; j < 4 ; ++j ) // number of polyphase filters
-            {
-                float absSample = fabs( polyphase4ComputeSum( input, i, buffer.getNumSamples(), filterPhaseArray[j], numCoeffs ) );
+            // previous samples are included, they are part of the first outputs
+            const juce::Range<float> range = juce::FloatVectorOperations::findMinAndMax( buffer.getReadPointer( ch ), numCoeffs - 1 + numSamples );
+            const float samplePeak = juce::jmax( -range.getStart(), range.getEnd() );
 
-                if ( absSample > value.m_channelArray[ch] )
-                    value.m_channelArray[ch] = absSample;
+            if ( samplePeak * m_overshootBound < m_earlyOutLevel )
+            {
+                value.m_channelArray[ ch ] = samplePeak;
+                continue;
             }
         }
+
+        inputs[ numOversampled ] = buffer.getReadPointer( ch, numCoeffs - 1 );
+        channels[ numOversampled ] = ch;
+        ++numOversampled;
+    }
+
+    if ( numOversampled > 0 )
+    {
+        float channelMax[ LUFS_TP_MAX_NB_CHANNELS ];
+        m_kernel( inputs, numOversampled, numSamples, channelMax );
+
+        for ( int i = 0 ; i < numOversampled ; ++i )
+            value.m_channelArray[ channels[ i ] ] = channelMax[ i ];
     }
 
     return value;
@@ -21,9 +21,12 @@
 
 #pragma once 
 
-#include "../JuceLibraryCode/JuceHeader.h"
+// shared with the analyzer target, so the JuceHeader of the target being built is used
+#include <JuceHeader.h>
 
-#define LUFS_TP_MAX_NB_CHANNELS 2
+#define LUFS_TP_MAX_NB_CHANNELS 16 // enough for 9.1.6 immersive layouts
+#define TRUE_PEAK_FILE_BLOCK_SIZE 65536 // samples read at a time when processing files
+#define TRUE_PEAK_MIN_LINEAR_VALUE 0.00001f // lower values are all shown as DEFAULT_MIN_VOLUME decibels
 
 class AudioProcessing
 {
@@ -32,10 +35,10 @@ public:
     // oversamples by 4 a wave file using polyphase4 and saves new file to disk
     static void TestOversampling( const juce::File & input );
 
-    // applies True Peak processing on file
+    // applies True Peak processing on file, streamed in TRUE_PEAK_FILE_BLOCK_SIZE buffers
     static float ProcessTruePeak( const juce::File & input );
 
-    // applies True Peak processing on file using bufferSize buffers 
+    // applies True Peak processing on file, streamed in bufferSize buffers 
     static float ProcessTruePeak( const juce::File & input, const int bufferSize );
 
     // applies simple convolution with polyphase params and saves new file to disk
@@ -68,18 +71,43 @@ public:
 
         TruePeak();
 
-        // process: since this method needs numCoeffs values more than buffer size, 
-        // numCoeffs values from previous process call are used at beginning of buffer
+        // oversampling needed at sampleRate: 4 up to 48 kHz, 2 at 96 kHz, 1 at 192 kHz
+        static int getOversamplingFactor( const double sampleRate );
+
+        // 1, 2 or 4, the default. Call outside of process()
+        void setOversamplingFactor( const int factor );
+        inline int getOversamplingFactor() const { return m_oversamplingFactor; }
+
+        // allocates internal buffers, so that process() calls with up to maxBlockSize samples don't reallocate
+        void prepare( const int numChannels, const int maxBlockSize );
+
+        // process: since this method needs numCoeffs - 1 values more than buffer size, 
+        // the last numCoeffs - 1 values from previous process call are used at beginning of buffer
         LinearValue process( const juce::AudioSampleBuffer & buffer );
 
         // resets internal buffers 
         void reset();
 
+        // channels whose true peak can't reach linearLevel skip oversampling, and return their sample peak instead.
+        // Defaults to TRUE_PEAK_MIN_LINEAR_VALUE, so decibel values are the same as with oversampling. That only
+        // skips channels with a sample peak below about -106 dBFS: digital silence, unused channels and decayed
+        // tails. A held maximum as the level skips every block that can't raise it, which is where quiet material
+        // gains, see LufsProcessor::setTruePeakEarlyOutLevel. 0 disables it
+        void setEarlyOutLevel( const float linearLevel ) { m_earlyOutLevel = linearLevel; }
+
+        // computes the abs max of the 4 polyphase outputs for numSamples samples of each channel.
+        // inputs[ch][-numCoeffs + 1] to inputs[ch][-1] must be valid (previous samples)
+        typedef void (*AbsMaxKernel)( const float * const * inputs, const int numChannels, const int numSamples, float * channelMax );
+
     private:
 
-        LinearValue processPolyphase4AbsMax( const juce::AudioSampleBuffer & buffer );
+        LinearValue processPolyphase4AbsMax( const juce::AudioSampleBuffer & buffer, const int numChannels, const int numSamples );
 
-        juce::AudioSampleBuffer m_inputs; // getPolyphase4AbsMax processes this buffer  
+        juce::AudioSampleBuffer m_inputs; // numCoeffs - 1 samples from previous call, followed by current buffer
+        AbsMaxKernel m_kernel; // SSE2/AVX/NEON/scalar for m_oversamplingFactor, chosen depending on CPU
+        int m_oversamplingFactor;
+        float m_overshootBound; // largest gain of the phases of m_oversamplingFactor
+        float m_earlyOutLevel;
     };
 
 private: